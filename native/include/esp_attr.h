@@ -0,0 +1,5 @@
+#pragma once
+/* Host shim of ESP-IDF esp_attr.h, every function and variable is in RAM. */
+
+#define IRAM_ATTR
+#define DRAM_ATTR
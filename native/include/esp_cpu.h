@@ -0,0 +1,9 @@
+#pragma once
+/* Host shim of ESP-IDF esp_cpu.h. */
+#include <stdint.h>
+
+/**
+ * @brief   Nanoseconds since boot, cut to 32 bits like the CCOUNT register
+ *          of a 1 GHz core: it wraps every 4.3 s.
+ */
+uint32_t esp_cpu_get_ccount(void);
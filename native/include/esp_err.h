@@ -0,0 +1,45 @@
+#pragma once
+/* Host shim of ESP-IDF esp_err.h, see native/src/esp_system.cpp. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_INVALID_SIZE            0x104
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NOT_SUPPORTED           0x106
+#define ESP_ERR_TIMEOUT                 0x107
+#define ESP_ERR_INVALID_RESPONSE        0x108
+#define ESP_ERR_INVALID_CRC             0x109
+#define ESP_ERR_INVALID_VERSION         0x10A
+#define ESP_ERR_INVALID_MAC             0x10B
+#define ESP_ERR_NOT_FINISHED            0x10C
+
+#define ESP_ERR_WIFI_BASE               0x3000
+#define ESP_ERR_NVS_BASE                0x1100
+#define ESP_ERR_HTTPD_BASE              0xb000
+#define ESP_ERR_HTTP_BASE               0x7000
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_ESP_NETIF_BASE          0x5000
+
+const char *esp_err_to_name(esp_err_t code);
+
+/**
+ * @brief   Aborts on an error like the firmware does, with the same message.
+ */
+#define ESP_ERROR_CHECK(x) do {                                             \
+        esp_err_t err_rc_ = (x);                                            \
+        if (err_rc_ != ESP_OK) {                                            \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) "  \
+                    "at %s:%d\nexpression: %s\n", err_rc_,                  \
+                    esp_err_to_name(err_rc_), __FILE__, __LINE__, #x);      \
+            abort();                                                        \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,14 @@
+#pragma once
+/* Host shim of ESP-IDF esp_freertos_hooks.h. Tick hooks run on a "tick"
+ * thread every tick, for each core in turn, xPortGetCoreID() gives it. */
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+typedef void (*esp_freertos_tick_cb_t)(void);
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(
+                                        esp_freertos_tick_cb_t new_tick_cb,
+                                        UBaseType_t cpuid);
+void esp_deregister_freertos_tick_hook_for_cpu(
+                                        esp_freertos_tick_cb_t old_tick_cb,
+                                        UBaseType_t cpuid);
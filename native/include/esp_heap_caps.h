@@ -0,0 +1,11 @@
+#pragma once
+/* Host shim of ESP-IDF esp_heap_caps.h. */
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT                 (1 << 2)
+
+/**
+ * @brief   The host heap isn't measured, 0.
+ */
+size_t heap_caps_get_largest_free_block(uint32_t caps);
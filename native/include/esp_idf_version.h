@@ -0,0 +1,23 @@
+#pragma once
+/* Host shim of ESP-IDF esp_idf_version.h. The shims follow the 4.4
+ * interfaces of the firmware build, except esp_http_server.h which has the
+ * async request handoff of 5.1, so that is the version reported.
+ * -DNATIVE_IDF_4_4 reports the firmware's 4.4 instead, without the handoff
+ * (pio run -e native-idf44). */
+
+#ifdef NATIVE_IDF_4_4
+#define ESP_IDF_VERSION_MAJOR           4
+#define ESP_IDF_VERSION_MINOR           4
+#else
+#define ESP_IDF_VERSION_MAJOR           5
+#define ESP_IDF_VERSION_MINOR           1
+#endif
+#define ESP_IDF_VERSION_PATCH           0
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch)                            \
+    (((major) << 16) | ((minor) << 8) | (patch))
+
+#define ESP_IDF_VERSION                                                     \
+    ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR,                              \
+                        ESP_IDF_VERSION_MINOR,                              \
+                        ESP_IDF_VERSION_PATCH)
@@ -0,0 +1,44 @@
+#pragma once
+/* Host shim of ESP-IDF esp_log.h. Lines keep the firmware format, the
+ * NATIVE_LOG_LEVEL environment variable (E, W, I, D or V) caps every tag. */
+#include <stdint.h>
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL                 ESP_LOG_INFO
+#endif
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+uint32_t esp_log_timestamp(void);
+void esp_log_write(esp_log_level_t level, const char *tag,
+                    const char *format, ...)
+                    __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_FORMAT(letter, format)  #letter " (%u) %s: " format "\n"
+
+#define ESP_LOG_LEVEL_LOCAL(level, letter, tag, format, ...) do {           \
+        if (LOG_LOCAL_LEVEL >= level) {                                     \
+            esp_log_write(level, tag, ESP_LOG_FORMAT(letter, format),       \
+                            (unsigned)esp_log_timestamp(), tag,             \
+                            ##__VA_ARGS__);                                 \
+        }                                                                   \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...)                                          \
+    ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)                                          \
+    ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)                                          \
+    ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)                                          \
+    ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)                                          \
+    ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
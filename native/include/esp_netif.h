@@ -0,0 +1,94 @@
+#pragma once
+/* Host shim of ESP-IDF esp_netif.h for the station and soft AP interfaces
+ * of the WiFi shim, see native/src/esp_wifi.cpp. */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_event.h>
+
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED  (ESP_ERR_ESP_NETIF_BASE + 0x05)
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED  (ESP_ERR_ESP_NETIF_BASE + 0x06)
+
+#define ESP_IPADDR_TYPE_V4              0
+#define ESP_IPADDR_TYPE_V6              6
+
+#define IPSTR                           "%d.%d.%d.%d"
+#define esp_ip4_addr_get_byte(ipaddr, idx)                                  \
+    (((const uint8_t *)(&(ipaddr)->addr))[idx])
+#define esp_ip4_addr1(ipaddr)           esp_ip4_addr_get_byte(ipaddr, 0)
+#define esp_ip4_addr2(ipaddr)           esp_ip4_addr_get_byte(ipaddr, 1)
+#define esp_ip4_addr3(ipaddr)           esp_ip4_addr_get_byte(ipaddr, 2)
+#define esp_ip4_addr4(ipaddr)           esp_ip4_addr_get_byte(ipaddr, 3)
+#define IP2STR(ipaddr)                  esp_ip4_addr1(ipaddr),              \
+                                        esp_ip4_addr2(ipaddr),              \
+                                        esp_ip4_addr3(ipaddr),              \
+                                        esp_ip4_addr4(ipaddr)
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    uint32_t addr;                      /* Network order. */
+} esp_ip4_addr_t;
+
+typedef struct {
+    uint32_t addr[4];
+    uint8_t zone;
+} esp_ip6_addr_t;
+
+typedef struct {
+    union {
+        esp_ip6_addr_t ip6;
+        esp_ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    esp_ip_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum {
+    ESP_NETIF_DNS_MAIN = 0,
+    ESP_NETIF_DNS_BACKUP,
+    ESP_NETIF_DNS_FALLBACK,
+    ESP_NETIF_DNS_MAX
+} esp_netif_dns_type_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP = 0,
+    IP_EVENT_STA_LOST_IP,
+    IP_EVENT_AP_STAIPASSIGNED
+} ip_event_t;
+
+typedef struct {
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcps_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif,
+                                const esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif,
+                                esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif,
+                                    esp_netif_dns_type_t type,
+                                    esp_netif_dns_info_t *dns);
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif,
+                                    esp_netif_dns_type_t type,
+                                    esp_netif_dns_info_t *dns);
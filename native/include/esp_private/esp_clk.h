@@ -0,0 +1,9 @@
+#pragma once
+/* Host shim of ESP-IDF esp_private/esp_clk.h. */
+
+/**
+ * @brief   1 GHz, the rate of esp_cpu_get_ccount() on the host, until
+ *          esp_pm_configure(). Then the frequency its locks would set, the
+ *          counter keeps its rate.
+ */
+int esp_clk_cpu_freq(void);
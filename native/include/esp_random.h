@@ -0,0 +1,7 @@
+#pragma once
+/* Host shim of ESP-IDF esp_random.h. */
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
@@ -0,0 +1,26 @@
+#pragma once
+/* Host shim of ESP-IDF esp_sntp.h, the host clock is already set. */
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNTP_OPMODE_POLL                0
+
+static inline void sntp_setoperatingmode(uint8_t operating_mode)
+{
+    (void)operating_mode;
+}
+
+static inline void sntp_setservername(uint8_t idx, const char *server)
+{
+    (void)idx;
+    (void)server;
+}
+
+static inline void sntp_init(void)
+{
+}
+
+static inline bool sntp_enabled(void)
+{
+    return true;
+}
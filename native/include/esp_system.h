@@ -0,0 +1,14 @@
+#pragma once
+/* Host shim of ESP-IDF esp_system.h. */
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @brief   Logged and ignored on the host, so a load run survives OTA
+ *          updates.
+ */
+void esp_restart(void);
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
@@ -0,0 +1,54 @@
+#pragma once
+/* Host shim of the FreeRTOS types and ESP32 port macros, see
+ * native/src/freertos.cpp. One tick is one millisecond like the Arduino
+ * core. */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define configTICK_RATE_HZ              1000
+#define configMAX_PRIORITIES            25
+#define portNUM_PROCESSORS              2
+#define portTICK_PERIOD_MS              (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY                   ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)                                                   \
+    ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define pdFALSE                         ((BaseType_t)0)
+#define pdTRUE                          ((BaseType_t)1)
+#define pdFAIL                          pdFALSE
+#define pdPASS                          pdTRUE
+#define errQUEUE_EMPTY                  ((BaseType_t)0)
+#define errQUEUE_FULL                   ((BaseType_t)0)
+
+#define tskIDLE_PRIORITY                ((UBaseType_t)0)
+#define tskNO_AFFINITY                  ((BaseType_t)0x7FFFFFFF)
+
+/**
+ * @brief   Every critical section of the host takes one recursive lock, the
+ *          spinlock itself is unused.
+ */
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {0, 0}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+BaseType_t xPortInIsrContext(void);
+BaseType_t xPortGetCoreID(void);
+
+#define portENTER_CRITICAL(mux)         vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)    vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     vPortExitCritical(mux)
+#define taskENTER_CRITICAL(mux)         vPortEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux)          vPortExitCritical(mux)
+#define portYIELD_FROM_ISR()            do {} while (0)
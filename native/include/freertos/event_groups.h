@@ -0,0 +1,6 @@
+#pragma once
+/* Host shim of FreeRTOS event groups, nothing of it is used yet. */
+#include <freertos/FreeRTOS.h>
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef TickType_t EventBits_t;
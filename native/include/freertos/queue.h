@@ -0,0 +1,25 @@
+#pragma once
+/* Host shim of FreeRTOS queues, a ring of copied items under a mutex. */
+#include <freertos/FreeRTOS.h>
+
+typedef struct QueueDefinition *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                        TickType_t ticks);
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item,
+                                TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer,
+                            TickType_t ticks);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks)                                \
+    xQueueSend(queue, item, ticks)
+#define xQueueSendFromISR(queue, item, woken)                               \
+    xQueueSend(queue, item, 0)
+#define xQueueReceiveFromISR(queue, buffer, woken)                          \
+    xQueueReceive(queue, buffer, 0)
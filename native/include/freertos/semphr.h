@@ -0,0 +1,19 @@
+#pragma once
+/* Host shim of FreeRTOS semaphores, queues of empty items like the
+ * originals. */
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count,
+                                            UBaseType_t initial_count);
+
+#define xSemaphoreTake(sem, ticks)      xQueueReceive(sem, NULL, ticks)
+#define xSemaphoreGive(sem)             xQueueSend(sem, NULL, 0)
+#define xSemaphoreTakeFromISR(sem, woken) xQueueReceive(sem, NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken) xQueueSend(sem, NULL, 0)
+#define uxSemaphoreGetCount(sem)        uxQueueMessagesWaiting(sem)
+#define vSemaphoreDelete(sem)           vQueueDelete(sem)
@@ -0,0 +1,50 @@
+#pragma once
+/* Host shim of FreeRTOS tasks: one thread per task, direct notifications
+ * with a condition variable. Priorities and cores are recorded only. */
+#include <freertos/FreeRTOS.h>
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *param);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code,
+                                    const char *name,
+                                    uint32_t stack_depth,
+                                    void *param,
+                                    UBaseType_t priority,
+                                    TaskHandle_t *created_task,
+                                    BaseType_t core_id);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t task_code,
+                                        const char *name,
+                                        uint32_t stack_depth,
+                                        void *param,
+                                        UBaseType_t priority,
+                                        TaskHandle_t *created_task)
+{
+    return xTaskCreatePinnedToCore(task_code, name, stack_depth, param,
+                                    priority, created_task, tskNO_AFFINITY);
+}
+
+/**
+ * @brief   Deleting the calling task ends its thread at once, another task
+ *          ends the next time it blocks in a shim call.
+ */
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/**
+ * @brief   Idle tasks have no thread on the host, their handles are only
+ *          what tick hooks see as the current task of an idle core.
+ */
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid);
+char *pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task,
+                            BaseType_t *higher_priority_task_woken);
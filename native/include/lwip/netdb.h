@@ -0,0 +1,6 @@
+#pragma once
+/* Host shim of lwip/netdb.h, the host sockets API stands in for lwIP. */
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
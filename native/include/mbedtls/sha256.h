@@ -0,0 +1,40 @@
+#pragma once
+/* Host shim of the mbedTLS 2.x SHA-256 API of ESP-IDF 4.4. */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[8];
+    unsigned char buffer[64];
+    int is224;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_clone(mbedtls_sha256_context *dst,
+                            const mbedtls_sha256_context *src);
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224);
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx,
+                                const unsigned char *input, size_t ilen);
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx,
+                                unsigned char output[32]);
+
+static inline void mbedtls_sha256_starts(mbedtls_sha256_context *ctx,
+                                            int is224)
+{
+    mbedtls_sha256_starts_ret(ctx, is224);
+}
+
+static inline void mbedtls_sha256_update(mbedtls_sha256_context *ctx,
+                                            const unsigned char *input,
+                                            size_t ilen)
+{
+    mbedtls_sha256_update_ret(ctx, input, ilen);
+}
+
+static inline void mbedtls_sha256_finish(mbedtls_sha256_context *ctx,
+                                            unsigned char output[32])
+{
+    mbedtls_sha256_finish_ret(ctx, output);
+}
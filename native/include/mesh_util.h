@@ -0,0 +1,2 @@
+#pragma once
+/* Host shim of the Arduino core mesh_util.h, nothing of it is used. */
@@ -0,0 +1,72 @@
+#pragma once
+/* Host shim of the ESP-MQTT client (mqtt_client.h), MQTT 3.1.1 over plain
+ * TCP with QoS 0 and 1 publishing. A task per client connects, keeps the
+ * session alive, reconnects after reconnect_timeout_ms and calls the
+ * registered handler from that task. Unlike ESP-MQTT there is no outbox:
+ * publishing while disconnected fails and a message not acknowledged when
+ * the connection drops is forgotten. Handlers get an esp_mqtt_event_handle_t
+ * as event data. NATIVE_MQTT_URI overrides the URI. */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_event.h>
+
+ESP_EVENT_DECLARE_BASE(MQTT_EVENTS);
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED
+} esp_mqtt_event_id_t;
+
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    void *user_context;
+    char *data;
+    int data_len;
+    char *topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    const char *uri;                    /* mqtt://host:port */
+    const char *client_id;
+    const char *username;
+    const char *password;
+    int keepalive;                      /* Seconds, 120 if 0. */
+    bool disable_clean_session;
+    void *user_context;
+    int task_prio;
+    int task_stack;
+    int buffer_size;
+    int out_buffer_size;
+    int reconnect_timeout_ms;           /* 10000 if 0. */
+    int network_timeout_ms;             /* 10000 if 0. */
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(
+                                    const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                            esp_mqtt_event_id_t event,
+                                            esp_event_handler_t event_handler,
+                                            void *event_handler_arg);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client,
+                            const char *topic, const char *data, int len,
+                            int qos, int retain);
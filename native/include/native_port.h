@@ -0,0 +1,19 @@
+#pragma once
+/* Included ahead of every source of the native build (see [env:native] in
+ * platformio.ini) for the newlib functions glibc lacks. */
+#ifndef __ASSEMBLER__
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || __GLIBC_MINOR__ >= 38)
+#ifdef __cplusplus
+extern "C" {
+#endif
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#ifdef __cplusplus
+}
+#endif
+#define NATIVE_PORT_STRLCPY             1
+#endif
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+/* Host shim of ESP-IDF nvs_flash.h. */
+#include <esp_err.h>
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
@@ -0,0 +1,11 @@
+#pragma once
+/* Host shim of the ESP32 ROM CRC, the zlib CRC-32 is the same one. */
+#include <stdint.h>
+
+#include <zlib.h>
+
+static inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf,
+                                uint32_t len)
+{
+    return (uint32_t)crc32(crc, buf, len);
+}
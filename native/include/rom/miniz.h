@@ -0,0 +1,77 @@
+#pragma once
+/* Host shim of the tinfl inflater in the ESP32 ROM, over zlib raw inflate.
+ * zlib keeps its own dictionary, so the output may be a ring window like
+ * with tinfl. */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE              32768
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER    1
+#define TINFL_FLAG_HAS_MORE_INPUT       2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+#define TINFL_FLAG_COMPUTE_ADLER32      8
+
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+/**
+ * @brief   The zlib state is freed when the stream ends or fails, only an
+ *          abandoned stream leaks it.
+ */
+typedef struct {
+    z_stream stream;
+    int active;
+} tinfl_decompressor;
+
+static inline void tinfl_init(tinfl_decompressor *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->active = (inflateInit2(&r->stream, -MAX_WBITS) == Z_OK);
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r,
+                                            const uint8_t *in_buf_next,
+                                            size_t *in_buf_size,
+                                            uint8_t *out_buf_start,
+                                            uint8_t *out_buf_next,
+                                            size_t *out_buf_size,
+                                            uint32_t flags)
+{
+    (void)out_buf_start;
+    (void)flags;
+
+    if (!r->active) {
+        *in_buf_size = 0;
+        *out_buf_size = 0;
+        return TINFL_STATUS_FAILED;
+    }
+
+    r->stream.next_in = (Bytef *)in_buf_next;
+    r->stream.avail_in = (uInt)*in_buf_size;
+    r->stream.next_out = out_buf_next;
+    r->stream.avail_out = (uInt)*out_buf_size;
+
+    const int rc = inflate(&r->stream, Z_NO_FLUSH);
+    *in_buf_size -= r->stream.avail_in;
+    *out_buf_size -= r->stream.avail_out;
+
+    if (rc == Z_STREAM_END || (rc != Z_OK && rc != Z_BUF_ERROR)) {
+        inflateEnd(&r->stream);
+        r->active = 0;
+        return rc == Z_STREAM_END ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+
+    return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT
+                                    : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
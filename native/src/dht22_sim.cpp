@@ -0,0 +1,122 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+
+#include "dht22.hpp"
+
+/**
+ * @brief   The simulated sensor follows a daily cycle around these values,
+ *          with noise of a few tenths.
+ */
+#define DHT22_SIM_TEMPERATURE           22.0f
+#define DHT22_SIM_TEMPERATURE_SWING     4.0f
+#define DHT22_SIM_HUMIDITY              45.0f
+#define DHT22_SIM_HUMIDITY_SWING        10.0f
+#define DHT22_SIM_DAY_US                (24LL * 3600 * 1000000)
+
+/**
+ * @brief   Timing of a frame: response and bit pulses, their jitter, and
+ *          the time the frame takes on the line.
+ */
+#define DHT22_SIM_RELEASE_US            30
+#define DHT22_SIM_RESPONSE_US           80
+#define DHT22_SIM_ZERO_US               27
+#define DHT22_SIM_ONE_US                70
+#define DHT22_SIM_JITTER_US             6
+#define DHT22_SIM_FRAME_MS              5
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "dht22_sim";
+
+/**
+ * @brief   Every DHT22_SIM_ERRORS-th frame has a flipped bit, 0 for none.
+ *          Set from the environment.
+ */
+static unsigned s_error_every = 0;
+static unsigned s_frames = 0;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Pulse width of one bit, with jitter.
+ */
+static uint16_t dht22_sim_pulse(bool one);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t dht22_init(int gpio)
+{
+    const char *errors = getenv("DHT22_SIM_ERRORS");
+
+    s_error_every = errors ? (unsigned)atoi(errors) : 0;
+    ESP_LOGI(TAG, "Simulated DHT22 on GPIO %d, a bad frame every %u.",
+                gpio, s_error_every);
+    return ESP_OK;
+}
+
+esp_err_t dht22_read(dht22_reading_t *reading)
+{
+    uint16_t high_us[2 + DHT22_BIT_COUNT];
+    uint8_t bytes[DHT22_BIT_COUNT / 8];
+    size_t count = 0;
+
+    /* 1. Values of the daily cycle, in tenths as the sensor sends them. */
+    const double phase = 2 * M_PI * (double)(esp_timer_get_time()
+                                            % DHT22_SIM_DAY_US)
+                                    / DHT22_SIM_DAY_US;
+    const float noise = ((int)(esp_random() % 7) - 3) / 10.0f;
+    const int temperature = (int)lroundf(10 * (DHT22_SIM_TEMPERATURE
+                                + DHT22_SIM_TEMPERATURE_SWING * sin(phase)
+                                + noise));
+    const int humidity = (int)lroundf(10 * (DHT22_SIM_HUMIDITY
+                                - DHT22_SIM_HUMIDITY_SWING * sin(phase)
+                                + noise));
+    const unsigned magnitude = (unsigned)abs(temperature);
+
+    bytes[0] = (uint8_t)(humidity >> 8);
+    bytes[1] = (uint8_t)humidity;
+    bytes[2] = (uint8_t)(((magnitude >> 8) & 0x7F)
+                            | (temperature < 0 ? 0x80 : 0));
+    bytes[3] = (uint8_t)magnitude;
+    bytes[4] = (uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+
+    if (s_error_every != 0 && ++s_frames % s_error_every == 0) {
+        bytes[esp_random() % 4] ^= (uint8_t)(1u << (esp_random() % 8));
+    }
+
+    /* 2. Pulses as the RMT would capture them: the release of the line,
+     * the response, then the bits. */
+    high_us[count++] = DHT22_SIM_RELEASE_US;
+    high_us[count++] = DHT22_SIM_RESPONSE_US;
+    for (size_t bit = 0; bit < DHT22_BIT_COUNT; bit++) {
+        high_us[count++] = dht22_sim_pulse(
+                                    bytes[bit / 8] & (0x80 >> (bit % 8)));
+    }
+
+    /* 3. The start signal and the frame take the same time as on the line,
+     * the task blocks meanwhile. */
+    vTaskDelay(pdMS_TO_TICKS(DHT22_START_SIGNAL_MS + DHT22_SIM_FRAME_MS));
+
+    return dht22_decode(high_us, count, reading);
+}
+
+/* Private function definition -----------------------------------------------*/
+static uint16_t dht22_sim_pulse(bool one)
+{
+    const int jitter = (int)(esp_random() % (2 * DHT22_SIM_JITTER_US + 1))
+                        - DHT22_SIM_JITTER_US;
+    return (uint16_t)((one ? DHT22_SIM_ONE_US : DHT22_SIM_ZERO_US) + jitter);
+}
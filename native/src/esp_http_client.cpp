@@ -0,0 +1,428 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+
+#define HTTP_CLIENT_DEFAULT_PORT        "80"
+#define HTTP_CLIENT_DEFAULT_TIMEOUT_MS  5000
+#define HTTP_CLIENT_DEFAULT_BUFFER_SIZE 512
+#define HTTP_CLIENT_RECV_SIZE           4096
+
+/* Private types -------------------------------------------------------------*/
+
+struct esp_http_client {
+    std::string host;
+    std::string port;
+    std::string path;
+    int timeout_ms;
+    size_t header_limit;                /* Longest response header block. */
+    http_event_handle_cb event_handler;
+    void *user_data;
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    int fd;                             /* -1 while closed. */
+    int status_code;
+    int64_t content_length;             /* -1 if the server didn't say. */
+    int64_t received;                   /* Body bytes handed out. */
+    std::string pending;                /* Body bytes read with the headers. */
+};
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "http_client";
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Opens the TCP connection to client->host.
+ *
+ * @return  The socket, -1 on failure.
+ */
+static int http_client_connect(esp_http_client_handle_t client);
+
+/**
+ * @brief   Waits up to client->timeout_ms for data, then reads it.
+ *
+ * @return  As recv(), -1 with errno ETIMEDOUT on timeout.
+ */
+static ssize_t http_client_recv(esp_http_client_handle_t client,
+                                char *buffer, size_t len);
+
+/**
+ * @brief   Parses the status line and the header lines, calling the event
+ *          handler for each header.
+ */
+static bool http_client_parse_headers(esp_http_client_handle_t client,
+                                        std::string *block);
+
+/* Public function definition ------------------------------------------------*/
+esp_http_client_handle_t esp_http_client_init(
+                                    const esp_http_client_config_t *config)
+{
+    if (config == NULL || config->url == NULL
+        || strncmp(config->url, "http://", 7) != 0) {
+        ESP_LOGE(TAG, "Only http:// URLs are supported.");
+        return NULL;
+    }
+
+    esp_http_client_handle_t client = new esp_http_client();
+
+    /* 1. http://host[:port][/path] */
+    std::string authority(config->url + 7);
+    const size_t slash = authority.find('/');
+    client->path = (slash != std::string::npos) ? authority.substr(slash)
+                                                : "/";
+    authority = authority.substr(0, slash);
+    const size_t colon = authority.rfind(':');
+    client->host = authority.substr(0, colon);
+    client->port = (colon != std::string::npos)
+                        ? authority.substr(colon + 1)
+                        : HTTP_CLIENT_DEFAULT_PORT;
+
+    /* 2. ESP-IDF defaults for the zeroes. */
+    client->timeout_ms = (config->timeout_ms > 0)
+                            ? config->timeout_ms
+                            : HTTP_CLIENT_DEFAULT_TIMEOUT_MS;
+    client->header_limit = 8 * ((config->buffer_size > 0)
+                                    ? config->buffer_size
+                                    : HTTP_CLIENT_DEFAULT_BUFFER_SIZE);
+    client->event_handler = config->event_handler;
+    client->user_data = config->user_data;
+
+    client->fd = -1;
+    client->status_code = -1;
+    client->content_length = -1;
+    client->received = 0;
+
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client,
+                                        const char *key, const char *value)
+{
+    if (client == NULL || key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (auto &header : client->headers) {
+        if (strcasecmp(header.first.c_str(), key) == 0) {
+            header.second = value;
+            return ESP_OK;
+        }
+    }
+    client->headers.emplace_back(key, value);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client,
+                                int write_len)
+{
+    if (client == NULL || write_len != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_http_client_close(client);
+
+    client->fd = http_client_connect(client);
+    if (client->fd < 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    /* 1. GET, the connection isn't reused. */
+    std::string request = "GET " + client->path + " HTTP/1.1\r\n"
+                            "Host: " + client->host + "\r\n"
+                            "User-Agent: ESP32 HTTP Client/1.0\r\n"
+                            "Connection: close\r\n";
+    for (const auto &header : client->headers) {
+        request += header.first + ": " + header.second + "\r\n";
+    }
+    request += "\r\n";
+
+    /* 2. Sent whole. */
+    size_t sent = 0;
+    while (sent < request.size()) {
+        const ssize_t len = send(client->fd, request.data() + sent,
+                                    request.size() - sent, MSG_NOSIGNAL);
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Request not sent: %s", strerror(errno));
+            esp_http_client_close(client);
+            return ESP_ERR_HTTP_WRITE_DATA;
+        }
+        sent += len;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char buffer[HTTP_CLIENT_RECV_SIZE];
+    std::string block;
+    size_t end = std::string::npos;
+
+    if (client == NULL || client->fd < 0) {
+        return ESP_FAIL;
+    }
+
+    /* 1. Up to the blank line, what follows is the start of the body. */
+    while ((end = block.find("\r\n\r\n")) == std::string::npos) {
+        if (block.size() > client->header_limit) {
+            ESP_LOGE(TAG, "Response header too long.");
+            return ESP_FAIL;
+        }
+
+        const ssize_t len = http_client_recv(client, buffer, sizeof(buffer));
+        if (len <= 0) {
+            ESP_LOGE(TAG, "Connection lost before the response header.");
+            return ESP_FAIL;
+        }
+        block.append(buffer, len);
+    }
+    client->pending = block.substr(end + 4);
+    block.resize(end + 2);
+
+    /* 2. Status and headers. */
+    if (!http_client_parse_headers(client, &block)) {
+        ESP_LOGE(TAG, "Malformed response header.");
+        return ESP_FAIL;
+    }
+
+    return (int)client->content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return (client != NULL) ? client->status_code : -1;
+}
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return (client != NULL) ? (int)client->content_length : -1;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer,
+                            int len)
+{
+    if (client == NULL || buffer == NULL || len < 0) {
+        return ESP_FAIL;
+    }
+
+    /* 1. Nothing past the announced length. */
+    if (client->content_length >= 0) {
+        len = (int)MIN((int64_t)len,
+                        client->content_length - client->received);
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    /* 2. What came with the headers first. */
+    if (!client->pending.empty()) {
+        const size_t copied = MIN((size_t)len, client->pending.size());
+
+        memcpy(buffer, client->pending.data(), copied);
+        client->pending.erase(0, copied);
+        client->received += copied;
+        return (int)copied;
+    }
+
+    if (client->fd < 0) {
+        return 0;
+    }
+
+    /* 3. The socket, 0 once the server closes it. */
+    const ssize_t received = http_client_recv(client, buffer, len);
+    if (received < 0) {
+        ESP_LOGW(TAG, "Read failed: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+    client->received += received;
+    return (int)received;
+}
+
+bool esp_http_client_is_complete_data_received(
+                                    esp_http_client_handle_t client)
+{
+    if (client == NULL) {
+        return false;
+    }
+
+    /* Without a length the body ends with the connection. */
+    return (client->content_length >= 0)
+            ? (client->received >= client->content_length)
+            : true;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    client->status_code = -1;
+    client->content_length = -1;
+    client->received = 0;
+    client->pending.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_http_client_close(client);
+    delete client;
+    return ESP_OK;
+}
+
+/* Private function definition -----------------------------------------------*/
+static int http_client_connect(esp_http_client_handle_t client)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(client->host.c_str(), client->port.c_str(), &hints,
+                    &addresses) != 0) {
+        ESP_LOGE(TAG, "Unknown host %s.", client->host.c_str());
+        return -1;
+    }
+    for (struct addrinfo *address = addresses; address != NULL;
+            address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype,
+                    address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Could not connect to %s:%s: %s",
+                    client->host.c_str(), client->port.c_str(),
+                    strerror(errno));
+        return -1;
+    }
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static ssize_t http_client_recv(esp_http_client_handle_t client,
+                                char *buffer, size_t len)
+{
+    struct pollfd pfd;
+
+    pfd.fd = client->fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        const int ready = poll(&pfd, 1, client->timeout_ms);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (ready < 0) {
+            return -1;
+        }
+
+        const ssize_t received = recv(client->fd, buffer, len, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        return received;
+    }
+}
+
+static bool http_client_parse_headers(esp_http_client_handle_t client,
+                                        std::string *block)
+{
+    esp_http_client_event_t event;
+    int major = 0;
+    int minor = 0;
+
+    /* 1. HTTP/1.x <status> <reason> */
+    size_t line_end = block->find("\r\n");
+    if (sscanf(block->c_str(), "HTTP/%d.%d %d", &major, &minor,
+                &client->status_code) != 3) {
+        return false;
+    }
+
+    /* 2. One event per header, as the IDF client sends them. */
+    memset(&event, 0, sizeof(event));
+    event.event_id = HTTP_EVENT_ON_HEADER;
+    event.client = client;
+    event.user_data = client->user_data;
+
+    for (size_t start = line_end + 2; start < block->size();
+            start = line_end + 2) {
+        line_end = block->find("\r\n", start);
+        std::string line = block->substr(start, line_end - start);
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+
+        std::string key = line.substr(0, colon);
+        const size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        std::string value = (value_start != std::string::npos)
+                                ? line.substr(value_start) : "";
+        while (!value.empty()
+                && (value.back() == ' ' || value.back() == '\t')) {
+            value.pop_back();
+        }
+
+        if (strcasecmp(key.c_str(), "Content-Length") == 0) {
+            client->content_length = strtoll(value.c_str(), NULL, 10);
+        } else if (strcasecmp(key.c_str(), "Transfer-Encoding") == 0) {
+            ESP_LOGE(TAG, "Chunked responses are not supported.");
+            return false;
+        }
+
+        if (client->event_handler != NULL) {
+            event.header_key = &key[0];
+            event.header_value = &value[0];
+            client->event_handler(&event);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,1242 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+
+/**
+ * @brief   A session buffer holds the request line and headers, then the
+ *          start of the body.
+ */
+#define HTTPD_SESSION_BUFFER_SIZE                                           \
+    (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 64)
+#define HTTPD_DRAIN_BUFFER_SIZE         512
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    int fd;                             /* -1 while free. */
+    uint64_t lru;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    bool ignore_ctx_changes;
+    bool for_async_req;                 /* Owned by an async handler. */
+    httpd_send_func_t send_fn;          /* NULL for send(). */
+    httpd_recv_func_t recv_fn;          /* NULL for recv(). */
+    size_t buffered;
+    char buffer[HTTPD_SESSION_BUFFER_SIZE];
+} httpd_session_t;
+
+typedef struct {
+    const char *field;
+    const char *value;
+} httpd_resp_hdr_t;
+
+/**
+ * @brief   Request in progress, `req.aux` of the handlers.
+ */
+typedef struct {
+    httpd_session_t *session;
+    char header[HTTPD_MAX_REQ_HDR_LEN + 1];     /* Lines after the first. */
+    size_t remaining;                           /* Body not received yet. */
+    const char *status;
+    const char *content_type;
+    std::vector<httpd_resp_hdr_t> resp_hdrs;
+    bool chunked;
+} httpd_req_aux_t;
+
+typedef std::pair<httpd_work_fn_t, void *> httpd_work_t;
+
+typedef struct {
+    struct httpd_data *hd;
+    int fd;
+} httpd_close_work_t;
+
+typedef struct {
+    struct httpd_data *hd;
+    int fd;
+    bool keep;                          /* The next request can be read. */
+} httpd_async_done_work_t;
+
+struct httpd_data {
+    httpd_config_t config;
+    int listen_fd;
+    int ctrl_fds[2];                    /* Wakes the loop for work items. */
+    std::vector<httpd_uri_t> handlers;
+    std::vector<httpd_session_t> sessions;
+    uint64_t lru_counter;
+    std::mutex work_lock;
+    std::deque<httpd_work_t> work;
+    bool stop;
+    SemaphoreHandle_t stopped;
+    httpd_req_t *req;                   /* The const uri rules out a member. */
+    httpd_req_aux_t aux;
+};
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "httpd";
+
+static const char *const s_method_names[] = {
+    "DELETE", "GET", "HEAD", "POST", "PUT", NULL, "OPTIONS"
+};
+
+static const struct {
+    const char *status;
+    const char *message;
+} s_errors[HTTPD_ERR_CODE_MAX] = {
+    {"500 Internal Server Error", "Server has encountered an unexpected "
+                                    "error"},
+    {"501 Method Not Implemented", "Request method is not supported by "
+                                    "server"},
+    {"505 Version Not Supported", "HTTP version not supported by server"},
+    {"400 Bad Request", "Server unable to understand request due to "
+                        "invalid syntax"},
+    {"401 Unauthorized", "Server known the client's identify and it must "
+                        "authenticate itself to get he requested "
+                        "response"},
+    {"403 Forbidden", "Server is refusing to give requested resource to "
+                        "client"},
+    {"404 Not Found", "This URI does not exist"},
+    {"405 Method Not Allowed", "Request method for this URI is not "
+                                "handled by server"},
+    {"408 Request Timeout", "Server closed this connection"},
+    {"411 Length Required", "Chunked encoding not supported by server"},
+    {"414 URI Too Long", "URI is too long"},
+    {"431 Request Header Fields Too Large", "Header fields are too long"}
+};
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Server task: accepts sessions, runs work items and serves one
+ *          request of each readable session per pass.
+ */
+static void httpd_server_task(void *param);
+
+static void httpd_accept(struct httpd_data *hd);
+static void httpd_run_work(struct httpd_data *hd);
+static void httpd_sess_close(struct httpd_data *hd,
+                                httpd_session_t *session);
+static httpd_session_t *httpd_sess_find(struct httpd_data *hd, int fd);
+
+/**
+ * @brief   Work item of httpd_sess_trigger_close().
+ */
+static void httpd_close_work(void *arg);
+
+/**
+ * @brief   Work item of httpd_req_async_handler_complete(), gives the
+ *          session back to the server task.
+ */
+static void httpd_async_done_work(void *arg);
+
+/**
+ * @brief   Reads, dispatches and completes one request of a session.
+ *
+ * @return  false if the session must be closed.
+ */
+static bool httpd_serve_request(struct httpd_data *hd,
+                                httpd_session_t *session);
+
+/**
+ * @brief   Reads until the end of the headers is buffered.
+ *
+ * @return  Length of the headers with the blank line, 0 if the peer left
+ *          and -1 if they don't fit.
+ */
+static int httpd_read_headers(httpd_session_t *session);
+
+/**
+ * @brief   Finds the handler of a request and runs it.
+ */
+static esp_err_t httpd_dispatch(struct httpd_data *hd, httpd_req_t *req);
+
+/**
+ * @brief   Sends through the override of the session, send() by default.
+ */
+static int httpd_send_all(httpd_req_t *r, const char *buf, size_t len);
+static esp_err_t httpd_send_headers(httpd_req_t *req,
+                                    const char *length_line);
+static int httpd_map_errno(void);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    struct sockaddr_in addr;
+    int enable = 1;
+
+    if (handle == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct httpd_data *hd = new httpd_data();
+    hd->config = *config;
+    hd->lru_counter = 0;
+    hd->stop = false;
+    hd->req = (httpd_req_t *)calloc(1, sizeof(httpd_req_t));
+    hd->handlers.reserve(config->max_uri_handlers);
+    hd->sessions.resize(config->max_open_sockets);
+    for (httpd_session_t &session : hd->sessions) {
+        session.fd = -1;
+    }
+
+    /* 1. Listening socket. */
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (hd->listen_fd < 0) {
+        ESP_LOGE(TAG, "error in socket (%d)", errno);
+        free(hd->req);
+        delete hd;
+        return ESP_ERR_HTTPD_TASK;
+    }
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR,
+                &enable, sizeof(enable));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config->server_port);
+    if (bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(hd->listen_fd, config->backlog_conn) < 0) {
+        ESP_LOGE(TAG, "error in bind/listen on port %d (%d)",
+                    config->server_port, errno);
+        close(hd->listen_fd);
+        free(hd->req);
+        delete hd;
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    /* 2. Control socket, the firmware uses a UDP socket on ctrl_port. */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, hd->ctrl_fds) < 0) {
+        close(hd->listen_fd);
+        free(hd->req);
+        delete hd;
+        return ESP_ERR_HTTPD_TASK;
+    }
+    fcntl(hd->ctrl_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(hd->ctrl_fds[1], F_SETFL, O_NONBLOCK);
+
+    hd->stopped = xSemaphoreCreateBinary();
+    if (xTaskCreatePinnedToCore(&httpd_server_task,
+                                "httpd",
+                                config->stack_size,
+                                hd,
+                                config->task_priority,
+                                NULL,
+                                config->core_id) != pdPASS) {
+        close(hd->listen_fd);
+        close(hd->ctrl_fds[0]);
+        close(hd->ctrl_fds[1]);
+        free(hd->req);
+        delete hd;
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    struct httpd_data *hd = (struct httpd_data *)handle;
+    const char byte = 0;
+
+    if (hd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(hd->work_lock);
+        hd->stop = true;
+    }
+    (void)!write(hd->ctrl_fds[1], &byte, 1);
+    xSemaphoreTake(hd->stopped, portMAX_DELAY);
+
+    if (hd->config.global_user_ctx_free_fn) {
+        hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+    } else {
+        free(hd->config.global_user_ctx);
+    }
+
+    close(hd->listen_fd);
+    close(hd->ctrl_fds[0]);
+    close(hd->ctrl_fds[1]);
+    vSemaphoreDelete(hd->stopped);
+    free(hd->req);
+    delete hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
+                                        const httpd_uri_t *uri_handler)
+{
+    struct httpd_data *hd = (struct httpd_data *)handle;
+
+    if (hd == NULL || uri_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (const httpd_uri_t &handler : hd->handlers) {
+        if (handler.method == uri_handler->method
+            && strcmp(handler.uri, uri_handler->uri) == 0) {
+            ESP_LOGW(TAG, "handler %s already exists", uri_handler->uri);
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+
+    if (hd->handlers.size() >= hd->config.max_uri_handlers) {
+        ESP_LOGW(TAG, "no slots left for registering handler");
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+
+    /* The firmware copies the URI too. */
+    httpd_uri_t handler = *uri_handler;
+    handler.uri = strdup(uri_handler->uri);
+    hd->handlers.push_back(handler);
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *reference_uri,
+                                const char *uri_to_match,
+                                size_t match_upto)
+{
+    const size_t tpl_len = strlen(reference_uri);
+    const char last = tpl_len > 0 ? reference_uri[tpl_len - 1] : 0;
+    const char prevlast = tpl_len > 1 ? reference_uri[tpl_len - 2] : 0;
+    const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    const bool quest = last == '?' || (prevlast == '?' && last == '*');
+    const size_t special = (asterisk ? 1 : 0) + (quest ? 2 : 0);
+
+    /* Same rules as the firmware: "/a/?" matches "/a" and "/a/", and a
+     * trailing asterisk any subpath. */
+    if (tpl_len < special) {
+        return false;
+    }
+
+    const size_t exact_match_chars = tpl_len - special;
+    if (match_upto < exact_match_chars) {
+        return false;
+    }
+
+    if (!quest) {
+        if (!asterisk && match_upto != exact_match_chars) {
+            return false;
+        }
+        return strncmp(reference_uri, uri_to_match, exact_match_chars) == 0;
+    }
+
+    if (match_upto > exact_match_chars
+        && reference_uri[exact_match_chars]
+            != uri_to_match[exact_match_chars]) {
+        return false;
+    }
+    if (strncmp(reference_uri, uri_to_match, exact_match_chars) != 0) {
+        return false;
+    }
+    return asterisk || match_upto <= exact_match_chars + 1;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+    httpd_session_t *session = aux->session;
+
+    if (buf_len > aux->remaining) {
+        buf_len = aux->remaining;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+
+    /* 1. Body bytes read along with the headers. */
+    if (session->buffered > 0) {
+        const size_t len = buf_len < session->buffered ? buf_len
+                                                        : session->buffered;
+        memcpy(buf, session->buffer, len);
+        memmove(session->buffer, session->buffer + len,
+                session->buffered - len);
+        session->buffered -= len;
+        aux->remaining -= len;
+        return (int)len;
+    }
+
+    /* 2. The socket, within recv_wait_timeout. */
+    const int ret = (session->recv_fn != NULL)
+                    ? session->recv_fn(r->handle, session->fd, buf, buf_len,
+                                        0)
+                    : httpd_socket_recv(r->handle, session->fd, buf,
+                                        buf_len, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    aux->remaining -= (size_t)ret;
+    return ret;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    char value[HTTPD_MAX_REQ_HDR_LEN];
+    esp_err_t err = httpd_req_get_hdr_value_str(r, field, value,
+                                                sizeof(value));
+    return (err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC)
+            ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field,
+                                        char *val, size_t val_size)
+{
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+    const size_t field_len = strlen(field);
+    const char *line = aux->header;
+
+    while (*line != '\0') {
+        const char *end = strstr(line, "\r\n");
+        if (end == NULL) {
+            end = line + strlen(line);
+        }
+
+        if ((size_t)(end - line) > field_len
+            && line[field_len] == ':'
+            && strncasecmp(line, field, field_len) == 0) {
+            const char *value = line + field_len + 1;
+            while (value < end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+
+            const size_t len = end - value;
+            if (val_size == 0) {
+                return ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            const size_t copy = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, value, copy);
+            val[copy] = '\0';
+            return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+
+        line = (*end != '\0') ? end + 2 : end;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *query = strchr(r->uri, '?');
+    return query ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf,
+                                        size_t buf_len)
+{
+    const char *query = strchr(r->uri, '?');
+
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    query++;
+    const size_t len = strlen(query);
+    const size_t copy = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query, copy);
+    buf[copy] = '\0';
+    return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key,
+                                char *val, size_t val_size)
+{
+    const size_t key_len = strlen(key);
+    const char *pair = qry;
+
+    while (pair != NULL && *pair != '\0') {
+        const char *end = strchr(pair, '&');
+        const char *eq = strchr(pair, '=');
+        if (end == NULL) {
+            end = pair + strlen(pair);
+        }
+
+        if (eq != NULL && eq < end && (size_t)(eq - pair) == key_len
+            && strncmp(pair, key, key_len) == 0) {
+            const size_t len = end - (eq + 1);
+            if (val_size == 0) {
+                return ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            const size_t copy = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, eq + 1, copy);
+            val[copy] = '\0';
+            return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+
+        pair = (*end != '\0') ? end + 1 : NULL;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return ((httpd_req_aux_t *)r->aux)->session->fd;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    ((httpd_req_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    ((httpd_req_aux_t *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field,
+                                const char *value)
+{
+    struct httpd_data *hd = (struct httpd_data *)r->handle;
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+
+    /* Like the firmware, only the pointers are kept until the send. */
+    if (aux->resp_hdrs.size() >= hd->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    aux->resp_hdrs.push_back({field, value});
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    char length_line[48];
+
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+
+    snprintf(length_line, sizeof(length_line),
+                "Content-Length: %d\r\n", (int)buf_len);
+    if (httpd_send_headers(r, length_line) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len > 0
+        && httpd_send_all(r, buf, buf_len) < 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf,
+                                ssize_t buf_len)
+{
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+    char size_line[16];
+
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+
+    if (!aux->chunked) {
+        if (httpd_send_headers(r, "Transfer-Encoding: chunked\r\n")
+                != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        aux->chunked = true;
+    }
+
+    const int size_len = snprintf(size_line, sizeof(size_line), "%x\r\n",
+                                    (unsigned)buf_len);
+    if (httpd_send_all(r, size_line, size_len) < 0
+        || (buf_len > 0
+            && httpd_send_all(r, buf, buf_len) < 0)
+        || httpd_send_all(r, "\r\n", 2) < 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error,
+                                const char *msg)
+{
+    if (error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    httpd_resp_set_status(req, s_errors[error].status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg ? msg : s_errors[error].message,
+                            HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    return httpd_send_all(r, buf, buf_len);
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    if (r == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+    httpd_req_t *async = (httpd_req_t *)malloc(sizeof(*async));
+    if (async == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The request of the server task is reused by the next session, the
+     * copy keeps its own headers and response state. */
+    memcpy((void *)async, r, sizeof(*async));
+    async->aux = new httpd_req_aux_t(*aux);
+    aux->session->for_async_req = true;
+
+    *out = async;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+    httpd_async_done_work_t *work = new httpd_async_done_work_t{
+        (struct httpd_data *)r->handle,
+        aux->session->fd,
+        aux->remaining == 0
+    };
+
+    delete aux;
+    free(r);
+
+    if (httpd_queue_work(work->hd, &httpd_async_done_work, work) != ESP_OK) {
+        delete work;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work,
+                            void *arg)
+{
+    struct httpd_data *hd = (struct httpd_data *)handle;
+    const char byte = 1;
+
+    if (hd == NULL || work == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(hd->work_lock);
+        if (hd->stop) {
+            return ESP_FAIL;
+        }
+        hd->work.push_back(httpd_work_t(work, arg));
+    }
+
+    /* A full control socket already has a wake up pending. */
+    (void)!write(hd->ctrl_fds[1], &byte, 1);
+    return ESP_OK;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf,
+                        size_t buf_len, int flags)
+{
+    httpd_session_t *session = httpd_sess_find((struct httpd_data *)hd,
+                                                sockfd);
+    ssize_t ret;
+
+    if (session != NULL && session->send_fn != NULL) {
+        return session->send_fn(hd, sockfd, buf, buf_len, flags);
+    }
+
+    do {
+        ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? httpd_map_errno() : (int)ret;
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd,
+                                        httpd_send_func_t send_func)
+{
+    httpd_session_t *session = httpd_sess_find((struct httpd_data *)hd,
+                                                sockfd);
+
+    if (session == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    session->send_fn = send_func;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_recv_override(httpd_handle_t hd, int sockfd,
+                                        httpd_recv_func_t recv_func)
+{
+    httpd_session_t *session = httpd_sess_find((struct httpd_data *)hd,
+                                                sockfd);
+
+    if (session == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    session->recv_fn = recv_func;
+    return ESP_OK;
+}
+
+int httpd_socket_recv(httpd_handle_t hd, int sockfd, char *buf,
+                        size_t buf_len, int flags)
+{
+    ssize_t ret;
+
+    (void)hd;
+    do {
+        ret = recv(sockfd, buf, buf_len, flags);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? httpd_map_errno() : (int)ret;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    struct httpd_data *hd = (struct httpd_data *)handle;
+
+    if (httpd_sess_find(hd, sockfd) == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Closed from the server task, the fd is looked up again there. */
+    httpd_close_work_t *work = new httpd_close_work_t{hd, sockfd};
+    if (httpd_queue_work(handle, &httpd_close_work, work) != ESP_OK) {
+        delete work;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd)
+{
+    httpd_session_t *session = httpd_sess_find((struct httpd_data *)handle,
+                                                sockfd);
+    return session ? session->ctx : NULL;
+}
+
+/* Private function definition -----------------------------------------------*/
+static void httpd_server_task(void *param)
+{
+    struct httpd_data *hd = (struct httpd_data *)param;
+
+    ESP_LOGI(TAG, "Started server on port: '%d'", hd->config.server_port);
+
+    while (1) {
+        fd_set read_set;
+        struct timeval zero = {0, 0};
+        bool buffered = false;
+        bool full = true;
+        int max_fd = hd->ctrl_fds[0];
+
+        /* 1. Sockets to wait for. A full table only accepts when the least
+         * recently used session may be purged. */
+        FD_ZERO(&read_set);
+        FD_SET(hd->ctrl_fds[0], &read_set);
+        for (httpd_session_t &session : hd->sessions) {
+            if (session.fd < 0) {
+                full = false;
+                continue;
+            }
+            if (session.for_async_req) {
+                continue;
+            }
+            FD_SET(session.fd, &read_set);
+            max_fd = session.fd > max_fd ? session.fd : max_fd;
+            buffered = buffered || session.buffered > 0;
+        }
+        if (!full || hd->config.lru_purge_enable) {
+            FD_SET(hd->listen_fd, &read_set);
+            max_fd = hd->listen_fd > max_fd ? hd->listen_fd : max_fd;
+        }
+
+        if (select(max_fd + 1, &read_set, NULL, NULL,
+                    buffered ? &zero : NULL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "error in select (%d)", errno);
+            break;
+        }
+
+        /* 2. Work items, and the stop request. */
+        if (FD_ISSET(hd->ctrl_fds[0], &read_set)) {
+            char drain[64];
+            while (read(hd->ctrl_fds[0], drain, sizeof(drain)) > 0) {
+            }
+            httpd_run_work(hd);
+
+            std::lock_guard<std::mutex> guard(hd->work_lock);
+            if (hd->stop) {
+                break;
+            }
+        }
+
+        /* 3. One request of each ready session. */
+        for (httpd_session_t &session : hd->sessions) {
+            if (session.fd >= 0 && !session.for_async_req
+                && (session.buffered > 0
+                    || FD_ISSET(session.fd, &read_set))) {
+                if (!httpd_serve_request(hd, &session)) {
+                    httpd_sess_close(hd, &session);
+                }
+            }
+        }
+
+        /* 4. New sessions. */
+        if (FD_ISSET(hd->listen_fd, &read_set)) {
+            httpd_accept(hd);
+        }
+    }
+
+    for (httpd_session_t &session : hd->sessions) {
+        if (session.fd >= 0) {
+            httpd_sess_close(hd, &session);
+        }
+    }
+    xSemaphoreGive(hd->stopped);
+    vTaskDelete(NULL);
+}
+
+static void httpd_accept(struct httpd_data *hd)
+{
+    httpd_session_t *slot = NULL;
+    struct timeval recv_timeout = {(time_t)hd->config.recv_wait_timeout, 0};
+    struct timeval send_timeout = {(time_t)hd->config.send_wait_timeout, 0};
+    int enable = 1;
+
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "error in accept (%d)", errno);
+        return;
+    }
+
+    /* 1. A free slot, or the least recently used session. */
+    for (httpd_session_t &session : hd->sessions) {
+        if (session.fd < 0) {
+            slot = &session;
+            break;
+        }
+    }
+    if (slot == NULL) {
+        /* Sessions of async handlers are in use, they aren't purged. */
+        for (httpd_session_t &session : hd->sessions) {
+            if (!session.for_async_req
+                && (slot == NULL || session.lru < slot->lru)) {
+                slot = &session;
+            }
+        }
+        if (slot == NULL) {
+            ESP_LOGW(TAG, "no session to purge");
+            close(fd);
+            return;
+        }
+        ESP_LOGD(TAG, "purging LRU session %d", slot->fd);
+        httpd_sess_close(hd, slot);
+    }
+
+    /* 2. Timeouts of the firmware. lwIP sends the header and body of a
+     * response in one segment more often than Linux, no Nagle delay keeps
+     * latencies comparable. */
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+                &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+                &send_timeout, sizeof(send_timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    slot->fd = fd;
+    slot->lru = ++hd->lru_counter;
+    slot->ctx = NULL;
+    slot->free_ctx = NULL;
+    slot->ignore_ctx_changes = false;
+    slot->for_async_req = false;
+    slot->send_fn = NULL;
+    slot->recv_fn = NULL;
+    slot->buffered = 0;
+
+    if (hd->config.open_fn != NULL
+        && hd->config.open_fn(hd, fd) != ESP_OK) {
+        httpd_sess_close(hd, slot);
+        return;
+    }
+
+    ESP_LOGD(TAG, "new session %d", fd);
+}
+
+static void httpd_run_work(struct httpd_data *hd)
+{
+    while (1) {
+        httpd_work_t work;
+        {
+            std::lock_guard<std::mutex> guard(hd->work_lock);
+            if (hd->work.empty()) {
+                return;
+            }
+            work = hd->work.front();
+            hd->work.pop_front();
+        }
+        work.first(work.second);
+    }
+}
+
+static void httpd_sess_close(struct httpd_data *hd,
+                                httpd_session_t *session)
+{
+    const int fd = session->fd;
+
+    if (session->ctx != NULL) {
+        if (session->free_ctx != NULL) {
+            session->free_ctx(session->ctx);
+        } else {
+            free(session->ctx);
+        }
+    }
+
+    session->fd = -1;
+    session->ctx = NULL;
+    session->free_ctx = NULL;
+    session->for_async_req = false;
+    session->buffered = 0;
+
+    if (hd->config.close_fn != NULL) {
+        hd->config.close_fn(hd, fd);
+    } else {
+        close(fd);
+    }
+    ESP_LOGD(TAG, "session %d closed", fd);
+}
+
+static httpd_session_t *httpd_sess_find(struct httpd_data *hd, int fd)
+{
+    for (httpd_session_t &session : hd->sessions) {
+        if (fd >= 0 && session.fd == fd) {
+            return &session;
+        }
+    }
+    return NULL;
+}
+
+static void httpd_close_work(void *arg)
+{
+    httpd_close_work_t *work = (httpd_close_work_t *)arg;
+    httpd_session_t *session = httpd_sess_find(work->hd, work->fd);
+
+    if (session != NULL) {
+        httpd_sess_close(work->hd, session);
+    }
+    delete work;
+}
+
+static void httpd_async_done_work(void *arg)
+{
+    httpd_async_done_work_t *work = (httpd_async_done_work_t *)arg;
+    httpd_session_t *session = httpd_sess_find(work->hd, work->fd);
+
+    /* A body left unread loses the framing, like an error. */
+    if (session != NULL && session->for_async_req) {
+        session->for_async_req = false;
+        if (!work->keep) {
+            httpd_sess_close(work->hd, session);
+        }
+    }
+    delete work;
+}
+
+static bool httpd_serve_request(struct httpd_data *hd,
+                                httpd_session_t *session)
+{
+    httpd_req_t *req = hd->req;
+    httpd_req_aux_t *aux = &hd->aux;
+    char *uri = (char *)req->uri;
+    char version[16];
+    char method[16];
+    httpd_err_code_t error = HTTPD_ERR_CODE_MAX;
+
+    /* 1. Request line and headers. */
+    const int header_len = httpd_read_headers(session);
+    if (header_len == 0) {
+        return false;
+    }
+
+    memset((void *)req, 0, sizeof(*req));
+    aux->session = session;
+    aux->header[0] = '\0';
+    aux->remaining = 0;
+    aux->status = HTTPD_200;
+    aux->content_type = HTTPD_TYPE_TEXT;
+    aux->resp_hdrs.clear();
+    aux->chunked = false;
+    req->handle = hd;
+    req->aux = aux;
+
+    if (header_len < 0) {
+        error = HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+    } else {
+        char *line_end = (char *)memmem(session->buffer, header_len,
+                                        "\r\n", 2);
+        const size_t line_len = line_end - session->buffer;
+        const char *uri_start = (const char *)memchr(session->buffer, ' ',
+                                                        line_len);
+        const char *uri_end = uri_start
+                ? (const char *)memchr(uri_start + 1, ' ',
+                                        line_end - uri_start - 1)
+                : NULL;
+        const size_t fields_len = header_len - line_len - 4;
+
+        if (uri_start == NULL || uri_end == NULL
+            || (size_t)(uri_start - session->buffer) >= sizeof(method)
+            || (size_t)(line_end - uri_end - 1) >= sizeof(version)) {
+            error = HTTPD_400_BAD_REQUEST;
+        } else if ((size_t)(uri_end - uri_start - 1) > HTTPD_MAX_URI_LEN) {
+            error = HTTPD_414_URI_TOO_LONG;
+        } else if (fields_len > HTTPD_MAX_REQ_HDR_LEN) {
+            error = HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+        } else {
+            memcpy(method, session->buffer, uri_start - session->buffer);
+            method[uri_start - session->buffer] = '\0';
+            memcpy(uri, uri_start + 1, uri_end - uri_start - 1);
+            uri[uri_end - uri_start - 1] = '\0';
+            memcpy(version, uri_end + 1, line_end - uri_end - 1);
+            version[line_end - uri_end - 1] = '\0';
+            memcpy(aux->header, line_end + 2, fields_len);
+            aux->header[fields_len] = '\0';
+
+            req->method = -1;
+            for (size_t i = 0;
+                    i < sizeof(s_method_names) / sizeof(s_method_names[0]);
+                    i++) {
+                if (s_method_names[i] && strcmp(method, s_method_names[i])
+                                            == 0) {
+                    req->method = (int)i;
+                }
+            }
+            if (req->method < 0) {
+                error = HTTPD_501_METHOD_NOT_IMPLEMENTED;
+            } else if (strncmp(version, "HTTP/1.", 7) != 0) {
+                error = HTTPD_505_VERSION_NOT_SUPPORTED;
+            }
+        }
+    }
+
+    /* 2. The body follows the headers in the buffer. */
+    if (header_len > 0) {
+        memmove(session->buffer, session->buffer + header_len,
+                session->buffered - header_len);
+        session->buffered -= header_len;
+    }
+
+    if (error == HTTPD_ERR_CODE_MAX) {
+        char value[16];
+        if (httpd_req_get_hdr_value_str(req, "Transfer-Encoding",
+                                        value, sizeof(value)) == ESP_OK) {
+            error = HTTPD_411_LENGTH_REQUIRED;
+        } else if (httpd_req_get_hdr_value_str(req, "Content-Length",
+                                        value, sizeof(value)) == ESP_OK) {
+            req->content_len = strtoul(value, NULL, 10);
+        }
+    }
+
+    if (error != HTTPD_ERR_CODE_MAX) {
+        /* Framing is lost, the session ends after the error. */
+        ESP_LOGW(TAG, "%s", s_errors[error].status);
+        httpd_resp_send_err(req, error, NULL);
+        return false;
+    }
+
+    aux->remaining = req->content_len;
+    session->lru = ++hd->lru_counter;
+
+    /* 3. Handler, with the context of the session. */
+    req->sess_ctx = session->ctx;
+    req->free_ctx = session->free_ctx;
+    req->ignore_sess_ctx_changes = session->ignore_ctx_changes;
+
+    const esp_err_t err = httpd_dispatch(hd, req);
+
+    if (!req->ignore_sess_ctx_changes && req->sess_ctx != session->ctx
+        && session->ctx != NULL) {
+        if (session->free_ctx != NULL) {
+            session->free_ctx(session->ctx);
+        } else {
+            free(session->ctx);
+        }
+    }
+    session->ctx = req->sess_ctx;
+    session->free_ctx = req->free_ctx;
+    session->ignore_ctx_changes = req->ignore_sess_ctx_changes;
+
+    if (err != ESP_OK) {
+        return false;
+    }
+
+    /* 4. Body left unread by the handler, unless an async handler still
+     * has the request. */
+    if (session->for_async_req) {
+        return true;
+    }
+    while (aux->remaining > 0) {
+        char drain[HTTPD_DRAIN_BUFFER_SIZE];
+        if (httpd_req_recv(req, drain, sizeof(drain)) <= 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int httpd_read_headers(httpd_session_t *session)
+{
+    while (1) {
+        const char *end = (const char *)memmem(session->buffer,
+                                                session->buffered,
+                                                "\r\n\r\n", 4);
+        if (end != NULL) {
+            return (int)(end + 4 - session->buffer);
+        }
+        if (session->buffered == sizeof(session->buffer)) {
+            return -1;
+        }
+
+        ssize_t ret = recv(session->fd,
+                            session->buffer + session->buffered,
+                            sizeof(session->buffer) - session->buffered,
+                            0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return 0;
+        }
+        session->buffered += (size_t)ret;
+    }
+}
+
+static esp_err_t httpd_dispatch(struct httpd_data *hd, httpd_req_t *req)
+{
+    const char *query = strchr(req->uri, '?');
+    const size_t path_len = query ? (size_t)(query - req->uri)
+                                    : strlen(req->uri);
+    bool uri_found = false;
+
+    for (const httpd_uri_t &handler : hd->handlers) {
+        const bool match = hd->config.uri_match_fn
+            ? hd->config.uri_match_fn(handler.uri, req->uri, path_len)
+            : (strlen(handler.uri) == path_len
+                && strncmp(handler.uri, req->uri, path_len) == 0);
+        if (!match) {
+            continue;
+        }
+
+        uri_found = true;
+        if ((int)handler.method == req->method) {
+            req->user_ctx = handler.user_ctx;
+            return handler.handler(req);
+        }
+    }
+
+    ESP_LOGW(TAG, "URI '%s' not found", req->uri);
+    return httpd_resp_send_err(req,
+                                uri_found ? HTTPD_405_METHOD_NOT_ALLOWED
+                                            : HTTPD_404_NOT_FOUND,
+                                NULL) == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+static int httpd_send_all(httpd_req_t *r, const char *buf, size_t len)
+{
+    httpd_session_t *session = ((httpd_req_aux_t *)r->aux)->session;
+    size_t sent = 0;
+
+    while (sent < len) {
+        ssize_t ret;
+
+        if (session->send_fn != NULL) {
+            ret = session->send_fn(r->handle, session->fd, buf + sent,
+                                    len - sent, 0);
+        } else {
+            ret = send(session->fd, buf + sent, len - sent, MSG_NOSIGNAL);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            ret = ret < 0 ? httpd_map_errno() : ret;
+        }
+
+        if (ret < 0) {
+            return (int)ret;
+        }
+        sent += (size_t)ret;
+    }
+    return (int)sent;
+}
+
+static esp_err_t httpd_send_headers(httpd_req_t *req,
+                                    const char *length_line)
+{
+    httpd_req_aux_t *aux = (httpd_req_aux_t *)req->aux;
+    std::vector<char> header;
+    char line[HTTPD_MAX_REQ_HDR_LEN];
+
+    /* Assembled into one send, the firmware does the same through its
+     * scratch buffer. */
+    int len = snprintf(line, sizeof(line),
+                        "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s",
+                        aux->status, aux->content_type, length_line);
+    header.insert(header.end(), line, line + len);
+
+    for (const httpd_resp_hdr_t &hdr : aux->resp_hdrs) {
+        len = snprintf(line, sizeof(line), "%s: %s\r\n",
+                        hdr.field, hdr.value);
+        header.insert(header.end(), line, line + len);
+    }
+    header.push_back('\r');
+    header.push_back('\n');
+
+    return httpd_send_all(req, header.data(), header.size()) < 0
+            ? ESP_FAIL : ESP_OK;
+}
+
+static int httpd_map_errno(void)
+{
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (errno == EBADF || errno == EINVAL || errno == EFAULT) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return HTTPD_SOCK_ERR_FAIL;
+}
@@ -0,0 +1,400 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+#define ESP_OTA_PARTITION_COUNT         5
+#define ESP_OTA_APP_FIRST               2   /* app0, the running one. */
+#define ESP_OTA_APP_COUNT               2
+#define ESP_OTA_FILE_FIRST              4   /* history, kept in a file. */
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    bool used;
+    const esp_partition_t *partition;
+    uint32_t wrote_size;
+    bool sequential;
+    uint8_t first_byte;
+} esp_ota_session_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "esp_ota_ops";
+
+/**
+ * @brief   The partitions.csv table of the firmware, without coredump.
+ */
+static const esp_partition_t s_partitions[ESP_OTA_PARTITION_COUNT] = {
+    {NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,
+        0x9000, 0x5000, "nvs", false},
+    {NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA,
+        0xe000, 0x2000, "otadata", false},
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0,
+        0x10000, 0x140000, "app0", false},
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1,
+        0x150000, 0x140000, "app1", false},
+    {NULL, ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40,
+        0x290000, 0x160000, "history", false}
+};
+
+static std::mutex s_lock;
+static uint8_t *s_flash[ESP_OTA_PARTITION_COUNT];
+static const esp_partition_t *s_boot = &s_partitions[ESP_OTA_APP_FIRST];
+static esp_ota_session_t s_session;         /* One update at a time. */
+static int s_write_us = -1;                 /* Per sector, -1 until read. */
+static int s_erase_us = -1;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Contents of a partition, erased on first use. s_lock held.
+ * @note    Data partitions from ESP_OTA_FILE_FIRST on are mapped from
+ *          `<label>.partition` in NATIVE_FLASH_DIR, the working directory by
+ *          default, so they persist across runs like on the chip and a
+ *          killed process leaves them as a power loss would.
+ */
+static uint8_t *esp_ota_flash(const esp_partition_t *partition);
+
+/**
+ * @brief   Session of a handle, s_lock held.
+ */
+static esp_ota_session_t *esp_ota_session(esp_ota_handle_t handle);
+
+/**
+ * @brief   Holds the flash busy for `size` bytes of an operation that takes
+ *          `env` microseconds per sector, s_lock held.
+ * @note    NATIVE_FLASH_WRITE_US and NATIVE_FLASH_ERASE_US give the time to
+ *          program and to erase a sector, 0 by default: the host writes
+ *          at memory speed. A chip programs a sector in about 10 ms and
+ *          erases it in about 30 ms, see scripts/ota_writer_bench.py.
+ */
+static void esp_ota_flash_busy(const char *env, int *sector_us, size_t size);
+
+/* Public function definition ------------------------------------------------*/
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                        esp_partition_subtype_t subtype,
+                                        const char *label)
+{
+    for (size_t i = 0; i < ESP_OTA_PARTITION_COUNT; i++) {
+        const esp_partition_t *partition = &s_partitions[i];
+
+        if (partition->type == type
+            && (subtype == ESP_PARTITION_SUBTYPE_ANY
+                || partition->subtype == subtype)
+            && (label == NULL || strcmp(label, partition->label) == 0)) {
+            return partition;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                                size_t src_offset, void *dst, size_t size)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (src_offset > partition->size
+        || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(dst, esp_ota_flash(partition) + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                                size_t dst_offset, const void *src,
+                                size_t size)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    const uint8_t *bytes = (const uint8_t *)src;
+
+    if (dst_offset > partition->size
+        || size > partition->size - dst_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* NOR flash only clears bits, writing over unerased data corrupts it
+     * like on the chip. */
+    uint8_t *flash = esp_ota_flash(partition) + dst_offset;
+    for (size_t i = 0; i < size; i++) {
+        flash[i] &= bytes[i];
+    }
+    esp_ota_flash_busy("NATIVE_FLASH_WRITE_US", &s_write_us, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(esp_ota_flash(partition) + offset, 0xFF, size);
+    esp_ota_flash_busy("NATIVE_FLASH_ERASE_US", &s_erase_us, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size,
+                        esp_ota_handle_t *out_handle)
+{
+    if (partition == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition == esp_ota_get_running_partition()) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        if (s_session.used) {
+            ESP_LOGW(TAG, "Replacing an unfinished update.");
+        }
+        s_session.used = true;
+        s_session.partition = partition;
+        s_session.wrote_size = 0;
+        s_session.sequential = (image_size == OTA_WITH_SEQUENTIAL_WRITES);
+    }
+
+    /* Sequential writes leave the erase to the caller. */
+    if (image_size == OTA_WITH_SEQUENTIAL_WRITES) {
+        /* Nothing. */
+    } else if (image_size == OTA_SIZE_UNKNOWN || image_size == 0) {
+        esp_partition_erase_range(partition, 0, partition->size);
+    } else {
+        const size_t aligned = (image_size + SPI_FLASH_SEC_SIZE - 1)
+                                & ~(size_t)(SPI_FLASH_SEC_SIZE - 1);
+        if (aligned > partition->size) {
+            std::lock_guard<std::mutex> guard(s_lock);
+            s_session.used = false;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        esp_partition_erase_range(partition, 0, aligned);
+    }
+
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data,
+                        size_t size)
+{
+    uint32_t offset;
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        esp_ota_session_t *session = esp_ota_session(handle);
+        if (session == NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        offset = session->wrote_size;
+    }
+
+    return esp_ota_write_with_offset(handle, data, size, offset);
+}
+
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle,
+                                    const void *data, size_t size,
+                                    uint32_t offset)
+{
+    const esp_partition_t *partition;
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        esp_ota_session_t *session = esp_ota_session(handle);
+        if (session == NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (offset == 0 && size > 0) {
+            session->first_byte = ((const uint8_t *)data)[0];
+            if (session->first_byte != ESP_IMAGE_HEADER_MAGIC) {
+                ESP_LOGE(TAG, "OTA image has invalid magic byte "
+                                "(expected 0xE9, saw 0x%02x)",
+                                session->first_byte);
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+        }
+        partition = session->partition;
+        if (offset + size > session->wrote_size) {
+            session->wrote_size = offset + size;
+        }
+    }
+
+    return esp_partition_write(partition, offset, data, size);
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    esp_ota_session_t *session = esp_ota_session(handle);
+    esp_err_t err = ESP_OK;
+
+    if (session == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* The chip verifies the image structure and checksum, the host only
+     * its header. */
+    if (session->wrote_size == 0
+        || esp_ota_flash(session->partition)[0]
+            != ESP_IMAGE_HEADER_MAGIC) {
+        err = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    session->used = false;
+    return err;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    esp_ota_session_t *session = esp_ota_session(handle);
+
+    if (session == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    session->used = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (partition == NULL || partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_ota_flash(partition)[0] != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    s_boot = partition;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    return s_boot;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_partitions[ESP_OTA_APP_FIRST];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(
+                                        const esp_partition_t *start_from)
+{
+    if (start_from == NULL) {
+        start_from = esp_ota_get_running_partition();
+    }
+
+    const size_t index = start_from - s_partitions;
+    if (index < ESP_OTA_APP_FIRST
+        || index >= ESP_OTA_APP_FIRST + ESP_OTA_APP_COUNT) {
+        return NULL;
+    }
+
+    return &s_partitions[ESP_OTA_APP_FIRST
+                        + (index - ESP_OTA_APP_FIRST + 1)
+                            % ESP_OTA_APP_COUNT];
+}
+
+/* Private function definition -----------------------------------------------*/
+static uint8_t *esp_ota_flash(const esp_partition_t *partition)
+{
+    const size_t index = partition - s_partitions;
+    uint8_t *flash = s_flash[index];
+
+    if (flash != NULL) {
+        return flash;
+    }
+
+    if (index < ESP_OTA_FILE_FIRST) {
+        flash = (uint8_t *)malloc(partition->size);
+        memset(flash, 0xFF, partition->size);
+    } else {
+        const char *dir = getenv("NATIVE_FLASH_DIR");
+        char path[256];
+        struct stat st;
+
+        snprintf(path, sizeof(path), "%s/%s.partition",
+                    dir ? dir : ".", partition->label);
+        const int fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            ESP_LOGE(TAG, "Can't open %s.", path);
+            abort();
+        }
+
+        /* A new file is erased flash. */
+        const bool created = (st.st_size == 0);
+        if (ftruncate(fd, partition->size) != 0) {
+            ESP_LOGE(TAG, "Can't size %s.", path);
+            abort();
+        }
+        flash = (uint8_t *)mmap(NULL, partition->size,
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (flash == MAP_FAILED) {
+            ESP_LOGE(TAG, "Can't map %s.", path);
+            abort();
+        }
+        if (created) {
+            memset(flash, 0xFF, partition->size);
+        }
+        ESP_LOGI(TAG, "Partition \"%s\" kept in %s.",
+                    partition->label, path);
+    }
+
+    s_flash[index] = flash;
+    return flash;
+}
+
+static esp_ota_session_t *esp_ota_session(esp_ota_handle_t handle)
+{
+    return (handle == 1 && s_session.used) ? &s_session : NULL;
+}
+
+static void esp_ota_flash_busy(const char *env, int *sector_us, size_t size)
+{
+    if (*sector_us < 0) {
+        const char *value = getenv(env);
+        *sector_us = value ? atoi(value) : 0;
+        if (*sector_us < 0) {
+            *sector_us = 0;
+        }
+    }
+
+    /* The SPI flash is one device, s_lock keeps the others waiting. */
+    if (*sector_us > 0 && size > 0) {
+        usleep((useconds_t)((uint64_t)*sector_us * size
+                            / SPI_FLASH_SEC_SIZE));
+    }
+}
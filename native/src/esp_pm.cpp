@@ -0,0 +1,134 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <sys/param.h>
+
+#include <atomic>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_private/esp_clk.h>
+
+#define ESP_PM_LOCK_TYPES               3
+#define ESP_PM_APB_MIN_MHZ              80  /* APB stays 80 MHz. */
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Counts like the ESP-IDF lock, recursive. A type is held while
+ *          any lock of it is.
+ */
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    const char *name;
+    std::atomic<int> count;
+};
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "esp_pm";
+
+static std::atomic<int> s_max_mhz(0);       /* 0 until configured. */
+static std::atomic<int> s_min_mhz(0);
+static std::atomic<int> s_held[ESP_PM_LOCK_TYPES];
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_esp32_t *pm = (const esp_pm_config_esp32_t *)config;
+
+    if (pm == NULL || pm->min_freq_mhz <= 0
+        || pm->min_freq_mhz > pm->max_freq_mhz) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pm->light_sleep_enable) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    s_min_mhz = pm->min_freq_mhz;
+    s_max_mhz = pm->max_freq_mhz;
+    ESP_LOGD(TAG, "Scaling %d to %d MHz.", pm->min_freq_mhz,
+                pm->max_freq_mhz);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg,
+                                const char *name,
+                                esp_pm_lock_handle_t *out_handle)
+{
+    (void)arg;
+
+    if (out_handle == NULL || lock_type >= ESP_PM_LOCK_TYPES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_pm_lock_handle_t lock = new esp_pm_lock;
+    lock->type = lock_type;
+    lock->name = name;
+    lock->count = 0;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (handle->count.fetch_add(1) == 0) {
+        s_held[handle->type]++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int count = handle->count.load();
+    do {
+        if (count == 0) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    } while (!handle->count.compare_exchange_weak(count, count - 1));
+
+    if (count == 1) {
+        s_held[handle->type]--;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->count != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    delete handle;
+    return ESP_OK;
+}
+
+int esp_clk_cpu_freq(void)
+{
+    const int max_mhz = s_max_mhz;
+    int mhz = s_min_mhz;
+
+    if (max_mhz == 0) {
+        return 1000000000;
+    }
+    if (s_held[ESP_PM_CPU_FREQ_MAX] > 0) {
+        mhz = max_mhz;
+    } else if (s_held[ESP_PM_APB_FREQ_MAX] > 0) {
+        mhz = MAX(mhz, ESP_PM_APB_MIN_MHZ);
+    }
+    return mhz * 1000000;
+}
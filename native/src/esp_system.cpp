@@ -0,0 +1,397 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_cpu.h>
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#define ESP_TIMER_TASK_PRIORITY         22
+#define ESP_TIMER_TASK_STACK_SIZE       4096
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   `expiry_us` is 0 while the timer isn't armed.
+ */
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t expiry_us;
+    uint64_t period_us;
+    esp_timer *next;
+};
+
+typedef struct {
+    esp_err_t code;
+    const char *name;
+} esp_system_err_name_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "esp_system";
+
+static const std::chrono::steady_clock::time_point s_boot =
+                                            std::chrono::steady_clock::now();
+
+static const esp_system_err_name_t s_err_names[] = {
+    {ESP_OK, "ESP_OK"},
+    {ESP_FAIL, "ESP_FAIL"},
+    {ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM"},
+    {ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG"},
+    {ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE"},
+    {ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE"},
+    {ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND"},
+    {ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED"},
+    {ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT"},
+    {ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE"},
+    {ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC"},
+    {ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION"},
+    {ESP_ERR_INVALID_MAC, "ESP_ERR_INVALID_MAC"},
+    {ESP_ERR_NOT_FINISHED, "ESP_ERR_NOT_FINISHED"},
+    {ESP_ERR_NVS_BASE + 0x02, "ESP_ERR_NVS_NOT_FOUND"},
+    {ESP_ERR_NVS_BASE + 0x03, "ESP_ERR_NVS_TYPE_MISMATCH"},
+    {ESP_ERR_NVS_BASE + 0x04, "ESP_ERR_NVS_READ_ONLY"},
+    {ESP_ERR_NVS_BASE + 0x07, "ESP_ERR_NVS_INVALID_HANDLE"},
+    {ESP_ERR_NVS_BASE + 0x0c, "ESP_ERR_NVS_INVALID_LENGTH"},
+    {ESP_ERR_OTA_BASE + 0x03, "ESP_ERR_OTA_VALIDATE_FAILED"},
+    {ESP_ERR_HTTPD_BASE + 4, "ESP_ERR_HTTPD_RESULT_TRUNC"},
+    {ESP_ERR_HTTPD_BASE + 5, "ESP_ERR_HTTPD_RESP_HDR"},
+    {ESP_ERR_HTTPD_BASE + 6, "ESP_ERR_HTTPD_RESP_SEND"},
+    {ESP_ERR_HTTP_BASE + 3, "ESP_ERR_HTTP_CONNECT"},
+    {ESP_ERR_HTTP_BASE + 4, "ESP_ERR_HTTP_WRITE_DATA"},
+    {ESP_ERR_HTTP_BASE + 5, "ESP_ERR_HTTP_FETCH_HEADER"},
+    {ESP_ERR_WIFI_BASE + 2, "ESP_ERR_WIFI_NOT_STARTED"},
+    {ESP_ERR_WIFI_BASE + 15, "ESP_ERR_WIFI_NOT_CONNECT"}
+};
+
+static std::mutex s_log_lock;
+static std::map<std::string, esp_log_level_t> s_log_levels;
+static esp_log_level_t s_log_default = ESP_LOG_INFO;
+static esp_log_level_t s_log_cap = ESP_LOG_VERBOSE;
+static bool s_log_cap_read = false;
+
+static std::mutex s_timer_lock;
+static std::condition_variable s_timer_cond;
+static esp_timer *s_timers = NULL;          /* Armed, soonest first. */
+static bool s_timer_task_started = false;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Task running the callbacks of the expired timers.
+ */
+static void esp_system_timer_task(void *param);
+
+/**
+ * @brief   Inserts an armed timer in s_timers, s_timer_lock held.
+ */
+static void esp_system_timer_insert(esp_timer *timer);
+
+/**
+ * @brief   Takes a timer out of s_timers, s_timer_lock held.
+ *
+ * @return  false if it wasn't armed.
+ */
+static bool esp_system_timer_remove(esp_timer *timer);
+
+/* Public function definition ------------------------------------------------*/
+const char *esp_err_to_name(esp_err_t code)
+{
+    for (size_t i = 0; i < sizeof(s_err_names) / sizeof(s_err_names[0]);
+            i++) {
+        if (s_err_names[i].code == code) {
+            return s_err_names[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    std::lock_guard<std::mutex> guard(s_log_lock);
+
+    if (strcmp(tag, "*") == 0) {
+        s_log_levels.clear();
+        s_log_default = level;
+    } else {
+        s_log_levels[tag] = level;
+    }
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag,
+                    const char *format, ...)
+{
+    va_list args;
+    esp_log_level_t tag_level;
+
+    {
+        std::lock_guard<std::mutex> guard(s_log_lock);
+
+        /* 1. NATIVE_LOG_LEVEL caps whatever the application sets. */
+        if (!s_log_cap_read) {
+            static const char letters[] = "NEWIDV";
+            const char *env = getenv("NATIVE_LOG_LEVEL");
+            const char *letter = env ? strchr(letters, env[0]) : NULL;
+
+            if (letter != NULL && *letter != '\0') {
+                s_log_cap = (esp_log_level_t)(letter - letters);
+            }
+            s_log_cap_read = true;
+        }
+
+        auto it = s_log_levels.find(tag);
+        tag_level = (it != s_log_levels.end()) ? it->second : s_log_default;
+    }
+
+    if (level > tag_level || level > s_log_cap) {
+        return;
+    }
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args,
+                            esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL
+        || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_timer *timer = new esp_timer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    timer->expiry_us = 0;
+    timer->period_us = 0;
+    timer->next = NULL;
+
+    std::lock_guard<std::mutex> guard(s_timer_lock);
+    if (!s_timer_task_started) {
+        xTaskCreate(&esp_system_timer_task,
+                    "esp_timer",
+                    ESP_TIMER_TASK_STACK_SIZE,
+                    NULL,
+                    ESP_TIMER_TASK_PRIORITY,
+                    NULL);
+        s_timer_task_started = true;
+    }
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    std::lock_guard<std::mutex> guard(s_timer_lock);
+
+    if (timer->expiry_us != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry_us = esp_timer_get_time() + (int64_t)timeout_us;
+    timer->period_us = 0;
+    esp_system_timer_insert(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    std::lock_guard<std::mutex> guard(s_timer_lock);
+
+    if (timer->expiry_us != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry_us = esp_timer_get_time() + (int64_t)period;
+    timer->period_us = period;
+    esp_system_timer_insert(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(s_timer_lock);
+    return esp_system_timer_remove(timer) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(s_timer_lock);
+
+    if (timer->expiry_us != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - s_boot).count();
+}
+
+uint32_t esp_cpu_get_ccount(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - s_boot).count();
+}
+
+void esp_restart(void)
+{
+    ESP_LOGW(TAG, "esp_restart() ignored on the host.");
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return 0;
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value = 0;
+    esp_fill_random(&value, sizeof(value));
+    return value;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+
+    while (len > 0) {
+        ssize_t got = getrandom(p, len, 0);
+        if (got <= 0) {
+            continue;
+        }
+        p += got;
+        len -= (size_t)got;
+    }
+}
+
+#ifdef NATIVE_PORT_STRLCPY
+extern "C" size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t len = strlen(src);
+
+    if (size > 0) {
+        const size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+
+extern "C" size_t strlcat(char *dst, const char *src, size_t size)
+{
+    const size_t used = strnlen(dst, size);
+
+    if (used == size) {
+        return size + strlen(src);
+    }
+    return used + strlcpy(dst + used, src, size - used);
+}
+#endif
+
+/* Private function definition -----------------------------------------------*/
+static void esp_system_timer_task(void *param)
+{
+    std::unique_lock<std::mutex> guard(s_timer_lock);
+
+    while (1) {
+        if (s_timers == NULL) {
+            s_timer_cond.wait(guard);
+            continue;
+        }
+
+        const int64_t now_us = esp_timer_get_time();
+        esp_timer *timer = s_timers;
+        if (timer->expiry_us > now_us) {
+            s_timer_cond.wait_for(guard, std::chrono::microseconds(
+                                            timer->expiry_us - now_us));
+            continue;
+        }
+
+        /* 1. Rearm or disarm before the callback, which may start it
+         * again. */
+        esp_system_timer_remove(timer);
+        if (timer->period_us != 0) {
+            timer->expiry_us = now_us + (int64_t)timer->period_us;
+            esp_system_timer_insert(timer);
+        }
+
+        /* 2. Callbacks run unlocked, they may use every timer function. */
+        const esp_timer_cb_t callback = timer->callback;
+        void *const arg = timer->arg;
+        guard.unlock();
+        callback(arg);
+        guard.lock();
+    }
+}
+
+static void esp_system_timer_insert(esp_timer *timer)
+{
+    esp_timer **link = &s_timers;
+
+    while (*link != NULL && (*link)->expiry_us <= timer->expiry_us) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    s_timer_cond.notify_all();
+}
+
+static bool esp_system_timer_remove(esp_timer *timer)
+{
+    for (esp_timer **link = &s_timers; *link != NULL;
+            link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            timer->next = NULL;
+            timer->expiry_us = 0;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,550 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+#define ESP_EVENT_QUEUE_SIZE            32
+#define ESP_EVENT_DATA_MAX_SIZE         64
+#define ESP_EVENT_TASK_STACK_SIZE       3072
+#define ESP_EVENT_TASK_PRIORITY         20
+
+#define ESP_WIFI_STA_IP                 "192.168.4.2"
+#define ESP_WIFI_STA_GATEWAY            "192.168.4.1"
+#define ESP_WIFI_STA_NETMASK            "255.255.255.0"
+#define ESP_WIFI_STA_DNS                "192.168.4.1"
+#define ESP_WIFI_AP_CHANNEL             6
+#define ESP_WIFI_AP_RSSI                -52
+#define ESP_WIFI_MIN_PASSWORD_LENGTH    8
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} esp_event_handler_entry_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[ESP_EVENT_DATA_MAX_SIZE];
+} esp_event_message_t;
+
+struct esp_netif_obj {
+    bool dhcp_client;
+    bool dhcp_server;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_MAX];
+};
+
+/**
+ * @brief   Simulated station: the timer steps it through association and
+ *          DHCP.
+ */
+typedef enum {
+    ESP_WIFI_STA_IDLE = 0,
+    ESP_WIFI_STA_ASSOCIATING,
+    ESP_WIFI_STA_WAITING_DHCP,
+    ESP_WIFI_STA_CONNECTED
+} esp_wifi_sta_state_e;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "wifi";
+
+static const uint8_t s_ap_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+static std::mutex s_lock;
+static std::vector<esp_event_handler_entry_t> s_handlers;
+static QueueHandle_t s_event_queue = NULL;
+
+static esp_netif_obj s_netif_sta;
+static esp_netif_obj s_netif_ap;
+
+static bool s_wifi_init = false;
+static bool s_wifi_started = false;
+static wifi_sta_config_t s_sta_config;
+static esp_wifi_sta_state_e s_sta_state = ESP_WIFI_STA_IDLE;
+static esp_timer_handle_t s_sta_timer = NULL;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Event loop task, calls the handlers of each posted event.
+ */
+static void esp_event_task(void *param);
+
+/**
+ * @brief   Steps the station through association and DHCP.
+ */
+static void esp_wifi_sta_timer_callback(void *arg);
+
+/**
+ * @brief   Posts IP_EVENT_STA_GOT_IP with the station address.
+ */
+static void esp_wifi_post_got_ip(void);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_event_queue = xQueueCreate(ESP_EVENT_QUEUE_SIZE,
+                                    sizeof(esp_event_message_t));
+    xTaskCreate(&esp_event_task,
+                "sys_evt",
+                ESP_EVENT_TASK_STACK_SIZE,
+                NULL,
+                ESP_EVENT_TASK_PRIORITY,
+                NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base,
+                                int32_t event_id,
+                                esp_event_handler_t event_handler,
+                                void *event_handler_arg,
+                                esp_event_handler_instance_t *instance)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    s_handlers.push_back({event_base, event_id, event_handler,
+                            event_handler_arg});
+    if (instance != NULL) {
+        *instance = (esp_event_handler_instance_t)s_handlers.size();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                            const void *event_data, size_t event_data_size,
+                            TickType_t ticks_to_wait)
+{
+    esp_event_message_t message;
+
+    if (s_event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (event_data_size > sizeof(message.data)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.base = event_base;
+    message.id = event_id;
+    if (event_data != NULL) {
+        memcpy(message.data, event_data, event_data_size);
+    }
+
+    if (xQueueSend(s_event_queue, &message, ticks_to_wait) != pdPASS) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    s_netif_sta.dhcp_client = true;
+    return &s_netif_sta;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void)
+{
+    s_netif_ap.dhcp_server = true;
+    return &s_netif_ap;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (esp_netif->dhcp_client) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED;
+    }
+    esp_netif->dhcp_client = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (!esp_netif->dhcp_client) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    }
+    esp_netif->dhcp_client = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t *esp_netif)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (esp_netif->dhcp_server) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED;
+    }
+    esp_netif->dhcp_server = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *esp_netif)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (!esp_netif->dhcp_server) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    }
+    esp_netif->dhcp_server = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif,
+                                const esp_netif_ip_info_t *ip_info)
+{
+    bool got_ip;
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+
+        if (esp_netif == &s_netif_sta && esp_netif->dhcp_client) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        esp_netif->ip_info = *ip_info;
+
+        /* 1. A static address of an associated station is up at once. */
+        got_ip = (esp_netif == &s_netif_sta && ip_info->ip.addr != 0
+                    && s_sta_state >= ESP_WIFI_STA_WAITING_DHCP);
+        if (got_ip) {
+            s_sta_state = ESP_WIFI_STA_CONNECTED;
+        }
+    }
+
+    if (got_ip) {
+        esp_wifi_post_got_ip();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif,
+                                esp_netif_ip_info_t *ip_info)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    *ip_info = esp_netif->ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif,
+                                    esp_netif_dns_type_t type,
+                                    esp_netif_dns_info_t *dns)
+{
+    if (type >= ESP_NETIF_DNS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> guard(s_lock);
+    esp_netif->dns[type] = *dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif,
+                                    esp_netif_dns_type_t type,
+                                    esp_netif_dns_info_t *dns)
+{
+    if (type >= ESP_NETIF_DNS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> guard(s_lock);
+    *dns = esp_netif->dns[type];
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &esp_wifi_sta_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_sta",
+        .skip_unhandled_events = false
+    };
+
+    (void)config;
+    if (s_wifi_init) {
+        return ESP_OK;
+    }
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_sta_timer));
+    s_wifi_init = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    (void)storage;
+    return s_wifi_init ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return (mode < WIFI_MODE_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface,
+                                wifi_config_t *conf)
+{
+    if (!s_wifi_init) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    if (interface == WIFI_IF_STA) {
+        std::lock_guard<std::mutex> guard(s_lock);
+        s_sta_config = conf->sta;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_bandwidth(wifi_interface_t ifx, wifi_bandwidth_t bw)
+{
+    (void)ifx;
+    (void)bw;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!s_wifi_init) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    s_wifi_started = true;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_START, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!s_wifi_started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        if (s_sta_state != ESP_WIFI_STA_IDLE) {
+            return ESP_ERR_WIFI_CONN;
+        }
+        s_sta_state = ESP_WIFI_STA_ASSOCIATING;
+    }
+
+    esp_timer_start_once(s_sta_timer, NATIVE_WIFI_CONNECT_MS * 1000);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    wifi_event_sta_disconnected_t disconnected;
+    esp_wifi_sta_state_e state;
+
+    if (!s_wifi_started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+
+    esp_timer_stop(s_sta_timer);
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        state = s_sta_state;
+        s_sta_state = ESP_WIFI_STA_IDLE;
+        memset(&s_netif_sta.ip_info, 0, sizeof(s_netif_sta.ip_info));
+
+        memset(&disconnected, 0, sizeof(disconnected));
+        disconnected.ssid_len = (uint8_t)strnlen(
+                                        (const char *)s_sta_config.ssid,
+                                        sizeof(s_sta_config.ssid));
+        memcpy(disconnected.ssid, s_sta_config.ssid, disconnected.ssid_len);
+        memcpy(disconnected.bssid, s_ap_bssid, sizeof(s_ap_bssid));
+        disconnected.reason = WIFI_REASON_ASSOC_LEAVE;
+    }
+
+    if (state != ESP_WIFI_STA_IDLE) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED,
+                        &disconnected, sizeof(disconnected), portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (s_sta_state < ESP_WIFI_STA_WAITING_DHCP) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, s_ap_bssid, sizeof(s_ap_bssid));
+    memcpy(ap_info->ssid, s_sta_config.ssid, sizeof(s_sta_config.ssid));
+    ap_info->primary = ESP_WIFI_AP_CHANNEL;
+    ap_info->rssi = ESP_WIFI_AP_RSSI;
+    ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+    return ESP_OK;
+}
+
+/* Private function definition -----------------------------------------------*/
+static void esp_event_task(void *param)
+{
+    esp_event_message_t message;
+
+    while (1) {
+        if (xQueueReceive(s_event_queue, &message, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        std::vector<esp_event_handler_entry_t> handlers;
+        {
+            std::lock_guard<std::mutex> guard(s_lock);
+            handlers = s_handlers;
+        }
+
+        for (const esp_event_handler_entry_t &entry : handlers) {
+            if ((entry.base == ESP_EVENT_ANY_BASE
+                    || entry.base == message.base)
+                && (entry.id == ESP_EVENT_ANY_ID
+                    || entry.id == message.id)) {
+                entry.handler(entry.arg, message.base, message.id,
+                                message.data);
+            }
+        }
+    }
+}
+
+static void esp_wifi_sta_timer_callback(void *arg)
+{
+    wifi_event_sta_connected_t connected;
+    wifi_event_sta_disconnected_t disconnected;
+    bool associated = false;
+    bool dhcp = false;
+    bool got_ip = false;
+
+    memset(&connected, 0, sizeof(connected));
+    memset(&disconnected, 0, sizeof(disconnected));
+
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        const size_t ssid_len = strnlen((const char *)s_sta_config.ssid,
+                                        sizeof(s_sta_config.ssid));
+        const size_t password_len = strnlen(
+                                    (const char *)s_sta_config.password,
+                                    sizeof(s_sta_config.password));
+
+        if (s_sta_state == ESP_WIFI_STA_ASSOCIATING) {
+            /* 1. Any SSID is in range, a short password is a wrong one. */
+            if (ssid_len == 0) {
+                disconnected.reason = WIFI_REASON_NO_AP_FOUND;
+                s_sta_state = ESP_WIFI_STA_IDLE;
+            } else if (password_len > 0
+                        && password_len < ESP_WIFI_MIN_PASSWORD_LENGTH) {
+                disconnected.reason = WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT;
+                s_sta_state = ESP_WIFI_STA_IDLE;
+            } else {
+                associated = true;
+                dhcp = s_netif_sta.dhcp_client;
+                s_sta_state = ESP_WIFI_STA_WAITING_DHCP;
+            }
+
+            memcpy(connected.ssid, s_sta_config.ssid, ssid_len);
+            connected.ssid_len = (uint8_t)ssid_len;
+            memcpy(connected.bssid, s_ap_bssid, sizeof(s_ap_bssid));
+            connected.channel = ESP_WIFI_AP_CHANNEL;
+            connected.authmode = password_len ? WIFI_AUTH_WPA2_PSK
+                                                : WIFI_AUTH_OPEN;
+            memcpy(disconnected.ssid, s_sta_config.ssid, ssid_len);
+            disconnected.ssid_len = (uint8_t)ssid_len;
+            memcpy(disconnected.bssid, s_ap_bssid, sizeof(s_ap_bssid));
+        } else if (s_sta_state == ESP_WIFI_STA_WAITING_DHCP
+                    && s_netif_sta.dhcp_client) {
+            /* 2. The lease. */
+            inet_pton(AF_INET, ESP_WIFI_STA_IP, &s_netif_sta.ip_info.ip);
+            inet_pton(AF_INET, ESP_WIFI_STA_GATEWAY,
+                        &s_netif_sta.ip_info.gw);
+            inet_pton(AF_INET, ESP_WIFI_STA_NETMASK,
+                        &s_netif_sta.ip_info.netmask);
+            inet_pton(AF_INET, ESP_WIFI_STA_DNS,
+                        &s_netif_sta.dns[ESP_NETIF_DNS_MAIN].ip.u_addr.ip4);
+            s_netif_sta.dns[ESP_NETIF_DNS_MAIN].ip.type = ESP_IPADDR_TYPE_V4;
+            s_sta_state = ESP_WIFI_STA_CONNECTED;
+            got_ip = true;
+        } else {
+            return;
+        }
+    }
+
+    if (associated) {
+        ESP_LOGI(TAG, "connected with %s, channel %d", connected.ssid,
+                    connected.channel);
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+                        &connected, sizeof(connected), portMAX_DELAY);
+        if (dhcp) {
+            esp_timer_start_once(s_sta_timer, NATIVE_WIFI_DHCP_MS * 1000);
+        }
+    } else if (got_ip) {
+        esp_wifi_post_got_ip();
+    } else {
+        ESP_LOGI(TAG, "connection to %s failed, reason %d",
+                    disconnected.ssid, disconnected.reason);
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED,
+                        &disconnected, sizeof(disconnected), portMAX_DELAY);
+    }
+}
+
+static void esp_wifi_post_got_ip(void)
+{
+    ip_event_got_ip_t got_ip;
+
+    memset(&got_ip, 0, sizeof(got_ip));
+    {
+        std::lock_guard<std::mutex> guard(s_lock);
+        got_ip.esp_netif = &s_netif_sta;
+        got_ip.ip_info = s_netif_sta.ip_info;
+        got_ip.ip_changed = true;
+    }
+
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip),
+                    portMAX_DELAY);
+}
@@ -0,0 +1,607 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_freertos_hooks.h>
+#include <esp_log.h>
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   A task is a detached thread. Its notification value is guarded by
+ *          `lock` and waited for on `cond`.
+ */
+struct tskTaskControlBlock {
+    char name[16];
+    TaskFunction_t code;
+    void *param;
+    UBaseType_t priority;
+    BaseType_t core_id;
+    std::mutex lock;
+    std::condition_variable cond;
+    uint32_t notify_value;
+    bool deleted;
+};
+
+/**
+ * @brief   Items are copied into a ring of `length` slots. Semaphores are
+ *          queues of 0 byte items.
+ */
+struct QueueDefinition {
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::vector<uint8_t> storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+typedef std::chrono::steady_clock freertos_clock_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "freertos";
+
+static const freertos_clock_t::time_point s_boot = freertos_clock_t::now();
+static std::recursive_mutex s_critical;
+static thread_local TaskHandle_t s_current_task = NULL;
+
+/**
+ * @brief   Idle tasks have no thread, the tick thread runs the hooks as
+ *          theirs while the process doesn't use the CPU.
+ */
+static tskTaskControlBlock s_idle_tasks[portNUM_PROCESSORS];
+static std::once_flag s_idle_once;
+static std::mutex s_tick_lock;
+static std::vector<esp_freertos_tick_cb_t> s_tick_hooks[portNUM_PROCESSORS];
+static bool s_tick_started = false;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Thread entry of every task.
+ */
+static void *freertos_task_entry(void *param);
+
+/**
+ * @brief   Ends the calling thread if its task was deleted by another one.
+ */
+static void freertos_check_deleted(TaskHandle_t task);
+
+/**
+ * @brief   Names the idle tasks and pins them, once.
+ */
+static void freertos_idle_init(void);
+
+/**
+ * @brief   Task of the tick hooks, every tick for each core in turn.
+ */
+static void freertos_tick_task(void *param);
+
+/**
+ * @brief   CPU time of a clock, CLOCK_PROCESS_CPUTIME_ID or
+ *          CLOCK_THREAD_CPUTIME_ID, in ns.
+ */
+static int64_t freertos_cpu_time(clockid_t clock);
+
+/**
+ * @brief   Waits on a condition for some ticks, portMAX_DELAY for ever.
+ *
+ * @return  The predicate once the wait ended.
+ */
+template <typename Predicate>
+static bool freertos_wait(std::condition_variable &cond,
+                            std::unique_lock<std::mutex> &guard,
+                            TickType_t ticks,
+                            Predicate predicate);
+
+static QueueHandle_t freertos_queue_create(UBaseType_t length,
+                                            UBaseType_t item_size,
+                                            UBaseType_t initial_count);
+static BaseType_t freertos_queue_send(QueueHandle_t queue,
+                                        const void *item,
+                                        TickType_t ticks,
+                                        bool front);
+
+/* Public function definition ------------------------------------------------*/
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    s_critical.lock();
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    s_critical.unlock();
+}
+
+BaseType_t xPortInIsrContext(void)
+{
+    return pdFALSE;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    return task->core_id == tskNO_AFFINITY ? 0 : task->core_id;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code,
+                                    const char *name,
+                                    uint32_t stack_depth,
+                                    void *param,
+                                    UBaseType_t priority,
+                                    TaskHandle_t *created_task,
+                                    BaseType_t core_id)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    TaskHandle_t task = new tskTaskControlBlock();
+
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->code = task_code;
+    task->param = param;
+    task->priority = priority;
+    task->core_id = core_id;
+    task->notify_value = 0;
+    task->deleted = false;
+
+    /* 1. The handle is out before the task can use it, like a higher
+     * priority task on the other core would see it. */
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+
+    /* 2. Host stacks are larger, FreeRTOS depths are in bytes on the ESP32
+     * and too small for glibc. */
+    (void)stack_depth;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, freertos_task_entry, task) != 0) {
+        ESP_LOGE(TAG, "Could not create task %s.", name);
+        pthread_attr_destroy(&attr);
+        return pdFAIL;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(thread, task->name);
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+
+    if (task == NULL || task == current) {
+        pthread_exit(NULL);
+    }
+
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->deleted = true;
+    task->cond.notify_all();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(task->lock);
+
+    freertos_wait(task->cond, guard, ticks,
+                    [task] { return task->deleted; });
+    guard.unlock();
+    freertos_check_deleted(task);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t increment)
+{
+    const TickType_t wake_time = *previous_wake_time + increment;
+    const TickType_t now = xTaskGetTickCount();
+
+    /* A deadline already passed doesn't block, like the kernel. */
+    *previous_wake_time = wake_time;
+    if ((int32_t)(wake_time - now) > 0) {
+        vTaskDelay(wake_time - now);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                            freertos_clock_t::now() - s_boot).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    /* Threads not created as tasks, main() among them, get a handle on
+     * first use. */
+    if (s_current_task == NULL) {
+        s_current_task = new tskTaskControlBlock();
+        pthread_getname_np(pthread_self(),
+                            s_current_task->name,
+                            sizeof(s_current_task->name));
+        s_current_task->priority = 1;
+        s_current_task->core_id = tskNO_AFFINITY;
+        s_current_task->notify_value = 0;
+        s_current_task->deleted = false;
+    }
+
+    return s_current_task;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid)
+{
+    std::call_once(s_idle_once, freertos_idle_init);
+    return (cpuid < portNUM_PROCESSORS) ? &s_idle_tasks[cpuid] : NULL;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    (void)task;
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(task->lock);
+    uint32_t value;
+
+    freertos_wait(task->cond, guard, ticks, [task] {
+        return task->notify_value != 0 || task->deleted;
+    });
+
+    value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    guard.unlock();
+
+    freertos_check_deleted(task);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notify_value++;
+    task->cond.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task,
+                            BaseType_t *higher_priority_task_woken)
+{
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return freertos_queue_create(length, item_size, 0);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                        TickType_t ticks)
+{
+    return freertos_queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item,
+                                TickType_t ticks)
+{
+    return freertos_queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer,
+                            TickType_t ticks)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!freertos_wait(queue->not_empty, guard, ticks,
+                        [queue] { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(buffer,
+                &queue->storage[queue->head * queue->item_size],
+                queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->not_full.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!freertos_wait(queue->not_empty, guard, ticks,
+                        [queue] { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(buffer,
+                &queue->storage[queue->head * queue->item_size],
+                queue->item_size);
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    queue->not_full.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return freertos_queue_create(1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return freertos_queue_create(1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count,
+                                            UBaseType_t initial_count)
+{
+    return freertos_queue_create(max_count, 0, initial_count);
+}
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(
+                                        esp_freertos_tick_cb_t new_tick_cb,
+                                        UBaseType_t cpuid)
+{
+    if (cpuid >= portNUM_PROCESSORS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> guard(s_tick_lock);
+    s_tick_hooks[cpuid].push_back(new_tick_cb);
+
+    /* The thread starts with the first hook, most runs have none. */
+    if (!s_tick_started) {
+        s_tick_started = true;
+        xTaskCreatePinnedToCore(freertos_tick_task, "tick", 2048, NULL,
+                                configMAX_PRIORITIES - 1, NULL,
+                                tskNO_AFFINITY);
+    }
+    return ESP_OK;
+}
+
+void esp_deregister_freertos_tick_hook_for_cpu(
+                                        esp_freertos_tick_cb_t old_tick_cb,
+                                        UBaseType_t cpuid)
+{
+    if (cpuid >= portNUM_PROCESSORS) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(s_tick_lock);
+    std::vector<esp_freertos_tick_cb_t> &hooks = s_tick_hooks[cpuid];
+    for (auto it = hooks.begin(); it != hooks.end(); it++) {
+        if (*it == old_tick_cb) {
+            hooks.erase(it);
+            return;
+        }
+    }
+}
+
+/* Private function definition -----------------------------------------------*/
+static void *freertos_task_entry(void *param)
+{
+    TaskHandle_t task = (TaskHandle_t)param;
+
+    s_current_task = task;
+    task->code(task->param);
+
+    /* A FreeRTOS task never returns, end the thread quietly anyway. */
+    ESP_LOGW(TAG, "Task %s returned.", task->name);
+    return NULL;
+}
+
+static void freertos_check_deleted(TaskHandle_t task)
+{
+    bool deleted;
+
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        deleted = task->deleted;
+    }
+
+    if (deleted) {
+        pthread_exit(NULL);
+    }
+}
+
+static void freertos_idle_init(void)
+{
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        snprintf(s_idle_tasks[core].name, sizeof(s_idle_tasks[core].name),
+                    "IDLE%u", (unsigned)core);
+        s_idle_tasks[core].priority = 0;
+        s_idle_tasks[core].core_id = core;
+        s_idle_tasks[core].notify_value = 0;
+        s_idle_tasks[core].deleted = false;
+    }
+}
+
+static void freertos_tick_task(void *param)
+{
+    const freertos_clock_t::duration tick =
+                                std::chrono::milliseconds(portTICK_PERIOD_MS);
+    const int64_t half_tick_ns = portTICK_PERIOD_MS * 1000000 / 2;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    freertos_clock_t::time_point next = freertos_clock_t::now() + tick;
+    int64_t last_others = 0;
+    std::vector<esp_freertos_tick_cb_t> hooks[portNUM_PROCESSORS];
+
+    (void)param;
+    std::call_once(s_idle_once, freertos_idle_init);
+
+    for (;;) {
+        std::this_thread::sleep_until(next);
+
+        /* 1. The host doesn't tell which thread ran where: the cores are
+         * busy for the tick if the other threads took half of it. */
+        const int64_t others = freertos_cpu_time(CLOCK_PROCESS_CPUTIME_ID)
+                                - freertos_cpu_time(CLOCK_THREAD_CPUTIME_ID);
+        const bool busy = (others - last_others) >= half_tick_ns;
+        last_others = others;
+
+        {
+            std::lock_guard<std::mutex> guard(s_tick_lock);
+            for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+                hooks[core] = s_tick_hooks[core];
+            }
+        }
+
+        /* 2. The hooks as the task running on each core, for the ticks a
+         * late wake up missed too: the host never skips one as light sleep
+         * would. */
+        while (next <= freertos_clock_t::now()) {
+            for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+                self->core_id = core;
+                s_current_task = busy ? self : &s_idle_tasks[core];
+                for (esp_freertos_tick_cb_t hook : hooks[core]) {
+                    hook();
+                }
+            }
+            s_current_task = self;
+            self->core_id = tskNO_AFFINITY;
+            next += tick;
+        }
+    }
+}
+
+static int64_t freertos_cpu_time(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+template <typename Predicate>
+static bool freertos_wait(std::condition_variable &cond,
+                            std::unique_lock<std::mutex> &guard,
+                            TickType_t ticks,
+                            Predicate predicate)
+{
+    if (ticks == portMAX_DELAY) {
+        cond.wait(guard, predicate);
+        return true;
+    }
+
+    return cond.wait_for(guard,
+                        std::chrono::milliseconds(ticks * portTICK_PERIOD_MS),
+                        predicate);
+}
+
+static QueueHandle_t freertos_queue_create(UBaseType_t length,
+                                            UBaseType_t item_size,
+                                            UBaseType_t initial_count)
+{
+    QueueHandle_t queue = new QueueDefinition();
+
+    queue->storage.resize((size_t)length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = 0;
+    queue->count = initial_count;
+    return queue;
+}
+
+static BaseType_t freertos_queue_send(QueueHandle_t queue,
+                                        const void *item,
+                                        TickType_t ticks,
+                                        bool front)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    UBaseType_t slot;
+
+    if (!freertos_wait(queue->not_full, guard, ticks, [queue] {
+            return queue->count < queue->length;
+        })) {
+        return errQUEUE_FULL;
+    }
+
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(&queue->storage[slot * queue->item_size],
+                item,
+                queue->item_size);
+    }
+    queue->count++;
+    queue->not_empty.notify_one();
+    return pdPASS;
+}
@@ -0,0 +1,793 @@
+/* The unit tests of test/ bring their own main(). */
+#ifndef PIO_UNIT_TESTING
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "config.hpp"
+#include "dht_sensor.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "history_store.hpp"
+#include "metrics.hpp"
+#include "mqtt_publisher.hpp"
+#include "ota_decoder.hpp"
+#include "ota_writer.hpp"
+#include "power.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
+#include "wifi_app.hpp"
+
+/**
+ * @brief   Tasks updating one histogram at once in native_metrics_bench().
+ */
+#define NATIVE_METRICS_BENCH_TASKS      4
+
+/**
+ * @brief   Tasks recording into one ring at once in native_trace_bench().
+ */
+#define NATIVE_TRACE_BENCH_TASKS        4
+
+/**
+ * @brief   Most producers publishing to one subscriber at once in
+ *          native_event_bus_bench(), doubled from one up to it.
+ */
+#define NATIVE_EVENT_BUS_BENCH_PRODUCERS    8
+
+/**
+ * @brief   Records logged between two renders in native_dlog_bench(), under
+ *          the half of the ring which wakes the dlog task.
+ */
+#define NATIVE_DLOG_BENCH_BURST         32
+
+/**
+ * @brief   Bytes one receive hands over in native_ota_writer_bench(), a TCP
+ *          segment.
+ */
+#define NATIVE_OTA_BENCH_SEGMENT        1460
+
+/**
+ * @brief   Times an image is decoded in native_ota_decoder_check(), the best
+ *          one is reported.
+ */
+#define NATIVE_OTA_DECODER_ROUNDS       5
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "main";
+
+/**
+ * @brief   Latencies spread log-uniformly from 100 us to 3 s, as a mix of
+ *          cached pages and long history requests would be.
+ */
+static void native_metrics_latencies(std::vector<uint32_t> &latencies,
+                                        uint32_t seed)
+{
+    for (uint32_t &latency : latencies) {
+        /* xorshift32, the same sequence on every run. */
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        latency = (uint32_t)(100.0 * pow(30000.0, seed / 4294967296.0));
+    }
+}
+
+/**
+ * @brief   Appends `count` samples, one per DHT_SENSOR_PERIOD_MS up to now,
+ *          and logs the append rate. HISTORY_STORE_FILL=<count> fills the
+ *          history that way before the start, for scripts/history_bench.py.
+ */
+static void native_history_fill(uint32_t count)
+{
+    struct timeval now;
+    history_store_stats_t stats;
+
+    gettimeofday(&now, NULL);
+    const int64_t now_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+    const int64_t start_us = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < count; i++) {
+        const float phase = (float)(i % 43200) / 43200;
+
+        history_store_append(now_ms - (int64_t)(count - i)
+                                        * DHT_SENSOR_PERIOD_MS,
+                                22.0f + 4.0f * phase + (i % 7) / 10.0f,
+                                45.0f - 10.0f * phase + (i % 5) / 10.0f);
+    }
+    history_store_flush();
+
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+    history_store_get_stats(&stats);
+    ESP_LOGI(TAG, "Appended %" PRIu32 " samples in %" PRId64 " ms, "
+                    "%.0f samples/s, %.2f bytes/sample, %" PRIu32
+                    " blocks erased.",
+                count, elapsed_us / 1000,
+                count * 1e6 / (elapsed_us > 0 ? elapsed_us : 1),
+                (double)stats.bytes / (count ? count : 1), stats.erases);
+}
+
+/**
+ * @brief   Saves a backlog of the last `seconds` as the MQTT publisher
+ *          finds it after a reboot that cut an outage short.
+ *          MQTT_PUBLISHER_BACKLOG=<seconds> sends that much of the history
+ *          once the broker is up, for scripts/mqtt_test_broker.py.
+ */
+static void native_mqtt_backlog(uint32_t seconds)
+{
+    struct timeval now;
+    nvs_handle_t handle;
+
+    gettimeofday(&now, NULL);
+    ESP_ERROR_CHECK(nvs_open(MQTT_PUBLISHER_NVS_NAMESPACE, NVS_READWRITE,
+                                &handle));
+    ESP_ERROR_CHECK(nvs_set_i64(handle, MQTT_PUBLISHER_NVS_KEY_BACKLOG,
+                                ((int64_t)now.tv_sec - seconds) * 1000));
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+/**
+ * @brief   Records `count` latencies in a histogram, then again from
+ *          NATIVE_METRICS_BENCH_TASKS tasks at once into one histogram, and
+ *          logs the cost of an update and the quantiles of the histogram
+ *          against the exact ones. METRICS_BENCH=<count> runs it instead of
+ *          the application, see scripts/metrics_check.py.
+ */
+static void native_metrics_bench(uint32_t count)
+{
+    static metrics_histogram_t single;
+    static metrics_histogram_t shared;
+    static metrics_counter64_t bytes;
+    std::vector<uint32_t> latencies[NATIVE_METRICS_BENCH_TASKS];
+    std::vector<std::thread> tasks;
+    uint64_t expected_sum = 0;
+
+    for (size_t t = 0; t < NATIVE_METRICS_BENCH_TASKS; t++) {
+        latencies[t].resize(count);
+        native_metrics_latencies(latencies[t], 2463534242u + t);
+        for (uint32_t latency : latencies[t]) {
+            expected_sum += latency;
+        }
+    }
+
+    /* 1. Uncontended, what the end of a request adds: its latency and its
+     * bytes. */
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t latency : latencies[0]) {
+        metrics_histogram_observe(&single, latency);
+        metrics_counter64_add(&bytes, 1460);
+    }
+    const int64_t single_us = esp_timer_get_time() - start_us;
+
+    /* 2. Every task on the same cache lines, the worst case. */
+    start_us = esp_timer_get_time();
+    for (size_t t = 0; t < NATIVE_METRICS_BENCH_TASKS; t++) {
+        tasks.emplace_back([&latencies, t]() {
+            for (uint32_t latency : latencies[t]) {
+                metrics_histogram_observe(&shared, latency);
+            }
+        });
+    }
+    for (std::thread &task : tasks) {
+        task.join();
+    }
+    const int64_t shared_us = esp_timer_get_time() - start_us;
+
+    const uint64_t updates = (uint64_t)count * NATIVE_METRICS_BENCH_TASKS;
+    uint64_t total = 0;
+    for (size_t i = 0; i < METRICS_BUCKET_COUNT; i++) {
+        total += shared.buckets[i].load();
+    }
+    ESP_LOGI(TAG, "Update: %.1f ns alone, %.1f ns each from %d tasks. "
+                    "Shared histogram: %" PRIu64 " of %" PRIu64 " counts, "
+                    "sum %s.",
+                single_us * 1000.0 / (count ? count : 1),
+                shared_us * 1000.0 / (updates ? updates : 1),
+                NATIVE_METRICS_BENCH_TASKS, total, updates,
+                metrics_counter64_load(&shared.sum_us) == expected_sum
+                    ? "exact" : "WRONG");
+
+    /* 3. Accuracy of the interpolated quantiles. */
+    std::sort(latencies[0].begin(), latencies[0].end());
+    for (double q : {0.5, 0.9, 0.99}) {
+        const double exact = latencies[0][(size_t)(q * (count - 1))];
+        const double estimate = metrics_histogram_quantile(&single, q);
+
+        ESP_LOGI(TAG, "p%g: exact %.2f ms, histogram %.2f ms, %+.1f %%.",
+                    q * 100, exact / 1000, estimate / 1000,
+                    100 * (estimate - exact) / exact);
+    }
+}
+
+#if TRACE_ENABLED
+/**
+ * @brief   Records `count` events, then again from NATIVE_TRACE_BENCH_TASKS
+ *          tasks at once into the same ring, and logs the cost of a record.
+ *          TRACE_BENCH=<count> runs it instead of the application, see
+ *          scripts/trace_check.py.
+ */
+static void native_trace_bench(uint32_t count)
+{
+    std::vector<std::thread> tasks;
+
+    /* 1. Uncontended, a span is two of them. */
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        TRACE_INSTANT("native_trace_bench", i);
+    }
+    const int64_t single_us = esp_timer_get_time() - start_us;
+
+    /* 2. Every task claiming slots of the same ring. */
+    start_us = esp_timer_get_time();
+    for (size_t t = 0; t < NATIVE_TRACE_BENCH_TASKS; t++) {
+        tasks.emplace_back([count]() {
+            for (uint32_t i = 0; i < count; i++) {
+                TRACE_INSTANT("native_trace_bench", i);
+            }
+        });
+    }
+    for (std::thread &task : tasks) {
+        task.join();
+    }
+    const int64_t shared_us = esp_timer_get_time() - start_us;
+
+    const uint64_t records = (uint64_t)count * NATIVE_TRACE_BENCH_TASKS;
+    ESP_LOGI(TAG, "Record: %.1f ns alone, %.1f ns each from %d tasks, "
+                    "%" PRIu32 " cycles measured by trace_init().",
+                single_us * 1000.0 / (count ? count : 1),
+                shared_us * 1000.0 / (records ? records : 1),
+                NATIVE_TRACE_BENCH_TASKS, trace_record_cycles());
+}
+#endif
+
+/**
+ * @brief   Queue the event bus replaced: a deque under a mutex, bounded to
+ *          EVENT_BUS_RING_SIZE, the consumer woken by a condition variable.
+ */
+typedef struct {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<int32_t> items;
+} native_event_queue_t;
+
+/**
+ * @brief   CPU time of the calling thread, scheduling left out.
+ */
+static int64_t native_thread_cpu_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief   Publishes `count` events from each of `producers` threads to one
+ *          consumer, through the event bus or `queue` if not NULL, retrying
+ *          on a full ring. Gives the CPU time a publish costs its producer
+ *          and the time per event from the first publish to the last
+ *          receive, checks that each producer's events arrive all and in
+ *          order.
+ */
+static void native_event_bus_run(uint32_t count, size_t producers,
+                                    native_event_queue_t *queue,
+                                    double *publish_ns, double *event_ns,
+                                    bool *in_order)
+{
+    static const event_bus_type_e types[] = { EVENT_BUS_MQTT_PUBLISHED };
+    std::atomic<event_bus_subscriber_t *> subscriber(nullptr);
+    std::atomic<bool> started(false);
+    std::atomic<int64_t> cpu_ns(0);
+    std::vector<std::thread> threads;
+    bool ordered = true;
+
+    /* 1. The consumer, subscribed before anything is published. */
+    std::thread consumer([&]() {
+        std::vector<uint32_t> next(producers, 0);
+        event_bus_event_t event;
+
+        if (queue == NULL) {
+            subscriber = event_bus_subscribe(xTaskGetCurrentTaskHandle(),
+                                                types, 1);
+        }
+        started = true;
+        for (uint64_t i = 0; i < (uint64_t)count * producers; i++) {
+            if (queue == NULL) {
+                event_bus_receive(subscriber, &event, portMAX_DELAY);
+            } else {
+                std::unique_lock<std::mutex> guard(queue->lock);
+                queue->ready.wait(guard, [queue] {
+                    return !queue->items.empty();
+                });
+                event.mqtt_published.msg_id = queue->items.front();
+                queue->items.pop_front();
+            }
+
+            const uint32_t id = (uint32_t)event.mqtt_published.msg_id;
+            if ((id & 0xFFFFFF) != next[id >> 24]++) {
+                ordered = false;
+            }
+        }
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    /* 2. Producers tagging their events with their number. */
+    const int64_t start_us = esp_timer_get_time();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([count, p, queue, &cpu_ns]() {
+            const int64_t start_ns = native_thread_cpu_ns();
+            event_bus_event_t event;
+
+            memset(&event, 0, sizeof(event));
+            event.type = EVENT_BUS_MQTT_PUBLISHED;
+            for (uint32_t i = 0; i < count; i++) {
+                event.mqtt_published.msg_id = (int32_t)(p << 24 | i);
+                if (queue == NULL) {
+                    while (!event_bus_publish(&event)) {
+                        std::this_thread::yield();
+                    }
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> guard(queue->lock);
+                while (queue->items.size() >= EVENT_BUS_RING_SIZE) {
+                    guard.unlock();
+                    std::this_thread::yield();
+                    guard.lock();
+                }
+                queue->items.push_back(event.mqtt_published.msg_id);
+                guard.unlock();
+                queue->ready.notify_one();
+            }
+            cpu_ns += native_thread_cpu_ns() - start_ns;
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    consumer.join();
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    if (subscriber != NULL) {
+        event_bus_unsubscribe(subscriber);
+    }
+    *publish_ns = (double)cpu_ns / ((uint64_t)count * producers);
+    *event_ns = elapsed_us * 1000.0 / ((uint64_t)count * producers);
+    *in_order = ordered;
+}
+
+/**
+ * @brief   Times event_bus_publish() from 1 to
+ *          NATIVE_EVENT_BUS_BENCH_PRODUCERS threads at once, `count` events
+ *          each to one consumer, against the queue it replaced, then checks
+ *          that a stale notification doesn't end event_bus_receive() before
+ *          its timeout. EVENT_BUS_BENCH=<count> runs it instead of the
+ *          application.
+ */
+static void native_event_bus_bench(uint32_t count)
+{
+    static const event_bus_type_e types[] = { EVENT_BUS_MQTT_PUBLISHED };
+
+    /* 1. Contention, every event delivered in order. */
+    for (size_t producers = 1; producers <= NATIVE_EVENT_BUS_BENCH_PRODUCERS;
+            producers *= 2) {
+        native_event_queue_t queue;
+        double publish_ns[2];
+        double event_ns[2];
+        bool ordered[2];
+
+        native_event_bus_run(count, producers, NULL, &publish_ns[0],
+                                &event_ns[0], &ordered[0]);
+        native_event_bus_run(count, producers, &queue, &publish_ns[1],
+                                &event_ns[1], &ordered[1]);
+        ESP_LOGI(TAG, "%u producers: publish ring %.1f ns, mutex queue "
+                        "%.1f ns of producer CPU; %.1f ns and %.1f ns per "
+                        "event delivered, %s.",
+                    (unsigned)producers, publish_ns[0], publish_ns[1],
+                    event_ns[0], event_ns[1],
+                    (ordered[0] && ordered[1]) ? "all in order"
+                                                : "OUT OF ORDER");
+    }
+
+    /* 2. A notification with nothing behind it, as an event popped without
+     * waiting leaves: the receive must still wait its timeout, then get the
+     * event published after it with portMAX_DELAY. */
+    std::thread consumer([]() {
+        event_bus_subscriber_t *subscriber = event_bus_subscribe(
+                                    xTaskGetCurrentTaskHandle(), types, 1);
+        event_bus_event_t event;
+
+        xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+        int64_t start_us = esp_timer_get_time();
+        const bool early = event_bus_receive(subscriber, &event,
+                                                pdMS_TO_TICKS(50));
+        const int64_t waited_us = esp_timer_get_time() - start_us;
+
+        xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+        std::thread publisher([]() {
+            usleep(20000);
+            event_bus_publish_type(EVENT_BUS_MQTT_PUBLISHED);
+        });
+        start_us = esp_timer_get_time();
+        const bool received = event_bus_receive(subscriber, &event,
+                                                portMAX_DELAY);
+        const int64_t forever_us = esp_timer_get_time() - start_us;
+        publisher.join();
+        event_bus_unsubscribe(subscriber);
+
+        ESP_LOGI(TAG, "Stale notification: 50 ms receive %s after "
+                        "%" PRId64 " ms, endless receive %s after "
+                        "%" PRId64 " ms.",
+                    early ? "GOT AN EVENT" : "timed out", waited_us / 1000,
+                    received ? "got the event" : "RETURNED EMPTY",
+                    forever_us / 1000);
+    });
+    consumer.join();
+}
+
+/**
+ * @brief   Logs `count` lines with ESP_LOGI(), then the same with DLOGI() in
+ *          bursts rendered in between, and logs what a line costs its caller
+ *          and the dlog task. DLOG_BENCH=<count> runs it instead of the
+ *          application, stderr redirected to a file or /dev/null.
+ */
+static void native_dlog_bench(uint32_t count)
+{
+    int64_t caller_us = 0;
+    int64_t render_us = 0;
+    dlog_stats_t stats;
+
+    /* 1. Formatted and written by the caller. */
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "Bench line %u of %u: %s", (unsigned)i,
+                    (unsigned)count, "/status.json");
+    }
+    const int64_t direct_us = esp_timer_get_time() - start_us;
+
+    /* 2. Recorded by the caller, timed apart from the renders. */
+    for (uint32_t i = 0; i < count; i += NATIVE_DLOG_BENCH_BURST) {
+        const uint32_t burst = std::min<uint32_t>(NATIVE_DLOG_BENCH_BURST,
+                                                    count - i);
+
+        start_us = esp_timer_get_time();
+        for (uint32_t j = i; j < i + burst; j++) {
+            DLOGI(TAG, "Bench line %u of %u: %s", (unsigned)j,
+                    (unsigned)count, "/status.json");
+        }
+        caller_us += esp_timer_get_time() - start_us;
+
+        /* Woken at once and waited for without sleeping a tick. */
+        start_us = esp_timer_get_time();
+        dlog_flush(0);
+        do {
+            std::this_thread::yield();
+            dlog_get_stats(&stats);
+        } while (stats.rendered < stats.written);
+        render_us += esp_timer_get_time() - start_us;
+    }
+
+    dlog_get_stats(&stats);
+    ESP_LOGI(TAG, "Line: ESP_LOGI %.1f ns, DLOGI %.1f ns to the caller and "
+                    "%.1f ns to the dlog task, %" PRIu32 " rendered, "
+                    "%" PRIu32 " dropped.",
+                direct_us * 1000.0 / (count ? count : 1),
+                caller_us * 1000.0 / (count ? count : 1),
+                render_us * 1000.0 / (count ? count : 1),
+                stats.rendered, stats.dropped);
+}
+
+/**
+ * @brief   Receives `kb` kB of a raw image at `rate_kbps`, as fast as memory
+ *          if 0, into a buffer of OTA_WRITER_BUFFER_SIZE written to the
+ *          flash by the receiver (esp_ota_write() after each buffer, the
+ *          image erased by esp_ota_begin()), then through the buffer pool
+ *          of ota_writer.hpp, and logs both throughputs.
+ *          OTA_WRITER_BENCH=<kb>[,<rate_kbps>] runs it instead of the
+ *          application, with the flash timings of NATIVE_FLASH_WRITE_US and
+ *          NATIVE_FLASH_ERASE_US, see scripts/ota_writer_bench.py.
+ */
+static void native_ota_writer_bench(uint32_t kb, uint32_t rate_kbps)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    const size_t size = std::min<size_t>((size_t)kb * 1024, partition->size);
+    std::vector<uint8_t> image(size);
+    uint32_t seed = 2463534242u;
+    esp_ota_handle_t handle;
+    ota_writer_stats_t stats;
+    int64_t elapsed_us[2];
+
+    /* xorshift32, the same image on every run. */
+    for (uint8_t &byte : image) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        byte = (uint8_t)seed;
+    }
+    image[0] = ESP_IMAGE_HEADER_MAGIC;
+
+    /* The link hands over a segment every segment / rate, the receiver
+     * can't take the next one earlier. */
+    auto receive = [rate_kbps](uint8_t *dst, const uint8_t *src,
+                                size_t len) {
+        for (size_t done = 0; done < len; done += NATIVE_OTA_BENCH_SEGMENT) {
+            const size_t segment = std::min<size_t>(NATIVE_OTA_BENCH_SEGMENT,
+                                                    len - done);
+
+            memcpy(dst + done, src + done, segment);
+            if (rate_kbps > 0) {
+                usleep((useconds_t)(segment * 1000000ULL
+                                    / (rate_kbps * 1024ULL)));
+            }
+        }
+    };
+
+    /* 1. Synchronous, the receiver waits for every write. */
+    std::vector<uint8_t> buffer(OTA_WRITER_BUFFER_SIZE);
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = esp_ota_begin(partition, size, &handle);
+    for (size_t offset = 0; err == ESP_OK && offset < size;
+            offset += OTA_WRITER_BUFFER_SIZE) {
+        const size_t len = std::min<size_t>(OTA_WRITER_BUFFER_SIZE,
+                                            size - offset);
+
+        receive(buffer.data(), image.data() + offset, len);
+        err = esp_ota_write(handle, buffer.data(), len);
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_end(handle);
+    }
+    elapsed_us[0] = esp_timer_get_time() - start_us;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Synchronous write failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    /* 2. Through the pool, the writer task overlaps the receiver. */
+    start_us = esp_timer_get_time();
+    err = ota_writer_begin(partition, size, NULL, NULL);
+    for (size_t offset = 0; err == ESP_OK && offset < size;
+            offset += OTA_WRITER_BUFFER_SIZE) {
+        const size_t len = std::min<size_t>(OTA_WRITER_BUFFER_SIZE,
+                                            size - offset);
+        uint8_t *pooled = ota_writer_acquire();
+
+        if (pooled == NULL) {
+            err = ESP_FAIL;
+            break;
+        }
+        receive(pooled, image.data() + offset, len);
+        err = ota_writer_submit(pooled, 0, len);
+    }
+    if (err == ESP_OK) {
+        err = ota_writer_end(&stats);
+    } else {
+        ota_writer_abort();
+    }
+    elapsed_us[1] = esp_timer_get_time() - start_us;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Pooled write failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    const double sync_kbps = size * 1e6 / 1024
+                                / std::max<int64_t>(elapsed_us[0], 1);
+    const double pool_kbps = size * 1e6 / 1024
+                                / std::max<int64_t>(elapsed_us[1], 1);
+    ESP_LOGI(TAG, "OTA write of %u kB received at %" PRIu32 " kB/s: "
+                    "synchronous %.1f kB/s, pool of %d %.1f kB/s, receiver "
+                    "stalled %" PRId64 " ms.",
+                (unsigned)(size / 1024), rate_kbps, sync_kbps,
+                OTA_WRITER_BUFFER_COUNT, pool_kbps, stats.stall_time_us / 1000);
+}
+
+/**
+ * @brief   Decoded image in native_ota_decoder_check(), hashed as written.
+ */
+typedef struct {
+    mbedtls_sha256_context sha256;
+    size_t size;
+} native_ota_image_t;
+
+static esp_err_t native_ota_decoder_sink(void *ctx, const uint8_t *data,
+                                            size_t len)
+{
+    native_ota_image_t *image = (native_ota_image_t *)ctx;
+
+    mbedtls_sha256_update(&image->sha256, data, len);
+    image->size += len;
+    return ESP_OK;
+}
+
+/**
+ * @brief   Decodes the upload file at `path`, raw or gzip, in chunks of
+ *          OTA_WRITER_BUFFER_SIZE through ota_decoder.hpp as the OTA writer
+ *          does, NATIVE_OTA_DECODER_ROUNDS times, and logs the SHA-256 of
+ *          the image and the best decode rate. OTA_DECODER_CHECK=<path> runs
+ *          it instead of the application, see scripts/compress_firmware.py.
+ */
+static void native_ota_decoder_check(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    std::vector<uint8_t> upload;
+    native_ota_image_t image;
+    uint8_t digest[OTA_WRITER_SHA256_LEN];
+    char hex[2 * OTA_WRITER_SHA256_LEN + 1];
+    int64_t best_us = INT64_MAX;
+    int64_t inflate_us = 0;
+    esp_err_t err = ESP_OK;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0) {
+        ESP_LOGE(TAG, "Can't open %s.", path);
+        return;
+    }
+    upload.resize((size_t)ftell(file));
+    rewind(file);
+    const size_t read = fread(upload.data(), 1, upload.size(), file);
+    fclose(file);
+    if (read != upload.size()) {
+        ESP_LOGE(TAG, "Can't read %s.", path);
+        return;
+    }
+
+    for (int round = 0; round < NATIVE_OTA_DECODER_ROUNDS; round++) {
+        /* 1. Fed as the buffers of the pool arrive, hashed as written. */
+        mbedtls_sha256_init(&image.sha256);
+        mbedtls_sha256_starts(&image.sha256, 0);
+        image.size = 0;
+        const int64_t start_us = esp_timer_get_time();
+        ota_decoder_begin(native_ota_decoder_sink, &image);
+        for (size_t offset = 0; err == ESP_OK && offset < upload.size();
+                offset += OTA_WRITER_BUFFER_SIZE) {
+            err = ota_decoder_feed(upload.data() + offset,
+                                    std::min<size_t>(OTA_WRITER_BUFFER_SIZE,
+                                                    upload.size() - offset));
+        }
+        const esp_err_t end_err = ota_decoder_end();
+        const int64_t elapsed_us = esp_timer_get_time() - start_us;
+        mbedtls_sha256_finish(&image.sha256, digest);
+        mbedtls_sha256_free(&image.sha256);
+
+        if (err == ESP_OK) {
+            err = end_err;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Decoding %s failed: %s", path,
+                        esp_err_to_name(err));
+            return;
+        }
+
+        /* 2. The best round, the first one also faults the window in. */
+        if (elapsed_us < best_us) {
+            best_us = elapsed_us;
+            inflate_us = ota_decoder_get_inflate_time_us();
+        }
+    }
+
+    for (size_t i = 0; i < OTA_WRITER_SHA256_LEN; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+    ESP_LOGI(TAG, "Decoded %s (%s) to %u bytes: SHA-256 %s, %.1f MB/s, "
+                    "%.1f ms inflating.",
+                path,
+                ota_decoder_get_format() == OTA_DECODER_FORMAT_GZIP
+                    ? "gzip" : "raw",
+                (unsigned)image.size, hex,
+                image.size / (double)std::max<int64_t>(best_us, 1),
+                inflate_us / 1000.0);
+}
+
+/**
+ * @brief   Host entry point, setup() and loop() of the firmware in one.
+ */
+int main(void)
+{
+    const char *fill = getenv("HISTORY_STORE_FILL");
+    const char *backlog = getenv("MQTT_PUBLISHER_BACKLOG");
+    const char *metrics_bench = getenv("METRICS_BENCH");
+    const char *dlog_bench = getenv("DLOG_BENCH");
+    const char *power_measure = getenv("POWER_MEASURE");
+    const char *placement = getenv("TASK_PLACEMENT");
+    const char *ota_bench = getenv("OTA_WRITER_BENCH");
+    const char *ota_check = getenv("OTA_DECODER_CHECK");
+    const char *event_bus_bench = getenv("EVENT_BUS_BENCH");
+#if TRACE_ENABLED
+    const char *trace_bench = getenv("TRACE_BENCH");
+#endif
+
+    /* 0. Tracing and the deferred log first, then the benches run alone, no
+     * application. */
+    trace_init();
+    dlog_start();
+    if (dlog_bench != NULL) {
+        native_dlog_bench((uint32_t)strtoul(dlog_bench, NULL, 10));
+        return 0;
+    }
+    if (metrics_bench != NULL) {
+        native_metrics_bench((uint32_t)strtoul(metrics_bench, NULL, 10));
+        return 0;
+    }
+    if (event_bus_bench != NULL) {
+        native_event_bus_bench((uint32_t)strtoul(event_bus_bench, NULL, 10));
+        return 0;
+    }
+    if (ota_check != NULL) {
+        native_ota_decoder_check(ota_check);
+        return 0;
+    }
+    if (ota_bench != NULL) {
+        const char *rate = strchr(ota_bench, ',');
+
+        native_ota_writer_bench((uint32_t)strtoul(ota_bench, NULL, 10),
+                                rate ? (uint32_t)strtoul(rate + 1, NULL, 10)
+                                        : 0);
+        return 0;
+    }
+#if TRACE_ENABLED
+    if (trace_bench != NULL) {
+        native_trace_bench((uint32_t)strtoul(trace_bench, NULL, 10));
+        return 0;
+    }
+#endif
+
+    /* 1. Initialize NVS, it starts empty on every run. */
+    ESP_ERROR_CHECK(nvs_flash_init());
+
+    /* NVS starts empty, a placement is given as a query instead:
+     * TASK_PLACEMENT="http_server=0&http_monitor=0". */
+    task_placement_init();
+    if (placement != NULL
+        && task_placement_set_query(placement, false) != ESP_OK) {
+        ESP_LOGE(TAG, "Bad TASK_PLACEMENT, cores are 0, 1 or -1.");
+    }
+
+    /* 2. The history is kept in a file, optionally filled first. */
+    if (fill != NULL && history_store_init() == ESP_OK) {
+        native_history_fill((uint32_t)strtoul(fill, NULL, 10));
+    }
+
+    /* 3. An outage left by the "last boot". */
+    if (backlog != NULL) {
+        native_mqtt_backlog((uint32_t)strtoul(backlog, NULL, 10));
+    }
+
+    /* 4. Frequency scaling, measured every POWER_MEASURE ms if set. */
+    power_init();
+    if (power_measure != NULL) {
+        power_measure_start((uint32_t)strtoul(power_measure, NULL, 10));
+    }
+
+    /* 5. Everything else runs in the tasks of the application. */
+    history_store_start();
+    dht_sensor_start();
+    wifi_app_start();
+    while (1) {
+        pause();
+    }
+}
+
+#endif /* PIO_UNIT_TESTING */
@@ -0,0 +1,183 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mbedtls/sha256.h>
+
+#define SHA256_ROTR(x, n)               (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* Private variables ---------------------------------------------------------*/
+
+static const uint32_t s_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Runs the compression function over one 64 byte block.
+ */
+static void sha256_process(mbedtls_sha256_context *ctx,
+                            const unsigned char data[64]);
+
+/* Public function definition ------------------------------------------------*/
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    if (ctx != NULL) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+}
+
+void mbedtls_sha256_clone(mbedtls_sha256_context *dst,
+                            const mbedtls_sha256_context *src)
+{
+    *dst = *src;
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t sha224_iv[8] = {
+        0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+        0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+    };
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    ctx->total[0] = 0;
+    ctx->total[1] = 0;
+    memcpy(ctx->state, is224 ? sha224_iv : sha256_iv, sizeof(ctx->state));
+    ctx->is224 = is224;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx,
+                                const unsigned char *input, size_t ilen)
+{
+    size_t left = ctx->total[0] & 0x3F;
+    const size_t fill = 64 - left;
+
+    ctx->total[0] += (uint32_t)ilen;
+    if (ctx->total[0] < (uint32_t)ilen) {
+        ctx->total[1]++;
+    }
+    ctx->total[1] += (uint32_t)((uint64_t)ilen >> 32);
+
+    if (left != 0 && ilen >= fill) {
+        memcpy(ctx->buffer + left, input, fill);
+        sha256_process(ctx, ctx->buffer);
+        input += fill;
+        ilen -= fill;
+        left = 0;
+    }
+
+    while (ilen >= 64) {
+        sha256_process(ctx, input);
+        input += 64;
+        ilen -= 64;
+    }
+
+    if (ilen > 0) {
+        memcpy(ctx->buffer + left, input, ilen);
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx,
+                                unsigned char output[32])
+{
+    const uint64_t bits = (((uint64_t)ctx->total[1] << 32) | ctx->total[0])
+                            << 3;
+    size_t used = ctx->total[0] & 0x3F;
+
+    /* 1. Padding, then the length in bits, big endian. */
+    ctx->buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(ctx->buffer + used, 0, 64 - used);
+        sha256_process(ctx, ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++) {
+        ctx->buffer[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_process(ctx, ctx->buffer);
+
+    /* 2. Digest, big endian words. */
+    for (int i = 0; i < (ctx->is224 ? 7 : 8); i++) {
+        output[4 * i] = (unsigned char)(ctx->state[i] >> 24);
+        output[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        output[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8);
+        output[4 * i + 3] = (unsigned char)ctx->state[i];
+    }
+    return 0;
+}
+
+/* Private function definition -----------------------------------------------*/
+static void sha256_process(mbedtls_sha256_context *ctx,
+                            const unsigned char data[64])
+{
+    uint32_t w[64];
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2];
+    uint32_t d = ctx->state[3], e = ctx->state[4], f = ctx->state[5];
+    uint32_t g = ctx->state[6], h = ctx->state[7];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)data[4 * i] << 24)
+                | ((uint32_t)data[4 * i + 1] << 16)
+                | ((uint32_t)data[4 * i + 2] << 8)
+                | (uint32_t)data[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        const uint32_t s0 = SHA256_ROTR(w[i - 15], 7)
+                            ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = SHA256_ROTR(w[i - 2], 17)
+                            ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    for (int i = 0; i < 64; i++) {
+        const uint32_t s1 = SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11)
+                            ^ SHA256_ROTR(e, 25);
+        const uint32_t ch = (e & f) ^ (~e & g);
+        const uint32_t t1 = h + s1 + ch + s_k[i] + w[i];
+        const uint32_t s0 = SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13)
+                            ^ SHA256_ROTR(a, 22);
+        const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
@@ -0,0 +1,620 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mqtt_client.h>
+
+#define MQTT_DEFAULT_PORT               1883
+#define MQTT_DEFAULT_KEEPALIVE_S        120
+#define MQTT_DEFAULT_TIMEOUT_MS         10000
+#define MQTT_DEFAULT_BUFFER_SIZE        1024
+#define MQTT_TASK_STACK_SIZE            6144
+#define MQTT_TASK_PRIORITY              5
+#define MQTT_STOP_POLL_MS               100
+
+/**
+ * @brief   Control packet types, the high nibble of the first byte.
+ */
+#define MQTT_CONNECT                    0x10
+#define MQTT_CONNACK                    0x20
+#define MQTT_PUBLISH                    0x30
+#define MQTT_PUBACK                     0x40
+#define MQTT_PINGREQ                    0xC0
+#define MQTT_PINGRESP                   0xD0
+#define MQTT_DISCONNECT                 0xE0
+
+ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
+
+/* Private types -------------------------------------------------------------*/
+
+struct esp_mqtt_client {
+    std::string host;
+    std::string port;
+    std::string client_id;
+    int keepalive_s;
+    int reconnect_timeout_ms;
+    int network_timeout_ms;
+    bool clean_session;
+    void *user_context;
+    std::vector<uint8_t> buffer;        /* One received packet. */
+
+    esp_event_handler_t handler;
+    void *handler_arg;
+
+    std::mutex lock;                    /* Sends, and fd and msg_id. */
+    int fd;                             /* -1 while disconnected. */
+    bool connected;
+    uint16_t msg_id;
+    int64_t sent_us;                    /* Last packet out. */
+
+    std::atomic<bool> running;
+    std::atomic<bool> stopped;
+};
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "mqtt_client";
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Connects, reads until the connection drops, waits and connects
+ *          again until esp_mqtt_client_stop().
+ */
+static void mqtt_client_task(void *param);
+
+/**
+ * @brief   Opens the TCP connection and completes CONNECT/CONNACK.
+ *
+ * @return  The socket, -1 on failure.
+ */
+static int mqtt_client_connect(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief   Handles packets and sends PINGREQ until the connection drops.
+ */
+static void mqtt_client_run(esp_mqtt_client_handle_t client, int fd);
+
+/**
+ * @brief   Reads one packet into client->buffer, waiting up to `timeout_ms`
+ *          for its first byte and network_timeout_ms for the rest.
+ *
+ * @return  The first byte, 0 on timeout, -1 if the connection is lost.
+ */
+static int mqtt_client_read_packet(esp_mqtt_client_handle_t client, int fd,
+                                    int timeout_ms, size_t *len);
+
+/**
+ * @brief   Sends a whole packet, client->lock held.
+ */
+static bool mqtt_client_send(esp_mqtt_client_handle_t client, int fd,
+                                const uint8_t *data, size_t len);
+
+static bool mqtt_client_recv(int fd, uint8_t *data, size_t len,
+                                int timeout_ms);
+static size_t mqtt_client_put_length(uint8_t *out, size_t len);
+static void mqtt_client_put_string(std::vector<uint8_t> *packet,
+                                    const char *data, size_t len);
+static void mqtt_client_dispatch(esp_mqtt_client_handle_t client,
+                                    esp_mqtt_event_id_t event_id,
+                                    int msg_id);
+
+/* Public function definition ------------------------------------------------*/
+esp_mqtt_client_handle_t esp_mqtt_client_init(
+                                    const esp_mqtt_client_config_t *config)
+{
+    const char *uri = getenv("NATIVE_MQTT_URI");
+    esp_mqtt_client_handle_t client = new esp_mqtt_client();
+    char id[32];
+
+    if (uri == NULL) {
+        uri = config->uri;
+    }
+    if (uri == NULL || strncmp(uri, "mqtt://", 7) != 0) {
+        ESP_LOGE(TAG, "Only mqtt:// URIs are supported.");
+        delete client;
+        return NULL;
+    }
+
+    /* 1. mqtt://host[:port][/path] */
+    std::string authority(uri + 7);
+    authority = authority.substr(0, authority.find('/'));
+    const size_t colon = authority.rfind(':');
+    client->host = authority.substr(0, colon);
+    client->port = (colon != std::string::npos)
+                        ? authority.substr(colon + 1)
+                        : std::to_string(MQTT_DEFAULT_PORT);
+
+    if (config->client_id != NULL) {
+        client->client_id = config->client_id;
+    } else {
+        snprintf(id, sizeof(id), "ESP32_%06X", (unsigned)getpid());
+        client->client_id = id;
+    }
+
+    /* 2. ESP-MQTT defaults for the zeroes. */
+    client->keepalive_s = (config->keepalive > 0)
+                            ? config->keepalive : MQTT_DEFAULT_KEEPALIVE_S;
+    client->reconnect_timeout_ms = (config->reconnect_timeout_ms > 0)
+                                    ? config->reconnect_timeout_ms
+                                    : MQTT_DEFAULT_TIMEOUT_MS;
+    client->network_timeout_ms = (config->network_timeout_ms > 0)
+                                    ? config->network_timeout_ms
+                                    : MQTT_DEFAULT_TIMEOUT_MS;
+    client->clean_session = !config->disable_clean_session;
+    client->user_context = config->user_context;
+    client->buffer.resize((config->buffer_size > 0)
+                            ? config->buffer_size : MQTT_DEFAULT_BUFFER_SIZE);
+
+    client->handler = NULL;
+    client->handler_arg = NULL;
+    client->fd = -1;
+    client->connected = false;
+    client->msg_id = 0;
+    client->sent_us = 0;
+    client->running = false;
+    client->stopped = true;
+
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                            esp_mqtt_event_id_t event,
+                                            esp_event_handler_t event_handler,
+                                            void *event_handler_arg)
+{
+    if (client == NULL || event != MQTT_EVENT_ANY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->running) {
+        return ESP_FAIL;
+    }
+
+    client->running = true;
+    client->stopped = false;
+    if (xTaskCreate(&mqtt_client_task,
+                    "mqtt_task",
+                    MQTT_TASK_STACK_SIZE,
+                    client,
+                    MQTT_TASK_PRIORITY,
+                    NULL) != pdPASS) {
+        client->running = false;
+        client->stopped = true;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL || !client->running) {
+        return ESP_FAIL;
+    }
+
+    /* The task sees the flag at its next wait, a shut socket wakes it. */
+    client->running = false;
+    {
+        std::lock_guard<std::mutex> guard(client->lock);
+
+        if (client->fd >= 0) {
+            shutdown(client->fd, SHUT_RDWR);
+        }
+    }
+    while (!client->stopped) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client,
+                            const char *topic, const char *data, int len,
+                            int qos, int retain)
+{
+    std::vector<uint8_t> packet;
+    uint8_t header[5];
+    int msg_id = 0;
+
+    if (client == NULL || topic == NULL || qos < 0 || qos > 1) {
+        return -1;
+    }
+    if (data != NULL && len == 0) {
+        len = (int)strlen(data);
+    }
+
+    std::lock_guard<std::mutex> guard(client->lock);
+
+    if (!client->connected) {
+        return -1;
+    }
+
+    /* 1. Variable header and payload. */
+    mqtt_client_put_string(&packet, topic, strlen(topic));
+    if (qos > 0) {
+        client->msg_id = (client->msg_id == UINT16_MAX) ? 1
+                                                        : client->msg_id + 1;
+        msg_id = client->msg_id;
+        packet.push_back((uint8_t)(msg_id >> 8));
+        packet.push_back((uint8_t)msg_id);
+    }
+    packet.insert(packet.end(), (const uint8_t *)data,
+                    (const uint8_t *)data + len);
+
+    /* 2. Fixed header in front. */
+    header[0] = MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0);
+    const size_t header_len = 1 + mqtt_client_put_length(header + 1,
+                                                        packet.size());
+    packet.insert(packet.begin(), header, header + header_len);
+
+    if (!mqtt_client_send(client, client->fd, packet.data(), packet.size())) {
+        return -1;
+    }
+    return msg_id;
+}
+
+/* Private function definition -----------------------------------------------*/
+static void mqtt_client_task(void *param)
+{
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)param;
+
+    while (client->running) {
+        mqtt_client_dispatch(client, MQTT_EVENT_BEFORE_CONNECT, 0);
+
+        const int fd = mqtt_client_connect(client);
+        if (fd >= 0) {
+            mqtt_client_run(client, fd);
+
+            std::lock_guard<std::mutex> guard(client->lock);
+            client->connected = false;
+            client->fd = -1;
+            close(fd);
+        } else {
+            mqtt_client_dispatch(client, MQTT_EVENT_ERROR, 0);
+        }
+        mqtt_client_dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+
+        /* Short steps, a stop doesn't wait for the whole delay. */
+        for (int waited = 0;
+                client->running && waited < client->reconnect_timeout_ms;
+                waited += MQTT_STOP_POLL_MS) {
+            vTaskDelay(pdMS_TO_TICKS(MQTT_STOP_POLL_MS));
+        }
+    }
+
+    client->stopped = true;
+    vTaskDelete(NULL);
+}
+
+static int mqtt_client_connect(esp_mqtt_client_handle_t client)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    std::vector<uint8_t> packet;
+    uint8_t header[5];
+    size_t len = 0;
+    int fd = -1;
+
+    /* 1. TCP. */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(client->host.c_str(), client->port.c_str(), &hints,
+                    &addresses) != 0) {
+        ESP_LOGE(TAG, "Unknown host %s.", client->host.c_str());
+        return -1;
+    }
+    for (struct addrinfo *address = addresses; address != NULL;
+            address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype,
+                    address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "Could not connect to %s:%s: %s",
+                    client->host.c_str(), client->port.c_str(),
+                    strerror(errno));
+        return -1;
+    }
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* 2. CONNECT, protocol level 4 (3.1.1). */
+    mqtt_client_put_string(&packet, "MQTT", 4);
+    packet.push_back(4);
+    packet.push_back(client->clean_session ? 0x02 : 0x00);
+    packet.push_back((uint8_t)(client->keepalive_s >> 8));
+    packet.push_back((uint8_t)client->keepalive_s);
+    mqtt_client_put_string(&packet, client->client_id.data(),
+                            client->client_id.size());
+
+    header[0] = MQTT_CONNECT;
+    const size_t header_len = 1 + mqtt_client_put_length(header + 1,
+                                                        packet.size());
+    packet.insert(packet.begin(), header, header + header_len);
+
+    {
+        std::lock_guard<std::mutex> guard(client->lock);
+
+        client->fd = fd;
+        if (!client->running
+            || !mqtt_client_send(client, fd, packet.data(), packet.size())) {
+            client->fd = -1;
+            close(fd);
+            return -1;
+        }
+    }
+
+    /* 3. CONNACK with return code 0. */
+    const int type = mqtt_client_read_packet(client, fd,
+                                            client->network_timeout_ms,
+                                            &len);
+    if (type != MQTT_CONNACK || len != 2 || client->buffer[1] != 0) {
+        ESP_LOGW(TAG, "Connection refused (packet 0x%02X, code %d).",
+                    (type > 0) ? type : 0,
+                    (type == MQTT_CONNACK && len == 2) ? client->buffer[1]
+                                                        : -1);
+        std::lock_guard<std::mutex> guard(client->lock);
+        client->fd = -1;
+        close(fd);
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(client->lock);
+        client->connected = true;
+    }
+    ESP_LOGI(TAG, "Connected to %s:%s as %s.", client->host.c_str(),
+                client->port.c_str(), client->client_id.c_str());
+    mqtt_client_dispatch(client, MQTT_EVENT_CONNECTED, 0);
+    return fd;
+}
+
+static void mqtt_client_run(esp_mqtt_client_handle_t client, int fd)
+{
+    const int64_t ping_us = (int64_t)client->keepalive_s * 1000000 / 2;
+    int64_t received_us = esp_timer_get_time();
+    size_t len = 0;
+
+    while (client->running) {
+        int64_t now_us = esp_timer_get_time();
+
+        /* 1. A PINGREQ halfway through an idle keepalive, the broker drops
+         * the session after 1.5 keepalives of silence. */
+        int64_t sent_us;
+        {
+            std::lock_guard<std::mutex> guard(client->lock);
+            sent_us = client->sent_us;
+        }
+        if (now_us - sent_us >= ping_us) {
+            static const uint8_t ping[] = {MQTT_PINGREQ, 0};
+
+            std::lock_guard<std::mutex> guard(client->lock);
+            if (!mqtt_client_send(client, fd, ping, sizeof(ping))) {
+                return;
+            }
+            sent_us = client->sent_us;
+        }
+        if (now_us - received_us > 3 * ping_us) {
+            ESP_LOGW(TAG, "No reply within the keepalive.");
+            return;
+        }
+
+        /* 2. Packets until the next ping is due. */
+        const int timeout_ms = (int)((sent_us + ping_us - now_us) / 1000)
+                                + 1;
+        const int type = mqtt_client_read_packet(client, fd,
+                                                    MIN(timeout_ms,
+                                                    MQTT_STOP_POLL_MS),
+                                                    &len);
+        if (type < 0) {
+            ESP_LOGW(TAG, "Connection lost.");
+            return;
+        }
+        if (type == 0) {
+            continue;
+        }
+        received_us = esp_timer_get_time();
+
+        switch (type & 0xF0) {
+            case MQTT_PUBACK:
+                if (len >= 2) {
+                    mqtt_client_dispatch(client, MQTT_EVENT_PUBLISHED,
+                                            (client->buffer[0] << 8)
+                                            | client->buffer[1]);
+                }
+                break;
+
+            case MQTT_PINGRESP:
+                break;
+
+            default:
+                /* Nothing is subscribed. */
+                ESP_LOGD(TAG, "Packet 0x%02X ignored.", type);
+                break;
+        }
+    }
+
+    static const uint8_t disconnect[] = {MQTT_DISCONNECT, 0};
+    std::lock_guard<std::mutex> guard(client->lock);
+    mqtt_client_send(client, fd, disconnect, sizeof(disconnect));
+}
+
+static int mqtt_client_read_packet(esp_mqtt_client_handle_t client, int fd,
+                                    int timeout_ms, size_t *len)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    uint8_t type = 0;
+    uint8_t byte = 0;
+    size_t remaining = 0;
+
+    const int ready = poll(&pfd, 1, timeout_ms);
+    if (ready == 0) {
+        return 0;
+    }
+    if (ready < 0 || !mqtt_client_recv(fd, &type, 1,
+                                        client->network_timeout_ms)) {
+        return -1;
+    }
+
+    /* 1. Remaining length, up to 4 bytes of 7 bits. */
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (!mqtt_client_recv(fd, &byte, 1, client->network_timeout_ms)) {
+            return -1;
+        }
+        remaining |= (size_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    if (byte & 0x80) {
+        return -1;
+    }
+
+    /* 2. The body, too long ones are read through and dropped. */
+    *len = remaining;
+    while (remaining > client->buffer.size()) {
+        if (!mqtt_client_recv(fd, client->buffer.data(),
+                                client->buffer.size(),
+                                client->network_timeout_ms)) {
+            return -1;
+        }
+        remaining -= client->buffer.size();
+        *len = 0;
+    }
+    if (!mqtt_client_recv(fd, client->buffer.data(), remaining,
+                            client->network_timeout_ms)) {
+        return -1;
+    }
+
+    return type;
+}
+
+static bool mqtt_client_send(esp_mqtt_client_handle_t client, int fd,
+                                const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        const ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+
+    client->sent_us = esp_timer_get_time();
+    return true;
+}
+
+static bool mqtt_client_recv(int fd, uint8_t *data, size_t len,
+                                int timeout_ms)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    while (len > 0) {
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+
+        const ssize_t received = recv(fd, data, len, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+static size_t mqtt_client_put_length(uint8_t *out, size_t len)
+{
+    size_t count = 0;
+
+    do {
+        out[count] = len & 0x7F;
+        len >>= 7;
+        if (len > 0) {
+            out[count] |= 0x80;
+        }
+        count++;
+    } while (len > 0);
+
+    return count;
+}
+
+static void mqtt_client_put_string(std::vector<uint8_t> *packet,
+                                    const char *data, size_t len)
+{
+    packet->push_back((uint8_t)(len >> 8));
+    packet->push_back((uint8_t)len);
+    packet->insert(packet->end(), (const uint8_t *)data,
+                    (const uint8_t *)data + len);
+}
+
+static void mqtt_client_dispatch(esp_mqtt_client_handle_t client,
+                                    esp_mqtt_event_id_t event_id,
+                                    int msg_id)
+{
+    esp_mqtt_event_t event;
+
+    if (client->handler == NULL) {
+        return;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.event_id = event_id;
+    event.client = client;
+    event.user_context = client->user_context;
+    event.msg_id = msg_id;
+
+    client->handler(client->handler_arg, MQTT_EVENTS, event_id, &event);
+}
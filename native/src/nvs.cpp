@@ -0,0 +1,274 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#define NVS_MAX_HANDLES                 32
+
+/* Private types -------------------------------------------------------------*/
+
+typedef enum {
+    NVS_TYPE_U8 = 0,
+    NVS_TYPE_U32,
+    NVS_TYPE_I64,
+    NVS_TYPE_STR,
+    NVS_TYPE_BLOB
+} nvs_type_e;
+
+typedef struct {
+    nvs_type_e type;
+    std::vector<uint8_t> value;
+} nvs_entry_t;
+
+typedef std::map<std::string, nvs_entry_t> nvs_namespace_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    std::string name;
+} nvs_handle_entry_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "nvs";
+
+static std::mutex s_lock;
+static bool s_initialized = false;
+static std::map<std::string, nvs_namespace_t> s_namespaces;
+static nvs_handle_entry_t s_handles[NVS_MAX_HANDLES];
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Namespace of an open handle, s_lock held.
+ *
+ * @return  NULL if the handle isn't open, or read only while `write`.
+ */
+static nvs_namespace_t *nvs_get_namespace(nvs_handle_t handle, bool write);
+
+static esp_err_t nvs_set(nvs_handle_t handle, const char *key,
+                            nvs_type_e type, const void *value,
+                            size_t length);
+static esp_err_t nvs_get(nvs_handle_t handle, const char *key,
+                            nvs_type_e type, void *out, size_t *length,
+                            bool exact);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t nvs_flash_init(void)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    s_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    ESP_LOGI(TAG, "Erasing every namespace.");
+    s_namespaces.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode,
+                    nvs_handle_t *out_handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (!s_initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (open_mode == NVS_READONLY
+        && s_namespaces.find(name) == s_namespaces.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (nvs_handle_t i = 0; i < NVS_MAX_HANDLES; i++) {
+        if (!s_handles[i].used) {
+            s_handles[i].used = true;
+            s_handles[i].writable = (open_mode == NVS_READWRITE);
+            s_handles[i].name = name;
+            s_namespaces[name];
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES) {
+        s_handles[handle - 1].used = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    return nvs_get_namespace(handle, false) ? ESP_OK
+                                            : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    nvs_namespace_t *ns = nvs_get_namespace(handle, true);
+
+    if (ns == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return ns->erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    nvs_namespace_t *ns = nvs_get_namespace(handle, true);
+
+    if (ns == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    ns->clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+{
+    size_t length = sizeof(*out);
+    return nvs_get(handle, key, NVS_TYPE_U8, out, &length, true);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set(handle, key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+{
+    size_t length = sizeof(*out);
+    return nvs_get(handle, key, NVS_TYPE_U32, out, &length, true);
+}
+
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value)
+{
+    return nvs_set(handle, key, NVS_TYPE_I64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *out)
+{
+    size_t length = sizeof(*out);
+    return nvs_get(handle, key, NVS_TYPE_I64, out, &length, true);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key,
+                        const char *value)
+{
+    return nvs_set(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out,
+                        size_t *length)
+{
+    return nvs_get(handle, key, NVS_TYPE_STR, out, length, false);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+                        const void *value, size_t length)
+{
+    return nvs_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out,
+                        size_t *length)
+{
+    return nvs_get(handle, key, NVS_TYPE_BLOB, out, length, false);
+}
+
+/* Private function definition -----------------------------------------------*/
+static nvs_namespace_t *nvs_get_namespace(nvs_handle_t handle, bool write)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES
+        || !s_handles[handle - 1].used
+        || (write && !s_handles[handle - 1].writable)) {
+        return NULL;
+    }
+    return &s_namespaces[s_handles[handle - 1].name];
+}
+
+static esp_err_t nvs_set(nvs_handle_t handle, const char *key,
+                            nvs_type_e type, const void *value,
+                            size_t length)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    nvs_namespace_t *ns = nvs_get_namespace(handle, true);
+
+    if (ns == NULL) {
+        return (handle >= 1 && handle <= NVS_MAX_HANDLES
+                && s_handles[handle - 1].used) ? ESP_ERR_NVS_READ_ONLY
+                                                : ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    nvs_entry_t &entry = (*ns)[key];
+    entry.type = type;
+    entry.value.assign((const uint8_t *)value,
+                        (const uint8_t *)value + length);
+    return ESP_OK;
+}
+
+static esp_err_t nvs_get(nvs_handle_t handle, const char *key,
+                            nvs_type_e type, void *out, size_t *length,
+                            bool exact)
+{
+    std::lock_guard<std::mutex> guard(s_lock);
+    nvs_namespace_t *ns = nvs_get_namespace(handle, false);
+
+    if (ns == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    auto it = ns->find(key);
+    if (it == ns->end() || it->second.type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    /* Like the firmware, a NULL output only asks for the length. */
+    const size_t size = it->second.value.size();
+    if (out == NULL && !exact) {
+        *length = size;
+        return ESP_OK;
+    }
+    if (*length < size) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(out, it->second.value.data(), size);
+    *length = size;
+    return ESP_OK;
+}
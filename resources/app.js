@@ -4,16 +4,26 @@
 var seconds 	= null;
 var otaTimerVar =  null;
 var wifiConnectInterval = null;
+var statusInterval = null;
+var statusVersion = 0;
+var eventSource = null;
+
+/**
+ * Displays each section of /status.json, also the /events event names.
+ */
+var sectionHandlers = {
+	"ota": showUpdateStatus,
+	"wifi": showWifiConnectStatus,
+	"sensor": showDHTSensorValues,
+	"time": showLocalTime,
+	"ap": showSSID
+};
 
 /**
  * Initialize functions here.
  */
 $(document).ready(function(){
-	getSSID();
-	getUpdateStatus();
-	startDHTSensorInterval();
-	startLocalTimeInterval();
-	getConnectInfo();
+	startEvents();
 	$("#connect_wifi").on("click", function(){
 		checkCredentials();
 	}); 
@@ -69,7 +79,11 @@ function updateProgress(oEvent)
 {
     if (oEvent.lengthComputable) 
 	{
-        getUpdateStatus();
+        // The event stream reports the result by itself
+        if (!eventsOpen())
+        {
+            getStatus();
+        }
     } 
 	else 
 	{
@@ -78,25 +92,52 @@ function updateProgress(oEvent)
 }
 
 /**
- * Posts the firmware udpate status.
+ * Gets the sections of /status.json changed since the last response, the
+ * device answers 304 when nothing changed.
+ */
+function getStatus()
+{
+	$.getJSON('/status.json', {'since': statusVersion}, showStatus);
+}
+
+/**
+ * Displays the sections of a /status.json response.
  */
-function getUpdateStatus() 
+function showStatus(data)
+{
+	// 304, nothing changed
+	if (!data)
+	{
+		return;
+	}
+
+	statusVersion = data.version;
+	for (var name in sectionHandlers)
+	{
+		if (data[name] !== undefined)
+		{
+			sectionHandlers[name](data[name]);
+		}
+	}
+}
+
+/**
+ * Displays the firmware update status of the ota section.
+ */
+function showUpdateStatus(response)
 {
-    var xhr = new XMLHttpRequest();
-    var requestURL = "/OTAstatus";
-    xhr.open('POST', requestURL, false);
-    xhr.send('ota_update_status');
-
-    if (xhr.readyState == 4 && xhr.status == 200) 
-	{		
-        var response = JSON.parse(xhr.responseText);
-						
 	 	document.getElementById("latest_firmware").innerHTML = response.compile_date + " - " + response.compile_time
 
 		// If flashing was complete it will return a 1, else -1
 		// A return of 0 is just for information on the Latest Firmware request
         if (response.ota_update_status == 1) 
 		{
+            // Already counting down, the stream may repeat the result
+            if (otaTimerVar != null)
+            {
+                return;
+            }
+
     		// Set the countdown timer time
             seconds = 10;
             // Start the countdown timer
@@ -104,9 +145,37 @@ function getUpdateStatus()
         } 
         else if (response.ota_update_status == -1)
 		{
-            document.getElementById("ota_update_status").innerHTML = "!!! Upload Error !!!";
+            document.getElementById("ota_update_status").innerHTML = "!!! Upload Error: " + otaReasonText(response.ota_update_reason) + " !!!";
         }
-    }
+        else if (response.ota_bytes_written > 0)
+        {
+            var total = response.ota_image_size > 0 ? " of " + response.ota_image_size : "";
+            document.getElementById("ota_update_status").innerHTML = "Downloading, " + response.ota_bytes_written + total + " bytes written...";
+        }
+}
+
+/**
+ * Describes the ota_update_reason code of /OTAstatus.
+ */
+function otaReasonText(reason)
+{
+    var reasons = [
+        "none",
+        "update could not start",
+        "upload interrupted",
+        "malformed upload",
+        "corrupt compressed image",
+        "image truncated",
+        "flash write failed",
+        "SHA-256 digest missing",
+        "SHA-256 digest mismatch",
+        "invalid firmware image",
+        "boot partition not switched",
+        "download refused by the server",
+        "image larger than the partition"
+    ];
+
+    return reasons[reason] || ("reason " + reason);
 }
 
 /**
@@ -128,22 +197,69 @@ function otaRebootTimer()
 }
 
 /**
- * Gets DHT22 sensor temperature and humidity values for display on the web page.
+ * Displays the DHT22 values of the sensor section.
  */
-function getDHTSensorValues()
+function showDHTSensorValues(data)
 {
-	$.getJSON('/dhtSensor.json', function(data) {
-		$("#temperature_reading").text(data["temp"]);
-		$("#humidity_reading").text(data["humidity"]);
+	$("#temperature_reading").text(data["temp"]);
+	$("#humidity_reading").text(data["humidity"]);
+}
+
+/**
+ * Opens the /events stream, the device pushes every /status.json section on
+ * it as it changes. Polling takes over without EventSource support, while
+ * the stream reconnects, or if the device has no stream left.
+ */
+function startEvents()
+{
+	if (!window.EventSource)
+	{
+		startPolling();
+		return;
+	}
+
+	eventSource = new EventSource("/events");
+	eventSource.onopen = stopPolling;
+	eventSource.onerror = startPolling;
+
+	$.each(sectionHandlers, function(name, handler) {
+		eventSource.addEventListener(name, function(e) {
+			handler(JSON.parse(e.data));
+		});
 	});
 }
 
 /**
- * Sets the interval for getting the updated DHT22 sensor values.
+ * Whether the /events stream is delivering updates.
+ */
+function eventsOpen()
+{
+	return eventSource != null && eventSource.readyState == EventSource.OPEN;
+}
+
+/**
+ * Polls /status.json for what the event stream would push.
  */
-function startDHTSensorInterval()
+function startPolling()
 {
-	setInterval(getDHTSensorValues, 5000);    
+	if (statusInterval == null)
+	{
+		getStatus();
+		statusInterval = setInterval(getStatus, 5000);
+	}
+}
+
+/**
+ * Stops polling once the event stream is open.
+ */
+function stopPolling()
+{
+	if (statusInterval != null)
+	{
+		clearInterval(statusInterval);
+		statusInterval = null;
+	}
+	stopWifiConnectStatusInterval();
 }
 
 /**
@@ -159,19 +275,16 @@ function stopWifiConnectStatusInterval()
 }
 
 /**
- * Gets the WiFi connection status.
+ * Displays the connection status of the wifi section.
  */
-function getWifiConnectStatus()
+function showWifiConnectStatus(response)
 {
-	var xhr = new XMLHttpRequest();
-	var requestURL = "/wifiConnectStatus";
-	xhr.open('POST', requestURL, false);
-	xhr.send('wifi_connect_status');
-	
-	if (xhr.readyState == 4 && xhr.status == 200)
-	{
-		var response = JSON.parse(xhr.responseText);
-		
+		// Nothing to show before a connection attempt
+		if (response.wifi_connect_status == 0)
+		{
+			return;
+		}
+
 		document.getElementById("wifi_connect_status").innerHTML = "Connecting...";
 		
 		if (response.wifi_connect_status == 2)
@@ -183,9 +296,8 @@ function getWifiConnectStatus()
 		{
 			document.getElementById("wifi_connect_status").innerHTML = "<h4 class='gr'>Connection Success!</h4>";
 			stopWifiConnectStatusInterval();
-			getConnectInfo();
+			showConnectInfo(response);
 		}
-	}
 }
 
 /**
@@ -193,7 +305,7 @@ function getWifiConnectStatus()
  */
 function startWifiConnectStatusInterval()
 {
-	wifiConnectInterval = setInterval(getWifiConnectStatus, 2800);
+	wifiConnectInterval = setInterval(getStatus, 2800);
 }
 
 /**
@@ -214,7 +326,15 @@ function connectWifi()
 		data: {'timestamp': Date.now()}
 	});
 	
-	startWifiConnectStatusInterval();
+	// The event stream reports the result by itself
+	if (eventsOpen())
+	{
+		document.getElementById("wifi_connect_status").innerHTML = "Connecting...";
+	}
+	else
+	{
+		startWifiConnectStatusInterval();
+	}
 }
 
 /**
@@ -267,12 +387,10 @@ function showPassword()
 }
 
 /**
- * Gets the connection information for displaying on the web page.
+ * Displays the connection information of a connected wifi section.
  */
-function getConnectInfo()
+function showConnectInfo(data)
 {
-	$.getJSON('/wifiConnectInfo.json', function(data)
-	{
 		$("#connected_ap_label").html("Connected to: ");
 		$("#connected_ap").text(data["ap"]);
 		
@@ -286,7 +404,6 @@ function getConnectInfo()
 		$("#wifi_connect_gw").text(data["gw"]);
 		
 		document.getElementById('disconnect_wifi').style.display = 'block';
-	});
 }
 
 /**
@@ -306,32 +423,20 @@ function disconnectWifi()
 }
 
 /**
- * Sets the interval for displaying local time.
- */
-function startLocalTimeInterval()
-{
-	setInterval(getLocalTime, 10000);
-}
-
-/**
- * Gets the local time.
+ * Displays the local time of the time section.
  * @note connect the ESP32 to the internet and the time will be updated.
  */
-function getLocalTime()
+function showLocalTime(data)
 {
-	$.getJSON('/localTime.json', function(data) {
-		$("#local_time").text(data["time"]);
-	});
+	$("#local_time").text(data["time"]);
 }
 
 /**
- * Gets the ESP32's access point SSID for displaying on the web page.
+ * Displays the ESP32's access point SSID of the ap section.
  */
-function getSSID()
+function showSSID(data)
 {
-	$.getJSON('/apSSID.json', function(data) {
-		$("#ap_ssid").text(data["ssid"]);
-	});
+	$("#ap_ssid").text(data["ssid"]);
 }
 
 
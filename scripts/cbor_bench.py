@@ -0,0 +1,157 @@
+r"""
+CBOR answers of the sensor endpoints (`src/cbor_writer.hpp`) against their
+JSON, on the host build or a device: decoded with the cbor2 package, they
+must hold the values of the JSON, then the sizes and response times of the
+three forms are compared.
+
+    NATIVE_LOG_LEVEL=I .pio/build/native/program
+    python scripts/cbor_bench.py --runs 20
+
+Packed CBOR is compared with the JSON turned into arrays in schema order.
+Numbers are equal up to the float the fixed decimals were rounded to. The
+time of a response is from the request to its last byte, the encoding
+dominates it for /dhtSensor.json, the flash log for a long /history.
+"""
+
+import argparse
+import http.client
+import json
+import math
+import statistics
+import sys
+import time
+
+import cbor2
+
+FORMS = {
+    "json": None,
+    "cbor": "application/cbor",
+    "packed": "application/cbor; form=packed",
+}
+
+
+def fetch(connection, path, accept):
+    """Returns the response headers and body."""
+    connection.request("GET", path, headers={"Accept": accept} if accept
+                       else {})
+    response = connection.getresponse()
+    payload = response.read()
+    if response.status != 200:
+        raise http.client.HTTPException("%s: status %d"
+                                        % (path, response.status))
+    return response, payload
+
+
+def pack(value):
+    """The JSON value as the packed form has it, objects as arrays."""
+    if isinstance(value, dict):
+        return [pack(v) for v in value.values()]
+    if isinstance(value, list):
+        return [pack(v) for v in value]
+    return value
+
+
+def same(expected, actual, where="$"):
+    """Returns where `actual` differs from `expected`, None if nowhere."""
+    if isinstance(expected, dict):
+        if not isinstance(actual, dict) or list(actual) != list(expected):
+            return where
+        for key in expected:
+            error = same(expected[key], actual[key], "%s.%s" % (where, key))
+            if error:
+                return error
+        return None
+    if isinstance(expected, list):
+        if not isinstance(actual, list) or len(actual) != len(expected):
+            return where
+        for i, (e, a) in enumerate(zip(expected, actual)):
+            error = same(e, a, "%s[%d]" % (where, i))
+            if error:
+                return error
+        return None
+    if isinstance(expected, float) and isinstance(actual, (int, float)):
+        # The nearest single float to the printed decimals.
+        return None if math.isclose(expected, actual, rel_tol=1e-7,
+                                    abs_tol=1e-9) else where
+    if type(expected) is not type(actual) or expected != actual:
+        return where
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--runs", type=int, default=10,
+                        help="responses timed per endpoint and form")
+    parser.add_argument("--window", type=float, default=86400.0,
+                        help="seconds of /history, 0 for all of it")
+    args = parser.parse_args()
+
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=60)
+    history = "/history"
+    if args.window:
+        _, payload = fetch(connection, "/history?from=0&to=0", None)
+        newest = json.loads(payload)["newest"]
+        history = "/history?from=%d&to=%d" % (newest - args.window * 1000,
+                                              newest)
+    paths = ["/dhtSensor.json", "/rollup.json?res=1m", history]
+
+    # 1. Interoperability, on one snapshot per endpoint. The sensor moves
+    # between requests, so its values are only compared in /history.
+    failed = False
+    for path in paths:
+        answers = {}
+        for form, accept in FORMS.items():
+            response, payload = fetch(connection, path, accept)
+            content_type = response.getheader("Content-Type", "")
+            if (accept or "application/json") != content_type:
+                print("%s %s: Content-Type %s" % (path, form, content_type))
+                failed = True
+            if response.getheader("Vary") != "Accept":
+                print("%s %s: no Vary: Accept" % (path, form))
+                failed = True
+            answers[form] = (json.loads(payload) if form == "json"
+                             else cbor2.loads(payload))
+
+        if path.startswith("/dhtSensor"):
+            continue
+        for form, expected in (("cbor", answers["json"]),
+                               ("packed", pack(answers["json"]))):
+            error = same(expected, answers[form])
+            if error:
+                print("%s %s: differs at %s" % (path, form, error))
+                failed = True
+
+    response, payload = fetch(connection, paths[0],
+                              "application/cbor;q=0, application/json")
+    if not payload.startswith(b"{"):
+        print("application/cbor;q=0 answered with CBOR")
+        failed = True
+
+    # 2. Sizes and times.
+    print("%-32s %-7s %10s %8s %10s %10s"
+          % ("endpoint", "form", "bytes", "ratio", "p50 ms", "min ms"))
+    for path in paths:
+        json_size = None
+        for form, accept in FORMS.items():
+            times = []
+            for _ in range(args.runs):
+                start = time.perf_counter()
+                _, payload = fetch(connection, path, accept)
+                times.append(1000 * (time.perf_counter() - start))
+            json_size = json_size or len(payload)
+            print("%-32s %-7s %10d %7.0f%% %10.2f %10.2f"
+                  % (path[:32], form, len(payload),
+                     100 * len(payload) / max(1, json_size),
+                     statistics.median(times), min(times)))
+    connection.close()
+
+    if failed:
+        return 1
+    print("CBOR and packed CBOR decode to the JSON values")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,162 @@
+r"""
+Post-build step producing a gzip compressed OTA image next to the firmware.
+
+`pio run -t compressed_firmware` builds `firmware.bin` then writes
+`firmware.bin.gz` in the build directory. It can be uploaded to `/OTAupdate`
+instead of the raw image: the device recognises the gzip magic and inflates
+the image on the fly (see `src/ota_decoder.cpp`).
+
+The device inflates through a single 32 KB window and accepts exactly one
+gzip member, so the image is compressed in one member with the default
+deflate window. Before it is kept, the compressed image is decoded again by
+the host build (`[env:native]`, OTA_DECODER_CHECK): `src/ota_decoder.cpp`
+inflates it through the tinfl interface of `rom/miniz.h` in 4 KB chunks like
+the OTA writer receives it, and the SHA-256 of its output must be the one of
+the raw image. Without a host build, Python's zlib checks the round trip
+instead. The ratio, the decode speed and the SHA-256 of the raw image are
+reported. The latter is the digest to send in the `X-OTA-SHA256` header of
+the upload:
+
+    curl -H "X-OTA-SHA256: <digest>" --data-binary @firmware.bin.gz \
+        http://192.168.0.1:8000/OTAupdate
+
+It can also be run by hand on existing images, `pio run -e native` first:
+
+    python scripts/compress_firmware.py .pio/build/esp32dev/firmware.bin \
+        --program .pio/build/native/program
+"""
+
+import argparse
+import gzip
+import hashlib
+import io
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+GZIP_SUFFIX = ".gz"
+ESP_IMAGE_HEADER_MAGIC = 0xE9
+OTA_CHUNK_SIZE = 4096
+SPEED_ROUNDS = 5
+NATIVE_PROGRAM = os.path.join(".pio", "build", "native", "program")
+DECODED = re.compile(r"Decoded .* to (\d+) bytes: SHA-256 ([0-9a-f]{64}), "
+                     r"([\d.]+) MB/s")
+
+
+def compress_image(raw):
+    """Returns the deterministic single member gzip of `raw`."""
+    buffer = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", fileobj=buffer,
+                       compresslevel=9, mtime=0) as gz:
+        gz.write(raw)
+    return buffer.getvalue()
+
+
+def stream_decompress(compressed):
+    """Inflates `compressed` in OTA sized chunks, as the device does."""
+    inflater = zlib.decompressobj(16 + zlib.MAX_WBITS)
+    out = []
+    for i in range(0, len(compressed), OTA_CHUNK_SIZE):
+        out.append(inflater.decompress(compressed[i:i + OTA_CHUNK_SIZE]))
+    out.append(inflater.flush())
+
+    if not inflater.eof or inflater.unused_data:
+        raise RuntimeError("gzip image is not exactly one complete member")
+
+    return b"".join(out)
+
+
+def native_decode(program, compressed):
+    """Decodes `compressed` with the decoder of the host build, returns the
+    size and SHA-256 of the image and the decode rate in MB/s."""
+    with tempfile.NamedTemporaryFile(suffix=GZIP_SUFFIX) as upload:
+        upload.write(compressed)
+        upload.flush()
+        env = dict(os.environ, OTA_DECODER_CHECK=upload.name,
+                   NATIVE_LOG_LEVEL="I")
+        output = subprocess.run([program], env=env, stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT,
+                                timeout=120).stdout.decode(errors="replace")
+
+    match = DECODED.search(output)
+    if match is None:
+        raise RuntimeError("%s failed to decode the image:\n%s"
+                           % (program, output))
+    return int(match.group(1)), match.group(2), float(match.group(3))
+
+
+def python_decode(compressed):
+    """Same as native_decode() with Python's zlib."""
+    best = None
+    for _ in range(SPEED_ROUNDS):
+        start = time.perf_counter()
+        decoded = stream_decompress(compressed)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+
+    return (len(decoded), hashlib.sha256(decoded).hexdigest(),
+            len(decoded) / best / 1e6 if best > 0 else float("inf"))
+
+
+def compress_firmware(source, target, program=None):
+    """Writes the compressed image of `source` to `target` and reports it."""
+    with open(source, "rb") as f:
+        raw = f.read()
+
+    if not raw or raw[0] != ESP_IMAGE_HEADER_MAGIC:
+        raise RuntimeError("%s is not an ESP app image" % source)
+
+    compressed = compress_image(raw)
+    digest = hashlib.sha256(raw).hexdigest()
+
+    # Round trip through the device's decoder, best of a few rounds.
+    if program is not None and os.path.exists(program):
+        decoder = "src/ota_decoder.cpp"
+        size, decoded_digest, rate = native_decode(program, compressed)
+    else:
+        decoder = "Python zlib, no host build"
+        size, decoded_digest, rate = python_decode(compressed)
+    if size != len(raw) or decoded_digest != digest:
+        raise RuntimeError("gzip round-trip mismatch for %s: %d bytes, "
+                           "SHA-256 %s" % (source, size, decoded_digest))
+
+    with open(target, "wb") as f:
+        f.write(compressed)
+
+    print("Compressed OTA image %s:" % target)
+    print("  %8d -> %8d bytes (%5.1f%%)"
+          % (len(raw), len(compressed), 100.0 * len(compressed) / len(raw)))
+    print("  decoded by %s: SHA-256 matches, %.1f MB/s" % (decoder, rate))
+    print("  X-OTA-SHA256: %s" % digest)
+
+
+def compressed_firmware_action(target, source, env):
+    firmware = str(source[0])
+    program = os.path.join(env.subst("$PROJECT_DIR"), NATIVE_PROGRAM)
+    compress_firmware(firmware, firmware + GZIP_SUFFIX, program)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO (SCons).
+except NameError:
+    env = None
+
+if env is not None:
+    env.AddCustomTarget(
+        name="compressed_firmware",
+        dependencies="$BUILD_DIR/${PROGNAME}.bin",
+        actions=compressed_firmware_action,
+        title="Compressed Firmware",
+        description="Build firmware.bin.gz for a compressed OTA upload")
+elif __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("images", nargs="+", metavar="firmware.bin")
+    parser.add_argument("--program", default=NATIVE_PROGRAM,
+                        help="host build decoding the images")
+    args = parser.parse_args()
+    for image in args.images:
+        compress_firmware(image, image + GZIP_SUFFIX, args.program)
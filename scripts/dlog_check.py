@@ -0,0 +1,133 @@
+r"""
+Checks /log (`src/dlog.cpp`) on the host build or a device: every line the
+dlog task renders must reach an open stream as one well-formed event, in
+order, at most a render period and a send after the request that logged it.
+
+    NATIVE_LOG_LEVEL=I .pio/build/native/program
+    python scripts/dlog_check.py --requests 200
+
+Each request for a static asset logs "<uri> is requested." from the httpd
+task, so the stream must carry one such line per request. A burst past the
+stream ring drops the oldest lines, announced by a `: lines lost` comment,
+which fails the check unless `--allow-lost` is given.
+
+What a line costs its caller, deferred or not, is measured by the host
+build alone:
+
+    DLOG_BENCH=200000 .pio/build/native/program 2>/dev/null
+"""
+
+import argparse
+import re
+import socket
+import sys
+import threading
+import time
+import urllib.request
+
+ASSET = "/index.html"
+LINE = re.compile(r"^[EWIDV] \(\d+\) \w+: ")
+
+
+class Stream(threading.Thread):
+    """Reads /log, keeps each event with the time it arrived."""
+
+    def __init__(self, host, port):
+        super().__init__(daemon=True)
+        self.sock = socket.create_connection((host, port), timeout=60)
+        self.sock.sendall(("GET /log HTTP/1.1\r\nHost: %s\r\n\r\n"
+                           % host).encode())
+        self.events = []
+        self.lost = 0
+        self.lock = threading.Lock()
+
+    def run(self):
+        buffer = b""
+        while True:
+            try:
+                chunk = self.sock.recv(4096)
+            except OSError:
+                return
+            if not chunk:
+                return
+            buffer += chunk
+            while b"\n\n" in buffer:
+                frame, buffer = buffer.split(b"\n\n", 1)
+                self.frame(frame.decode(errors="replace"))
+
+    def frame(self, frame):
+        now = time.perf_counter()
+        if frame.startswith("HTTP/1.1"):
+            frame = frame.split("\r\n\r\n", 1)[1]
+        data = [line[6:] for line in frame.split("\n")
+                if line.startswith("data: ")]
+        with self.lock:
+            if frame.startswith(": lines lost"):
+                self.lost += 1
+            elif data:
+                self.events.append(("\n".join(data), now))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--requests", type=int, default=100)
+    parser.add_argument("--latency", type=float, default=0.5,
+                        help="seconds a line may take to reach the stream")
+    parser.add_argument("--allow-lost", action="store_true")
+    args = parser.parse_args()
+
+    # 1. The stream first, it starts with the lines kept so far.
+    stream = Stream(args.host, args.port)
+    stream.start()
+    time.sleep(0.5)
+    with stream.lock:
+        backlog = len(stream.events)
+
+    # 2. Requests which log a line each, timed by the client.
+    done = []
+    for _ in range(args.requests):
+        with urllib.request.urlopen("http://%s:%d%s"
+                                    % (args.host, args.port, ASSET)) as page:
+            page.read()
+        done.append(time.perf_counter())
+    time.sleep(args.latency + 0.5)
+    stream.sock.close()
+
+    # 3. One well-formed line per request, in order, soon enough.
+    failed = False
+    with stream.lock:
+        events = stream.events[backlog:]
+        lost = stream.lost
+    malformed = [text for text, _ in stream.events if not LINE.match(text)]
+    for text in malformed[:10]:
+        print("malformed line %r" % text)
+    failed |= bool(malformed)
+
+    arrivals = [now for text, now in events
+                if text.endswith("%s is requested." % ASSET)]
+    if len(arrivals) != args.requests:
+        print("%d requests, %d lines for them" % (args.requests,
+                                                 len(arrivals)))
+        failed = failed or not (lost and args.allow_lost)
+    delays = sorted(max(0.0, arrival - sent)
+                    for arrival, sent in zip(arrivals, done))
+    if delays:
+        print("lines: %d in the backlog, %d since, delay after the "
+              "response p50 %.1f ms, max %.1f ms, %d lost notices"
+              % (backlog, len(events), 1000 * delays[len(delays) // 2],
+                 1000 * delays[-1], lost))
+        if delays[-1] > args.latency:
+            failed = True
+    if lost and not args.allow_lost:
+        failed = True
+
+    if failed:
+        return 1
+    print("/log carried every line, in order and well formed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,155 @@
+"""
+Pre-build step for the web assets embedded into the firmware (see
+`board_build.embed_files` in platformio.ini).
+
+1. Every `<asset>.gz` listed in `board_build.embed_files` is regenerated from
+   its raw `<asset>` whenever the raw file is newer. The output is
+   deterministic (no file name, mtime = 0) so identical sources always give
+   identical images. Each compressed copy is decompressed again and compared
+   byte-for-byte with the source before the build continues, and the
+   compression ratio is reported.
+2. A strong ETag (truncated SHA-256 of the bytes actually served) is computed
+   for every embedded file and written to `include/static_assets_etag.hpp`,
+   which the static asset table in `src/static_assets.cpp` includes.
+
+It can also be run by hand from the project root:
+
+    python scripts/embed_assets.py [resources/app.js ...]
+"""
+
+import gzip
+import hashlib
+import io
+import os
+import re
+import sys
+
+GZIP_SUFFIX = ".gz"
+ETAG_HEADER = os.path.join("include", "static_assets_etag.hpp")
+ETAG_HEX_DIGITS = 16
+
+
+def compress_asset(source, target):
+    """Writes the gzip copy of `source` to `target` and returns both sizes."""
+    with open(source, "rb") as f:
+        raw = f.read()
+
+    buffer = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", fileobj=buffer,
+                       compresslevel=9, mtime=0) as gz:
+        gz.write(raw)
+    compressed = buffer.getvalue()
+
+    if gzip.decompress(compressed) != raw:
+        raise RuntimeError("gzip round-trip mismatch for %s" % source)
+
+    with open(target, "wb") as f:
+        f.write(compressed)
+
+    return len(raw), len(compressed)
+
+
+def verify_asset(source, target):
+    """Checks an up-to-date gzip copy still decodes to the raw source."""
+    with open(source, "rb") as f:
+        raw = f.read()
+    with open(target, "rb") as f:
+        compressed = f.read()
+
+    if gzip.decompress(compressed) != raw:
+        raise RuntimeError("%s does not decode to %s" % (target, source))
+
+    return len(raw), len(compressed)
+
+
+def compress_assets(project_dir, targets):
+    """Refreshes the `.gz` targets and prints a per-asset ratio report."""
+    total_raw = 0
+    total_gz = 0
+
+    for target in targets:
+        if not target.endswith(GZIP_SUFFIX):
+            continue
+
+        source = os.path.join(project_dir, target[:-len(GZIP_SUFFIX)])
+        target = os.path.join(project_dir, target)
+
+        if not os.path.isfile(source):
+            raise RuntimeError("Missing source asset %s" % source)
+
+        if (not os.path.isfile(target)
+                or os.path.getmtime(target) < os.path.getmtime(source)):
+            raw_size, gz_size = compress_asset(source, target)
+        else:
+            raw_size, gz_size = verify_asset(source, target)
+
+        total_raw += raw_size
+        total_gz += gz_size
+        print("  %-40s %8d -> %7d bytes (%5.1f%%)"
+              % (os.path.relpath(source, project_dir), raw_size, gz_size,
+                 100.0 * gz_size / raw_size))
+
+    if total_raw:
+        print("  %-40s %8d -> %7d bytes (%5.1f%%)"
+              % ("total", total_raw, total_gz, 100.0 * total_gz / total_raw))
+
+
+def etag_macro(path):
+    """`resources/jquery-3.3.1.min.js.gz` -> `..._JQUERY_3_3_1_MIN_JS_GZ`."""
+    name = os.path.basename(path)
+    return "STATIC_ASSET_ETAG_" + re.sub(r"[^0-9A-Za-z]", "_", name).upper()
+
+
+def write_etag_header(project_dir, files):
+    """Writes the ETag header, leaving it untouched when nothing changed."""
+    lines = [
+        "#pragma once",
+        "",
+        "/* Generated by scripts/embed_assets.py, do not edit. */",
+        "",
+    ]
+    for path in files:
+        with open(os.path.join(project_dir, path), "rb") as f:
+            digest = hashlib.sha256(f.read()).hexdigest()[:ETAG_HEX_DIGITS]
+        lines.append('#define %-44s "\\"%s\\""' % (etag_macro(path), digest))
+    content = "\n".join(lines) + "\n"
+
+    header = os.path.join(project_dir, ETAG_HEADER)
+    if os.path.isfile(header):
+        with open(header) as f:
+            if f.read() == content:
+                return
+
+    with open(header, "w") as f:
+        f.write(content)
+
+
+def embedded_files(env):
+    """Returns the entries of `board_build.embed_files`."""
+    option = env.GetProjectOption("board_build.embed_files", "")
+    if isinstance(option, str):
+        option = option.splitlines()
+    return [f.strip() for f in option if f.strip()]
+
+
+def embed_assets(project_dir, files):
+    print("Compressing embedded web assets:")
+    compress_assets(project_dir, files)
+    write_etag_header(project_dir, files)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO (SCons).
+except NameError:
+    env = None
+
+if env is not None:
+    embed_assets(env.subst("$PROJECT_DIR"), embedded_files(env))
+elif __name__ == "__main__":
+    project = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    assets = sys.argv[1:] or sorted(
+        os.path.join("resources", f)
+        for f in os.listdir(os.path.join(project, "resources"))
+        if not f.endswith(GZIP_SUFFIX))
+    embed_assets(project,
+                 [f for a in assets for f in (a, a + GZIP_SUFFIX)])
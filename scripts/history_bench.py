@@ -0,0 +1,110 @@
+r"""
+Query rate of the flash sensor history (`src/history_store.cpp`) through
+/history, against the host build or a device.
+
+The host build keeps the partition in `history.partition`, in
+NATIVE_FLASH_DIR or the working directory. `HISTORY_STORE_FILL=<n>` appends
+n samples, one per sensor period up to now, before the start and logs the
+append rate; 400000 wraps the ring of a fresh partition:
+
+    HISTORY_STORE_FILL=400000 NATIVE_LOG_LEVEL=I .pio/build/native/program
+    python scripts/history_bench.py --windows 200
+
+The whole log is streamed a few times, then windows of `--window` seconds
+at random places are fetched. The index of block start times should keep
+the latency of a window flat whatever the depth of the log behind it.
+"""
+
+import argparse
+import http.client
+import json
+import random
+import sys
+import time
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile of sorted `values`."""
+    if not values:
+        return 0.0
+    rank = max(0, min(len(values) - 1,
+                      int(round(fraction * len(values) + 0.5)) - 1))
+    return values[rank]
+
+
+def fetch(connection, path):
+    """Returns the decoded history and the response size."""
+    connection.request("GET", path)
+    response = connection.getresponse()
+    payload = response.read()
+    if response.status != 200:
+        raise http.client.HTTPException("status %d" % response.status)
+    return json.loads(payload), len(payload)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--full", type=int, default=3,
+                        help="streams of the whole log")
+    parser.add_argument("--windows", type=int, default=100,
+                        help="random windows fetched")
+    parser.add_argument("--window", type=float, default=3600.0,
+                        help="seconds of history per window")
+    args = parser.parse_args()
+
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=60)
+
+    # The whole log, streamed.
+    rates = []
+    for _ in range(args.full):
+        start = time.perf_counter()
+        history, size = fetch(connection, "/history")
+        elapsed = time.perf_counter() - start
+        rates.append((len(history["samples"]), size, elapsed))
+
+    oldest, newest = history["oldest"], history["newest"]
+    if not history["samples"]:
+        print("the history is empty")
+        return 1
+    times = [s["time"] for s in history["samples"]]
+    if any(b <= a for a, b in zip(times, times[1:])):
+        print("samples out of order")
+        return 1
+
+    count, size, elapsed = min(rates, key=lambda r: r[2])
+    print("log: %d samples over %.1f h, oldest %d, newest %d"
+          % (count, (newest - oldest) / 3.6e6, oldest, newest))
+    print("full stream: %.0f ms, %.0f samples/s, %.1f MB/s"
+          % (1000 * elapsed, count / elapsed, size / elapsed / 1e6))
+
+    # Windows anywhere in the log.
+    span = int(args.window * 1000)
+    latencies = []
+    returned = []
+    for _ in range(args.windows):
+        start_ms = random.randint(oldest, max(oldest, newest - span))
+        path = "/history?from=%d&to=%d" % (start_ms, start_ms + span)
+        start = time.perf_counter()
+        window, _ = fetch(connection, path)
+        latencies.append(1000 * (time.perf_counter() - start))
+        returned.append(len(window["samples"]))
+        if any(not start_ms <= s["time"] <= start_ms + span
+               for s in window["samples"]):
+            print("sample outside %s" % path)
+            return 1
+    connection.close()
+
+    latencies.sort()
+    print("%.0f s windows: %d, %.1f samples each, latency p50 %.2f ms, "
+          "p99 %.2f ms, max %.2f ms"
+          % (args.window, len(latencies),
+             sum(returned) / max(1, len(returned)),
+             percentile(latencies, 0.50), percentile(latencies, 0.99),
+             latencies[-1] if latencies else 0.0))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
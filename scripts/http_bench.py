@@ -0,0 +1,327 @@
+r"""
+Load generator for the HTTP server (`src/http_server.cpp`), run against the
+host build or a device.
+
+Build and start the host build, it listens on port 8000 like the device:
+
+    pio run -e native
+    NATIVE_LOG_LEVEL=W .pio/build/native/program
+
+Then fire concurrent asset, status and OTA requests for a while:
+
+    python scripts/http_bench.py --assets 4 --status 2 --ota 1 --duration 10
+
+Every worker holds one keep-alive connection and loops over the requests of
+its group. At the end the count, errors, p50/p99/max latency, requests per
+second and payload throughput are printed per route. `--save` writes them as
+JSON and `--compare` checks a run against a saved one, the exit status is 1
+when a route got slower than `--tolerance` allows.
+
+Against a device, use `--host 192.168.0.1` and `--ota 0`: a successful
+upload restarts it into the random image it was sent.
+
+`--ota-rate` sends the image at the pace of a real WiFi upload. The status
+latency shouldn't depend on it, the upload is received on a worker task:
+
+    python scripts/http_bench.py --assets 0 --ota 0 --save idle.json
+    python scripts/http_bench.py --assets 0 --ota-rate 200 --compare idle.json
+
+The firmware's ESP-IDF 4.4 has no async request handoff, its uploads reach
+the worker with their socket. `pio run -e native-idf44` builds that path.
+"""
+
+import argparse
+import hashlib
+import http.client
+import json
+import os
+import sys
+import threading
+import time
+
+OTA_SHA256_HEADER = "X-OTA-SHA256"
+ESP_IMAGE_HEADER_MAGIC = b"\xe9"
+SERVER_MAX_OPEN_SOCKETS = 7
+
+
+class RouteStats:
+    """Latencies and payload bytes of one route."""
+
+    def __init__(self):
+        self.latencies = []
+        self.errors = 0
+        self.bytes = 0
+
+    def merge(self, other):
+        self.latencies.extend(other.latencies)
+        self.errors += other.errors
+        self.bytes += other.bytes
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile of sorted `values`."""
+    if not values:
+        return 0.0
+    rank = max(0, min(len(values) - 1,
+                      int(round(fraction * len(values) + 0.5)) - 1))
+    return values[rank]
+
+
+class Worker(threading.Thread):
+    """One connection, requests of one group until the deadline."""
+
+    def __init__(self, args, deadline):
+        super().__init__(daemon=True)
+        self.args = args
+        self.deadline = deadline
+        self.stats = {}
+        self.connection = None
+
+    def run(self):
+        while time.perf_counter() < self.deadline:
+            self.iteration()
+        if self.connection is not None:
+            self.connection.close()
+
+    def request(self, route, method, path, body=None, headers=None,
+                expect=(200,)):
+        """Times one request, with the body read. Returns the response."""
+        stats = self.stats.setdefault(route, RouteStats())
+        if self.connection is None:
+            self.connection = http.client.HTTPConnection(
+                self.args.host, self.args.port, timeout=self.args.timeout)
+
+        start = time.perf_counter()
+        try:
+            self.connection.request(method, path, body=body,
+                                    headers=headers or {})
+            response = self.connection.getresponse()
+            payload = response.read()
+        except (OSError, http.client.HTTPException):
+            # The server closed the session, or it timed out.
+            stats.errors += 1
+            self.connection.close()
+            self.connection = None
+            return None
+        elapsed = time.perf_counter() - start
+
+        if response.status not in expect:
+            stats.errors += 1
+        else:
+            stats.latencies.append(elapsed)
+            stats.bytes += len(payload) + (
+                len(body or b"") if isinstance(body, (bytes, type(None)))
+                else int(headers["Content-Length"]))
+        response.payload = payload
+        return response
+
+    def iteration(self):
+        raise NotImplementedError
+
+
+class AssetWorker(Worker):
+    """Page load: compressed assets, a revalidation and a HEAD."""
+
+    ASSETS = ["/index.html", "/app.js", "/app.css",
+              "/jquery-3.3.1.min.js", "/favicon.ico"]
+
+    def __init__(self, args, deadline):
+        super().__init__(args, deadline)
+        self.etags = {}
+        self.iterations = 0
+
+    def iteration(self):
+        for path in self.ASSETS:
+            if time.perf_counter() >= self.deadline:
+                return
+
+            # 1. Revalidation once the ETag is known, a full GET before.
+            etag = self.etags.get(path)
+            if etag is not None:
+                self.request("GET %s (304)" % path, "GET", path,
+                             headers={"Accept-Encoding": "gzip",
+                                      "If-None-Match": etag},
+                             expect=(304,))
+                continue
+
+            response = self.request("GET %s" % path, "GET", path,
+                                    headers={"Accept-Encoding": "gzip"})
+            if response is not None and response.getheader("ETag"):
+                self.etags[path] = response.getheader("ETag")
+
+        self.request("HEAD /favicon.ico", "HEAD", "/favicon.ico")
+
+        # Forget the validators now and then, full GETs stay in the mix.
+        self.iterations += 1
+        if self.iterations % 4 == 0:
+            self.etags.clear()
+
+
+class StatusWorker(Worker):
+    """Polling page: full status, then the delta since its version."""
+
+    def __init__(self, args, deadline):
+        super().__init__(args, deadline)
+        self.version = None
+
+    def iteration(self):
+        if self.version is None:
+            response = self.request("GET /status.json", "GET",
+                                    "/status.json")
+        else:
+            response = self.request("GET /status.json?since", "GET",
+                                    "/status.json?since=%d" % self.version,
+                                    expect=(200, 304))
+
+        if response is not None and response.status == 200:
+            try:
+                self.version = json.loads(response.payload)["version"]
+            except (ValueError, KeyError):
+                self.version = None
+
+        self.request("GET /OTAstatus", "GET", "/OTAstatus")
+
+
+class OtaWorker(Worker):
+    """Raw image upload with its digest, then the result."""
+
+    def __init__(self, args, deadline):
+        super().__init__(args, deadline)
+        self.image = ESP_IMAGE_HEADER_MAGIC \
+            + os.urandom(args.ota_size - len(ESP_IMAGE_HEADER_MAGIC))
+        self.digest = hashlib.sha256(self.image).hexdigest()
+
+    def throttled(self):
+        """The image in 1 kB pieces at `--ota-rate` kB/s."""
+        start = time.perf_counter()
+        for offset in range(0, len(self.image), 1024):
+            delay = start + offset / 1e3 / self.args.ota_rate \
+                - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            yield self.image[offset:offset + 1024]
+
+    def iteration(self):
+        headers = {"Content-Type": "application/octet-stream",
+                   OTA_SHA256_HEADER: self.digest}
+        body = self.image
+        if self.args.ota_rate:
+            headers["Content-Length"] = str(len(self.image))
+            body = self.throttled()
+        self.request("POST /OTAupdate", "POST", "/OTAupdate",
+                     body=body, headers=headers)
+        self.request("GET /OTAstatus", "GET", "/OTAstatus")
+
+
+def run(args):
+    deadline = time.perf_counter() + args.duration
+    workers = ([AssetWorker(args, deadline) for _ in range(args.assets)]
+               + [StatusWorker(args, deadline) for _ in range(args.status)]
+               + [OtaWorker(args, deadline) for _ in range(args.ota)])
+
+    start = time.perf_counter()
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    elapsed = time.perf_counter() - start
+
+    stats = {}
+    for worker in workers:
+        for route, route_stats in worker.stats.items():
+            stats.setdefault(route, RouteStats()).merge(route_stats)
+
+    results = {}
+    for route, route_stats in sorted(stats.items()):
+        latencies = sorted(route_stats.latencies)
+        results[route] = {
+            "count": len(latencies),
+            "errors": route_stats.errors,
+            "p50_ms": 1000 * percentile(latencies, 0.50),
+            "p99_ms": 1000 * percentile(latencies, 0.99),
+            "max_ms": 1000 * (latencies[-1] if latencies else 0.0),
+            "req_per_s": len(latencies) / elapsed,
+            "mb_per_s": route_stats.bytes / elapsed / 1e6,
+        }
+    return results
+
+
+def print_results(results):
+    print("%-32s %7s %6s %8s %8s %8s %9s %8s"
+          % ("route", "count", "errors", "p50 ms", "p99 ms", "max ms",
+             "req/s", "MB/s"))
+    for route, r in results.items():
+        print("%-32s %7d %6d %8.2f %8.2f %8.2f %9.1f %8.2f"
+              % (route, r["count"], r["errors"], r["p50_ms"], r["p99_ms"],
+                 r["max_ms"], r["req_per_s"], r["mb_per_s"]))
+
+
+def compare_results(results, baseline, tolerance):
+    """Lists the routes slower than `baseline` by more than `tolerance`."""
+    regressions = []
+    for route, r in results.items():
+        base = baseline.get(route)
+        if base is None or base["count"] == 0:
+            continue
+        if r["p99_ms"] > base["p99_ms"] * (1 + tolerance):
+            regressions.append("%s: p99 %.2f ms, was %.2f ms"
+                               % (route, r["p99_ms"], base["p99_ms"]))
+        if r["req_per_s"] < base["req_per_s"] * (1 - tolerance):
+            regressions.append("%s: %.1f req/s, was %.1f req/s"
+                               % (route, r["req_per_s"], base["req_per_s"]))
+        if r["errors"] > base["errors"]:
+            regressions.append("%s: %d errors, was %d"
+                               % (route, r["errors"], base["errors"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="seconds of load")
+    parser.add_argument("--assets", type=int, default=4,
+                        help="connections loading the page assets")
+    parser.add_argument("--status", type=int, default=2,
+                        help="connections polling the status")
+    parser.add_argument("--ota", type=int, default=1,
+                        help="connections uploading OTA images")
+    parser.add_argument("--ota-size", type=int, default=1024 * 1024,
+                        help="bytes of the uploaded image")
+    parser.add_argument("--ota-rate", type=float, default=0.0,
+                        help="kB/s of the upload, 0 for as fast as it goes")
+    parser.add_argument("--timeout", type=float, default=10.0,
+                        help="seconds before a request counts as failed")
+    parser.add_argument("--save", help="writes the results to this JSON")
+    parser.add_argument("--compare", help="JSON of an earlier --save")
+    parser.add_argument("--tolerance", type=float, default=0.25,
+                        help="allowed p99 and req/s change for --compare")
+    args = parser.parse_args()
+
+    connections = args.assets + args.status + args.ota
+    if connections > SERVER_MAX_OPEN_SOCKETS:
+        print("warning: %d connections, the server keeps %d and purges the "
+              "least recently used" % (connections, SERVER_MAX_OPEN_SOCKETS),
+              file=sys.stderr)
+
+    results = run(args)
+    print_results(results)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        regressions = compare_results(results, baseline, args.tolerance)
+        for regression in regressions:
+            print("regression: %s" % regression, file=sys.stderr)
+        return 1 if regressions else 0
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
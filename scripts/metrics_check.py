@@ -0,0 +1,211 @@
+r"""
+Checks /metrics (`src/metrics.cpp`) against what a client sees, on the host
+build or a device: requests are sent from several connections at once, then
+the difference of two scrapes must count each of them once, with the bytes
+the client received, and a latency histogram no slower than the client's.
+
+    NATIVE_LOG_LEVEL=I .pio/build/native/program
+    python scripts/metrics_check.py --requests 200 --connections 4
+
+The server times a request from its dispatch to the return of its handler,
+the client from its send to its last byte, so at every bucket bound the
+server must have counted at least the requests the client saw complete
+under it. The quantiles of both are printed, the server ones interpolated
+as Prometheus' histogram_quantile() does.
+
+The cost of an update and the accuracy of the quantiles on known data are
+measured by the host build alone:
+
+    METRICS_BENCH=1000000 .pio/build/native/program
+"""
+
+import argparse
+import http.client
+import re
+import socket
+import statistics
+import sys
+import threading
+import time
+from urllib.parse import urlsplit
+
+PATHS = [
+    "/status.json",
+    "/dhtSensor.json",
+    "/index.html",
+    "/rollup.json?res=1m",
+    "/history?from=0&to=0",
+]
+
+SAMPLE = re.compile(r'^([a-z_]+)(?:\{(.*)\})? (\S+)$')
+LABEL = re.compile(r'(\w+)="([^"]*)"')
+
+
+def scrape(host, port):
+    """Returns {(name, labels): value} of /metrics, labels sorted."""
+    connection = http.client.HTTPConnection(host, port, timeout=60)
+    connection.request("GET", "/metrics")
+    response = connection.getresponse()
+    body = response.read()
+    connection.close()
+    if response.status != 200:
+        raise http.client.HTTPException("/metrics: status %d"
+                                        % response.status)
+    samples = {}
+    for line in body.decode().splitlines():
+        match = SAMPLE.match(line)
+        if match:
+            labels = tuple(sorted(LABEL.findall(match.group(2) or "")))
+            samples[(match.group(1), labels)] = float(match.group(3))
+    return samples
+
+
+def fetch(host, port, path):
+    """One request on its own connection, half closed once sent so the
+    server closes it after the response: every byte sent is received.
+    Returns the status, the raw response and the seconds until its end."""
+    with socket.create_connection((host, port), timeout=60) as sock:
+        start = time.perf_counter()
+        sock.sendall(("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n"
+                      % (path, host)).encode())
+        sock.shutdown(socket.SHUT_WR)
+        chunks = []
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            chunks.append(chunk)
+        elapsed = time.perf_counter() - start
+    response = b"".join(chunks)
+    status = int(response.split(b" ", 2)[1]) if response else 0
+    return status, response, elapsed
+
+
+def histogram(samples, uri):
+    """Cumulative [(le, count)] of a URI, +Inf last."""
+    buckets = []
+    for (name, labels), value in samples.items():
+        labels = dict(labels)
+        if (name == "iot_http_request_duration_seconds_bucket"
+                and labels["uri"] == uri and labels["method"] == "GET"):
+            buckets.append((float(labels["le"]), value))
+    return sorted(buckets)
+
+
+def quantile(buckets, q):
+    """histogram_quantile() of cumulative buckets, in seconds."""
+    total = buckets[-1][1]
+    if not total:
+        return 0.0
+    rank = q * total
+    lower, below = 0.0, 0.0
+    for le, count in buckets:
+        if count >= rank and count > below:
+            if le == float("inf"):
+                return lower
+            return lower + (le - lower) * (rank - below) / (count - below)
+        lower, below = le, count
+    return lower
+
+
+def value(samples, name, uri):
+    return samples.get((name, (("method", "GET"), ("uri", uri))), 0.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--requests", type=int, default=100,
+                        help="requests per path")
+    parser.add_argument("--connections", type=int, default=4,
+                        help="requests in flight at once")
+    args = parser.parse_args()
+
+    # 1. Requests from several threads, so the counters are updated from
+    # the httpd task and the workers at once.
+    results = {path: [] for path in PATHS}
+    lock = threading.Lock()
+    jobs = [path for path in PATHS for _ in range(args.requests)]
+
+    def client():
+        while True:
+            with lock:
+                if not jobs:
+                    return
+                path = jobs.pop()
+            try:
+                status, response, elapsed = fetch(args.host, args.port, path)
+            except OSError:
+                # Purged unserved past the sockets of the server, again.
+                with lock:
+                    jobs.append(path)
+                continue
+            with lock:
+                results[path].append((status, len(response), elapsed))
+
+    before = scrape(args.host, args.port)
+    threads = [threading.Thread(target=client)
+               for _ in range(args.connections)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    start = time.perf_counter()
+    after = scrape(args.host, args.port)
+    scrape_ms = 1000 * (time.perf_counter() - start)
+
+    # 2. Each path against the difference of the scrapes.
+    failed = False
+    print("%-22s %5s %5s %10s %10s %9s %9s %9s %9s"
+          % ("uri", "sent", "count", "bytes", "received", "p50 ms",
+             "hist p50", "p99 ms", "hist p99"))
+    for path in PATHS:
+        uri = urlsplit(path).path
+        answers = results[path]
+        latencies = sorted(elapsed for _, _, elapsed in answers)
+        received = sum(size for _, size, _ in answers)
+        refused = sum(1 for status, _, _ in answers if status == 503)
+
+        count = (value(after, "iot_http_request_duration_seconds_count", uri)
+                 - value(before, "iot_http_request_duration_seconds_count",
+                         uri))
+        sent = (value(after, "iot_http_response_bytes_total", uri)
+                - value(before, "iot_http_response_bytes_total", uri))
+        errors = (value(after, "iot_http_request_errors_total", uri)
+                  - value(before, "iot_http_request_errors_total", uri))
+        buckets = [(le, count_after - count_before)
+                   for (le, count_after), (_, count_before)
+                   in zip(histogram(after, uri), histogram(before, uri))]
+
+        print("%-22s %5d %5d %10d %10d %9.2f %9.2f %9.2f %9.2f%s"
+              % (uri, len(answers), count, sent, received,
+                 1000 * statistics.median(latencies),
+                 1000 * quantile(buckets, 0.5),
+                 1000 * latencies[int(0.99 * (len(latencies) - 1))],
+                 1000 * quantile(buckets, 0.99),
+                 " (%d refused)" % refused if refused else ""))
+
+        if count != len(answers) or sent != received or errors:
+            print("%s: counted %d requests, %d bytes, %d errors"
+                  % (uri, count, sent, errors))
+            failed = True
+        for le, server in buckets:
+            client_count = sum(1 for elapsed in latencies if elapsed <= le)
+            if server < client_count:
+                print("%s: %d requests under %g s, the client saw %d"
+                      % (uri, server, le, client_count))
+                failed = True
+
+    size = len(fetch(args.host, args.port, "/metrics")[1])
+    print("scrape: %.1f ms, %d bytes" % (scrape_ms, size))
+
+    if failed:
+        return 1
+    print("/metrics counts every request and byte, its histograms bound "
+          "the client latencies")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
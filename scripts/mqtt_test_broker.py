@@ -0,0 +1,192 @@
+r"""
+Minimal MQTT 3.1.1 broker recording the telemetry of
+`src/mqtt_publisher.cpp`, to test the publisher on the host build without
+a real broker, and to measure how fast a backlog drains.
+Batches are JSON, or packed CBOR with `MQTT_PUBLISHER_CBOR`, which needs
+the cbor2 package.
+
+It accepts any client, acks QoS 1 publishes after `--ack-delay` ms (the
+round trip of a real network), answers pings and drops nothing. Every
+message is decoded as a batch of samples and checked: duplicated samples
+are counted, they are expected around reconnects. `--cut-every` closes the
+connection every n messages to exercise the offline queue.
+
+    python scripts/mqtt_test_broker.py --ack-delay 20 --device 127.0.0.1:8000
+    NATIVE_MQTT_URI=mqtt://127.0.0.1:1883 MQTT_PUBLISHER_BACKLOG=86400 \
+        NATIVE_LOG_LEVEL=I .pio/build/native/program
+
+`--device` posts station credentials to the web server of the host build,
+whose station then gets an IP and starts the publisher. The rates are
+printed every `--interval` seconds and at the end.
+"""
+
+import argparse
+import asyncio
+import http.client
+import json
+import sys
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+PINGREQ, PINGRESP, DISCONNECT = 12, 13, 14
+
+
+class Recorder:
+    """Messages and samples received, overall and since the last report."""
+
+    def __init__(self):
+        self.start = None
+        self.messages = 0
+        self.samples = 0
+        self.bytes = 0
+        self.duplicates = 0
+        self.invalid = 0
+        self.times = set()
+        self.window = (0, 0, 0)
+        self.window_start = time.monotonic()
+
+    def record(self, payload):
+        if self.start is None:
+            self.start = time.monotonic()
+        self.messages += 1
+        self.bytes += len(payload)
+        try:
+            if payload[:1] == b"{":
+                times = [sample["time"]
+                         for sample in json.loads(payload)["samples"]]
+            else:
+                import cbor2
+                # [[[time, temp, humidity], ...]]
+                times = [sample[0] for sample in cbor2.loads(payload)[0]]
+        except (ValueError, KeyError, TypeError, IndexError):
+            self.invalid += 1
+            return
+        for time_ms in times:
+            if time_ms in self.times:
+                self.duplicates += 1
+            else:
+                self.times.add(time_ms)
+                self.samples += 1
+
+    def report(self, final=False):
+        now = time.monotonic()
+        messages, samples, size = self.window
+        elapsed = max(1e-9, now - self.window_start)
+        if final:
+            elapsed = max(1e-9, now - (self.start or now))
+            messages, samples, size = 0, 0, 0
+        print("%s%d msg/s, %d samples/s, %.1f kB/s | total %d messages, "
+              "%d samples, %d duplicates, %d invalid, %.1f B/sample"
+              % ("final: " if final else "",
+                 (self.messages - messages) / elapsed,
+                 (self.samples - samples) / elapsed,
+                 (self.bytes - size) / elapsed / 1e3,
+                 self.messages, self.samples, self.duplicates, self.invalid,
+                 self.bytes / max(1, self.samples)), flush=True)
+        self.window = (self.messages, self.samples, self.bytes)
+        self.window_start = now
+
+
+async def read_packet(reader):
+    """Returns the type, flags and body of the next packet."""
+    first = (await reader.readexactly(1))[0]
+    length, shift = 0, 0
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return first >> 4, first & 0x0F, await reader.readexactly(length)
+
+
+async def session(reader, writer, args, recorder):
+    """One client connection, until it closes or is cut."""
+    peer = writer.get_extra_info("peername")
+    received = 0
+    try:
+        kind, _, body = await read_packet(reader)
+        if kind != CONNECT:
+            return
+        id_len = int.from_bytes(body[10:12], "big")
+        print("%s connected as %s" % (peer, body[12:12 + id_len].decode()),
+              flush=True)
+        writer.write(bytes([CONNACK << 4, 2, 0, 0]))
+
+        while True:
+            kind, flags, body = await read_packet(reader)
+            if kind == PUBLISH:
+                qos = (flags >> 1) & 3
+                topic_len = int.from_bytes(body[:2], "big")
+                start = 2 + topic_len + (2 if qos else 0)
+                recorder.record(body[start:])
+                if qos:
+                    msg_id = body[2 + topic_len:4 + topic_len]
+                    asyncio.get_running_loop().call_later(
+                        args.ack_delay / 1000, writer.write,
+                        bytes([PUBACK << 4, 2]) + msg_id)
+                received += 1
+                if args.cut_every and received % args.cut_every == 0:
+                    print("%s cut after %d messages" % (peer, received),
+                          flush=True)
+                    return
+            elif kind == PINGREQ:
+                writer.write(bytes([PINGRESP << 4, 0]))
+            elif kind == DISCONNECT:
+                return
+    except (asyncio.IncompleteReadError, asyncio.CancelledError,
+            ConnectionError):
+        pass
+    finally:
+        writer.close()
+        print("%s disconnected" % (peer,), flush=True)
+
+
+def connect_device(device):
+    """Gives the station of the host build credentials, it gets an IP."""
+    host, port = device.split(":")
+    connection = http.client.HTTPConnection(host, int(port), timeout=10)
+    connection.request("POST", "/wifiConnect.json", body=b"",
+                       headers={"my-connect-ssid": "bench",
+                                "my-connect-pwd": "benchbench"})
+    connection.getresponse().read()
+    connection.close()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--ack-delay", type=float, default=0.0,
+                        help="ms before a PUBACK")
+    parser.add_argument("--cut-every", type=int, default=0,
+                        help="close the connection every n messages")
+    parser.add_argument("--interval", type=float, default=1.0,
+                        help="seconds between reports")
+    parser.add_argument("--duration", type=float, default=0.0,
+                        help="seconds to run, 0 for ever")
+    parser.add_argument("--device", help="host:port of the host build")
+    args = parser.parse_args()
+
+    recorder = Recorder()
+    server = await asyncio.start_server(
+        lambda r, w: session(r, w, args, recorder), "0.0.0.0", args.port)
+    if args.device:
+        await asyncio.get_running_loop().run_in_executor(
+            None, connect_device, args.device)
+
+    deadline = time.monotonic() + args.duration
+    try:
+        while not args.duration or time.monotonic() < deadline:
+            await asyncio.sleep(args.interval)
+            recorder.report()
+    finally:
+        server.close()
+        recorder.report(final=True)
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(asyncio.run(main()))
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,148 @@
+r"""
+Local HTTP server for the pull-mode OTA client (`src/ota_client.cpp`) which
+drops connections on purpose.
+
+It serves the given image with `ETag`, `Range` and `If-Range` support, like
+a CDN would, and cuts responses partway through:
+
+    python scripts/ota_test_server.py .pio/build/esp32dev/firmware.bin \
+        --port 8080 --drop-probability 0.5 --max-chunk 200000
+
+Then ask the device to pull it, the digest is printed at start-up:
+
+    curl -X POST -H "X-OTA-URL: http://<host>:8080/firmware.bin" \
+        -H "X-OTA-SHA256: <digest>" http://192.168.0.1:8000/OTApull
+
+The host build (`pio run -e native`) pulls as well, through the
+esp_http_client shim of native/: post to http://127.0.0.1:8000/OTApull with
+http://127.0.0.1:8080/firmware.bin. Any image starting with 0xE9 will do.
+
+Every request is logged with the range asked for and where it was cut, so
+the resume offsets of the device can be followed. `--refuse-ranges` makes
+it answer 200 to every request and `--change-etag` serves a new ETag after
+the first drop, both force the device to start over.
+"""
+
+import argparse
+import gzip
+import hashlib
+import http.server
+import os
+import random
+import re
+import sys
+
+RANGE_PATTERN = re.compile(r"^bytes=(\d+)-(\d*)$")
+
+
+class OtaTestHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_HEAD(self):
+        self.serve(send_body=False)
+
+    def do_GET(self):
+        self.serve(send_body=True)
+
+    def serve(self, send_body):
+        server = self.server
+        image = server.image
+        size = len(image)
+
+        # 1. Range, only honoured while the validator still matches.
+        first, last, partial = 0, size - 1, False
+        match = RANGE_PATTERN.match(self.headers.get("Range", ""))
+        if_range = self.headers.get("If-Range")
+        if (match and not server.refuse_ranges
+                and (if_range is None or if_range == server.etag)):
+            first = int(match.group(1))
+            if match.group(2):
+                last = min(int(match.group(2)), size - 1)
+            partial = True
+
+            if first >= size or first > last:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % size)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                self.log_message("416 for %s", match.group(0))
+                return
+
+        self.send_response(206 if partial else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("ETag", server.etag)
+        self.send_header("Content-Length", str(last - first + 1))
+        if partial:
+            self.send_header("Content-Range",
+                             "bytes %d-%d/%d" % (first, last, size))
+        self.end_headers()
+
+        if not send_body:
+            return
+
+        # 2. Body, maybe cut short.
+        end = last + 1
+        if random.random() < server.drop_probability:
+            end = min(end, first + random.randint(0, server.max_chunk))
+
+        self.wfile.write(image[first:end])
+        self.wfile.flush()
+
+        if end <= last:
+            self.log_message("%d, bytes %d-%d dropped at %d",
+                             206 if partial else 200, first, last, end)
+            if server.change_etag:
+                server.etag = '"%s"' % os.urandom(8).hex()
+            self.close_connection = True
+            self.connection.shutdown(2)
+        else:
+            self.log_message("%d, bytes %d-%d complete",
+                             206 if partial else 200, first, last)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("image", help="firmware.bin or firmware.bin.gz")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop-probability", type=float, default=0.5,
+                        help="chance that a response is cut")
+    parser.add_argument("--max-chunk", type=int, default=200000,
+                        help="most bytes sent before a cut")
+    parser.add_argument("--refuse-ranges", action="store_true",
+                        help="ignore Range, always send the whole image")
+    parser.add_argument("--change-etag", action="store_true",
+                        help="new ETag after every drop")
+    parser.add_argument("--seed", type=int, default=None)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    server = http.server.ThreadingHTTPServer(("", args.port), OtaTestHandler)
+    server.image = image
+    server.etag = '"%s"' % hashlib.sha256(image).hexdigest()[:16]
+    server.drop_probability = args.drop_probability
+    server.max_chunk = args.max_chunk
+    server.refuse_ranges = args.refuse_ranges
+    server.change_etag = args.change_etag
+
+    decoded = image
+    if image[:2] == b"\x1f\x8b":
+        decoded = gzip.decompress(image)
+
+    print("Serving %s (%d bytes) on port %d" % (args.image, len(image),
+                                                args.port))
+    print("X-OTA-SHA256: %s" % hashlib.sha256(decoded).hexdigest())
+    sys.stdout.flush()
+
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+r"""
+Throughput of an OTA write through the buffer pool of `src/ota_writer.cpp`
+against the receiver writing each buffer itself, on the host build.
+
+    python scripts/ota_writer_bench.py --program .pio/build/native/program
+
+For each receive rate, the host build runs OTA_WRITER_BENCH: the same image
+is received at that rate into the flash shim, first written synchronously
+(esp_ota_write() after each buffer, erased up front by esp_ota_begin()),
+then through the pool. The shim sleeps NATIVE_FLASH_WRITE_US to program and
+NATIVE_FLASH_ERASE_US to erase each 4 kB sector, the defaults are those of
+the ESP32 flash, about 400 kB/s to program and 130 kB/s to erase. Rate 0
+receives at memory speed, the flash alone then bounds both.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+RATES = [0, 50, 100, 200, 400]
+RESULT = re.compile(r"OTA write of (\d+) kB received at (\d+) kB/s: "
+                    r"synchronous ([\d.]+) kB/s, pool of (\d+) ([\d.]+) kB/s, "
+                    r"receiver stalled (\d+) ms")
+
+
+def run(args, rate):
+    """One OTA_WRITER_BENCH run, returns its result line as a dict."""
+    env = dict(os.environ,
+               OTA_WRITER_BENCH="%d,%d" % (args.size, rate),
+               NATIVE_FLASH_WRITE_US=str(args.write_us),
+               NATIVE_FLASH_ERASE_US=str(args.erase_us),
+               NATIVE_LOG_LEVEL="I")
+    output = subprocess.run([args.program], env=env, cwd=args.flash_dir,
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            timeout=600).stdout.decode(errors="replace")
+    match = RESULT.search(output)
+    if match is None:
+        raise RuntimeError("no result at %d kB/s:\n%s" % (rate, output))
+    return {"rate_kbps": rate,
+            "sync_kbps": float(match.group(3)),
+            "buffers": int(match.group(4)),
+            "pool_kbps": float(match.group(5)),
+            "stall_ms": int(match.group(6))}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--program", required=True, help="host build")
+    parser.add_argument("--size", type=int, default=512,
+                        help="image size in kB")
+    parser.add_argument("--rate", type=int, action="append", default=[],
+                        help="receive rate in kB/s, the defaults if none")
+    parser.add_argument("--write-us", type=int, default=10000,
+                        help="time to program a sector")
+    parser.add_argument("--erase-us", type=int, default=30000,
+                        help="time to erase a sector")
+    parser.add_argument("--flash-dir", default=".",
+                        help="working directory of the host build")
+    parser.add_argument("--save", help="write the results as JSON")
+    args = parser.parse_args()
+
+    results = [run(args, rate) for rate in args.rate or RATES]
+
+    print("%10s %10s %10s %8s %10s" % ("recv kB/s", "sync kB/s", "pool kB/s",
+                                       "speedup", "stall ms"))
+    for result in results:
+        print("%10s %10.1f %10.1f %7.2fx %10d"
+              % (result["rate_kbps"] or "memory", result["sync_kbps"],
+                 result["pool_kbps"],
+                 result["pool_kbps"] / max(result["sync_kbps"], 0.1),
+                 result["stall_ms"]))
+
+    if args.save:
+        with open(args.save, "w") as output:
+            json.dump(results, output, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,221 @@
+r"""
+Compares task placements (`src/task_placement.cpp`) on a device or the host
+build: for each one, the wake-up latency of the HTTP and WiFi application
+tasks and the latency of small requests, both while other clients keep the
+WiFi link busy with downloads.
+
+Against a device, each placement is saved with POST /placement and applied
+by the restart it asks for:
+
+    python scripts/placement_bench.py --host 192.168.0.1
+
+The host build is started once per placement instead, with the placement in
+TASK_PLACEMENT. Its tasks aren't pinned, the numbers only check the tool:
+
+    python scripts/placement_bench.py --program .pio/build/native/program
+
+A placement is `name=query`, the cores of the tasks it moves, e.g.
+`--placement "httpd0=http_server=0&http_monitor=0"`. The defaults compare
+the build's placement, application on core 1, with everything on core 0.
+"""
+
+import argparse
+import http.client
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+
+PLACEMENTS = [
+    ("split", "wifi_app=1&http_server=1&http_monitor=1&http_worker=1"
+              "&history_store=1&mqtt_publisher=1&ota_writer=0&ota_client=1"
+              "&dht_sensor=1"),
+    ("core0", "wifi_app=0&http_server=0&http_monitor=0&http_worker=0"
+              "&history_store=0&mqtt_publisher=0&ota_writer=0&ota_client=0"
+              "&dht_sensor=1"),
+]
+TASKS = ["http_server", "http_monitor", "wifi_app"]
+LOAD_ASSET = "/jquery-3.3.1.min.js"
+PROBE_URI = "/status.json"
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile of sorted `values`."""
+    if not values:
+        return 0.0
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+class Load(threading.Thread):
+    """Downloads an asset in a loop on one keep-alive connection."""
+
+    def __init__(self, host, port):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.bytes = 0
+        self.running = True
+
+    def run(self):
+        conn = None
+        while self.running:
+            try:
+                if conn is None:
+                    conn = http.client.HTTPConnection(self.host, self.port,
+                                                      timeout=10)
+                conn.request("GET", LOAD_ASSET,
+                             headers={"Accept-Encoding": "identity"})
+                self.bytes += len(conn.getresponse().read())
+            except (OSError, http.client.HTTPException):
+                conn = None
+                time.sleep(0.1)
+
+
+def request(host, port, method, uri, timeout=30):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request(method, uri)
+        response = conn.getresponse()
+        return response.status, response.read()
+    finally:
+        conn.close()
+
+
+def wait_up(host, port, timeout):
+    """Polls /placement until the server answers, returns its cores."""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            status, body = request(host, port, "GET", "/placement", 2)
+            if status == 200:
+                return json.loads(body)
+        except (OSError, http.client.HTTPException):
+            pass
+        time.sleep(0.5)
+    raise RuntimeError("no answer from %s:%d" % (host, port))
+
+
+def apply(args, query):
+    """Puts the placement in force, returns the host build process if any."""
+    if args.program:
+        env = dict(os.environ, TASK_PLACEMENT=query)
+        env.setdefault("NATIVE_LOG_LEVEL", "W")
+        process = subprocess.Popen([args.program], env=env,
+                                   stdout=subprocess.DEVNULL,
+                                   stderr=subprocess.DEVNULL)
+        wait_up(args.host, args.port, 10)
+        return process
+
+    status, body = request(args.host, args.port, "POST",
+                           "/placement?%s&restart=1" % query)
+    if status != 200:
+        raise RuntimeError("placement refused: %s" % body.decode())
+    time.sleep(3)
+    wait_up(args.host, args.port, 60)
+    return None
+
+
+def measure(args):
+    """Wake-ups and request latencies while the load runs."""
+    loads = [Load(args.host, args.port) for _ in range(args.load)]
+    for load in loads:
+        load.start()
+    time.sleep(1)
+    start = time.monotonic()
+
+    # 1. The queue hand-over to each task, timed on the target.
+    wakeups = {}
+    for task in TASKS:
+        status, body = request(args.host, args.port, "GET",
+                               "/placement/wakeup?task=%s&count=%d"
+                               % (task, args.count))
+        if status == 200:
+            wakeups[task] = json.loads(body)
+
+    # 2. Small requests on their own connection, timed by the client.
+    latencies = []
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    for _ in range(args.requests):
+        sent = time.perf_counter()
+        try:
+            conn.request("GET", PROBE_URI)
+            conn.getresponse().read()
+        except (OSError, http.client.HTTPException):
+            conn = http.client.HTTPConnection(args.host, args.port,
+                                              timeout=10)
+            continue
+        latencies.append(1000 * (time.perf_counter() - sent))
+    conn.close()
+
+    elapsed = time.monotonic() - start
+    for load in loads:
+        load.running = False
+    for load in loads:
+        load.join(15)
+    latencies.sort()
+    return {
+        "wakeup": wakeups,
+        "request_ms": {"count": len(latencies),
+                       "p50": percentile(latencies, 0.5),
+                       "p99": percentile(latencies, 0.99),
+                       "max": latencies[-1] if latencies else 0.0},
+        "load_kbps": sum(load.bytes for load in loads) / elapsed / 1024,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--program",
+                        help="host build to start once per placement")
+    parser.add_argument("--placement", action="append", default=[],
+                        help="name=query, the defaults if none given")
+    parser.add_argument("--count", type=int, default=200,
+                        help="hand-overs timed per task")
+    parser.add_argument("--requests", type=int, default=200)
+    parser.add_argument("--load", type=int, default=3,
+                        help="connections downloading meanwhile")
+    parser.add_argument("--save", help="write the results as JSON")
+    args = parser.parse_args()
+
+    placements = [tuple(p.split("=", 1)) for p in args.placement]
+    results = {}
+    for name, query in placements or PLACEMENTS:
+        process = apply(args, query)
+        try:
+            cores = wait_up(args.host, args.port, 10)
+            results[name] = dict(measure(args), cores=cores)
+        finally:
+            if process is not None:
+                process.terminate()
+                process.wait()
+                time.sleep(0.5)
+
+    # One line per placement and task, then the requests.
+    print("%-10s %-13s %4s %8s %8s %8s" % ("placement", "task", "core",
+                                          "p50 us", "p99 us", "max us"))
+    for name, result in results.items():
+        for task, wakeup in result["wakeup"].items():
+            print("%-10s %-13s %4d %8d %8d %8d"
+                  % (name, task, wakeup["core"], wakeup["p50_us"],
+                     wakeup["p99_us"], wakeup["max_us"]))
+    print("%-10s %8s %8s %8s %10s" % ("placement", "p50 ms", "p99 ms",
+                                      "max ms", "load KB/s"))
+    for name, result in results.items():
+        req = result["request_ms"]
+        print("%-10s %8.2f %8.2f %8.2f %10.0f" % (name, req["p50"],
+                                                  req["p99"], req["max"],
+                                                  result["load_kbps"]))
+
+    if args.save:
+        with open(args.save, "w") as output:
+            json.dump(results, output, indent=2)
+    return 0 if all(r["wakeup"] and r["request_ms"]["count"]
+                    for r in results.values()) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
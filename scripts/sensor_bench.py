@@ -0,0 +1,130 @@
+r"""
+Sampling jitter and read latency of the DHT22 sensor task
+(`src/dht_sensor.cpp`), against the host build or a device.
+
+With the host build the simulated sensor is read, `DHT22_SIM_ERRORS=<n>`
+corrupts every n-th frame:
+
+    DHT22_SIM_ERRORS=10 NATIVE_LOG_LEVEL=W .pio/build/native/program
+    python scripts/sensor_bench.py --readers 4 --duration 60
+
+Readers keep fetching /dhtSensor.json on their own connections meanwhile,
+the sampler must not notice them. At the end the history of the device is
+fetched and the lateness of each read against its schedule, the interval
+between reads, the capture time and the reader latency are printed as
+p50/p99/max.
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+
+SENSOR_PATH = "/dhtSensor.json"
+SENSOR_PERIOD_MS = 2000
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile of sorted `values`."""
+    if not values:
+        return 0.0
+    rank = max(0, min(len(values) - 1,
+                      int(round(fraction * len(values) + 0.5)) - 1))
+    return values[rank]
+
+
+def fetch(connection, path):
+    connection.request("GET", path)
+    response = connection.getresponse()
+    payload = response.read()
+    if response.status != 200:
+        raise http.client.HTTPException("status %d" % response.status)
+    return json.loads(payload)
+
+
+class Reader(threading.Thread):
+    """Fetches the sensor state in a loop until the deadline."""
+
+    def __init__(self, args, deadline):
+        super().__init__(daemon=True)
+        self.args = args
+        self.deadline = deadline
+        self.latencies = []
+        self.errors = 0
+
+    def run(self):
+        connection = None
+        while time.perf_counter() < self.deadline:
+            if connection is None:
+                connection = http.client.HTTPConnection(
+                    self.args.host, self.args.port, timeout=10)
+            start = time.perf_counter()
+            try:
+                fetch(connection, SENSOR_PATH)
+            except (OSError, ValueError, http.client.HTTPException):
+                self.errors += 1
+                connection.close()
+                connection = None
+                continue
+            self.latencies.append(time.perf_counter() - start)
+        if connection is not None:
+            connection.close()
+
+
+def print_row(name, unit, values):
+    values = sorted(values)
+    print("%-24s %6d %10.2f %10.2f %10.2f  %s"
+          % (name, len(values), percentile(values, 0.50),
+             percentile(values, 0.99), values[-1] if values else 0.0, unit))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--duration", type=float, default=60.0,
+                        help="seconds of reader load")
+    parser.add_argument("--readers", type=int, default=4,
+                        help="connections fetching the sensor state")
+    args = parser.parse_args()
+
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    before = fetch(connection, SENSOR_PATH)
+
+    deadline = time.perf_counter() + args.duration
+    readers = [Reader(args, deadline) for _ in range(args.readers)]
+    for reader in readers:
+        reader.start()
+    for reader in readers:
+        reader.join()
+
+    after = fetch(connection, SENSOR_PATH)
+    connection.close()
+
+    # Samples taken during the run, those already there are left out.
+    known = set(sample["time"] for sample in before["history"])
+    samples = [s for s in after["history"] if s["time"] not in known]
+
+    # A failed read leaves a gap of whole periods, not jitter.
+    intervals = [b["time"] - a["time"]
+                 for a, b in zip(samples, samples[1:])]
+    jitter = [abs(i - SENSOR_PERIOD_MS * max(1, round(i / SENSOR_PERIOD_MS)))
+              for i in intervals]
+    latencies = [1000 * l for r in readers for l in r.latencies]
+
+    print("%-24s %6s %10s %10s %10s" % ("", "count", "p50", "p99", "max"))
+    print_row("lateness", "us", [s["lateness_us"] for s in samples])
+    print_row("interval - period", "ms", jitter)
+    print_row("capture", "us", [s["capture_us"] for s in samples])
+    print_row("reader latency", "ms", latencies)
+    print("reads %d, read errors %d, reader errors %d"
+          % (after["reads"] - before["reads"],
+             after["errors"] - before["errors"],
+             sum(r.errors for r in readers)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
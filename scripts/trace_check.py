@@ -0,0 +1,152 @@
+r"""
+Checks /trace (`src/trace.cpp`) on the host build or a device: the output
+must load as Chrome trace_event JSON, spans must nest on every task, and
+two requests sent `--gap` seconds apart must be as far apart in the trace.
+
+    NATIVE_LOG_LEVEL=I .pio/build/native/program
+    python scripts/trace_check.py --gap 10
+
+The events are timestamped with the 32-bit cycle counter, which wraps every
+4.3 s on the host and 17.9 s at 240 MHz, so a gap longer than that checks
+the wraps are told apart. The cost of a record on the host build:
+
+    TRACE_BENCH=1000000 .pio/build/native/program
+
+The device logs its own at boot, `record_cycles` of the output.
+"""
+
+import argparse
+import collections
+import http.client
+import json
+import sys
+import time
+
+MARKER = "/status.json"
+PAGES = ["/index.html", "/dhtSensor.json", "/rollup.json?res=1m"]
+
+
+def get(host, port, path):
+    """Returns the status and body of one request on its own connection."""
+    connection = http.client.HTTPConnection(host, port, timeout=60)
+    connection.request("GET", path)
+    response = connection.getresponse()
+    body = response.read()
+    connection.close()
+    return response.status, body
+
+
+def spans(events):
+    """Pairs the B and E events of each task. Returns the spans as
+    (name, begin, end) and the errors found. An E without a B (overwritten)
+    and a B without an E (still open) are left out, not errors."""
+    stacks = collections.defaultdict(list)
+    found = []
+    errors = []
+    for event in sorted((e for e in events if e["ph"] in "BE"),
+                        key=lambda e: e["ts"]):
+        stack = stacks[event["tid"]]
+        if event["ph"] == "B":
+            stack.append(event)
+        elif stack:
+            begin = stack.pop()
+            if begin["name"] != event["name"]:
+                errors.append("tid %d: %s ended inside %s"
+                              % (event["tid"], begin["name"], event["name"]))
+            found.append((begin["name"], begin["ts"], event["ts"]))
+    return found, errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--gap", type=float, default=10.0,
+                        help="seconds between the two marker requests")
+    parser.add_argument("--tolerance", type=float, default=0.05,
+                        help="seconds the trace may be off the client")
+    parser.add_argument("--output", help="also saves the trace there")
+    args = parser.parse_args()
+
+    # 1. Two marker requests around some load, timed by the client.
+    get(args.host, args.port, MARKER)
+    first = time.perf_counter()
+    for path in PAGES:
+        get(args.host, args.port, path)
+    time.sleep(max(0.0, args.gap - (time.perf_counter() - first)))
+    second = time.perf_counter()
+    get(args.host, args.port, MARKER)
+    client_gap = second - first
+
+    start = time.perf_counter()
+    status, body = get(args.host, args.port, "/trace")
+    fetch_ms = 1000 * (time.perf_counter() - start)
+    if status != 200:
+        print("/trace: status %d" % status)
+        return 1
+    if args.output:
+        with open(args.output, "wb") as output:
+            output.write(body)
+
+    # 2. The format chrome://tracing and Perfetto load.
+    trace = json.loads(body)
+    events = trace["traceEvents"]
+    failed = False
+    for event in events:
+        if (event.get("ph") not in ("B", "E", "i", "M")
+                or not isinstance(event.get("tid"), int)
+                or (event["ph"] != "M"
+                    and not isinstance(event.get("ts"), (int, float)))):
+            print("malformed event %r" % event)
+            failed = True
+    names = {event["tid"]: event["args"]["name"]
+             for event in events if event["ph"] == "M"}
+
+    # 3. Spans nest and the marker requests are where the client saw them.
+    found, errors = spans([e for e in events if e["ph"] != "M"])
+    for error in errors[:10]:
+        print(error)
+    failed |= bool(errors)
+
+    markers = [begin for name, begin, _ in found if name == MARKER]
+    if len(markers) < 2:
+        print("%d %s spans in the trace, %d events per core are kept"
+              % (len(markers), MARKER, len(events)))
+        failed = True
+    else:
+        trace_gap = (markers[-1] - markers[-2]) / 1e6
+        print("%s apart: client %.3f s, trace %.3f s"
+              % (MARKER, client_gap, trace_gap))
+        if abs(trace_gap - client_gap) > args.tolerance:
+            failed = True
+
+    # 4. Where the time went.
+    durations = collections.defaultdict(list)
+    for name, begin, end in found:
+        durations[name].append(end - begin)
+    tasks = collections.Counter(names.get(e["tid"], "?") for e in events
+                                if e["ph"] != "M")
+    print("%-28s %6s %10s %10s" % ("span", "count", "mean us", "max us"))
+    for name, values in sorted(durations.items()):
+        print("%-28s %6d %10.1f %10.1f" % (name, len(values),
+                                           sum(values) / len(values),
+                                           max(values)))
+    print("events per task: %s" % ", ".join("%s %d" % item
+                                            for item in tasks.most_common()))
+    other = trace["otherData"]
+    print("%d events, %d overwritten, %d cycles per record at %d MHz "
+          "(%.2f us), fetched in %.1f ms, %d bytes"
+          % (len(events) - len(names), other["overwritten"],
+             other["record_cycles"], other["cpu_mhz"],
+             other["record_cycles"] / other["cpu_mhz"], fetch_ms,
+             len(body)))
+
+    if failed:
+        return 1
+    print("/trace loads as trace_event JSON, its spans nest and its clock "
+          "follows the client's")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,414 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tuple>
+#include <utility>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#include "json_writer.hpp"
+
+/**
+ * @brief   CBOR (RFC 8949) writer for the schemas of json_writer.hpp.
+ * @note    The schema that gives a JSON document gives its CBOR twin with
+ *          the same values:
+ *
+ *              uint8_t cbor[cbor_schema<sensor_json_t>::max_size];
+ *              size_t len = cbor_write<sensor_json_t>(cbor, 21.5f, 40.0f);
+ *
+ *          Objects become maps with text keys, arrays of known count
+ *          definite arrays and json_stream an indefinite array. Integers
+ *          and heads take their shortest form, json_fixed values are the
+ *          rounded value as a half float when that is exact, a single
+ *          float otherwise, and null when JSON has null.
+ *
+ *          The packed form writes every object as an array of its values
+ *          in schema order, keys are left to the reader who knows the
+ *          schema. A series of samples then costs its values alone.
+ *          json_raw has no CBOR form, a schema holding one doesn't compile.
+ */
+
+#define CBOR_CONTENT_TYPE               "application/cbor"
+
+/**
+ * @brief   Major types, in the top 3 bits of the initial byte.
+ */
+#define CBOR_MAJOR_UINT                 0
+#define CBOR_MAJOR_NINT                 1
+#define CBOR_MAJOR_TEXT                 3
+#define CBOR_MAJOR_ARRAY                4
+#define CBOR_MAJOR_MAP                  5
+
+#define CBOR_FALSE                      0xF4
+#define CBOR_TRUE                       0xF5
+#define CBOR_NULL                       0xF6
+#define CBOR_FLOAT16                    0xF9
+#define CBOR_FLOAT32                    0xFA
+#define CBOR_ARRAY_INDEFINITE           0x9F
+#define CBOR_BREAK                      0xFF
+
+/* Heads ---------------------------------------------------------------------*/
+
+/**
+ * @brief   Size of a head carrying `value`.
+ */
+constexpr size_t cbor_head_size(uint64_t value)
+{
+    return (value < 24) ? 1
+            : (value <= UINT8_MAX) ? 2
+            : (value <= UINT16_MAX) ? 3
+            : (value <= UINT32_MAX) ? 5 : 9;
+}
+
+/**
+ * @brief   Writes the head of a data item, the argument in its shortest
+ *          form.
+ */
+template <typename Sink>
+void cbor_put_head(Sink &sink, uint8_t major, uint64_t value)
+{
+    char head[9];
+    const size_t size = cbor_head_size(value);
+
+    if (size == 1) {
+        head[0] = (char)((major << 5) | value);
+    } else {
+        static const uint8_t infos[] = {0, 24, 25, 0, 26, 0, 0, 0, 27};
+
+        head[0] = (char)((major << 5) | infos[size - 1]);
+        for (size_t i = size - 1; i > 0; i--) {
+            head[i] = (char)(value & 0xFF);
+            value >>= 8;
+        }
+    }
+    sink.put(head, size);
+}
+
+template <typename Sink>
+void cbor_put_text(Sink &sink, const char *text, size_t len)
+{
+    cbor_put_head(sink, CBOR_MAJOR_TEXT, len);
+    sink.put(text, len);
+}
+
+/* Values --------------------------------------------------------------------*/
+
+/**
+ * @brief   CBOR writer of a schema type, specialized below for every
+ *          json_writer.hpp type that has a CBOR form.
+ */
+template <typename Schema>
+struct cbor_schema;
+
+template <typename T>
+struct cbor_schema<json_int<T>> {
+    static constexpr size_t max_size = 1 + sizeof(T);
+
+    template <bool Packed, typename Sink>
+    static void write(Sink &sink, T value)
+    {
+        if (value < 0) {
+            /* -1 - n, without overflow at the minimum. */
+            cbor_put_head(sink, CBOR_MAJOR_NINT,
+                            (uint64_t)(-(value + 1)));
+        } else {
+            cbor_put_head(sink, CBOR_MAJOR_UINT, (uint64_t)value);
+        }
+    }
+};
+
+template <unsigned Decimals>
+struct cbor_schema<json_fixed<Decimals>> {
+    static constexpr size_t max_size = 5;
+
+    template <bool Packed, typename Sink>
+    static void write(Sink &sink, double value)
+    {
+        if (!(fabs(value) < 1e9)) {
+            sink.put((char)CBOR_NULL);
+            return;
+        }
+
+        double scale = 1;
+        for (unsigned i = 0; i < Decimals; i++) {
+            scale *= 10;
+        }
+
+        /* The value JSON prints, as the nearest float. */
+        const float rounded = (float)(llround(value * scale) / scale);
+        uint32_t bits;
+        memcpy(&bits, &rounded, sizeof(bits));
+
+        const uint32_t sign = bits >> 31;
+        const int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127;
+        const uint32_t mantissa = bits & 0x7FFFFF;
+        char out[5];
+
+        if ((bits & 0x7FFFFFFF) == 0
+            || (exponent >= -14 && exponent <= 15
+                && (mantissa & 0x1FFF) == 0)) {
+            /* A normal half float holds it exactly. */
+            const uint16_t half = (bits & 0x7FFFFFFF) == 0
+                                    ? (uint16_t)(sign << 15)
+                                    : (uint16_t)((sign << 15)
+                                                | ((exponent + 15) << 10)
+                                                | (mantissa >> 13));
+            out[0] = (char)CBOR_FLOAT16;
+            out[1] = (char)(half >> 8);
+            out[2] = (char)half;
+            sink.put(out, 3);
+        } else {
+            out[0] = (char)CBOR_FLOAT32;
+            out[1] = (char)(bits >> 24);
+            out[2] = (char)(bits >> 16);
+            out[3] = (char)(bits >> 8);
+            out[4] = (char)bits;
+            sink.put(out, 5);
+        }
+    }
+};
+
+template <>
+struct cbor_schema<json_bool> {
+    static constexpr size_t max_size = 1;
+
+    template <bool Packed, typename Sink>
+    static void write(Sink &sink, bool value)
+    {
+        sink.put((char)(value ? CBOR_TRUE : CBOR_FALSE));
+    }
+};
+
+/**
+ * @brief   Text of at most `MaxLen` bytes, longer ones are cut. Nothing is
+ *          escaped.
+ */
+template <size_t MaxLen>
+struct cbor_schema<json_string<MaxLen>> {
+    static constexpr size_t max_size = cbor_head_size(MaxLen) + MaxLen;
+
+    template <bool Packed, typename Sink>
+    static void write(Sink &sink, const char *value)
+    {
+        cbor_put_text(sink, value, strnlen(value, MaxLen));
+    }
+};
+
+/**
+ * @brief   Dotted text, like JSON.
+ */
+template <>
+struct cbor_schema<json_ipv4> {
+    static constexpr size_t max_size = 1 + 15;
+
+    template <bool Packed, typename Sink>
+    static void write(Sink &sink, uint32_t addr)
+    {
+        char text[json_ipv4::max_size];
+        json_buffer_sink quoted = { text, 0 };
+
+        json_ipv4::write(quoted, addr);
+        cbor_put_text(sink, text + 1, quoted.len - 2);
+    }
+};
+
+/* Structure -----------------------------------------------------------------*/
+
+template <typename Key, typename Value>
+struct cbor_schema<json_field<Key, Value>> {
+    /* The name between the quotes of `"name": `. */
+    static constexpr size_t name_len = sizeof(Key::text) - 5;
+    static constexpr size_t max_size = json_size_sum({
+        cbor_head_size(name_len), name_len, cbor_schema<Value>::max_size
+    });
+
+    template <typename Arg>
+    static bool present(const Arg &value)
+    {
+        (void)value;
+        return true;
+    }
+
+    template <bool Packed, typename Sink, typename Arg>
+    static void write(Sink &sink, const Arg &value)
+    {
+        if (!Packed) {
+            cbor_put_text(sink, Key::text + 1, name_len);
+        }
+        cbor_schema<Value>::template write<Packed>(sink, value);
+    }
+};
+
+/**
+ * @brief   Left out of a map when NULL, null in the packed form so the
+ *          positions hold.
+ */
+template <typename Key, typename Value>
+struct cbor_schema<json_optional_field<Key, Value>> {
+    static constexpr size_t max_size =
+                            cbor_schema<json_field<Key, Value>>::max_size;
+
+    template <typename Arg>
+    static bool present(const Arg &value)
+    {
+        return value != NULL;
+    }
+
+    template <bool Packed, typename Sink, typename Arg>
+    static void write(Sink &sink, const Arg &value)
+    {
+        if (value != NULL) {
+            cbor_schema<json_field<Key, Value>>::template write<Packed>(
+                                                                sink, value);
+        } else if (Packed) {
+            sink.put((char)CBOR_NULL);
+        }
+    }
+};
+
+template <typename... Fields>
+struct cbor_schema<json_object<Fields...>> {
+    static constexpr size_t max_size = json_size_sum({
+        cbor_head_size(sizeof...(Fields)),
+        cbor_schema<Fields>::max_size...
+    });
+
+    template <bool Packed, typename Sink, typename... Args>
+    static void write(Sink &sink, const Args &... values)
+    {
+        static_assert(sizeof...(Args) == sizeof...(Fields),
+                        "one value per field");
+
+        /* A map counts the fields it holds, an array holds them all. */
+        if (Packed) {
+            cbor_put_head(sink, CBOR_MAJOR_ARRAY, sizeof...(Fields));
+        } else {
+            const size_t count = (0 + ... + (size_t)
+                                    cbor_schema<Fields>::present(values));
+            cbor_put_head(sink, CBOR_MAJOR_MAP, count);
+        }
+        (cbor_schema<Fields>::template write<Packed>(sink, values), ...);
+    }
+
+    template <bool Packed, typename Sink, typename... Args>
+    static void write(Sink &sink, const std::tuple<Args...> &values)
+    {
+        std::apply([&sink](const Args &... args) {
+            write<Packed>(sink, args...);
+        }, values);
+    }
+};
+
+template <typename Element, size_t MaxCount>
+struct cbor_schema<json_array<Element, MaxCount>> {
+    static constexpr size_t max_size =
+        (MaxCount == JSON_UNBOUNDED)
+            ? JSON_UNBOUNDED
+            : json_size_add(cbor_head_size(MaxCount),
+                            json_size_mul(cbor_schema<Element>::max_size,
+                                            MaxCount));
+
+    template <bool Packed, typename Sink, typename Get>
+    static void write(Sink &sink, size_t count, Get get)
+    {
+        if (count > MaxCount) {
+            count = MaxCount;
+        }
+
+        cbor_put_head(sink, CBOR_MAJOR_ARRAY, count);
+        for (size_t i = 0; i < count; i++) {
+            cbor_schema<Element>::template write<Packed>(sink, get(i));
+        }
+    }
+
+    template <bool Packed, typename Sink, typename Get>
+    static void write(Sink &sink, const std::pair<size_t, Get> &values)
+    {
+        write<Packed>(sink, values.first, values.second);
+    }
+};
+
+/**
+ * @brief   Indefinite array, closed by a break once `next()` is empty or
+ *          the sink failed.
+ */
+template <typename Element>
+struct cbor_schema<json_stream<Element>> {
+    static constexpr size_t max_size = JSON_UNBOUNDED;
+
+    template <bool Packed, typename Sink, typename Next>
+    static void write(Sink &sink, Next next)
+    {
+        sink.put((char)CBOR_ARRAY_INDEFINITE);
+        while (!sink.failed()) {
+            const auto value = next();
+            if (!value) {
+                break;
+            }
+            cbor_schema<Element>::template write<Packed>(sink, *value);
+        }
+        sink.put((char)CBOR_BREAK);
+    }
+};
+
+/* Output --------------------------------------------------------------------*/
+
+/**
+ * @brief   Writes `Schema` as CBOR into `buffer`, which must hold
+ *          `cbor_schema<Schema>::max_size` bytes as the compiler checks.
+ *
+ * @param   buffer  - Output buffer, of bytes or chars.
+ * @param   values  - Values of the schema.
+ * @return  Length written.
+ */
+template <typename Schema, bool Packed = false, typename T, size_t N,
+            typename... Args>
+size_t cbor_write(T (&buffer)[N], const Args &... values)
+{
+    static_assert(sizeof(T) == 1, "a byte buffer");
+    static_assert(cbor_schema<Schema>::max_size <= N,
+                    "buffer below the schema bound");
+    json_buffer_sink sink = { (char *)buffer, 0 };
+
+    cbor_schema<Schema>::template write<Packed>(sink, values...);
+
+    return sink.len;
+}
+
+/**
+ * @brief   Sends `Schema` as a chunked `application/cbor` response, through
+ *          a JSON_CHUNK_SIZE buffer whatever the size of the output.
+ *
+ * @param   req     - HTTP request.
+ * @param   packed  - Objects as arrays, the Content-Type says so.
+ * @param   values  - Values of the schema.
+ * @return  ESP_OK, otherwise the first error of httpd_resp_send_chunk().
+ */
+template <typename Schema, typename... Args>
+esp_err_t cbor_send(httpd_req_t *req, bool packed, const Args &... values)
+{
+    json_chunk_sink<JSON_CHUNK_SIZE> sink;
+
+    sink.req = req;
+    sink.len = 0;
+    sink.err = httpd_resp_set_type(req, packed
+                                        ? CBOR_CONTENT_TYPE "; form=packed"
+                                        : CBOR_CONTENT_TYPE);
+
+    if (packed) {
+        cbor_schema<Schema>::template write<true>(sink, values...);
+    } else {
+        cbor_schema<Schema>::template write<false>(sink, values...);
+    }
+    sink.flush();
+
+    if (sink.err == ESP_OK) {
+        sink.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    return sink.err;
+}
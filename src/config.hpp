@@ -2,14 +2,74 @@
 
 #define WIFI_APP_TASK_STACK_SIZE        4096
 #define WIFI_APP_TASK_PRIORITY          5
-#define WIFI_APP_TASK_CORE_ID           0
-#define WIFI_APP_MAX_QUEUE_HANDLE       10
+#define WIFI_APP_TASK_CORE_ID           1               /* WiFi, LwIP on 0. */
 
 #define HTTP_SERVER_TASK_STACK_SIZE     8192
 #define HTTP_SERVER_TASK_PRIORITY       4
-#define HTTP_SERVER_TASK_CORE_ID        0
+#define HTTP_SERVER_TASK_CORE_ID        1
 
 #define HTTP_SERVER_MONITOR_STACK_SIZE  4096
 #define HTTP_SERVER_MONITOR_PRIORITY    3
-#define HTTP_SERVER_MONITOR_CORE_ID     0
-#define HTTP_SERVER_MONITOR_MAX_QUEUE_HANDLE       10
+#define HTTP_SERVER_MONITOR_CORE_ID     1
+
+#define HTTP_WORKER_TASK_STACK_SIZE     8192            /* OTA upload. */
+#define HTTP_WORKER_TASK_PRIORITY       3               /* Below httpd. */
+#define HTTP_WORKER_TASK_CORE_ID        1
+#define HTTP_WORKER_COUNT               2               /* Long requests. */
+#define HTTP_WORKER_QUEUE_LENGTH        4               /* 503 past it. */
+
+#define OTA_WRITER_TASK_STACK_SIZE      4096
+#define OTA_WRITER_TASK_PRIORITY        5
+#define OTA_WRITER_TASK_CORE_ID         0               /* WiFi's core, not httpd's. */
+#define OTA_WRITER_BUFFER_COUNT         4               /* Receive/flash pool. */
+#define OTA_WRITER_BUFFER_SIZE          4096            /* One flash sector. */
+#define OTA_WRITER_BACKPRESSURE_TIMEOUT_MS         10000
+#define OTA_WRITER_REQUIRE_SHA256       0               /* Reject undigested. */
+#define OTA_WRITER_ERASE_AHEAD          1               /* 0: erase at begin. */
+#define OTA_WRITER_ERASE_AHEAD_SIZE     (64 * 1024)     /* Past the cursor. */
+#define OTA_WRITER_PROGRESS_INTERVAL    (64 * 1024)     /* Between events. */
+
+#define OTA_CLIENT_TASK_STACK_SIZE      6144
+#define OTA_CLIENT_TASK_PRIORITY        5
+#define OTA_CLIENT_TASK_CORE_ID         1
+
+#define DHT_SENSOR_TASK_STACK_SIZE      3072
+#define DHT_SENSOR_TASK_PRIORITY        6               /* Sampling on time. */
+#define DHT_SENSOR_TASK_CORE_ID         1               /* Away from WiFi. */
+#define DHT_SENSOR_GPIO                 4
+#define DHT_SENSOR_PERIOD_MS            2000            /* DHT22 minimum. */
+#define DHT_SENSOR_RING_SIZE            64              /* Power of 2. */
+
+#define HISTORY_STORE_TASK_STACK_SIZE   4096
+#define HISTORY_STORE_TASK_PRIORITY     2               /* Below httpd. */
+#define HISTORY_STORE_TASK_CORE_ID      1
+#define HISTORY_STORE_PARTITION         "history"       /* partitions.csv */
+#define HISTORY_STORE_MAX_BLOCKS        352             /* 0x160000 bytes. */
+#define HISTORY_STORE_BATCH_SIZE        30              /* Lost on power cut. */
+
+#define ROLLUP_1M_BUCKETS               360             /* 6 h. */
+#define ROLLUP_15M_BUCKETS              192             /* 2 days. */
+#define ROLLUP_1H_BUCKETS               336             /* 14 days. */
+
+#define MQTT_PUBLISHER_TASK_STACK_SIZE  4096
+#define MQTT_PUBLISHER_TASK_PRIORITY    3
+#define MQTT_PUBLISHER_TASK_CORE_ID     1
+#define MQTT_PUBLISHER_BATCH_SIZE       15              /* 30 s of samples. */
+#define MQTT_PUBLISHER_INFLIGHT_MAX     4               /* QoS 1 window. */
+#define MQTT_PUBLISHER_DRAIN_PER_S      2               /* Backlog batches. */
+#define MQTT_PUBLISHER_ACK_TIMEOUT_MS   10000
+#define MQTT_PUBLISHER_CBOR             0               /* Packed, not JSON. */
+
+#define DLOG_TASK_STACK_SIZE            3072
+#define DLOG_TASK_PRIORITY              1               /* Above idle only. */
+#define DLOG_TASK_CORE_ID               1               /* Away from WiFi. */
+#define DLOG_FLUSH_PERIOD_MS            100             /* Console latency. */
+
+#define POWER_MAX_FREQ_MHZ              240
+#define POWER_MIN_FREQ_MHZ              80              /* APB stays 80 MHz. */
+#define POWER_LIGHT_SLEEP               1               /* Tickless idle. */
+#define POWER_MEASURE_PERIOD_MS         0               /* Idle log, 0: off. */
+
+#define TASK_PLACEMENT_PROBE_STACK_SIZE 2048
+#define TASK_PLACEMENT_PROBE_PRIORITY   18              /* tcpip_thread's. */
+#define TASK_PLACEMENT_PROBE_CORE_ID    0               /* Beside LwIP. */
@@ -0,0 +1,56 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include "dht22.hpp"
+
+/**
+ * @brief   Range of the DHT22, anything outside is a corrupt frame that the
+ *          checksum let through.
+ */
+#define DHT22_TEMPERATURE_MIN           -40.0f
+#define DHT22_TEMPERATURE_MAX           80.0f
+#define DHT22_HUMIDITY_MAX              100.0f
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t dht22_decode(const uint16_t *high_us, size_t count,
+                        dht22_reading_t *reading)
+{
+    uint8_t bytes[DHT22_BIT_COUNT / 8] = {0};
+
+    if (count < DHT22_BIT_COUNT) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* 1. The long pulses are the ones, MSB first. */
+    high_us += count - DHT22_BIT_COUNT;
+    for (size_t bit = 0; bit < DHT22_BIT_COUNT; bit++) {
+        bytes[bit / 8] <<= 1;
+        if (high_us[bit] > DHT22_BIT_THRESHOLD_US) {
+            bytes[bit / 8] |= 1;
+        }
+    }
+
+    /* 2. The last byte is the sum of the others. */
+    if ((uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]) != bytes[4]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    /* 3. Tenths, the temperature in sign and magnitude. */
+    const float humidity = ((bytes[0] << 8) | bytes[1]) / 10.0f;
+    float temperature = (((bytes[2] & 0x7F) << 8) | bytes[3]) / 10.0f;
+    if (bytes[2] & 0x80) {
+        temperature = -temperature;
+    }
+
+    if (humidity > DHT22_HUMIDITY_MAX
+        || temperature < DHT22_TEMPERATURE_MIN
+        || temperature > DHT22_TEMPERATURE_MAX) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    reading->temperature = temperature;
+    reading->humidity = humidity;
+    return ESP_OK;
+}
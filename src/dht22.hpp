@@ -0,0 +1,66 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @brief   A frame is 40 bits, each a ~50 us low then a high pulse of
+ *          26-28 us for a 0 and 70 us for a 1.
+ */
+#define DHT22_BIT_COUNT                 40
+#define DHT22_BIT_THRESHOLD_US          48
+
+/**
+ * @brief   The sensor answers within 200 us of the start signal, and needs
+ *          2 s between conversions.
+ */
+#define DHT22_START_SIGNAL_MS           2
+#define DHT22_FRAME_TIMEOUT_MS          20
+#define DHT22_MIN_PERIOD_MS             2000
+
+/* Public types --------------------------------------------------------------*/
+
+typedef struct {
+    float temperature;                  /* Degrees Celsius. */
+    float humidity;                     /* Percent. */
+} dht22_reading_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Sets up the capture of the sensor on `gpio`. The capture
+ *          interrupt runs on the core of the caller.
+ * @note    On the device the frame is timed by the RMT receiver, no
+ *          interrupt is masked and no core spins while the sensor talks.
+ *          The host build links a simulated sensor instead.
+ *
+ * @param   gpio    - Data pin, with a pull-up.
+ * @return  ESP_OK, otherwise the error of the RMT or GPIO driver.
+ */
+esp_err_t dht22_init(int gpio);
+
+/**
+ * @brief   Sends the start signal and waits for the frame, the calling task
+ *          blocks meanwhile.
+ *
+ * @param   reading - Receives the decoded values.
+ * @return  ESP_OK, ESP_ERR_TIMEOUT if the sensor didn't answer, otherwise
+ *          the error of dht22_decode().
+ */
+esp_err_t dht22_read(dht22_reading_t *reading);
+
+/**
+ * @brief   Decodes a frame from the durations of its high pulses. The last
+ *          DHT22_BIT_COUNT pulses are the bits, those before them (the
+ *          release of the line and the response of the sensor) are skipped.
+ *
+ * @param   high_us - Duration of each high pulse, in microseconds.
+ * @param   count   - Number of pulses.
+ * @param   reading - Receives the decoded values.
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE if bits are missing,
+ *          ESP_ERR_INVALID_CRC on a checksum mismatch and
+ *          ESP_ERR_INVALID_RESPONSE for values out of the sensor range.
+ */
+esp_err_t dht22_decode(const uint16_t *high_us, size_t count,
+                        dht22_reading_t *reading);
@@ -0,0 +1,122 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+
+#include <driver/gpio.h>
+#include <driver/rmt.h>
+#include <esp_err.h>
+#include <esp_log.h>
+
+#include "dht22.hpp"
+#include "dlog.hpp"
+
+/**
+ * @brief   RMT receiver of the sensor. One tick per microsecond, the frame
+ *          ends once the line idles high for DHT22_RMT_IDLE_US. A frame is
+ *          ~42 items, one 64 item memory block holds it.
+ */
+#define DHT22_RMT_CHANNEL               RMT_CHANNEL_0
+#define DHT22_RMT_CLK_DIV               80
+#define DHT22_RMT_IDLE_US               200
+#define DHT22_RMT_FILTER_TICKS          100     /* APB ticks, 1.25 us. */
+#define DHT22_RMT_RINGBUF_SIZE          512
+#define DHT22_MAX_PULSES                64
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "dht22";
+
+static gpio_num_t s_gpio = GPIO_NUM_NC;
+static RingbufHandle_t s_ringbuf = NULL;
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t dht22_init(int gpio)
+{
+    rmt_config_t config = RMT_DEFAULT_CONFIG_RX((gpio_num_t)gpio,
+                                                DHT22_RMT_CHANNEL);
+    esp_err_t err;
+
+    /* 1. The pin stays an open drain output with its input enabled, the
+     * start signal pulls it low and the RMT samples it through the GPIO
+     * matrix. */
+    s_gpio = (gpio_num_t)gpio;
+    gpio_set_level(s_gpio, 1);
+    err = gpio_set_direction(s_gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+    if (err == ESP_OK) {
+        err = gpio_set_pull_mode(s_gpio, GPIO_PULLUP_ONLY);
+    }
+
+    /* 2. Receiver, its interrupt is allocated on this core. */
+    config.clk_div = DHT22_RMT_CLK_DIV;
+    config.rx_config.idle_threshold = DHT22_RMT_IDLE_US;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = DHT22_RMT_FILTER_TICKS;
+    if (err == ESP_OK) {
+        err = rmt_config(&config);
+    }
+    if (err == ESP_OK) {
+        err = rmt_driver_install(DHT22_RMT_CHANNEL, DHT22_RMT_RINGBUF_SIZE,
+                                    0);
+    }
+    if (err == ESP_OK) {
+        err = rmt_get_ringbuf_handle(DHT22_RMT_CHANNEL, &s_ringbuf);
+    }
+
+    if (err != ESP_OK) {
+        DLOGE(TAG, "Capture setup on GPIO %d failed: %s",
+                    gpio, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t dht22_read(dht22_reading_t *reading)
+{
+    uint16_t high_us[DHT22_MAX_PULSES];
+    size_t count = 0;
+    size_t size = 0;
+
+    /* 1. Start signal, the task sleeps while the line is held low. */
+    gpio_set_level(s_gpio, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT22_START_SIGNAL_MS));
+
+    /* 2. Capture from the release of the line, the RMT times every edge in
+     * hardware and hands over the whole frame once the line idles. */
+    rmt_rx_start(DHT22_RMT_CHANNEL, true);
+    gpio_set_level(s_gpio, 1);
+
+    rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(
+                                    s_ringbuf, &size,
+                                    pdMS_TO_TICKS(DHT22_FRAME_TIMEOUT_MS));
+    rmt_rx_stop(DHT22_RMT_CHANNEL);
+
+    if (items == NULL) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    /* 3. Keep the high pulses, a zero duration ends the frame. */
+    for (size_t i = 0; i < size / sizeof(rmt_item32_t); i++) {
+        const uint32_t levels[2] = {items[i].level0, items[i].level1};
+        const uint32_t durations[2] = {items[i].duration0,
+                                        items[i].duration1};
+
+        for (size_t half = 0; half < 2; half++) {
+            if (durations[half] == 0) {
+                break;
+            }
+            if (levels[half] && count < DHT22_MAX_PULSES) {
+                high_us[count++] = (uint16_t)durations[half];
+            }
+        }
+    }
+    vRingbufferReturnItem(s_ringbuf, items);
+
+    return dht22_decode(high_us, count, reading);
+}
@@ -0,0 +1,300 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <string.h>
+#include <sys/time.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "dht22.hpp"
+#include "dht_sensor.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "metrics.hpp"
+#include "rollup.hpp"
+#include "task_placement.hpp"
+
+#define DHT_SENSOR_RING_MASK            (DHT_SENSOR_RING_SIZE - 1)
+#define DHT_SENSOR_SAMPLE_WORDS         (sizeof(dht_sensor_sample_t) / 4)
+
+/**
+ * @brief   Copies of a slot retried while the sampler rewrites it. A write
+ *          takes microseconds every DHT_SENSOR_PERIOD_MS, a few are plenty.
+ */
+#define DHT_SENSOR_READ_RETRIES         4
+
+/**
+ * @brief   Unix time of 2020-01-01, the clock is taken as unset before it.
+ */
+#define DHT_SENSOR_CLOCK_VALID_S        1577836800
+
+static_assert((DHT_SENSOR_RING_SIZE & DHT_SENSOR_RING_MASK) == 0,
+                "DHT_SENSOR_RING_SIZE must be a power of 2");
+static_assert(sizeof(dht_sensor_sample_t) % 4 == 0, "copied by words");
+static_assert(DHT_SENSOR_PERIOD_MS >= DHT22_MIN_PERIOD_MS,
+                "the DHT22 needs 2 s between conversions");
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Ring slot. `seq` is 2 * position + 1 while the sampler writes the
+ *          sample of that position and 2 * position + 2 once it is written,
+ *          so a reader knows both that its copy is whole and that it is the
+ *          position it asked for. The sample is kept as atomic words, a copy
+ *          racing with a write is discarded but is never undefined.
+ */
+typedef struct {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> words[DHT_SENSOR_SAMPLE_WORDS];
+} dht_sensor_slot_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "dht_sensor";
+
+static TaskHandle_t s_dht_sensor_task = NULL;
+
+static dht_sensor_slot_t s_ring[DHT_SENSOR_RING_SIZE];
+static std::atomic<uint32_t> s_ring_head(0);    /* Samples written. */
+
+static std::atomic<uint32_t> s_reads(0);
+static std::atomic<uint32_t> s_errors(0);
+static std::atomic<uint32_t> s_max_lateness_us(0);
+static std::atomic<uint32_t> s_max_capture_us(0);
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Sampling task, reads the sensor every DHT_SENSOR_PERIOD_MS.
+ *
+ * @param param
+ */
+static void dht_sensor_task(void *param);
+
+/**
+ * @brief   Writes the sample of the next position, sampler task only.
+ */
+static void dht_sensor_push(const dht_sensor_sample_t *sample);
+
+/**
+ * @brief   Copies the sample of a position.
+ *
+ * @return  false if it was overwritten, or kept being rewritten.
+ */
+static bool dht_sensor_read_slot(uint32_t position,
+                                    dht_sensor_sample_t *sample);
+
+/* Public function definition ------------------------------------------------*/
+void dht_sensor_start(void)
+{
+    if (s_dht_sensor_task != NULL) {
+        return;
+    }
+
+    DLOGI(TAG, "Starting DHT22 sampling on core %d.",
+                task_placement_core(TASK_PLACEMENT_DHT_SENSOR));
+
+    xTaskCreatePinnedToCore(&dht_sensor_task,
+                            "dht_sensor_task",
+                            DHT_SENSOR_TASK_STACK_SIZE,
+                            NULL,
+                            DHT_SENSOR_TASK_PRIORITY,
+                            &s_dht_sensor_task,
+                            task_placement_core(TASK_PLACEMENT_DHT_SENSOR));
+}
+
+bool dht_sensor_get_latest(dht_sensor_sample_t *sample)
+{
+    /* The latest slot can only be overwritten by the next sample, a retry
+     * takes that one instead. */
+    for (size_t i = 0; i < DHT_SENSOR_READ_RETRIES; i++) {
+        const uint32_t head = s_ring_head.load(std::memory_order_acquire);
+
+        if (head == 0) {
+            return false;
+        }
+        if (dht_sensor_read_slot(head - 1, sample)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t dht_sensor_get_history(dht_sensor_sample_t *samples, size_t max)
+{
+    const uint32_t head = s_ring_head.load(std::memory_order_acquire);
+    size_t count = 0;
+
+    if (max > DHT_SENSOR_RING_SIZE) {
+        max = DHT_SENSOR_RING_SIZE;
+    }
+    if (max > head) {
+        max = head;
+    }
+
+    /* Oldest first. The oldest position is the next to be overwritten, it
+     * is skipped if the sampler got there meanwhile. */
+    for (uint32_t position = head - max; position != head; position++) {
+        if (dht_sensor_read_slot(position, &samples[count])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void dht_sensor_get_stats(dht_sensor_stats_t *stats)
+{
+    stats->reads = s_reads.load(std::memory_order_relaxed);
+    stats->errors = s_errors.load(std::memory_order_relaxed);
+    stats->max_lateness_us = s_max_lateness_us.load(
+                                                std::memory_order_relaxed);
+    stats->max_capture_us = s_max_capture_us.load(std::memory_order_relaxed);
+}
+
+/* Private function definition -----------------------------------------------*/
+static void dht_sensor_task(void *param)
+{
+    TickType_t last_wake;
+    int64_t schedule_us = 0;
+    uint32_t period = 0;
+
+    metrics_register_task(NULL, DHT_SENSOR_TASK_STACK_SIZE);
+
+    /* 1. The capture interrupt is allocated on this core. */
+    if (dht22_init(DHT_SENSOR_GPIO) != ESP_OK) {
+        DLOGE(TAG, "No DHT22 capture, sampling stopped.");
+        s_dht_sensor_task = NULL;
+        metrics_unregister_task(NULL);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    last_wake = xTaskGetTickCount();
+    while (1) {
+        dht_sensor_sample_t sample;
+        dht22_reading_t reading;
+
+        /* 2. Lateness against the first read, which sets the schedule. */
+        const int64_t start_us = esp_timer_get_time();
+        if (period == 0) {
+            schedule_us = start_us;
+        }
+        const int64_t lateness_us = start_us - schedule_us
+                        - (int64_t)period * DHT_SENSOR_PERIOD_MS * 1000;
+
+        const esp_err_t err = dht22_read(&reading);
+        const int64_t end_us = esp_timer_get_time();
+
+        if (err == ESP_OK) {
+            sample.time_us = end_us;
+            sample.temperature = reading.temperature;
+            sample.humidity = reading.humidity;
+            sample.lateness_us = lateness_us > 0 ? (uint32_t)lateness_us : 0;
+            sample.capture_us = (uint32_t)(end_us - start_us);
+
+            /* 3. Into the ring first, so a reader woken by the event finds
+             * it. */
+            dht_sensor_push(&sample);
+            s_reads.fetch_add(1, std::memory_order_relaxed);
+            if (sample.lateness_us > s_max_lateness_us.load(
+                                            std::memory_order_relaxed)) {
+                s_max_lateness_us.store(sample.lateness_us,
+                                        std::memory_order_relaxed);
+            }
+            if (sample.capture_us > s_max_capture_us.load(
+                                            std::memory_order_relaxed)) {
+                s_max_capture_us.store(sample.capture_us,
+                                        std::memory_order_relaxed);
+            }
+
+            /* 4. Stamped once by the wall clock once it is set, so the
+             * log, the rollups and the publisher agree on each sample. */
+            struct timeval now;
+            int64_t time_ms = 0;
+            gettimeofday(&now, NULL);
+            if (now.tv_sec >= DHT_SENSOR_CLOCK_VALID_S) {
+                time_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+            }
+
+            event_bus_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.type = EVENT_BUS_SENSOR_SAMPLE;
+            event.sensor_sample.time_ms = time_ms;
+            event.sensor_sample.temperature = reading.temperature;
+            event.sensor_sample.humidity = reading.humidity;
+            event_bus_publish(&event);
+
+            /* 5. Rollups, a few updates in RAM, the sampling stays on
+             * time. */
+            if (time_ms != 0) {
+                rollup_add(time_ms, reading.temperature, reading.humidity);
+            }
+        } else {
+            s_errors.fetch_add(1, std::memory_order_relaxed);
+            DLOGW(TAG, "DHT22 read failed: %s", esp_err_to_name(err));
+        }
+
+        /* 6. Periodic from the first read whatever a read took. */
+        period++;
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(DHT_SENSOR_PERIOD_MS));
+    }
+}
+
+static void dht_sensor_push(const dht_sensor_sample_t *sample)
+{
+    const uint32_t position = s_ring_head.load(std::memory_order_relaxed);
+    dht_sensor_slot_t *slot = &s_ring[position & DHT_SENSOR_RING_MASK];
+    uint32_t words[DHT_SENSOR_SAMPLE_WORDS];
+
+    memcpy(words, sample, sizeof(words));
+
+    slot->seq.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < DHT_SENSOR_SAMPLE_WORDS; i++) {
+        slot->words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot->seq.store(2 * position + 2, std::memory_order_release);
+
+    s_ring_head.store(position + 1, std::memory_order_release);
+}
+
+static bool dht_sensor_read_slot(uint32_t position,
+                                    dht_sensor_sample_t *sample)
+{
+    const dht_sensor_slot_t *slot = &s_ring[position & DHT_SENSOR_RING_MASK];
+    const uint32_t written = 2 * position + 2;
+    uint32_t words[DHT_SENSOR_SAMPLE_WORDS];
+
+    for (size_t i = 0; i < DHT_SENSOR_READ_RETRIES; i++) {
+        const uint32_t seq = slot->seq.load(std::memory_order_acquire);
+
+        if ((int32_t)(seq - written) > 0) {
+            /* A later lap is being written, or is. */
+            return false;
+        }
+        if (seq != written) {
+            continue;
+        }
+
+        for (size_t w = 0; w < DHT_SENSOR_SAMPLE_WORDS; w++) {
+            words[w] = slot->words[w].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (slot->seq.load(std::memory_order_relaxed) == seq) {
+            memcpy(sample, words, sizeof(words));
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   A reading with its timing. `lateness_us` measures the sampling
+ *          jitter, `capture_us` the time the sensor read took.
+ */
+typedef struct {
+    int64_t time_us;                    /* esp_timer_get_time() at the read. */
+    float temperature;                  /* Degrees Celsius. */
+    float humidity;                     /* Percent. */
+    uint32_t lateness_us;               /* Read start past its schedule. */
+    uint32_t capture_us;                /* Start signal to decoded frame. */
+} dht_sensor_sample_t;
+
+typedef struct {
+    uint32_t reads;                     /* Successful reads since boot. */
+    uint32_t errors;                    /* Timeouts and corrupt frames. */
+    uint32_t max_lateness_us;
+    uint32_t max_capture_us;
+} dht_sensor_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Starts the sampling task on DHT_SENSOR_TASK_CORE_ID. Every
+ *          DHT_SENSOR_PERIOD_MS it reads the DHT22, keeps the sample in a
+ *          ring of the last DHT_SENSOR_RING_SIZE and publishes
+ *          EVENT_BUS_SENSOR_SAMPLE.
+ * @note    The task is the only writer of the ring. Readers copy samples
+ *          out under a per-slot sequence number and retry the rare copy
+ *          that raced with a write, so they take no lock and never delay
+ *          the sampler.
+ */
+void dht_sensor_start(void);
+
+/**
+ * @brief   Copies the latest sample, callable from any task.
+ *
+ * @return  false before the first successful read.
+ */
+bool dht_sensor_get_latest(dht_sensor_sample_t *sample);
+
+/**
+ * @brief   Copies the latest samples, oldest first, callable from any task.
+ *
+ * @param   samples - Receives up to `max` samples.
+ * @param   max     - Size of `samples`, DHT_SENSOR_RING_SIZE for all.
+ * @return  Number of samples copied.
+ */
+size_t dht_sensor_get_history(dht_sensor_sample_t *samples, size_t max);
+
+/**
+ * @brief   Read counters and worst timings since boot.
+ */
+void dht_sensor_get_stats(dht_sensor_stats_t *stats);
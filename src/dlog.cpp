@@ -0,0 +1,675 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+
+#define DLOG_LINE_MAX_LEN               256
+#define DLOG_SPEC_MAX_LEN               16
+#define DLOG_STREAM_CHUNK_SIZE          512
+#define DLOG_STREAM_RETRY_MS            3000
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Header of a record in the ring, its arguments follow.
+ */
+typedef struct {
+    uint16_t len;                       /* With the header. */
+    uint8_t truncated;
+    uint8_t reserved;
+    uint32_t ms;                        /* esp_log_timestamp(). */
+    const dlog_site_t *site;
+} dlog_header_t;
+
+/**
+ * @brief   A /log stream, `sent` is its position in the stream ring. A chunk
+ *          the socket didn't take at once stays in `pending`.
+ */
+typedef struct {
+    int fd;                             /* -1 if the slot is free. */
+    bool closing;
+    uint32_t sent;
+    char pending[DLOG_STREAM_CHUNK_SIZE];
+    size_t pending_len;
+    size_t pending_off;
+} dlog_stream_client_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "dlog";
+static TaskHandle_t s_dlog_task = NULL;
+
+/**
+ * @brief   Records are reserved and copied under `s_dlog_lock`, taken by the
+ *          dlog task alone, which moves `s_dlog_tail` without the lock.
+ */
+static uint8_t s_dlog_ring[DLOG_RING_SIZE];
+static std::atomic<uint32_t> s_dlog_head(0);
+static std::atomic<uint32_t> s_dlog_tail(0);
+static portMUX_TYPE s_dlog_lock = portMUX_INITIALIZER_UNLOCKED;
+static dlog_stats_t s_dlog_stats = {};
+
+/**
+ * @brief   Rendered lines as text/event-stream frames, written by the dlog
+ *          task alone, the oldest overwritten.
+ */
+static char s_dlog_stream[DLOG_STREAM_RING_SIZE];
+static std::atomic<uint32_t> s_dlog_stream_head(0);
+static dlog_stream_client_t s_dlog_clients[DLOG_STREAM_MAX_CLIENTS];
+static httpd_handle_t s_dlog_httpd = NULL;
+static volatile bool s_dlog_flush_queued = false;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Renders the records of the ring, every DLOG_FLUSH_PERIOD_MS or
+ *          when woken.
+ */
+static void dlog_task(void *param);
+
+/**
+ * @brief   Renders every record in the ring and frees it.
+ *
+ * @return  true if a line was written.
+ */
+static bool dlog_render_all(void);
+
+/**
+ * @brief   Formats the message of a record, the format of its site applied
+ *          to its recorded arguments.
+ *
+ * @return  Length of the message in `line`.
+ */
+static size_t dlog_format(char *line, size_t size, const char *format,
+                            const uint8_t *args, size_t args_len);
+
+/**
+ * @brief   Formats one conversion, `spec` without its length modifier, with
+ *          the next argument, which is consumed.
+ *
+ * @return  Length written, or -1 if no argument is left.
+ */
+static int dlog_format_arg(char *out, size_t size, const char *spec,
+                            char conversion, const uint8_t **args,
+                            const uint8_t *end);
+
+/**
+ * @brief   Writes a line as ESP_LOGx() would and adds it to the streams.
+ */
+static void dlog_emit(esp_log_level_t level, const char *tag, uint32_t ms,
+                        const char *message, bool truncated);
+
+static void dlog_stream_append(const char *data, size_t len);
+
+static void dlog_ring_read(uint32_t pos, void *data, size_t n);
+
+static void dlog_stream_free_ctx(void *ctx);
+
+/**
+ * @brief   Queues a flush of the streams on the httpd task, once.
+ */
+static void dlog_stream_schedule(void);
+
+/**
+ * @brief   httpd work item sending the new lines to every stream.
+ */
+static void dlog_stream_flush(void *arg);
+
+static void dlog_stream_send(dlog_stream_client_t *client);
+
+/**
+ * @brief   Sends what is left of `pending`.
+ *
+ * @return  true if all of it went.
+ */
+static bool dlog_stream_send_pending(dlog_stream_client_t *client);
+
+/**
+ * @brief   First frame of the stream ring still whole, where a new or
+ *          overrun client resumes.
+ */
+static uint32_t dlog_stream_oldest(void);
+
+/* Public function definition ------------------------------------------------*/
+
+void dlog_start(void)
+{
+    if (s_dlog_task != NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < DLOG_STREAM_MAX_CLIENTS; i++) {
+        s_dlog_clients[i].fd = -1;
+    }
+
+    xTaskCreatePinnedToCore(&dlog_task,
+                            "dlog_task",
+                            DLOG_TASK_STACK_SIZE,
+                            NULL,
+                            DLOG_TASK_PRIORITY,
+                            &s_dlog_task,
+                            DLOG_TASK_CORE_ID);
+}
+
+void dlog_commit(const dlog_site_t *site, dlog_record_t *record)
+{
+    dlog_header_t header;
+    bool wake;
+
+    header.len = sizeof(header) + record->len;
+    header.truncated = record->truncated;
+    header.reserved = 0;
+    header.ms = esp_log_timestamp();
+    header.site = site;
+
+    /* 1. Reserve and copy at once, the dlog task only sees whole records. */
+    portENTER_CRITICAL_SAFE(&s_dlog_lock);
+    const uint32_t head = s_dlog_head.load(std::memory_order_relaxed);
+    const uint32_t used = head - s_dlog_tail.load(std::memory_order_acquire);
+
+    if (used + header.len <= DLOG_RING_SIZE) {
+        const uint8_t *parts[] = { (const uint8_t *)&header, record->data };
+        const size_t sizes[] = { sizeof(header), record->len };
+        uint32_t pos = head;
+
+        for (size_t i = 0; i < 2; i++) {
+            const size_t off = pos & (DLOG_RING_SIZE - 1);
+            const size_t first = MIN(sizes[i], DLOG_RING_SIZE - off);
+
+            memcpy(s_dlog_ring + off, parts[i], first);
+            memcpy(s_dlog_ring, parts[i] + first, sizes[i] - first);
+            pos += sizes[i];
+        }
+        s_dlog_head.store(pos, std::memory_order_release);
+        s_dlog_stats.written++;
+    } else {
+        s_dlog_stats.dropped++;
+    }
+    wake = (site->level == ESP_LOG_ERROR
+            || used + header.len > DLOG_RING_SIZE / 2);
+    portEXIT_CRITICAL_SAFE(&s_dlog_lock);
+
+    /* 2. Errors and a filling ring don't wait for the period. */
+    if (wake && s_dlog_task != NULL) {
+        if (xPortInIsrContext()) {
+            BaseType_t woken = pdFALSE;
+
+            vTaskNotifyGiveFromISR(s_dlog_task, &woken);
+            if (woken) {
+                portYIELD_FROM_ISR();
+            }
+        } else {
+            xTaskNotifyGive(s_dlog_task);
+        }
+    }
+}
+
+bool dlog_flush(uint32_t timeout_ms)
+{
+    const uint32_t head = s_dlog_head.load(std::memory_order_acquire);
+    const TickType_t start = xTaskGetTickCount();
+
+    if (s_dlog_task == NULL) {
+        return false;
+    }
+
+    xTaskNotifyGive(s_dlog_task);
+    while ((int32_t)(s_dlog_tail.load(std::memory_order_acquire) - head) < 0) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms)) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+
+    return true;
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    portENTER_CRITICAL_SAFE(&s_dlog_lock);
+    *stats = s_dlog_stats;
+    portEXIT_CRITICAL_SAFE(&s_dlog_lock);
+}
+
+esp_err_t dlog_stream_handler(httpd_req_t *req)
+{
+    char header[128];
+    dlog_stream_client_t *client = NULL;
+
+    /* 1. A free stream slot. */
+    for (size_t i = 0; i < DLOG_STREAM_MAX_CLIENTS; i++) {
+        if (s_dlog_clients[i].fd < 0) {
+            client = &s_dlog_clients[i];
+            break;
+        }
+    }
+
+    if (client == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many log streams",
+                                HTTPD_RESP_USE_STRLEN);
+    }
+
+    /* 2. Header without a length, the body lasts as long as the socket. */
+    int header_len = snprintf(header, sizeof(header),
+                                "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/event-stream\r\n"
+                                "Cache-Control: no-cache\r\n"
+                                "\r\n"
+                                "retry: %d\n\n",
+                                DLOG_STREAM_RETRY_MS);
+    if (httpd_send(req, header, header_len) < 0) {
+        return ESP_FAIL;
+    }
+
+    /* 3. The session outlives the request, the lines kept so far are sent
+     * once the handler has returned, then every new one. */
+    memset(client, 0, sizeof(*client));
+    client->sent = dlog_stream_oldest();
+    client->fd = httpd_req_to_sockfd(req);
+    req->sess_ctx = client;
+    req->free_ctx = dlog_stream_free_ctx;
+    s_dlog_httpd = req->handle;
+
+    DLOGI(TAG, "Log stream opened on socket %d.", client->fd);
+    dlog_stream_schedule();
+
+    return ESP_OK;
+}
+
+/* Private function definition -----------------------------------------------*/
+
+static void dlog_task(void *param)
+{
+    (void)param;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DLOG_FLUSH_PERIOD_MS));
+        if (dlog_render_all()) {
+            dlog_stream_schedule();
+        }
+    }
+}
+
+static bool dlog_render_all(void)
+{
+    static uint32_t s_dropped_reported = 0;
+    uint8_t record[sizeof(dlog_header_t) + DLOG_RECORD_MAX_SIZE];
+    char line[DLOG_LINE_MAX_LEN];
+    dlog_stats_t stats;
+    bool rendered = false;
+
+    uint32_t tail = s_dlog_tail.load(std::memory_order_relaxed);
+    const uint32_t head = s_dlog_head.load(std::memory_order_acquire);
+
+    /* 1. Oldest first, each freed once rendered. */
+    while (tail != head) {
+        dlog_header_t header;
+
+        dlog_ring_read(tail, &header, sizeof(header));
+        dlog_ring_read(tail + sizeof(header), record,
+                        header.len - sizeof(header));
+
+        dlog_format(line, sizeof(line), header.site->format, record,
+                    header.len - sizeof(header));
+        tail += header.len;
+        s_dlog_tail.store(tail, std::memory_order_release);
+
+        dlog_emit(header.site->level, header.site->tag, header.ms, line,
+                    header.truncated);
+        portENTER_CRITICAL_SAFE(&s_dlog_lock);
+        s_dlog_stats.rendered++;
+        portEXIT_CRITICAL_SAFE(&s_dlog_lock);
+        rendered = true;
+    }
+
+    /* 2. What a full ring lost, after the records it held. */
+    dlog_get_stats(&stats);
+    if (stats.dropped != s_dropped_reported) {
+        snprintf(line, sizeof(line), "%u records dropped, the ring was full.",
+                    (unsigned)(stats.dropped - s_dropped_reported));
+        s_dropped_reported = stats.dropped;
+        dlog_emit(ESP_LOG_WARN, TAG, esp_log_timestamp(), line, false);
+        rendered = true;
+    }
+
+    return rendered;
+}
+
+static size_t dlog_format(char *line, size_t size, const char *format,
+                            const uint8_t *args, size_t args_len)
+{
+    const uint8_t *end = args + args_len;
+    size_t len = 0;
+
+    while (*format != '\0' && len + 1 < size) {
+        char spec[DLOG_SPEC_MAX_LEN];
+        size_t spec_len = 0;
+        const char *start = format;
+
+        if (*format != '%') {
+            line[len++] = *format++;
+            continue;
+        }
+
+        format++;
+        if (*format == '%') {
+            line[len++] = *format++;
+            continue;
+        }
+
+        /* 1. Flags, width and precision are kept, the length modifier is
+         * chosen by the recorded type. */
+        spec[spec_len++] = '%';
+        while (*format != '\0' && strchr("-+ #0123456789.", *format) != NULL
+                && spec_len < sizeof(spec) - 4) {
+            spec[spec_len++] = *format++;
+        }
+        while (*format != '\0' && strchr("hlLqjzt", *format) != NULL) {
+            format++;
+        }
+        spec[spec_len] = '\0';
+
+        if (*format == '\0') {
+            break;
+        }
+
+        /* 2. A missing argument leaves the conversion as written. */
+        int written = dlog_format_arg(line + len, size - len, spec,
+                                        *format, &args, end);
+        format++;
+        if (written < 0) {
+            written = snprintf(line + len, size - len, "%.*s",
+                                (int)(format - start), start);
+        }
+        len += MIN((size_t)written, size - len - 1);
+    }
+
+    line[len] = '\0';
+    return len;
+}
+
+static int dlog_format_arg(char *out, size_t size, const char *spec,
+                            char conversion, const uint8_t **args,
+                            const uint8_t *end)
+{
+    char full[DLOG_SPEC_MAX_LEN];
+    const bool is_signed = (conversion == 'd' || conversion == 'i');
+    uint8_t type;
+
+    if (*args >= end) {
+        return -1;
+    }
+    type = *(*args)++;
+
+    switch (type) {
+    case DLOG_ARG_INT:
+    case DLOG_ARG_UINT: {
+        uint32_t value;
+
+        memcpy(&value, *args, sizeof(value));
+        *args += sizeof(value);
+        if (conversion == 'c') {
+            snprintf(full, sizeof(full), "%sc", spec);
+            return snprintf(out, size, full, (int)value);
+        }
+        snprintf(full, sizeof(full), "%sll%c", spec, conversion);
+        if (is_signed && type == DLOG_ARG_INT) {
+            return snprintf(out, size, full, (long long)(int32_t)value);
+        }
+        return snprintf(out, size, full, (unsigned long long)value);
+    }
+    case DLOG_ARG_INT64:
+    case DLOG_ARG_UINT64: {
+        uint64_t value;
+
+        memcpy(&value, *args, sizeof(value));
+        *args += sizeof(value);
+        snprintf(full, sizeof(full), "%sll%c", spec, conversion);
+        if (is_signed) {
+            return snprintf(out, size, full, (long long)value);
+        }
+        return snprintf(out, size, full, (unsigned long long)value);
+    }
+    case DLOG_ARG_DOUBLE: {
+        double value;
+
+        memcpy(&value, *args, sizeof(value));
+        *args += sizeof(value);
+        snprintf(full, sizeof(full), "%s%c", spec, conversion);
+        return snprintf(out, size, full, value);
+    }
+    case DLOG_ARG_POINTER: {
+        uintptr_t value;
+
+        memcpy(&value, *args, sizeof(value));
+        *args += sizeof(value);
+        snprintf(full, sizeof(full), "%sp", spec);
+        return snprintf(out, size, full, (void *)value);
+    }
+    case DLOG_ARG_STRING: {
+        char value[DLOG_STRING_MAX_LEN + 1];
+        const uint8_t len = MIN(**args, (size_t)(end - *args - 1));
+
+        memcpy(value, *args + 1, len);
+        value[len] = '\0';
+        *args += 1 + len;
+        snprintf(full, sizeof(full), "%ss", spec);
+        return snprintf(out, size, full, value);
+    }
+    default:
+        *args = end;
+        return -1;
+    }
+}
+
+static void dlog_emit(esp_log_level_t level, const char *tag, uint32_t ms,
+                        const char *message, bool truncated)
+{
+    static const char letters[] = "NEWIDV";
+    char frame[DLOG_LINE_MAX_LEN + 64];
+    size_t len;
+
+    /* 1. The console, as ESP_LOGx() prints, filtered by the levels set at
+     * runtime. */
+    esp_log_write(level, tag, "%c (%u) %s: %s%s\n", letters[level],
+                    (unsigned)ms, tag, message, truncated ? "..." : "");
+
+    /* 2. One event per line, a newline in it starts another data field. */
+    len = snprintf(frame, sizeof(frame), "data: %c (%u) %s: ",
+                    letters[level], (unsigned)ms, tag);
+    for (const char *c = message; *c != '\0' && len + 16 < sizeof(frame);
+            c++) {
+        if (*c == '\n') {
+            memcpy(frame + len, "\ndata: ", 7);
+            len += 7;
+        } else {
+            frame[len++] = *c;
+        }
+    }
+    len += snprintf(frame + len, sizeof(frame) - len, "%s\n\n",
+                    truncated ? "..." : "");
+    dlog_stream_append(frame, len);
+}
+
+static void dlog_stream_append(const char *data, size_t len)
+{
+    const uint32_t head = s_dlog_stream_head.load(std::memory_order_relaxed);
+    const size_t off = head & (DLOG_STREAM_RING_SIZE - 1);
+    const size_t first = MIN(len, DLOG_STREAM_RING_SIZE - off);
+
+    memcpy(s_dlog_stream + off, data, first);
+    memcpy(s_dlog_stream, data + first, len - first);
+    s_dlog_stream_head.store(head + len, std::memory_order_release);
+}
+
+static void dlog_ring_read(uint32_t pos, void *data, size_t n)
+{
+    const size_t off = pos & (DLOG_RING_SIZE - 1);
+    const size_t first = MIN(n, DLOG_RING_SIZE - off);
+
+    memcpy(data, s_dlog_ring + off, first);
+    memcpy((uint8_t *)data + first, s_dlog_ring, n - first);
+}
+
+static void dlog_stream_free_ctx(void *ctx)
+{
+    dlog_stream_client_t *client = (dlog_stream_client_t *)ctx;
+
+    DLOGI(TAG, "Log stream closed on socket %d.", client->fd);
+    client->fd = -1;
+}
+
+static void dlog_stream_schedule(void)
+{
+    if (s_dlog_httpd == NULL || s_dlog_flush_queued) {
+        return;
+    }
+
+    s_dlog_flush_queued = true;
+    if (httpd_queue_work(s_dlog_httpd, dlog_stream_flush, NULL) != ESP_OK) {
+        s_dlog_flush_queued = false;
+    }
+}
+
+static void dlog_stream_flush(void *arg)
+{
+    (void)arg;
+    s_dlog_flush_queued = false;
+
+    for (size_t i = 0; i < DLOG_STREAM_MAX_CLIENTS; i++) {
+        if (s_dlog_clients[i].fd >= 0) {
+            dlog_stream_send(&s_dlog_clients[i]);
+        }
+    }
+}
+
+static void dlog_stream_send(dlog_stream_client_t *client)
+{
+    /* 1. A chunk cut by a full socket goes first. */
+    if (!dlog_stream_send_pending(client)) {
+        return;
+    }
+
+    for (;;) {
+        const uint32_t head =
+                        s_dlog_stream_head.load(std::memory_order_acquire);
+        const size_t n = MIN((size_t)(head - client->sent),
+                                sizeof(client->pending));
+
+        if (n == 0) {
+            return;
+        }
+
+        /* 2. Copied out, then kept only if the dlog task didn't write over
+         * it meanwhile. A client that fell behind skips to whole frames. */
+        const size_t off = client->sent & (DLOG_STREAM_RING_SIZE - 1);
+        const size_t first = MIN(n, DLOG_STREAM_RING_SIZE - off);
+
+        memcpy(client->pending, s_dlog_stream + off, first);
+        memcpy(client->pending + first, s_dlog_stream, n - first);
+        if (s_dlog_stream_head.load(std::memory_order_acquire)
+                - client->sent > DLOG_STREAM_RING_SIZE) {
+            client->sent = dlog_stream_oldest();
+            client->pending_len = snprintf(client->pending,
+                                            sizeof(client->pending),
+                                            ": lines lost\n\n");
+        } else {
+            client->sent += n;
+            client->pending_len = n;
+        }
+        client->pending_off = 0;
+
+        if (!dlog_stream_send_pending(client)) {
+            return;
+        }
+    }
+}
+
+static bool dlog_stream_send_pending(dlog_stream_client_t *client)
+{
+    while (!client->closing && client->pending_off < client->pending_len) {
+        int ret = httpd_socket_send(s_dlog_httpd,
+                                    client->fd,
+                                    client->pending + client->pending_off,
+                                    client->pending_len - client->pending_off,
+                                    MSG_DONTWAIT);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            /* Socket full, the rest goes with the next flush. */
+            return false;
+        }
+
+        if (ret < 0) {
+            DLOGW(TAG, "Log stream on socket %d lost.", client->fd);
+            client->closing = true;
+            httpd_sess_trigger_close(s_dlog_httpd, client->fd);
+            return false;
+        }
+
+        client->pending_off += ret;
+    }
+
+    if (client->closing) {
+        return false;
+    }
+
+    client->pending_len = 0;
+    client->pending_off = 0;
+    return true;
+}
+
+static uint32_t dlog_stream_oldest(void)
+{
+    char window[DLOG_STREAM_CHUNK_SIZE];
+    uint32_t pos;
+    uint32_t head;
+
+    /* Nothing was overwritten yet, the ring starts with a frame. */
+    head = s_dlog_stream_head.load(std::memory_order_acquire);
+    if (head <= DLOG_STREAM_RING_SIZE) {
+        return 0;
+    }
+
+    /* A frame ends with the only blank line in it. A frame overwritten
+     * while searched moves the search on. */
+    pos = head - DLOG_STREAM_RING_SIZE + DLOG_STREAM_CHUNK_SIZE / 4;
+    while ((int32_t)(head - pos) > 1) {
+        const size_t n = MIN((size_t)(head - pos), sizeof(window));
+        const size_t off = pos & (DLOG_STREAM_RING_SIZE - 1);
+        const size_t first = MIN(n, DLOG_STREAM_RING_SIZE - off);
+
+        memcpy(window, s_dlog_stream + off, first);
+        memcpy(window + first, s_dlog_stream, n - first);
+        head = s_dlog_stream_head.load(std::memory_order_acquire);
+        if (head - pos > DLOG_STREAM_RING_SIZE) {
+            pos = head - DLOG_STREAM_RING_SIZE + DLOG_STREAM_CHUNK_SIZE / 4;
+            continue;
+        }
+
+        for (size_t i = 0; i + 1 < n; i++) {
+            if (window[i] == '\n' && window[i + 1] == '\n') {
+                return pos + i + 2;
+            }
+        }
+        pos += n - 1;
+    }
+
+    return head;
+}
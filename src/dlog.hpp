@@ -0,0 +1,228 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <type_traits>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+
+/**
+ * @brief   Records wait in a ring of DLOG_RING_SIZE bytes, a power of 2,
+ *          until the dlog task renders them. One takes at most
+ *          DLOG_RECORD_MAX_SIZE bytes, a string argument at most
+ *          DLOG_STRING_MAX_LEN of them.
+ */
+#define DLOG_RING_SIZE                  4096
+#define DLOG_RECORD_MAX_SIZE            128
+#define DLOG_STRING_MAX_LEN             48
+
+/**
+ * @brief   Up to DLOG_STREAM_MAX_CLIENTS /log streams read the last
+ *          DLOG_STREAM_RING_SIZE bytes of rendered lines, a power of 2.
+ */
+#define DLOG_STREAM_MAX_CLIENTS         2
+#define DLOG_STREAM_RING_SIZE           4096
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   A call site, constant and in flash. Its address is the id of the
+ *          format in the records.
+ */
+typedef struct {
+    const char *tag;
+    const char *format;
+    esp_log_level_t level;
+} dlog_site_t;
+
+/**
+ * @brief   Type of an argument in a record, which keeps its raw value.
+ */
+typedef enum {
+    DLOG_ARG_INT = 0,                   /* int32_t. */
+    DLOG_ARG_UINT,                      /* uint32_t. */
+    DLOG_ARG_INT64,
+    DLOG_ARG_UINT64,
+    DLOG_ARG_DOUBLE,
+    DLOG_ARG_POINTER,                   /* uintptr_t. */
+    DLOG_ARG_STRING                     /* Length byte, then the bytes. */
+} dlog_arg_e;
+
+typedef struct {
+    uint32_t written;                   /* Records taken. */
+    uint32_t dropped;                   /* Records lost to a full ring. */
+    uint32_t rendered;                  /* Lines written by the task. */
+} dlog_stats_t;
+
+/**
+ * @brief   Record being built on the caller's stack.
+ */
+typedef struct {
+    size_t len;
+    bool truncated;
+    uint8_t data[DLOG_RECORD_MAX_SIZE];
+} dlog_record_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   ESP_LOGx() with the formatting left to the dlog task: the call
+ *          site records the id of its format and its raw arguments. Levels
+ *          above LOG_LOCAL_LEVEL, set by each module, are compiled out. The
+ *          format is checked against the arguments as printf's.
+ */
+#define DLOG_LEVEL_LOCAL(level, tag, format, ...) do {                      \
+        if (LOG_LOCAL_LEVEL >= level) {                                     \
+            static const dlog_site_t dlog_site = { tag, format, level };    \
+            (void)sizeof(dlog_check_format(format, ##__VA_ARGS__));         \
+            dlog_write(&dlog_site, ##__VA_ARGS__);                          \
+        }                                                                   \
+    } while (0)
+
+#define DLOGE(tag, format, ...)                                             \
+    DLOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...)                                             \
+    DLOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...)                                             \
+    DLOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...)                                             \
+    DLOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...)                                             \
+    DLOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+/**
+ * @brief   Never called, only gives DLOG_LEVEL_LOCAL() printf's format
+ *          checks.
+ */
+int dlog_check_format(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief   Creates the dlog task, once. Records taken before wait for it.
+ */
+void dlog_start(void);
+
+/**
+ * @brief   Appends a built record to the ring, dropped if it is full. An
+ *          error wakes the dlog task at once, otherwise it renders every
+ *          DLOG_FLUSH_PERIOD_MS.
+ */
+void dlog_commit(const dlog_site_t *site, dlog_record_t *record);
+
+/**
+ * @brief   Waits until the dlog task rendered every record taken so far.
+ *
+ * @param   timeout_ms  - Longest wait.
+ * @return  true if it did.
+ */
+bool dlog_flush(uint32_t timeout_ms);
+
+void dlog_get_stats(dlog_stats_t *stats);
+
+/**
+ * @brief   GET /log handler, the rendered lines as a text/event-stream, one
+ *          event per line, from the last DLOG_STREAM_RING_SIZE bytes on.
+ */
+esp_err_t dlog_stream_handler(httpd_req_t *req);
+
+/**
+ * @brief   Appends `n` bytes to a record, past DLOG_RECORD_MAX_SIZE it is
+ *          cut.
+ */
+static inline void dlog_put(dlog_record_t *record, const void *data,
+                            size_t n)
+{
+    if (record->len + n > DLOG_RECORD_MAX_SIZE) {
+        record->truncated = true;
+        return;
+    }
+    memcpy(record->data + record->len, data, n);
+    record->len += n;
+}
+
+static inline void dlog_put_arg(dlog_record_t *record, dlog_arg_e type,
+                                const void *value, size_t n)
+{
+    const uint8_t tag = type;
+
+    dlog_put(record, &tag, 1);
+    dlog_put(record, value, n);
+}
+
+static inline void dlog_put_string(dlog_record_t *record, const char *value)
+{
+    const char *string = (value != NULL) ? value : "(null)";
+    const uint8_t tag = DLOG_ARG_STRING;
+    uint8_t len = 0;
+
+    /* Not strnlen(), GCC warns of its bound past a shorter literal. */
+    while (len < DLOG_STRING_MAX_LEN && string[len] != '\0') {
+        len++;
+    }
+
+    dlog_put(record, &tag, 1);
+    dlog_put(record, &len, 1);
+    dlog_put(record, string, len);
+}
+
+/**
+ * @brief   Records one argument by its type: integers and enums as 32 or
+ *          64 bits, floating point as double, strings copied, other
+ *          pointers as addresses.
+ */
+template <typename T>
+static inline void dlog_put_value(dlog_record_t *record, T value)
+{
+    if constexpr (std::is_same<T, const char *>::value
+                    || std::is_same<T, char *>::value) {
+        dlog_put_string(record, value);
+    } else if constexpr (std::is_pointer<T>::value) {
+        const uintptr_t address = (uintptr_t)value;
+
+        dlog_put_arg(record, DLOG_ARG_POINTER, &address, sizeof(address));
+    } else if constexpr (std::is_floating_point<T>::value) {
+        const double number = value;
+
+        dlog_put_arg(record, DLOG_ARG_DOUBLE, &number, sizeof(number));
+    } else if constexpr (std::is_enum<T>::value) {
+        dlog_put_value(record, (typename std::underlying_type<T>::type)value);
+    } else {
+        static_assert(std::is_integral<T>::value, "no printf argument");
+
+        if constexpr (sizeof(T) > 4 && std::is_signed<T>::value) {
+            const int64_t number = value;
+
+            dlog_put_arg(record, DLOG_ARG_INT64, &number, sizeof(number));
+        } else if constexpr (sizeof(T) > 4) {
+            const uint64_t number = value;
+
+            dlog_put_arg(record, DLOG_ARG_UINT64, &number, sizeof(number));
+        } else if constexpr (std::is_signed<T>::value) {
+            const int32_t number = value;
+
+            dlog_put_arg(record, DLOG_ARG_INT, &number, sizeof(number));
+        } else {
+            const uint32_t number = value;
+
+            dlog_put_arg(record, DLOG_ARG_UINT, &number, sizeof(number));
+        }
+    }
+}
+
+/**
+ * @brief   Builds the record of a call site and commits it. Arguments are
+ *          taken by value, arrays are recorded as the strings they hold.
+ */
+template <typename... Args>
+void dlog_write(const dlog_site_t *site, Args... args)
+{
+    dlog_record_t record;
+
+    record.len = 0;
+    record.truncated = false;
+    (dlog_put_value(&record, args), ...);
+    dlog_commit(site, &record);
+}
@@ -0,0 +1,365 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "trace.hpp"
+
+#define EVENT_BUS_RING_MASK             (EVENT_BUS_RING_SIZE - 1)
+
+static_assert((EVENT_BUS_RING_SIZE & EVENT_BUS_RING_MASK) == 0,
+                "EVENT_BUS_RING_SIZE must be a power of 2");
+static_assert(EVENT_BUS_MAX_SUBSCRIBERS <= 32, "one mask bit each");
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Ring slot. `seq` equals the position of the slot when it is free
+ *          for that position, and the position + 1 once the event is
+ *          written, so producers and consumers claim positions with one
+ *          compare-and-swap and never wait for each other.
+ */
+typedef struct {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint8_t> policy;        /* Of the event, peeked at unclaimed. */
+    event_bus_event_t event;
+} event_bus_slot_t;
+
+/**
+ * @brief   Bounded multi-producer ring of one subscriber. Its task is the
+ *          only regular consumer, publishers of DROP_OLDEST events also
+ *          take from the head to make room.
+ */
+struct event_bus_subscriber {
+    std::atomic<uint32_t> head;         /* Next position to take. */
+    std::atomic<uint32_t> tail;         /* Next position to write. */
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> high_water;   /* Most events ever in the ring. */
+    TaskHandle_t task;
+    bool used;
+    event_bus_slot_t slots[EVENT_BUS_RING_SIZE];
+};
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "event_bus";
+
+/**
+ * @brief   Full ring policy of every event type. Requests and state changes
+ *          are never overwritten, samples and progress only matter while
+ *          recent.
+ */
+static const event_bus_policy_e s_policies[EVENT_BUS_TYPE_MAX] = {
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_START_HTTP_SERVER */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_CONNECT_REQUESTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_DISCONNECT_REQUESTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_STA_RETRY */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_STA_CONNECTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_STA_DISCONNECTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_STA_GOT_IP */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_CONNECT_INIT */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_CONNECT_SUCCESS */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_CONNECT_FAIL */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_WIFI_DISCONNECTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_OTA_RESULT */
+    EVENT_BUS_DROP_OLDEST,      /* EVENT_BUS_OTA_PROGRESS */
+    EVENT_BUS_DROP_OLDEST,      /* EVENT_BUS_SENSOR_SAMPLE */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_MQTT_CONNECTED */
+    EVENT_BUS_DROP_NEWEST,      /* EVENT_BUS_MQTT_DISCONNECTED */
+    EVENT_BUS_DROP_NEWEST       /* EVENT_BUS_MQTT_PUBLISHED */
+};
+
+static event_bus_subscriber_t s_subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+static std::atomic<uint32_t> s_type_subscribers[EVENT_BUS_TYPE_MAX];
+static portMUX_TYPE s_subscribe_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Writes an event at the tail of a ring.
+ *
+ * @return  false if the ring is full.
+ */
+static bool event_bus_push(event_bus_subscriber_t *ring,
+                            const event_bus_event_t *event);
+
+/**
+ * @brief   Takes the event at the head of a ring.
+ *
+ * @param   event       - Receives the event.
+ * @param   policy_only - Only takes an event of a DROP_OLDEST type, the
+ *                        others are left in place.
+ * @return  false if the ring is empty, or if the head event was kept.
+ */
+static bool event_bus_pop(event_bus_subscriber_t *ring,
+                            event_bus_event_t *event,
+                            bool policy_only);
+
+/**
+ * @brief   Wakes the task of a subscriber, from a task or an ISR.
+ */
+static void event_bus_notify(event_bus_subscriber_t *subscriber);
+
+/* Public function definition ------------------------------------------------*/
+event_bus_subscriber_t *event_bus_subscribe(TaskHandle_t task,
+                                            const event_bus_type_e *types,
+                                            size_t count)
+{
+    event_bus_subscriber_t *subscriber = NULL;
+    size_t index = 0;
+
+    portENTER_CRITICAL(&s_subscribe_lock);
+    for (index = 0; index < EVENT_BUS_MAX_SUBSCRIBERS; index++) {
+        if (!s_subscribers[index].used) {
+            subscriber = &s_subscribers[index];
+            subscriber->used = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_subscribe_lock);
+
+    if (subscriber == NULL) {
+        DLOGE(TAG, "No subscriber left.");
+        return NULL;
+    }
+
+    /* 1. Empty ring, every slot free for its first position. */
+    subscriber->head.store(0, std::memory_order_relaxed);
+    subscriber->tail.store(0, std::memory_order_relaxed);
+    subscriber->dropped.store(0, std::memory_order_relaxed);
+    subscriber->high_water.store(0, std::memory_order_relaxed);
+    subscriber->task = task;
+    for (uint32_t i = 0; i < EVENT_BUS_RING_SIZE; i++) {
+        subscriber->slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /* 2. Published from now on. */
+    for (size_t i = 0; i < count; i++) {
+        s_type_subscribers[types[i]].fetch_or(1u << index,
+                                                std::memory_order_release);
+    }
+
+    return subscriber;
+}
+
+void event_bus_unsubscribe(event_bus_subscriber_t *subscriber)
+{
+    const uint32_t bit = 1u << (subscriber - s_subscribers);
+
+    for (size_t type = 0; type < EVENT_BUS_TYPE_MAX; type++) {
+        s_type_subscribers[type].fetch_and(~bit, std::memory_order_acq_rel);
+    }
+
+    portENTER_CRITICAL(&s_subscribe_lock);
+    subscriber->used = false;
+    portEXIT_CRITICAL(&s_subscribe_lock);
+}
+
+bool event_bus_publish(const event_bus_event_t *event)
+{
+    const event_bus_policy_e policy = s_policies[event->type];
+    uint32_t mask = s_type_subscribers[event->type].load(
+                                                std::memory_order_acquire);
+    bool delivered = true;
+
+    TRACE_INSTANT("event_bus_publish", event->type);
+    while (mask != 0) {
+        event_bus_subscriber_t *subscriber =
+                                    &s_subscribers[__builtin_ctz(mask)];
+        mask &= mask - 1;
+
+        /* A full ring makes room by dropping its oldest sample, once. A
+         * concurrent publisher can take the room first, then the new event
+         * is dropped after all. */
+        bool pushed = event_bus_push(subscriber, event);
+        if (!pushed && policy == EVENT_BUS_DROP_OLDEST) {
+            event_bus_event_t oldest;
+
+            if (event_bus_pop(subscriber, &oldest, true)) {
+                subscriber->dropped.fetch_add(1, std::memory_order_relaxed);
+                pushed = event_bus_push(subscriber, event);
+            }
+        }
+
+        if (pushed) {
+            event_bus_notify(subscriber);
+        } else {
+            subscriber->dropped.fetch_add(1, std::memory_order_relaxed);
+            delivered = false;
+        }
+    }
+
+    return delivered;
+}
+
+bool event_bus_publish_type(event_bus_type_e type)
+{
+    event_bus_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    return event_bus_publish(&event);
+}
+
+bool event_bus_receive(event_bus_subscriber_t *subscriber,
+                        event_bus_event_t *event,
+                        TickType_t timeout)
+{
+    const TickType_t start = xTaskGetTickCount();
+    TickType_t remaining = timeout;
+
+    /* A notification is given after every push, so one taken after an empty
+     * ring is never missed. One may also be stale, left by an event popped
+     * without waiting or taken by a DROP_OLDEST publisher: the ring is then
+     * still empty and the wait goes on until the deadline. */
+    while (!event_bus_pop(subscriber, event, false)) {
+        if (ulTaskNotifyTake(pdTRUE, remaining) == 0) {
+            return false;
+        }
+
+        if (timeout != portMAX_DELAY) {
+            const TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout) {
+                return event_bus_pop(subscriber, event, false);
+            }
+            remaining = timeout - elapsed;
+        }
+    }
+
+    return true;
+}
+
+uint32_t event_bus_dropped(const event_bus_subscriber_t *subscriber)
+{
+    return subscriber->dropped.load(std::memory_order_relaxed);
+}
+
+size_t event_bus_get_stats(event_bus_stats_t *stats, size_t max)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS && count < max; i++) {
+        const event_bus_subscriber_t *subscriber = &s_subscribers[i];
+
+        if (!subscriber->used) {
+            continue;
+        }
+
+        /* Head first, a tail read after it is never behind. */
+        const uint32_t head = subscriber->head.load(std::memory_order_relaxed);
+        const uint32_t tail = subscriber->tail.load(std::memory_order_relaxed);
+
+        stats[count].task = subscriber->task;
+        stats[count].depth = tail - head;
+        stats[count].high_water = subscriber->high_water.load(
+                                                std::memory_order_relaxed);
+        stats[count].dropped = subscriber->dropped.load(
+                                                std::memory_order_relaxed);
+        count++;
+    }
+    return count;
+}
+
+/* Private function definition -----------------------------------------------*/
+static bool event_bus_push(event_bus_subscriber_t *ring,
+                            const event_bus_event_t *event)
+{
+    uint32_t pos = ring->tail.load(std::memory_order_relaxed);
+    event_bus_slot_t *slot;
+
+    while (1) {
+        slot = &ring->slots[pos & EVENT_BUS_RING_MASK];
+        const uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        const int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            /* Free for this position, claim it. */
+            if (ring->tail.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Still holds the event of the previous lap. */
+            return false;
+        } else {
+            pos = ring->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    slot->policy.store(s_policies[event->type], std::memory_order_relaxed);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    /* Counts the slots claimed but not yet written too. */
+    const uint32_t depth = pos + 1 - ring->head.load(std::memory_order_relaxed);
+    uint32_t high_water = ring->high_water.load(std::memory_order_relaxed);
+    while (depth > high_water
+            && !ring->high_water.compare_exchange_weak(high_water, depth,
+                                            std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+static bool event_bus_pop(event_bus_subscriber_t *ring,
+                            event_bus_event_t *event,
+                            bool policy_only)
+{
+    uint32_t pos = ring->head.load(std::memory_order_relaxed);
+    event_bus_slot_t *slot;
+
+    while (1) {
+        slot = &ring->slots[pos & EVENT_BUS_RING_MASK];
+        const uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        const int32_t diff = (int32_t)(seq - (pos + 1));
+
+        if (diff == 0) {
+            /* Peeked before the claim, a stale policy is harmless as the
+             * claim then fails. */
+            if (policy_only
+                && slot->policy.load(std::memory_order_relaxed)
+                    != EVENT_BUS_DROP_OLDEST) {
+                return false;
+            }
+            if (ring->head.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Empty, or the producer of this position hasn't finished. */
+            return false;
+        } else {
+            pos = ring->head.load(std::memory_order_relaxed);
+        }
+    }
+
+    *event = slot->event;
+    slot->seq.store(pos + EVENT_BUS_RING_SIZE, std::memory_order_release);
+    return true;
+}
+
+static void event_bus_notify(event_bus_subscriber_t *subscriber)
+{
+    if (xPortInIsrContext()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+
+        vTaskNotifyGiveFromISR(subscriber->task,
+                                &higher_priority_task_woken);
+        if (higher_priority_task_woken) {
+            portYIELD_FROM_ISR();
+        }
+    } else {
+        xTaskNotifyGive(subscriber->task);
+    }
+}
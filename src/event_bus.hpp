@@ -0,0 +1,166 @@
+#pragma once
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * @brief   Every subscriber owns a ring of EVENT_BUS_RING_SIZE events, a
+ *          power of 2. Up to EVENT_BUS_MAX_SUBSCRIBERS tasks subscribe.
+ */
+#define EVENT_BUS_RING_SIZE             16
+#define EVENT_BUS_MAX_SUBSCRIBERS       4
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Event types of the whole application. The payload member of
+ *          event_bus_event_t used by each type is given next to it.
+ */
+typedef enum {
+    /* Requests to the WiFi application. */
+    EVENT_BUS_WIFI_START_HTTP_SERVER = 0,
+    EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS,
+    EVENT_BUS_WIFI_CONNECT_REQUESTED,
+    EVENT_BUS_WIFI_DISCONNECT_REQUESTED,
+    EVENT_BUS_WIFI_STA_RETRY,
+
+    /* WiFi driver and IP events. */
+    EVENT_BUS_WIFI_STA_CONNECTED,
+    EVENT_BUS_WIFI_STA_DISCONNECTED,        /* sta_disconnected */
+    EVENT_BUS_WIFI_STA_GOT_IP,              /* sta_got_ip */
+
+    /* Station state shown by the web page. */
+    EVENT_BUS_WIFI_CONNECT_INIT,
+    EVENT_BUS_WIFI_CONNECT_SUCCESS,
+    EVENT_BUS_WIFI_CONNECT_FAIL,
+    EVENT_BUS_WIFI_DISCONNECTED,
+
+    /* OTA updates, pushed or pulled. */
+    EVENT_BUS_OTA_RESULT,                   /* ota_result */
+    EVENT_BUS_OTA_PROGRESS,                 /* ota_progress */
+
+    /* Sensors. */
+    EVENT_BUS_SENSOR_SAMPLE,                /* sensor_sample */
+
+    /* MQTT client. */
+    EVENT_BUS_MQTT_CONNECTED,
+    EVENT_BUS_MQTT_DISCONNECTED,
+    EVENT_BUS_MQTT_PUBLISHED,               /* mqtt_published */
+
+    EVENT_BUS_TYPE_MAX
+} event_bus_type_e;
+
+/**
+ * @brief   What a publish does when a subscriber's ring is full.
+ */
+typedef enum {
+    EVENT_BUS_DROP_NEWEST = 0,      /* The new event is dropped. */
+    EVENT_BUS_DROP_OLDEST           /* The oldest event is overwritten. */
+} event_bus_policy_e;
+
+typedef struct {
+    event_bus_type_e type;
+    union {
+        struct {
+            uint8_t reason;                 /* wifi_err_reason_t. */
+        } sta_disconnected;
+        struct {
+            uint32_t ip;                    /* Network order. */
+            uint32_t netmask;
+            uint32_t gw;
+        } sta_got_ip;
+        struct {
+            int32_t reason;                 /* ota_update_reason_e. */
+        } ota_result;
+        struct {
+            uint32_t written;               /* Image bytes written. */
+            uint32_t total;                 /* Image size, 0 if unknown. */
+        } ota_progress;
+        struct {
+            int64_t time_ms;                /* Unix time, 0 if unset. */
+            float temperature;              /* Degrees Celsius. */
+            float humidity;                 /* Percent. */
+        } sensor_sample;
+        struct {
+            int32_t msg_id;                 /* QoS 1 message acknowledged. */
+        } mqtt_published;
+    };
+} event_bus_event_t;
+
+typedef struct event_bus_subscriber event_bus_subscriber_t;
+
+/**
+ * @brief   Ring of a subscriber, reported by event_bus_get_stats().
+ */
+typedef struct {
+    TaskHandle_t task;
+    uint32_t depth;                     /* Events waiting. */
+    uint32_t high_water;                /* Most events ever waiting. */
+    uint32_t dropped;
+} event_bus_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Subscribes a task to some event types. Events published from now
+ *          on are copied to its ring and the task is woken with a direct
+ *          notification, so it mustn't use task notifications for anything
+ *          else.
+ *
+ * @param   task    - Task calling event_bus_receive().
+ * @param   types   - Event types to receive.
+ * @param   count   - Number of types.
+ * @return  The subscriber, NULL if EVENT_BUS_MAX_SUBSCRIBERS are taken.
+ */
+event_bus_subscriber_t *event_bus_subscribe(TaskHandle_t task,
+                                            const event_bus_type_e *types,
+                                            size_t count);
+
+/**
+ * @brief   Stops delivering events to a subscriber and frees it. Must be
+ *          called before its task is deleted.
+ */
+void event_bus_unsubscribe(event_bus_subscriber_t *subscriber);
+
+/**
+ * @brief   Copies an event to the ring of every subscriber of its type.
+ *          Never blocks and lock-free, callable from any task or ISR. A full
+ *          ring is handled with the policy of the type.
+ *
+ * @param   event   - Event with the payload of its type.
+ * @return  true if every subscriber got it, false if one dropped it.
+ */
+bool event_bus_publish(const event_bus_event_t *event);
+
+/**
+ * @brief   Publishes an event without payload.
+ */
+bool event_bus_publish_type(event_bus_type_e type);
+
+/**
+ * @brief   Takes the oldest event of a subscriber's ring, waiting for one.
+ *          Only the subscribed task may call it.
+ *
+ * @param   subscriber  - From event_bus_subscribe().
+ * @param   event       - Receives the event.
+ * @param   timeout     - Ticks to wait, portMAX_DELAY for ever.
+ * @return  true if an event was received, false on timeout only: never
+ *          with portMAX_DELAY.
+ */
+bool event_bus_receive(event_bus_subscriber_t *subscriber,
+                        event_bus_event_t *event,
+                        TickType_t timeout);
+
+/**
+ * @brief   Events this subscriber lost to a full ring.
+ */
+uint32_t event_bus_dropped(const event_bus_subscriber_t *subscriber);
+
+/**
+ * @brief   Fills the ring statistics of the current subscribers.
+ *
+ * @param   stats   - Receives up to `max` subscribers.
+ * @return  Number of subscribers filled.
+ */
+size_t event_bus_get_stats(event_bus_stats_t *stats, size_t max);
@@ -0,0 +1,770 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <rom/crc.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "history_store.hpp"
+#include "metrics.hpp"
+#include "rollup.hpp"
+#include "task_placement.hpp"
+
+#define HISTORY_STORE_MAGIC             0x31545348      /* "HST1" */
+#define HISTORY_STORE_ERASED_LEN        0xFFFF
+
+/**
+ * @brief   Longest encoded sample: the time delta as a varint of up to 10
+ *          bytes, then the value deltas, 3 bytes each within int16 tenths.
+ */
+#define HISTORY_STORE_SAMPLE_MAX_LEN    16
+
+static_assert(HISTORY_STORE_BLOCK_SIZE == SPI_FLASH_SEC_SIZE,
+                "a block is erased on its own");
+static_assert(HISTORY_STORE_BATCH_SIZE * HISTORY_STORE_SAMPLE_MAX_LEN
+                    <= HISTORY_STORE_FRAME_MAX_LEN,
+                "a batch must fit a frame");
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Start of every block, written right after the erase.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                       /* Slot is seq % block count. */
+    int64_t base_ms;                    /* Time of the first sample. */
+    uint32_t reserved;                  /* Left erased. */
+    uint32_t crc;                       /* Of the fields above. */
+} history_store_header_t;
+
+/**
+ * @brief   Header of a frame. The payload follows, one sample after another
+ *          as varint deltas from the previous sample of the block: the time
+ *          in ms, then zigzag temperature and humidity in tenths. The first
+ *          sample of a block is relative to the block time and to zero.
+ */
+typedef struct {
+    uint16_t len;                       /* Payload, 0xFFFF if erased. */
+    uint16_t count;                     /* Samples. */
+    uint32_t crc;                       /* Of len, count and the payload. */
+} history_store_frame_t;
+
+typedef struct {
+    int64_t time_ms;
+    int16_t temperature;                /* Tenths. */
+    int16_t humidity;                   /* Tenths. */
+} history_store_entry_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "history_store";
+
+static const esp_partition_t *s_partition = NULL;
+static SemaphoreHandle_t s_lock = NULL;     /* Flash, index and head. */
+static TaskHandle_t s_history_store_task = NULL;
+static event_bus_subscriber_t *s_history_store_subscriber = NULL;
+
+static uint32_t s_block_count;
+static uint32_t s_index_s[HISTORY_STORE_MAX_BLOCKS];    /* Block start. */
+
+static uint32_t s_head_seq = 0;             /* 0 while the log is empty. */
+static uint32_t s_head_offset;              /* Next frame of the head. */
+static int64_t s_head_time_ms;              /* Last sample of the head. */
+static int32_t s_head_temperature;
+static int32_t s_head_humidity;
+
+static history_store_entry_t s_batch[HISTORY_STORE_BATCH_SIZE];
+static size_t s_batch_count = 0;
+static int64_t s_last_ms = 0;               /* Last sample appended. */
+static uint8_t s_frame[sizeof(history_store_frame_t)
+                        + HISTORY_STORE_FRAME_MAX_LEN];
+
+static uint32_t s_samples = 0;
+static uint32_t s_bytes = 0;
+static uint32_t s_erases = 0;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Replays the log into the rollups, then appends every sensor
+ *          sample once the clock is set.
+ *
+ * @param param
+ */
+static void history_store_task(void *param);
+
+/**
+ * @brief   Finds the head of the log from the block headers, fills the
+ *          index, then finds the end of the head block.
+ */
+static void history_store_recover(void);
+
+/**
+ * @brief   Checks the frames of the head block, the first torn one seals
+ *          it. s_lock held.
+ */
+static void history_store_scan_head(void);
+
+/**
+ * @brief   Erases the block after the head and writes its header. s_lock
+ *          held.
+ */
+static esp_err_t history_store_open_block(int64_t base_ms);
+
+/**
+ * @brief   Reads the header of a slot.
+ *
+ * @return  true if it is whole and belongs to the slot.
+ */
+static bool history_store_read_header(uint32_t slot,
+                                        history_store_header_t *header);
+
+/**
+ * @brief   Reads and checks the frame at `offset` of a slot.
+ *
+ * @return  ESP_OK, ESP_ERR_NOT_FOUND past the last frame of the block,
+ *          ESP_ERR_INVALID_CRC if it is torn or corrupt.
+ */
+static esp_err_t history_store_read_frame(uint32_t slot, uint32_t offset,
+                                            history_store_frame_t *frame,
+                                            uint8_t *payload);
+
+/**
+ * @brief   Encodes the batch after the given sample, which is updated to the
+ *          last one.
+ *
+ * @return  Payload length.
+ */
+static size_t history_store_encode(uint8_t *payload, int64_t *time_ms,
+                                    int32_t *temperature, int32_t *humidity);
+
+/**
+ * @brief   Decodes the sample at `*pos` of a payload and applies it to the
+ *          previous sample.
+ *
+ * @return  false if the payload ends within it.
+ */
+static bool history_store_decode(const uint8_t *payload, size_t len,
+                                    size_t *pos, int64_t *time_ms,
+                                    int32_t *temperature,
+                                    int32_t *humidity);
+
+static size_t history_store_put_varint(uint8_t *out, uint64_t value);
+static bool history_store_get_varint(const uint8_t *data, size_t len,
+                                        size_t *pos, uint64_t *value);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t history_store_init(void)
+{
+    if (s_partition != NULL) {
+        return ESP_OK;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(
+                                                ESP_PARTITION_TYPE_DATA,
+                                                ESP_PARTITION_SUBTYPE_ANY,
+                                                HISTORY_STORE_PARTITION);
+    if (partition == NULL) {
+        DLOGE(TAG, "No \"%s\" partition, history not kept.",
+                    HISTORY_STORE_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_block_count = partition->size / HISTORY_STORE_BLOCK_SIZE;
+    if (s_block_count > HISTORY_STORE_MAX_BLOCKS) {
+        s_block_count = HISTORY_STORE_MAX_BLOCKS;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_partition = partition;
+    history_store_recover();
+
+    return ESP_OK;
+}
+
+void history_store_start(void)
+{
+    if (s_history_store_task != NULL || history_store_init() != ESP_OK) {
+        return;
+    }
+
+    xTaskCreatePinnedToCore(&history_store_task,
+                            "history_store_task",
+                            HISTORY_STORE_TASK_STACK_SIZE,
+                            NULL,
+                            HISTORY_STORE_TASK_PRIORITY,
+                            &s_history_store_task,
+                            task_placement_core(TASK_PLACEMENT_HISTORY_STORE));
+}
+
+esp_err_t history_store_append(int64_t time_ms, float temperature,
+                                float humidity)
+{
+    if (s_partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const long temperature_tenths = lroundf(temperature * 10);
+    const long humidity_tenths = lroundf(humidity * 10);
+    if (!isfinite(temperature) || !isfinite(humidity)
+        || labs(temperature_tenths) > INT16_MAX
+        || labs(humidity_tenths) > INT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* The log is in time order, a clock stepped back drops samples until
+     * it catches up. */
+    if (time_ms < s_last_ms) {
+        DLOGD(TAG, "Sample before the last one dropped.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_last_ms = time_ms;
+
+    history_store_entry_t *entry = &s_batch[s_batch_count++];
+    entry->time_ms = time_ms;
+    entry->temperature = (int16_t)temperature_tenths;
+    entry->humidity = (int16_t)humidity_tenths;
+
+    if (s_batch_count == HISTORY_STORE_BATCH_SIZE) {
+        return history_store_flush();
+    }
+    return ESP_OK;
+}
+
+esp_err_t history_store_flush(void)
+{
+    history_store_frame_t frame;
+    uint8_t *payload = s_frame + sizeof(frame);
+    esp_err_t err = ESP_OK;
+
+    if (s_partition == NULL || s_batch_count == 0) {
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    /* 1. Encode after the last sample of the head block. */
+    int64_t time_ms = s_head_time_ms;
+    int32_t temperature = s_head_temperature;
+    int32_t humidity = s_head_humidity;
+    size_t len = history_store_encode(payload, &time_ms, &temperature,
+                                        &humidity);
+
+    /* 2. A frame that doesn't fit starts the next block, relative to it. */
+    if (s_head_seq == 0
+        || s_head_offset + sizeof(frame) + len > HISTORY_STORE_BLOCK_SIZE) {
+        err = history_store_open_block(s_batch[0].time_ms);
+        if (err == ESP_OK) {
+            time_ms = s_head_time_ms;
+            temperature = s_head_temperature;
+            humidity = s_head_humidity;
+            len = history_store_encode(payload, &time_ms, &temperature,
+                                        &humidity);
+        }
+    }
+
+    /* 3. Header and payload in one program, a power loss leaves a frame
+     * whose CRC fails. */
+    if (err == ESP_OK) {
+        frame.len = (uint16_t)len;
+        frame.count = (uint16_t)s_batch_count;
+        frame.crc = crc32_le(0, (const uint8_t *)&frame,
+                                offsetof(history_store_frame_t, crc));
+        frame.crc = crc32_le(frame.crc, payload, len);
+        memcpy(s_frame, &frame, sizeof(frame));
+
+        err = esp_partition_write(s_partition,
+                            (s_head_seq % s_block_count)
+                                * HISTORY_STORE_BLOCK_SIZE + s_head_offset,
+                            s_frame, sizeof(frame) + len);
+    }
+
+    if (err == ESP_OK) {
+        s_head_offset += sizeof(frame) + len;
+        s_head_time_ms = time_ms;
+        s_head_temperature = temperature;
+        s_head_humidity = humidity;
+        s_samples += s_batch_count;
+        s_bytes += sizeof(frame) + len;
+    } else {
+        /* The batch is lost, the next one goes to a fresh block. */
+        DLOGE(TAG, "Frame write failed: %s", esp_err_to_name(err));
+        s_head_offset = HISTORY_STORE_BLOCK_SIZE;
+    }
+    s_batch_count = 0;
+
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void history_store_query(history_store_cursor_t *cursor, int64_t from_ms,
+                            int64_t to_ms)
+{
+    cursor->offset = 0;
+    cursor->from_ms = from_ms;
+    cursor->to_ms = to_ms;
+    cursor->frame_len = 0;
+    cursor->frame_pos = 0;
+    cursor->seq = 1;
+
+    if (s_partition == NULL) {
+        cursor->seq = UINT32_MAX;
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    /* The last block started at or before `from_ms`, the start times of the
+     * blocks in the ring are in increasing order. */
+    const int64_t key = (from_ms > 0) ? from_ms / 1000 : 0;
+    uint32_t low = (s_head_seq >= s_block_count)
+                        ? s_head_seq - s_block_count + 1 : 1;
+    uint32_t high = s_head_seq;
+
+    cursor->seq = low;
+    while (low <= high) {
+        const uint32_t mid = low + (high - low) / 2;
+
+        if (s_index_s[mid % s_block_count] <= key) {
+            cursor->seq = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    xSemaphoreGive(s_lock);
+}
+
+bool history_store_next(history_store_cursor_t *cursor,
+                        history_store_sample_t *sample)
+{
+    while (1) {
+        /* 1. Samples of the current frame. */
+        while (cursor->frame_pos < cursor->frame_len) {
+            size_t pos = cursor->frame_pos;
+
+            if (!history_store_decode(cursor->frame, cursor->frame_len, &pos,
+                                        &cursor->time_ms,
+                                        &cursor->temperature,
+                                        &cursor->humidity)) {
+                cursor->frame_len = 0;
+                break;
+            }
+            cursor->frame_pos = (uint16_t)pos;
+
+            if (cursor->time_ms < cursor->from_ms) {
+                continue;
+            }
+            if (cursor->time_ms > cursor->to_ms) {
+                cursor->seq = UINT32_MAX;
+                cursor->frame_len = 0;
+                return false;
+            }
+
+            sample->time_ms = cursor->time_ms;
+            sample->temperature = cursor->temperature / 10.0f;
+            sample->humidity = cursor->humidity / 10.0f;
+            return true;
+        }
+
+        /* 2. The next frame, in this block or the following ones. */
+        history_store_frame_t frame;
+        history_store_header_t header;
+        bool loaded = false;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        while (!loaded && cursor->seq <= s_head_seq) {
+            const uint32_t slot = cursor->seq % s_block_count;
+
+            /* Recycled since the query started, or never written. */
+            if (!history_store_read_header(slot, &header)
+                || header.seq != cursor->seq) {
+                cursor->seq++;
+                cursor->offset = 0;
+                continue;
+            }
+            if (header.base_ms > cursor->to_ms) {
+                cursor->seq = UINT32_MAX;
+                break;
+            }
+            if (cursor->offset == 0) {
+                cursor->offset = sizeof(header);
+                cursor->time_ms = header.base_ms;
+                cursor->temperature = 0;
+                cursor->humidity = 0;
+            }
+
+            if (history_store_read_frame(slot, cursor->offset, &frame,
+                                            cursor->frame) == ESP_OK) {
+                cursor->offset += sizeof(frame) + frame.len;
+                cursor->frame_len = frame.len;
+                cursor->frame_pos = 0;
+                loaded = true;
+            } else if (cursor->seq == s_head_seq) {
+                /* The end of the log. */
+                cursor->seq = UINT32_MAX;
+            } else {
+                cursor->seq++;
+                cursor->offset = 0;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        if (!loaded) {
+            return false;
+        }
+    }
+}
+
+void history_store_get_stats(history_store_stats_t *stats)
+{
+    history_store_header_t header;
+
+    memset(stats, 0, sizeof(*stats));
+    if (s_partition == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    stats->blocks = s_block_count;
+    stats->used_blocks = (s_head_seq < s_block_count) ? s_head_seq
+                                                        : s_block_count;
+    for (uint32_t seq = (s_head_seq >= s_block_count)
+                            ? s_head_seq - s_block_count + 1 : 1;
+            seq <= s_head_seq; seq++) {
+        if (history_store_read_header(seq % s_block_count, &header)
+            && header.seq == seq) {
+            stats->oldest_ms = header.base_ms;
+            break;
+        }
+    }
+    stats->newest_ms = (s_head_seq != 0) ? s_head_time_ms : 0;
+    stats->samples = s_samples;
+    stats->bytes = s_bytes;
+    stats->erases = s_erases;
+
+    xSemaphoreGive(s_lock);
+}
+
+/* Private function definition -----------------------------------------------*/
+static void history_store_task(void *param)
+{
+    static const event_bus_type_e types[] = {
+        EVENT_BUS_SENSOR_SAMPLE
+    };
+    event_bus_event_t event;
+
+    metrics_register_task(NULL, HISTORY_STORE_TASK_STACK_SIZE);
+    s_history_store_subscriber = event_bus_subscribe(
+                                        xTaskGetCurrentTaskHandle(),
+                                        types,
+                                        sizeof(types) / sizeof(types[0]));
+
+    /* 1. The rollups survive a reboot, rebuilt from the log while the
+     * sampler already feeds them. A bucket takes samples in any order. */
+    {
+        history_store_cursor_t cursor;
+        history_store_sample_t sample;
+        uint32_t count = 0;
+        const int64_t start_us = esp_timer_get_time();
+
+        history_store_query(&cursor, 0, INT64_MAX);
+        while (history_store_next(&cursor, &sample)) {
+            rollup_add(sample.time_ms, sample.temperature, sample.humidity);
+            count++;
+        }
+        DLOGI(TAG, "Rollups rebuilt from %u samples in %lld ms.",
+                    (unsigned)count,
+                    (long long)((esp_timer_get_time() - start_us) / 1000));
+    }
+
+    /* 2. Samples from now on. */
+    while (1) {
+        if (!event_bus_receive(s_history_store_subscriber, &event,
+                                portMAX_DELAY)) {
+            continue;
+        }
+
+        /* Taken before the clock was set. */
+        if (event.sensor_sample.time_ms == 0) {
+            continue;
+        }
+
+        history_store_append(event.sensor_sample.time_ms,
+                                event.sensor_sample.temperature,
+                                event.sensor_sample.humidity);
+    }
+}
+
+static void history_store_recover(void)
+{
+    history_store_header_t header;
+    const int64_t start_us = esp_timer_get_time();
+
+    /* 1. The highest sequence number is the head. */
+    s_head_seq = 0;
+    for (uint32_t slot = 0; slot < s_block_count; slot++) {
+        s_index_s[slot] = 0;
+        if (history_store_read_header(slot, &header)
+            && header.seq > s_head_seq) {
+            s_head_seq = header.seq;
+        }
+    }
+
+    if (s_head_seq == 0) {
+        DLOGI(TAG, "Empty log of %u blocks.", (unsigned)s_block_count);
+        return;
+    }
+
+    /* 2. Start times in ring order. A block lost to an interrupted erase
+     * takes the time of the one before, the index stays sorted. */
+    uint32_t previous_s = 0;
+    for (uint32_t seq = (s_head_seq >= s_block_count)
+                            ? s_head_seq - s_block_count + 1 : 1;
+            seq <= s_head_seq; seq++) {
+        const uint32_t slot = seq % s_block_count;
+
+        if (history_store_read_header(slot, &header) && header.seq == seq) {
+            previous_s = (uint32_t)(header.base_ms / 1000);
+        }
+        s_index_s[slot] = previous_s;
+    }
+
+    /* 3. Where appending resumes. */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    history_store_scan_head();
+    xSemaphoreGive(s_lock);
+
+    s_last_ms = s_head_time_ms;
+    DLOGI(TAG, "Log recovered in %lld ms, head block %u at %u bytes.",
+                (long long)((esp_timer_get_time() - start_us) / 1000),
+                (unsigned)s_head_seq, (unsigned)s_head_offset);
+}
+
+static void history_store_scan_head(void)
+{
+    const uint32_t slot = s_head_seq % s_block_count;
+    history_store_header_t header;
+    history_store_frame_t frame;
+    uint8_t *payload = s_frame + sizeof(frame);
+
+    if (!history_store_read_header(slot, &header)
+        || header.seq != s_head_seq) {
+        s_head_offset = HISTORY_STORE_BLOCK_SIZE;
+        return;
+    }
+
+    s_head_offset = sizeof(header);
+    s_head_time_ms = header.base_ms;
+    s_head_temperature = 0;
+    s_head_humidity = 0;
+
+    while (1) {
+        const esp_err_t err = history_store_read_frame(slot, s_head_offset,
+                                                        &frame, payload);
+        if (err == ESP_ERR_NOT_FOUND) {
+            return;
+        }
+
+        /* Frames after a torn one can't be trusted, the block is closed
+         * and appending goes on in the next one. */
+        size_t pos = 0;
+        for (size_t i = 0; err == ESP_OK && i < frame.count; i++) {
+            if (!history_store_decode(payload, frame.len, &pos,
+                                        &s_head_time_ms,
+                                        &s_head_temperature,
+                                        &s_head_humidity)) {
+                break;
+            }
+        }
+        if (err != ESP_OK || pos != frame.len) {
+            DLOGW(TAG, "Torn frame at %u of block %u, block closed.",
+                        (unsigned)s_head_offset, (unsigned)s_head_seq);
+            s_head_offset = HISTORY_STORE_BLOCK_SIZE;
+            return;
+        }
+
+        s_head_offset += sizeof(frame) + frame.len;
+    }
+}
+
+static esp_err_t history_store_open_block(int64_t base_ms)
+{
+    const uint32_t seq = s_head_seq + 1;
+    const uint32_t slot = seq % s_block_count;
+    const size_t address = slot * HISTORY_STORE_BLOCK_SIZE;
+    history_store_header_t header;
+
+    /* 1. The oldest block makes room, each block is erased once a lap. */
+    esp_err_t err = esp_partition_erase_range(s_partition, address,
+                                                HISTORY_STORE_BLOCK_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_erases++;
+
+    /* 2. Until the header is written the block is one of the lost ones. */
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = HISTORY_STORE_MAGIC;
+    header.seq = seq;
+    header.base_ms = base_ms;
+    header.crc = crc32_le(0, (const uint8_t *)&header,
+                            offsetof(history_store_header_t, crc));
+
+    err = esp_partition_write(s_partition, address, &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_head_seq = seq;
+    s_head_offset = sizeof(header);
+    s_head_time_ms = base_ms;
+    s_head_temperature = 0;
+    s_head_humidity = 0;
+    s_index_s[slot] = (uint32_t)(base_ms / 1000);
+    s_bytes += sizeof(header);
+
+    return ESP_OK;
+}
+
+static bool history_store_read_header(uint32_t slot,
+                                        history_store_header_t *header)
+{
+    if (esp_partition_read(s_partition, slot * HISTORY_STORE_BLOCK_SIZE,
+                            header, sizeof(*header)) != ESP_OK) {
+        return false;
+    }
+
+    return header->magic == HISTORY_STORE_MAGIC
+            && header->seq != 0
+            && header->seq % s_block_count == slot
+            && header->crc == crc32_le(0, (const uint8_t *)header,
+                                    offsetof(history_store_header_t, crc));
+}
+
+static esp_err_t history_store_read_frame(uint32_t slot, uint32_t offset,
+                                            history_store_frame_t *frame,
+                                            uint8_t *payload)
+{
+    const size_t address = slot * HISTORY_STORE_BLOCK_SIZE + offset;
+
+    if (offset + sizeof(*frame) > HISTORY_STORE_BLOCK_SIZE
+        || esp_partition_read(s_partition, address, frame, sizeof(*frame))
+            != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (frame->len == HISTORY_STORE_ERASED_LEN) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (frame->len > HISTORY_STORE_FRAME_MAX_LEN
+        || offset + sizeof(*frame) + frame->len > HISTORY_STORE_BLOCK_SIZE
+        || esp_partition_read(s_partition, address + sizeof(*frame),
+                                payload, frame->len) != ESP_OK) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint32_t crc = crc32_le(0, (const uint8_t *)frame,
+                            offsetof(history_store_frame_t, crc));
+    crc = crc32_le(crc, payload, frame->len);
+
+    return (crc == frame->crc) ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+static size_t history_store_encode(uint8_t *payload, int64_t *time_ms,
+                                    int32_t *temperature, int32_t *humidity)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < s_batch_count; i++) {
+        const history_store_entry_t *entry = &s_batch[i];
+        const int32_t temperature_delta = entry->temperature - *temperature;
+        const int32_t humidity_delta = entry->humidity - *humidity;
+
+        len += history_store_put_varint(payload + len,
+                                    (uint64_t)(entry->time_ms - *time_ms));
+        len += history_store_put_varint(payload + len,
+                                    ((uint32_t)temperature_delta << 1)
+                                        ^ (uint32_t)(temperature_delta >> 31));
+        len += history_store_put_varint(payload + len,
+                                    ((uint32_t)humidity_delta << 1)
+                                        ^ (uint32_t)(humidity_delta >> 31));
+
+        *time_ms = entry->time_ms;
+        *temperature = entry->temperature;
+        *humidity = entry->humidity;
+    }
+
+    return len;
+}
+
+static bool history_store_decode(const uint8_t *payload, size_t len,
+                                    size_t *pos, int64_t *time_ms,
+                                    int32_t *temperature,
+                                    int32_t *humidity)
+{
+    uint64_t time_delta;
+    uint64_t temperature_delta;
+    uint64_t humidity_delta;
+
+    if (!history_store_get_varint(payload, len, pos, &time_delta)
+        || !history_store_get_varint(payload, len, pos, &temperature_delta)
+        || !history_store_get_varint(payload, len, pos, &humidity_delta)) {
+        return false;
+    }
+
+    *time_ms += (int64_t)time_delta;
+    *temperature += (int32_t)((temperature_delta >> 1)
+                                ^ (~(temperature_delta & 1) + 1));
+    *humidity += (int32_t)((humidity_delta >> 1)
+                                ^ (~(humidity_delta & 1) + 1));
+    return true;
+}
+
+static size_t history_store_put_varint(uint8_t *out, uint64_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+
+    return len;
+}
+
+static bool history_store_get_varint(const uint8_t *data, size_t len,
+                                        size_t *pos, uint64_t *value)
+{
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 64 && *pos < len; shift += 7) {
+        const uint8_t byte = data[(*pos)++];
+
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
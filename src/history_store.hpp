@@ -0,0 +1,111 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @brief   A block is one flash sector, the erase unit. A frame is a batch
+ *          of samples written at once, at most HISTORY_STORE_FRAME_MAX_LEN
+ *          encoded bytes.
+ */
+#define HISTORY_STORE_BLOCK_SIZE        4096
+#define HISTORY_STORE_FRAME_MAX_LEN     512
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   A stored sample. Values keep the 0.1 resolution of the sensor.
+ */
+typedef struct {
+    int64_t time_ms;                    /* Unix time. */
+    float temperature;                  /* Degrees Celsius. */
+    float humidity;                     /* Percent. */
+} history_store_sample_t;
+
+/**
+ * @brief   Read position of a history_store_query(), on the reader's stack.
+ *          The decoded frame is kept so flash is read once per frame.
+ */
+typedef struct {
+    uint32_t seq;                       /* Block being read. */
+    uint32_t offset;                    /* Next frame in the block. */
+    int64_t from_ms;
+    int64_t to_ms;
+    int64_t time_ms;                    /* Previous sample, delta base. */
+    int32_t temperature;                /* Tenths. */
+    int32_t humidity;                   /* Tenths. */
+    uint16_t frame_len;
+    uint16_t frame_pos;
+    uint8_t frame[HISTORY_STORE_FRAME_MAX_LEN];
+} history_store_cursor_t;
+
+typedef struct {
+    uint32_t blocks;                    /* Blocks of the partition. */
+    uint32_t used_blocks;               /* Holding samples. */
+    int64_t oldest_ms;                  /* First sample kept, 0 if none. */
+    int64_t newest_ms;                  /* Last sample on flash, 0 if none. */
+    uint32_t samples;                   /* Appended since boot. */
+    uint32_t bytes;                     /* Written since boot, headers too. */
+    uint32_t erases;                    /* Blocks erased since boot. */
+} history_store_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Opens the HISTORY_STORE_PARTITION partition and recovers the log
+ *          from the block headers. Called by history_store_start(), or
+ *          before it to append samples of another source.
+ * @note    The partition is a ring of blocks, each starting with a header
+ *          holding its sequence number and the time of its first sample.
+ *          After a power loss the header with the highest sequence number
+ *          is the head of the log, and the frames of that block are checked
+ *          up to the first one that is torn. Blocks are erased in turn once
+ *          per lap, so the wear is spread evenly over the partition.
+ *
+ * @return  ESP_OK, ESP_ERR_NOT_FOUND without the partition.
+ */
+esp_err_t history_store_init(void);
+
+/**
+ * @brief   Starts the task appending every EVENT_BUS_SENSOR_SAMPLE, stamped
+ *          with the Unix time. Samples taken before the clock is set are
+ *          not logged.
+ */
+void history_store_start(void);
+
+/**
+ * @brief   Appends a sample to the batch in RAM, the batch is written as
+ *          one frame every HISTORY_STORE_BATCH_SIZE samples. Samples older
+ *          than the last one are dropped. A single task appends.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_STATE before history_store_init(),
+ *          otherwise the flash error of the frame write.
+ */
+esp_err_t history_store_append(int64_t time_ms, float temperature,
+                                float humidity);
+
+/**
+ * @brief   Writes the batch to flash now. Called by the appending task.
+ */
+esp_err_t history_store_flush(void);
+
+/**
+ * @brief   Starts reading the samples between `from_ms` and `to_ms`. The
+ *          first block is found in the index of block start times, so the
+ *          cost doesn't grow with the history before `from_ms`.
+ */
+void history_store_query(history_store_cursor_t *cursor, int64_t from_ms,
+                            int64_t to_ms);
+
+/**
+ * @brief   Reads the next sample of a query, oldest first, from any task.
+ *          Samples still in the RAM batch are not returned. A block
+ *          recycled under the reader is skipped.
+ *
+ * @return  false at the end of the range.
+ */
+bool history_store_next(history_store_cursor_t *cursor,
+                        history_store_sample_t *sample);
+
+void history_store_get_stats(history_store_stats_t *stats);
@@ -1,13 +1,221 @@
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
 #include <esp_http_server.h>
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_ota_ops.h>
+#include <esp_random.h>
+#include <esp_wifi.h>
 #include <mesh_util.h>
 
 #include "config.hpp"
+#include "dht_sensor.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "history_store.hpp"
+#include "cbor_writer.hpp"
 #include "http_server.hpp"
+#include "http_worker.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
+#include "multipart_parser.hpp"
+#include "ota_client.hpp"
+#include "ota_writer.hpp"
+#include "rollup.hpp"
+#include "static_assets.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
+#include "wifi_app.hpp"
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Event types pushed on /events, also the sections of /status.json.
+ *          Each keeps only its latest payload, so a slow client skips the
+ *          states it couldn't take in time.
+ */
+typedef enum {
+    HTTP_SERVER_EVENT_OTA = 0,
+    HTTP_SERVER_EVENT_WIFI,
+    HTTP_SERVER_EVENT_SENSOR,
+    HTTP_SERVER_EVENT_TIME,
+    HTTP_SERVER_EVENT_AP,
+    HTTP_SERVER_EVENT_MAX
+} http_server_event_e;
+
+typedef struct {
+    uint32_t version;                       /* s_status_version when set. */
+    char data[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+} http_server_event_t;
+
+/**
+ * @brief   JSON schemas of the sections, their bounds are checked against
+ *          HTTP_SERVER_EVENT_DATA_MAX_LEN at compile time.
+ */
+JSON_KEY(ota_update_status);
+JSON_KEY(ota_update_reason);
+JSON_KEY(ota_bytes_written);
+JSON_KEY(ota_image_size);
+JSON_KEY(compile_time);
+JSON_KEY(compile_date);
+JSON_KEY(wifi_connect_status);
+JSON_KEY(ap);
+JSON_KEY(ip);
+JSON_KEY(netmask);
+JSON_KEY(gw);
+JSON_KEY(temp);
+JSON_KEY(humidity);
+JSON_KEY(time);
+JSON_KEY(ssid);
+JSON_KEY(version);
+JSON_KEY(ota);
+JSON_KEY(wifi);
+JSON_KEY(sensor);
+JSON_KEY(lateness_us);
+JSON_KEY(capture_us);
+JSON_KEY(reads);
+JSON_KEY(errors);
+JSON_KEY(max_lateness_us);
+JSON_KEY(max_capture_us);
+JSON_KEY(history);
+JSON_KEY(oldest);
+JSON_KEY(newest);
+JSON_KEY(samples);
+JSON_KEY(res);
+JSON_KEY(count);
+JSON_KEY(min);
+JSON_KEY(max);
+JSON_KEY(mean);
+JSON_KEY(buckets);
+
+typedef json_object<
+    json_field<json_key_ota_update_status, json_int<int>>,
+    json_field<json_key_ota_update_reason, json_int<int>>,
+    json_field<json_key_ota_bytes_written, json_int<uint32_t>>,
+    json_field<json_key_ota_image_size, json_int<uint32_t>>,
+    json_field<json_key_compile_time, json_string<sizeof(__TIME__) - 1>>,
+    json_field<json_key_compile_date, json_string<sizeof(__DATE__) - 1>>
+> http_server_ota_json_t;
+
+typedef json_object<
+    json_field<json_key_wifi_connect_status, json_int<int>>
+> http_server_wifi_status_json_t;
+
+typedef json_object<
+    json_field<json_key_wifi_connect_status, json_int<int>>,
+    json_field<json_key_ap, json_string<MAX_SSID_LENGTH>>,
+    json_field<json_key_ip, json_ipv4>,
+    json_field<json_key_netmask, json_ipv4>,
+    json_field<json_key_gw, json_ipv4>
+> http_server_wifi_info_json_t;
+
+typedef json_object<
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>
+> http_server_sensor_json_t;
+
+/**
+ * @brief   /dhtSensor.json, the latest values then the ring of samples. The
+ *          time of a sample is in milliseconds since boot.
+ */
+typedef json_object<
+    json_field<json_key_time, json_int<uint32_t>>,
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>,
+    json_field<json_key_lateness_us, json_int<uint32_t>>,
+    json_field<json_key_capture_us, json_int<uint32_t>>
+> http_server_dht_sample_json_t;
+
+typedef json_object<
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>,
+    json_field<json_key_reads, json_int<uint32_t>>,
+    json_field<json_key_errors, json_int<uint32_t>>,
+    json_field<json_key_max_lateness_us, json_int<uint32_t>>,
+    json_field<json_key_max_capture_us, json_int<uint32_t>>,
+    json_field<json_key_history, json_array<http_server_dht_sample_json_t,
+                                            DHT_SENSOR_RING_SIZE>>
+> http_server_dht_json_t;
+
+/**
+ * @brief   /history, the range kept on flash then the samples asked for,
+ *          streamed as they are read. Times are Unix time in milliseconds.
+ */
+typedef json_object<
+    json_field<json_key_time, json_int<int64_t>>,
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>
+> http_server_history_sample_json_t;
+
+typedef json_object<
+    json_field<json_key_oldest, json_int<int64_t>>,
+    json_field<json_key_newest, json_int<int64_t>>,
+    json_field<json_key_samples,
+                json_stream<http_server_history_sample_json_t>>
+> http_server_history_json_t;
+
+/**
+ * @brief   /rollup.json, the period in seconds then the buckets holding
+ *          samples, each stamped with the Unix time of its start in ms.
+ */
+typedef json_object<
+    json_field<json_key_min, json_fixed<1>>,
+    json_field<json_key_max, json_fixed<1>>,
+    json_field<json_key_mean, json_fixed<2>>
+> http_server_rollup_stat_json_t;
+
+typedef json_object<
+    json_field<json_key_time, json_int<int64_t>>,
+    json_field<json_key_count, json_int<uint32_t>>,
+    json_field<json_key_temp, http_server_rollup_stat_json_t>,
+    json_field<json_key_humidity, http_server_rollup_stat_json_t>
+> http_server_rollup_bucket_json_t;
+
+typedef json_object<
+    json_field<json_key_res, json_int<uint32_t>>,
+    json_field<json_key_buckets,
+                json_stream<http_server_rollup_bucket_json_t>>
+> http_server_rollup_json_t;
+
+typedef json_object<
+    json_field<json_key_time, json_string<HTTP_SERVER_LOCAL_TIME_MAX_LEN>>
+> http_server_time_json_t;
+
+typedef json_object<
+    json_field<json_key_ssid, json_string<MAX_SSID_LENGTH>>
+> http_server_ap_json_t;
+
+/**
+ * @brief   /status.json, a section is left out when its value is NULL.
+ */
+typedef json_raw<HTTP_SERVER_EVENT_DATA_MAX_LEN - 1> http_server_section_t;
+typedef json_object<
+    json_field<json_key_version, json_int<uint32_t>>,
+    json_optional_field<json_key_ota, http_server_section_t>,
+    json_optional_field<json_key_wifi, http_server_section_t>,
+    json_optional_field<json_key_sensor, http_server_section_t>,
+    json_optional_field<json_key_time, http_server_section_t>,
+    json_optional_field<json_key_ap, http_server_section_t>
+> http_server_status_json_t;
+
+/**
+ * @brief   An /events stream. A frame the socket didn't take at once stays in
+ *          `pending` and is finished before anything newer is sent.
+ */
+typedef struct {
+    int fd;                                 /* -1 if the slot is free. */
+    bool closing;
+    uint32_t sent[HTTP_SERVER_EVENT_MAX];   /* Versions already sent. */
+    char pending[HTTP_SERVER_EVENT_DATA_MAX_LEN + 32];
+    size_t pending_len;
+    size_t pending_off;
+} http_server_events_client_t;
 
 /* Private variables ---------------------------------------------------------*/
 
@@ -17,8 +225,30 @@
 static const char TAG[] = "http_server";
 static httpd_handle_t s_http_server_handler = NULL;
 static TaskHandle_t s_http_server_monitor = NULL;
-static QueueHandle_t s_http_server_event_queue = NULL;
+static event_bus_subscriber_t *s_http_server_subscriber = NULL;
 static int g_fw_update_state = OTA_UPDATE_PENDING_STATE;
+static ota_update_reason_e s_fw_update_reason = OTA_UPDATE_REASON_NONE;
+static size_t s_ota_bytes_written = 0;
+static size_t s_ota_image_size = 0;
+static int s_wifi_connect_status = WIFI_CONNECT_NONE_STATE;
+static float s_sensor_temperature = 0.0f;
+static float s_sensor_humidity = 0.0f;
+
+static char s_local_time[HTTP_SERVER_LOCAL_TIME_MAX_LEN] = "";
+
+static const char *const s_event_names[HTTP_SERVER_EVENT_MAX] = {
+    "ota",
+    "wifi",
+    "sensor",
+    "time",
+    "ap"
+};
+static http_server_event_t s_events[HTTP_SERVER_EVENT_MAX];
+static uint32_t s_status_version = 0;   /* Version of the latest publish. */
+static SemaphoreHandle_t s_events_mutex = NULL;
+static http_server_events_client_t
+    s_events_clients[HTTP_SERVER_EVENTS_MAX_CLIENTS];
+static volatile bool s_events_flush_queued = false;
 
 const esp_timer_create_args_t g_fw_update_reset_args = {
     .callback = &http_server_fw_update_reset_callback,
@@ -29,39 +259,6 @@ const esp_timer_create_args_t g_fw_update_reset_args = {
 
 static esp_timer_handle_t s_fw_update_reset;
 
-/**
- * @brief   Embedded files.
- */
-extern const uint8_t
-jquery_3_3_1_min_js_start[] asm("_binary_resources_jquery_3_3_1_min_js_start");
-
-extern const uint8_t
-jquery_3_3_1_min_js_end[] asm("_binary_resources_jquery_3_3_1_min_js_end");
-
-extern const uint8_t
-index_html_start[] asm("_binary_resources_index_html_start");
-
-extern const uint8_t
-index_html_end[] asm("_binary_resources_index_html_end");
-
-extern const uint8_t
-app_css_start[] asm("_binary_resources_app_css_start");
-
-extern const uint8_t
-app_css_end[] asm("_binary_resources_app_css_end");
-
-extern const uint8_t
-app_js_start[] asm("_binary_resources_app_js_start");
-
-extern const uint8_t
-app_js_end[] asm("_binary_resources_app_js_end");
-
-extern const uint8_t
-favicon_ico_start[] asm("_binary_resources_favicon_ico_start");
-
-extern const uint8_t
-favicon_ico_end[] asm("_binary_resources_favicon_ico_end");
-
 /* Private function prototype ------------------------------------------------*/
 
 /**
@@ -72,18 +269,6 @@ favicon_ico_end[] asm("_binary_resources_favicon_ico_end");
  */
 static httpd_handle_t http_server_configure(void);
 
-/**
- * @brief   Jquery get handler requested when accessing the webpage.
- * 
- * @param req - HTTP request.
- * @return esp_err_t - ESP_OK.
- */
-static esp_err_t http_server_jquery_handler(httpd_req_t *req);
-static esp_err_t http_server_index_html_handler(httpd_req_t *req);
-static esp_err_t http_server_app_css_handler(httpd_req_t *req);
-static esp_err_t http_server_app_js_handler(httpd_req_t *req);
-static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req);
-
 /**
  * @brief   Receive binary file and handle firmware update.
  * 
@@ -93,6 +278,49 @@ static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req);
  */
 static esp_err_t http_server_ota_update_handler(httpd_req_t *req);
 
+/**
+ * @brief   The upload body of a session detached by the update handler,
+ *          before ESP-IDF 5.1.
+ *
+ * @param   conn    - Detached session.
+ * @param   arg     - The update partition.
+ * @return  esp_err_t
+ */
+static esp_err_t http_server_ota_update_detached(http_worker_conn_t *conn,
+                                                    void *arg);
+
+/**
+ * @brief   Receives the image into the begun OTA writer, from `req` or else
+ *          `conn`, switches the boot partition to `partition` once it is
+ *          verified and reports the result. The partition is released, the
+ *          response is left to the caller.
+ */
+static void http_server_ota_receive(httpd_req_t *req,
+                                    http_worker_conn_t *conn,
+                                    const esp_partition_t *partition,
+                                    int content_length);
+
+/**
+ * @brief   Starts a pull-mode update from the URL in the OTA_PULL_URL_HEADER
+ *          header, with an optional OTA_UPDATE_SHA256_HEADER digest.
+ *          Responds 202 at once, the result comes through /OTAstatus.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_ota_pull_handler(httpd_req_t *req);
+
+/**
+ * @brief   Reads the expected image digest from the OTA_UPDATE_SHA256_HEADER
+ *          header, 64 hex digits.
+ *
+ * @param   req     - HTTP request.
+ * @param   digest  - Receives OTA_WRITER_SHA256_LEN bytes.
+ * @return  ESP_OK, ESP_ERR_NOT_FOUND without the header, ESP_ERR_INVALID_ARG
+ *          if it isn't a SHA-256 digest.
+ */
+static esp_err_t http_server_get_sha256(httpd_req_t *req, uint8_t *digest);
+
 /**
  * @brief   OTA status handler responds with the firmware update status after
  *          the OTA update is started and responds with the compile time/date
@@ -103,6 +331,172 @@ static esp_err_t http_server_ota_update_handler(httpd_req_t *req);
  */
 static esp_err_t http_server_ota_status_handler(httpd_req_t *req);
 
+/**
+ * @brief   Connects the station to the network in the
+ *          WIFI_CONNECT_SSID_HEADER and WIFI_CONNECT_PWD_HEADER headers.
+ *          The result comes through the wifi section.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req);
+
+/**
+ * @brief   Disconnects the station and forgets its network.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_wifi_disconnect_handler(httpd_req_t *req);
+
+/**
+ * @brief   Responds with every /events section in one JSON object. With
+ *          `?since=<version>`, only the sections changed after that version
+ *          are included, and 304 if none changed.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_status_handler(httpd_req_t *req);
+
+/**
+ * @brief   Whether the client takes `application/cbor`, and asks for the
+ *          packed form with a `form=packed` parameter.
+ *
+ * @param req       - HTTP request.
+ * @param packed    - Set if the packed form is asked for.
+ * @return  true for CBOR, false for JSON.
+ */
+static bool http_server_accepts_cbor(httpd_req_t *req, bool *packed);
+
+/**
+ * @brief   Sends `Schema` as CBOR if the client asked for it, as JSON
+ *          otherwise. The answer depends on Accept, caches are told so.
+ */
+template <typename Schema, typename... Args>
+static esp_err_t http_server_send(httpd_req_t *req, const Args &... values);
+
+/**
+ * @brief   Responds with the latest DHT22 values, the read counters and the
+ *          last samples, `?history=<n>` limits them to n.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_dht_sensor_handler(httpd_req_t *req);
+
+/**
+ * @brief   Responds with the samples of the flash history between
+ *          `?from=<ms>` and `?to=<ms>`, all of them by default. The samples
+ *          are streamed as the log is read, whatever their number.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_history_handler(httpd_req_t *req);
+
+/**
+ * @brief   Responds with the rollup buckets of `?res=1m|15m|1h` (1m by
+ *          default) between `?from=<ms>` and `?to=<ms>`, those still kept
+ *          by default. The cost is the number of buckets returned.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_rollup_handler(httpd_req_t *req);
+
+/**
+ * @brief   Opens a Server-Sent Events stream. The response header is written
+ *          straight to the socket and the handler returns with the session
+ *          left open, events are sent later from httpd work items.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t
+ */
+static esp_err_t http_server_events_handler(httpd_req_t *req);
+
+/**
+ * @brief   Session free callback of an /events stream, releases its slot.
+ *
+ * @param   ctx     - The http_server_events_client_t of the stream.
+ */
+static void http_server_events_free_ctx(void *ctx);
+
+/**
+ * @brief   Replaces the payload of an event type and schedules a flush.
+ *
+ * @param   type    - Event type.
+ * @param   data    - JSON payload, shorter than
+ *                    HTTP_SERVER_EVENT_DATA_MAX_LEN.
+ */
+static void http_server_events_publish(http_server_event_e type,
+                                        const char *data);
+
+/**
+ * @brief   Publishes the ota event from the current update state.
+ */
+static void http_server_events_publish_ota(void);
+
+/**
+ * @brief   Clears the last OTA result and count, pending, once an upload or
+ *          a pull has the partition.
+ */
+static void http_server_ota_started(void);
+
+/**
+ * @brief   Publishes the wifi event, with the station addresses once it is
+ *          connected.
+ */
+static void http_server_events_publish_wifi(void);
+
+/**
+ * @brief   Publishes the time event when the local time, to the minute,
+ *          changed. Nothing before the clock is set.
+ */
+static void http_server_events_refresh_time(void);
+
+/**
+ * @brief   Queues a flush on the httpd task unless one is already queued, it
+ *          covers every publish made before it runs.
+ *
+ * @param   keepalive   - Also send a comment to the idle streams.
+ */
+static void http_server_events_schedule(bool keepalive);
+
+/**
+ * @brief   httpd work items sending the newest events to every stream.
+ *
+ * @param   arg     - Unused.
+ */
+static void http_server_events_flush(void *arg);
+static void http_server_events_keepalive(void *arg);
+
+/**
+ * @brief   Sends what a stream hasn't seen yet, never blocks.
+ *
+ * @param   client      - Stream.
+ * @param   keepalive   - Send a comment if there is nothing else.
+ */
+static void http_server_events_send(http_server_events_client_t *client,
+                                    bool keepalive);
+
+/**
+ * @brief   Writes as much of the pending frame as the socket takes.
+ *
+ * @param   client  - Stream.
+ * @return  true once the frame is fully sent, false if the socket is full or
+ *          the stream is closing.
+ */
+static bool http_server_events_send_pending(
+                                    http_server_events_client_t *client);
+
+/**
+ * @brief   httpd work item reporting the stack of the httpd task.
+ *
+ * @param   arg     - Unused.
+ */
+static void http_server_register_task(void *arg);
+
 /**
  * @brief   HTTP server monitor task used to track events of the HTTP server.
  * 
@@ -110,6 +504,13 @@ static esp_err_t http_server_ota_status_handler(httpd_req_t *req);
  */
 static void http_server_monitor(void *param);
 
+/**
+ * @brief   Publishes the outcome of a pushed update.
+ *
+ * @param   reason  - OTA_UPDATE_REASON_NONE on success.
+ */
+static void http_server_report_ota_result(ota_update_reason_e reason);
+
 /**
  * @brief   Checks fw update status and creates the update timer if ready.
  */
@@ -130,25 +531,22 @@ void http_server_stop(void)
         s_http_server_handler = NULL;
         httpd_stop(s_http_server_handler);
 
-        ESP_LOGI(TAG, "HTTP server stopped.");
+        DLOGI(TAG, "HTTP server stopped.");
     }
 
     if (s_http_server_monitor) {
+        event_bus_unsubscribe(s_http_server_subscriber);
+        metrics_unregister_task(s_http_server_monitor);
         vTaskDelete(s_http_server_monitor);
         s_http_server_monitor = NULL;
     }
 }
 
-BaseType_t http_server_monitor_send_message(http_server_message_e msgID)
-{
-    http_server_message_t msg;
-    msg.msgID = msgID;
-    return xQueueSend(s_http_server_event_queue, &msg, portMAX_DELAY);
-}
-
 void http_server_fw_update_reset_callback(void *param)
 {
-    ESP_LOGI(TAG, "Timer timed-out, resetting the device.");
+    /* The lines still waiting go out before the reset. */
+    DLOGI(TAG, "Timer timed-out, resetting the device.");
+    dlog_flush(HTTP_SERVER_RESET_LOG_FLUSH_MS);
     esp_restart();
 }
 
@@ -164,87 +562,188 @@ static httpd_handle_t http_server_configure(void)
                             NULL,
                             HTTP_SERVER_MONITOR_PRIORITY,
                             &s_http_server_monitor,
-                            HTTP_SERVER_MONITOR_CORE_ID);
+                            task_placement_core(TASK_PLACEMENT_HTTP_MONITOR));
 
-    /* 2. Create message queue. */
-    s_http_server_event_queue = xQueueCreate(
-                                HTTP_SERVER_MONITOR_MAX_QUEUE_HANDLE,
-                                sizeof(http_server_message_t));
+    /* 2. Workers of the long handlers: OTA upload, history and rollups. */
+    http_worker_start();
 
-    /* 3. The core that the HTTP server will run on. */
-    config.core_id = HTTP_SERVER_MONITOR_CORE_ID;
+    /* 3. Latest payload of each /events type, no stream is open yet. */
+    s_events_mutex = xSemaphoreCreateMutex();
+    /* A random start so a `since` from before a reboot doesn't match. */
+    s_status_version = esp_random() >> 1;
+    for (size_t i = 0; i < HTTP_SERVER_EVENTS_MAX_CLIENTS; i++) {
+        s_events_clients[i].fd = -1;
+    }
 
-    /* 4. Configure default priority to 1 less than the WiFi task. */
-    config.task_priority = HTTP_SERVER_MONITOR_PRIORITY;
+    /* 4. The core that the HTTP server will run on. */
+    config.core_id = task_placement_core(TASK_PLACEMENT_HTTP_SERVER);
+
+    /* 5. Configure default priority to 1 less than the WiFi task. */
+    config.task_priority = HTTP_SERVER_TASK_PRIORITY;
 
     config.stack_size = HTTP_SERVER_TASK_STACK_SIZE;
-    config.max_uri_handlers = 20;
+    /* The assets, ours, /metrics, /trace, /log and /placement. */
+    config.max_uri_handlers = static_assets_handler_count() + 16;
     config.recv_wait_timeout = HTTP_SERVER_RECV_WAIT_TIMEOUT;
     config.send_wait_timeout = HTTP_SERVER_SEND_WAIT_TIMEOUT;
     config.server_port = HTTP_SERVER_PORT;
 
-    ESP_LOGI(TAG, "Configured the HTTP server.");
-    ESP_LOGI(TAG, "Starting HTTP server on port: %d", config.server_port);
+    /* Event streams hold their sockets, let new requests reclaim the least
+     * recently used one, the browser reopens its stream by itself. */
+    config.lru_purge_enable = true;
+
+    /* Uploads leave the httpd task with their socket before ESP-IDF 5.1,
+     * its session is closed without it. */
+    config.close_fn = http_worker_close_session;
+
+    DLOGI(TAG, "Configured the HTTP server.");
+    DLOGI(TAG, "Starting HTTP server on port: %d", config.server_port);
 
     if (httpd_start(&s_http_server_handler, &config) == ESP_OK) {
         /* Register URI handler. */
 
-        httpd_uri_t jquery_js = {
-            .uri = "/jquery-3.3.1.min.js",
+        httpd_uri_t ota_update = {
+            .uri = "/OTAupdate",
+            .method = HTTP_POST,
+            .handler = http_server_ota_update_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t ota_pull = {
+            .uri = "/OTApull",
+            .method = HTTP_POST,
+            .handler = http_server_ota_pull_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t ota_status = {
+            .uri = "/OTAstatus",
             .method = HTTP_GET,
-            .handler = http_server_jquery_handler,
+            .handler = http_server_ota_status_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t wifi_connect = {
+            .uri = "/wifiConnect.json",
+            .method = HTTP_POST,
+            .handler = http_server_wifi_connect_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t wifi_disconnect = {
+            .uri = "/wifiDisconnect.json",
+            .method = HTTP_DELETE,
+            .handler = http_server_wifi_disconnect_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t index_html = {
-            .uri = "/index.html",
+        httpd_uri_t status = {
+            .uri = "/status.json",
             .method = HTTP_GET,
-            .handler = http_server_index_html_handler,
+            .handler = http_server_status_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t app_css = {
-            .uri = "/app.css",
+        httpd_uri_t dht_sensor = {
+            .uri = "/dhtSensor.json",
             .method = HTTP_GET,
-            .handler = http_server_app_css_handler,
+            .handler = http_server_dht_sensor_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t app_js = {
-            .uri = "/app.js",
+        httpd_uri_t history = {
+            .uri = "/history",
             .method = HTTP_GET,
-            .handler = http_server_app_js_handler,
+            .handler = http_server_history_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t favicon_ico = {
-            .uri = "/favicon.ico",
+        httpd_uri_t rollup = {
+            .uri = "/rollup.json",
             .method = HTTP_GET,
-            .handler = http_server_favicon_ico_handler,
+            .handler = http_server_rollup_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t ota_update = {
-            .uri = "/OTAupdate",
-            .method = HTTP_POST,
-            .handler = http_server_ota_update_handler,
+        httpd_uri_t events = {
+            .uri = "/events",
+            .method = HTTP_GET,
+            .handler = http_server_events_handler,
             .user_ctx = NULL
         };
 
-        httpd_uri_t ota_status = {
-            .uri = "/OTAstatus",
+        httpd_uri_t log = {
+            .uri = "/log",
             .method = HTTP_GET,
-            .handler = http_server_ota_status_handler,
+            .handler = dlog_stream_handler,
             .user_ctx = NULL
         };
 
-        httpd_register_uri_handler(s_http_server_handler, &jquery_js);
-        httpd_register_uri_handler(s_http_server_handler, &index_html);
-        httpd_register_uri_handler(s_http_server_handler, &app_css);
-        httpd_register_uri_handler(s_http_server_handler, &app_js);
-        httpd_register_uri_handler(s_http_server_handler, &favicon_ico);
-        httpd_register_uri_handler(s_http_server_handler, &ota_update);
-        httpd_register_uri_handler(s_http_server_handler, &ota_status);
+        httpd_uri_t metrics = {
+            .uri = "/metrics",
+            .method = HTTP_GET,
+            .handler = metrics_send,
+            .user_ctx = NULL
+        };
+        httpd_uri_t placement_get = {
+            .uri = "/placement",
+            .method = HTTP_GET,
+            .handler = task_placement_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t placement_set = {
+            .uri = "/placement",
+            .method = HTTP_POST,
+            .handler = task_placement_handler,
+            .user_ctx = NULL
+        };
+
+        httpd_uri_t placement_wakeup = {
+            .uri = "/placement/wakeup",
+            .method = HTTP_GET,
+            .handler = task_placement_wakeup_handler,
+            .user_ctx = NULL
+        };
+#if TRACE_ENABLED
+        httpd_uri_t trace = {
+            .uri = "/trace",
+            .method = HTTP_GET,
+            .handler = trace_send,
+            .user_ctx = NULL
+        };
+#endif
+
+        /* Every handler is timed. */
+        static_assets_register(s_http_server_handler);
+        metrics_register_uri_handler(s_http_server_handler, &ota_update);
+        metrics_register_uri_handler(s_http_server_handler, &ota_pull);
+        metrics_register_uri_handler(s_http_server_handler, &ota_status);
+        metrics_register_uri_handler(s_http_server_handler, &wifi_connect);
+        metrics_register_uri_handler(s_http_server_handler, &wifi_disconnect);
+        metrics_register_uri_handler(s_http_server_handler, &status);
+        metrics_register_uri_handler(s_http_server_handler, &dht_sensor);
+        metrics_register_uri_handler(s_http_server_handler, &history);
+        metrics_register_uri_handler(s_http_server_handler, &rollup);
+        metrics_register_uri_handler(s_http_server_handler, &events);
+        metrics_register_uri_handler(s_http_server_handler, &log);
+        metrics_register_uri_handler(s_http_server_handler, &metrics);
+        metrics_register_uri_handler(s_http_server_handler, &placement_get);
+        metrics_register_uri_handler(s_http_server_handler, &placement_set);
+        metrics_register_uri_handler(s_http_server_handler,
+                                        &placement_wakeup);
+#if TRACE_ENABLED
+        metrics_register_uri_handler(s_http_server_handler, &trace);
+#endif
+        httpd_queue_work(s_http_server_handler, http_server_register_task,
+                            NULL);
+
+        /* First state sent to every new stream. */
+        http_server_events_publish_ota();
+        http_server_events_publish_wifi();
+        char ap[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+        json_write<http_server_ap_json_t>(ap, WIFI_AP_SSID);
+        http_server_events_publish(HTTP_SERVER_EVENT_AP, ap);
 
         return s_http_server_handler;
     }
@@ -252,160 +751,191 @@ static httpd_handle_t http_server_configure(void)
     return NULL;
 }
 
-static esp_err_t http_server_jquery_handler(httpd_req_t *req)
+static esp_err_t http_server_ota_update_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "Jquery is requested.");
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req,
-                    (const char *)jquery_3_3_1_min_js_start,
-                    jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
-    return ESP_OK;
-}
+    char content_type[HTTP_SERVER_CONTENT_TYPE_MAX_LEN];
+    char boundary[MULTIPART_MAX_BOUNDARY_LEN + 1];
+    const char *boundary_p = NULL;
+    uint8_t sha256[OTA_WRITER_SHA256_LEN];
+    const uint8_t *sha256_p = NULL;
+    int content_length = req->content_len;
 
-static esp_err_t http_server_index_html_handler(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "index.html is requested.");
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req,
-                    (const char *)index_html_start,
-                    index_html_end - index_html_start);
-    return ESP_OK;
-}
+    /* 0. Received on a worker, status and assets are served meanwhile. */
+    if (http_worker_submit(req, http_server_ota_update_handler)) {
+        return ESP_OK;
+    }
 
-static esp_err_t http_server_app_css_handler(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "app.css is requested.");
-    httpd_resp_set_type(req, "text/css");
-    httpd_resp_send(req,
-                    (const char *)app_css_start,
-                    app_css_end - app_css_start);
-    return ESP_OK;
-}
+    /* 1. Find an OTA app partition which can be passed to esp_ota_begin().
+     * Finds next partition round-robin, starting from the current running
+     * partition. */
+    const esp_partition_t *update_partition =
+        esp_ota_get_next_update_partition(NULL);
+
+    DLOGI(TAG, "OTA filesize: %d", content_length);
+
+    /* 2. A form upload carries the image in a multipart body, anything else
+     * is taken as the raw image. */
+    if (httpd_req_get_hdr_value_str(req, "Content-Type",
+                                    content_type, sizeof(content_type))
+            == ESP_OK
+        && multipart_parser_get_boundary(content_type,
+                                            boundary,
+                                            sizeof(boundary)) == ESP_OK) {
+        boundary_p = boundary;
+    }
+
+    /* 3. Digest of the image, checked before the boot partition switch. */
+    esp_err_t digest_err = http_server_get_sha256(req, sha256);
+    if (digest_err == ESP_OK) {
+        sha256_p = sha256;
+    } else if (digest_err != ESP_ERR_NOT_FOUND) {
+        /* A bad request, not an update: the OTA result stays as it is.
+         * The body isn't drained, the connection is closed. */
+        DLOGE(TAG, "Malformed " OTA_UPDATE_SHA256_HEADER " header.");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            "Malformed " OTA_UPDATE_SHA256_HEADER);
+        return ESP_FAIL;
+    }
+
+    /* Uploads run on the workers side by side and a pull in its task, the
+     * one owning the partition keeps its progress on /events. */
+    if (!ota_writer_claim(OTA_WRITER_OWNER_UPLOAD)) {
+        DLOGE(TAG, "OTA %s in progress, upload rejected.",
+                (ota_writer_get_owner() == OTA_WRITER_OWNER_PULL)
+                    ? "pull" : "upload");
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "OTA update in progress",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    http_server_ota_started();
+
+    if (ota_writer_begin(update_partition,
+                            content_length,
+                            boundary_p,
+                            sha256_p) != ESP_OK) {
+        DLOGE(TAG, "Error with OTA begin, cancelling OTA.");
+        http_server_report_ota_result(ota_writer_get_reason());
+        ota_writer_release(OTA_WRITER_OWNER_UPLOAD);
+        return ESP_FAIL;
+    }
+
+    /* 4. Without the async handoff the socket itself goes to a worker for
+     * the body, the failure makes httpd forget the session. */
+    if (http_worker_detach(req, http_server_ota_update_detached,
+                            (void *)update_partition)) {
+        return ESP_FAIL;
+    }
+
+    http_server_ota_receive(req, NULL, update_partition, content_length);
+
+    /* The result goes out on /events and /OTAstatus, the upload itself is
+     * only acknowledged instead of left to the client timeout. */
+    httpd_resp_send(req, NULL, 0);
 
-static esp_err_t http_server_app_js_handler(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "app.js is requested.");
-    httpd_resp_set_type(req, "text/js");
-    httpd_resp_send(req,
-                    (const char *)app_js_start,
-                    app_js_end - app_js_start);
     return ESP_OK;
 }
 
-static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req)
+static esp_err_t http_server_ota_update_detached(http_worker_conn_t *conn,
+                                                    void *arg)
 {
-    ESP_LOGI(TAG, "favicon.ico is requested.");
-    httpd_resp_set_type(req, "image/x-icon");
-    httpd_resp_send(req,
-                    (const char *)favicon_ico_start,
-                    favicon_ico_end - favicon_ico_start);
-    return ESP_OK;
+    http_server_ota_receive(NULL, conn, (const esp_partition_t *)arg,
+                            conn->content_len);
+    return http_worker_conn_respond(conn, HTTPD_200, NULL);
 }
 
-static esp_err_t http_server_ota_update_handler(httpd_req_t *req)
+static void http_server_ota_receive(httpd_req_t *req,
+                                    http_worker_conn_t *conn,
+                                    const esp_partition_t *partition,
+                                    int content_length)
 {
-    esp_ota_handle_t ota_handler;
-    char ota_buffer[1024];
-    int content_length = req->content_len;
     int received_content = 0;
-    int recv_len = 0;
-    bool is_req_body_started = false;
+    int timeout_retries = 0;
+    bool receive_successful = true;
     bool flash_successful = false;
 
-    /* 1. Find an OTA app partition which can be passed to esp_ota_begin().
-     * Finds next partition round-robin, starting from the current running
-     * partition. */
-    const esp_partition_t *update_partition =
-        esp_ota_get_next_update_partition(NULL);
+    while (receive_successful && received_content < content_length) {
+        /* 1. Take a free buffer, blocks while the flash writer catches up. */
+        uint8_t *buffer = ota_writer_acquire();
+        if (buffer == NULL) {
+            receive_successful = false;
+            break;
+        }
 
-    do {
-        /* 1. Read data from request. */
-        recv_len = httpd_req_recv(req,
-                                    ota_buffer,
-                                    MIN(content_length, 1024));
-        if (recv_len < 0) {
-            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT) {
-                ESP_LOGE(TAG, "Socket timeout.");
+        /* 2. Fill it with as much of the request as it can hold. */
+        int filled = 0;
+        while (filled < OTA_WRITER_BUFFER_SIZE
+                && received_content + filled < content_length) {
+            const size_t len = MIN(content_length - received_content - filled,
+                                    OTA_WRITER_BUFFER_SIZE - filled);
+            int recv_len = (conn != NULL)
+                ? http_worker_conn_recv(conn, (char *)buffer + filled, len)
+                : httpd_req_recv(req, (char *)buffer + filled, len);
+            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT
+                && ++timeout_retries <= OTA_UPDATE_RECV_TIMEOUT_RETRIES) {
+                DLOGE(TAG, "Socket timeout.");
 
                 /* Retry receiving if timeout occurred. */
                 continue;
             }
 
-            ESP_LOGE(TAG, "Error when OTA updating.");
-            return ESP_FAIL;
-        }
-        printf("OTA receive: %d of %d\r", received_content, content_length);
-
-        /* If it is first data we are receiving, it will have the information in
-         * the header that we need. */
-        if (!is_req_body_started) {
-            is_req_body_started = true;
-            /* Get the location of the binary file content. */
-            char *body_start_p = strstr(ota_buffer, "\r\n\r\n") + 4;
-
-            int body_part_len = recv_len - (body_start_p - ota_buffer);
-            printf("OTA filesize: %d\r\n", content_length);
-
-            esp_err_t err = esp_ota_begin(update_partition,
-                                            OTA_SIZE_UNKNOWN,
-                                            &ota_handler);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Error with OTA begin, cancelling OTA.");
-                return ESP_FAIL;
-            } else {
-                ESP_LOGI(TAG, "Writing to partition subtype %d at: 0x%x",
-                            update_partition->subtype,
-                            update_partition->address);
+            if (recv_len <= 0) {
+                DLOGE(TAG, "Error when OTA updating.");
+                receive_successful = false;
+                break;
             }
 
-            /* Write the first part of data. */
-            esp_ota_write(ota_handler, body_start_p, body_part_len);
-            received_content += body_part_len;
-
-        } else {
-            /* Write the rest of data. */
-            esp_ota_write(ota_handler, ota_buffer, recv_len);
-            received_content += recv_len;
+            timeout_retries = 0;
+            filled += recv_len;
         }
+        received_content += filled;
+        DLOGD(TAG, "OTA receive: %d of %d", received_content, content_length);
 
-    } while (recv_len > 0 && received_content < content_length);
+        /* 3. Hand the buffer to the flash writer, it strips the multipart
+         * framing. */
+        if (ota_writer_submit(buffer, 0, filled) != ESP_OK) {
+            receive_successful = false;
+        }
+    }
 
-    /* Update the partition. */
-    if (esp_ota_end(ota_handler) == ESP_OK) {
-        if (esp_ota_set_boot_partition(update_partition) == ESP_OK) {
+    /* Update the partition, only once the image is complete and verified. */
+    if (!receive_successful) {
+        ota_writer_abort();
+    } else if (ota_writer_end(NULL) == ESP_OK) {
+        if (esp_ota_set_boot_partition(partition) == ESP_OK) {
             const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-            ESP_LOGI(TAG, "OTA next boot subtype: %d at: 0x%x",
+            DLOGI(TAG, "OTA next boot subtype: %d at: 0x%x",
                             boot_partition->subtype,
                             boot_partition->address);
 
             flash_successful = true;
         } else {
-            ESP_LOGE(TAG, "Flashed error.");
+            DLOGE(TAG, "Flashed error.");
         }
     } else {
-        ESP_LOGE(TAG, "Flashed error.");
+        DLOGE(TAG, "Flashed error.");
     }
 
     if (flash_successful == true) {
-        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_SUCCESSFUL);
+        http_server_report_ota_result(OTA_UPDATE_REASON_NONE);
+    } else if (ota_writer_get_reason() != OTA_UPDATE_REASON_NONE) {
+        http_server_report_ota_result(ota_writer_get_reason());
     } else {
-        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        http_server_report_ota_result(
+                                    OTA_UPDATE_REASON_SET_BOOT_FAILED);
     }
-
-    return ESP_OK;
+    ota_writer_release(OTA_WRITER_OWNER_UPLOAD);
 }
 
 static esp_err_t http_server_ota_status_handler(httpd_req_t *req)
 {
-    char otaJSON[100];
-    ESP_LOGI(TAG, "OTAstatus is requested.");
+    char otaJSON[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+    DLOGI(TAG, "OTAstatus is requested.");
 
-    sprintf(otaJSON,
-            "{\"ota_update_status\": %d, "
-            "\"compile_time\": \"%s\", \"compile_date\": \"%s\"}",
-            g_fw_update_state,
-            __TIME__,
-            __DATE__);
+    /* The ota section is kept up to date, no formatting per request. */
+    xSemaphoreTake(s_events_mutex, portMAX_DELAY);
+    memcpy(otaJSON, s_events[HTTP_SERVER_EVENT_OTA].data, sizeof(otaJSON));
+    xSemaphoreGive(s_events_mutex);
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, otaJSON, strlen(otaJSON));
@@ -413,51 +943,758 @@ static esp_err_t http_server_ota_status_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-static void http_server_monitor(void *param)
+static esp_err_t http_server_ota_pull_handler(httpd_req_t *req)
+{
+    char url[OTA_CLIENT_URL_MAX_LEN];
+    uint8_t sha256[OTA_WRITER_SHA256_LEN];
+    const uint8_t *sha256_p = NULL;
+
+    /* 1. Image URL and its optional digest. */
+    if (httpd_req_get_hdr_value_str(req, OTA_PULL_URL_HEADER,
+                                    url, sizeof(url)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                    "Missing or too long " OTA_PULL_URL_HEADER);
+    }
+
+    esp_err_t err = http_server_get_sha256(req, sha256);
+    if (err == ESP_OK) {
+        sha256_p = sha256;
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                    "Malformed " OTA_UPDATE_SHA256_HEADER);
+    }
+
+    /* 2. The download runs in its own task, if it gets the partition. */
+    err = ota_client_start(url, sha256_p);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "OTA update in progress",
+                                HTTPD_RESP_USE_STRLEN);
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_500(req);
+    }
+
+    http_server_ota_started();
+
+    httpd_resp_set_status(req, "202 Accepted");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t http_server_get_sha256(httpd_req_t *req, uint8_t *digest)
 {
+    char hex[2 * OTA_WRITER_SHA256_LEN + 1];
+
+    if (httpd_req_get_hdr_value_len(req, OTA_UPDATE_SHA256_HEADER) == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (httpd_req_get_hdr_value_str(req, OTA_UPDATE_SHA256_HEADER,
+                                    hex, sizeof(hex)) != ESP_OK
+        || strlen(hex) != 2 * OTA_WRITER_SHA256_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < OTA_WRITER_SHA256_LEN; i++) {
+        uint8_t byte = 0;
+
+        for (size_t j = 0; j < 2; j++) {
+            const char c = hex[2 * i + j];
+
+            byte <<= 4;
+            if (c >= '0' && c <= '9') {
+                byte |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                byte |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                byte |= c - 'A' + 10;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+
+        digest[i] = byte;
+    }
 
-    http_server_message_t msg;
+    return ESP_OK;
+}
+
+static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req)
+{
+    char ssid[MAX_SSID_LENGTH + 1];
+    char password[MAX_PASSWORD_LENGTH + 1];
+
+    if (httpd_req_get_hdr_value_str(req, WIFI_CONNECT_SSID_HEADER,
+                                    ssid, sizeof(ssid)) != ESP_OK
+        || httpd_req_get_hdr_value_str(req, WIFI_CONNECT_PWD_HEADER,
+                                    password, sizeof(password)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                    "Missing or too long credentials");
+    }
+
+    DLOGI(TAG, "wifiConnect.json requested for %s.", ssid);
+    wifi_app_connect_sta(ssid, password);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t http_server_wifi_disconnect_handler(httpd_req_t *req)
+{
+    DLOGI(TAG, "wifiDisconnect.json requested.");
+    wifi_app_disconnect_sta();
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t http_server_status_handler(httpd_req_t *req)
+{
+    char query[HTTP_SERVER_STATUS_QUERY_MAX_LEN];
+    char value[HTTP_SERVER_STATUS_QUERY_MAX_LEN];
+    char json[http_server_status_json_t::max_size + 1];
+    const char *sections[HTTP_SERVER_EVENT_MAX];
+    uint32_t since = 0;
+    size_t len = 0;
+
+    /* 1. Version the client already has, 0 for everything. */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "since", value, sizeof(value))
+            == ESP_OK) {
+        since = strtoul(value, NULL, 10);
+    }
+
+    http_server_events_refresh_time();
+
+    /* 2. Sections newer than `since`, copied in one go so the version and
+     * the sections match. A `since` ahead of the device is from another
+     * boot. */
+    xSemaphoreTake(s_events_mutex, portMAX_DELAY);
+    const uint32_t version = s_status_version;
+    if (since > version) {
+        since = 0;
+    }
+
+    if (since != version) {
+        for (size_t type = 0; type < HTTP_SERVER_EVENT_MAX; type++) {
+            const bool changed = (s_events[type].version != 0
+                                    && s_events[type].version > since);
+            sections[type] = changed ? s_events[type].data : NULL;
+        }
+
+        static_assert(HTTP_SERVER_EVENT_MAX == 5, "one field per section");
+        len = json_write<http_server_status_json_t>(json,
+                                    version,
+                                    sections[HTTP_SERVER_EVENT_OTA],
+                                    sections[HTTP_SERVER_EVENT_WIFI],
+                                    sections[HTTP_SERVER_EVENT_SENSOR],
+                                    sections[HTTP_SERVER_EVENT_TIME],
+                                    sections[HTTP_SERVER_EVENT_AP]);
+    }
+    xSemaphoreGive(s_events_mutex);
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    /* 3. Nothing changed. */
+    if (since == version) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+static esp_err_t http_server_dht_sensor_handler(httpd_req_t *req)
+{
+    char query[HTTP_SERVER_STATUS_QUERY_MAX_LEN];
+    char value[HTTP_SERVER_STATUS_QUERY_MAX_LEN];
+    dht_sensor_sample_t history[DHT_SENSOR_RING_SIZE];
+    dht_sensor_sample_t latest;
+    dht_sensor_stats_t stats;
+    size_t max = DHT_SENSOR_RING_SIZE;
+
+    /* 1. Samples asked for, the whole ring by default. */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "history", value, sizeof(value))
+            == ESP_OK) {
+        max = strtoul(value, NULL, 10);
+    }
+
+    /* 2. Copied out of the sampler's ring without holding it up, null
+     * values before the first read. */
+    const size_t count = dht_sensor_get_history(history, max);
+    if (!dht_sensor_get_latest(&latest)) {
+        latest.temperature = NAN;
+        latest.humidity = NAN;
+    }
+    dht_sensor_get_stats(&stats);
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return http_server_send<http_server_dht_json_t>(req,
+                latest.temperature,
+                latest.humidity,
+                stats.reads,
+                stats.errors,
+                stats.max_lateness_us,
+                stats.max_capture_us,
+                std::make_pair(count, [&history](size_t i) {
+                    return std::make_tuple(
+                                (uint32_t)(history[i].time_us / 1000),
+                                history[i].temperature,
+                                history[i].humidity,
+                                history[i].lateness_us,
+                                history[i].capture_us);
+                }));
+}
+
+static esp_err_t http_server_history_handler(httpd_req_t *req)
+{
+    char query[HTTP_SERVER_HISTORY_QUERY_MAX_LEN];
+    char value[HTTP_SERVER_HISTORY_QUERY_MAX_LEN];
+    history_store_cursor_t cursor;
+    history_store_stats_t stats;
+    int64_t from_ms = 0;
+    int64_t to_ms = INT64_MAX;
+
+    /* 0. Streamed from a worker, the log can be long. */
+    if (http_worker_submit(req, http_server_history_handler)) {
+        return ESP_OK;
+    }
+
+    /* 1. Range asked for, the whole log by default. */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "from", value, sizeof(value))
+                == ESP_OK) {
+            from_ms = strtoll(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "to", value, sizeof(value))
+                == ESP_OK) {
+            to_ms = strtoll(value, NULL, 10);
+        }
+    }
+
+    /* 2. The first block comes from the index, then the log is decoded a
+     * frame at a time while the response goes out. */
+    history_store_get_stats(&stats);
+    history_store_query(&cursor, from_ms, to_ms);
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return http_server_send<http_server_history_json_t>(req,
+                stats.oldest_ms,
+                stats.newest_ms,
+                [&cursor]() -> std::optional<std::tuple<int64_t, float,
+                                                        float>> {
+                    history_store_sample_t sample;
+
+                    if (!history_store_next(&cursor, &sample)) {
+                        return std::nullopt;
+                    }
+                    return std::make_tuple(sample.time_ms,
+                                            sample.temperature,
+                                            sample.humidity);
+                });
+}
+
+static esp_err_t http_server_rollup_handler(httpd_req_t *req)
+{
+    static const char *const resolutions[ROLLUP_RES_MAX] = {
+        "1m", "15m", "1h"
+    };
+    char query[HTTP_SERVER_HISTORY_QUERY_MAX_LEN];
+    char value[HTTP_SERVER_HISTORY_QUERY_MAX_LEN];
+    rollup_res_e res = ROLLUP_1M;
+    rollup_cursor_t cursor;
+    int64_t from_ms = 0;
+    int64_t to_ms = INT64_MAX;
+
+    /* 0. Streamed from a worker. */
+    if (http_worker_submit(req, http_server_rollup_handler)) {
+        return ESP_OK;
+    }
+
+    /* 1. Resolution and range asked for. */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "res", value, sizeof(value))
+                == ESP_OK) {
+            size_t i = 0;
+            while (i < ROLLUP_RES_MAX && strcmp(value, resolutions[i]) != 0) {
+                i++;
+            }
+            if (i == ROLLUP_RES_MAX) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                            "res is 1m, 15m or 1h");
+            }
+            res = (rollup_res_e)i;
+        }
+        if (httpd_query_key_value(query, "from", value, sizeof(value))
+                == ESP_OK) {
+            from_ms = strtoll(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "to", value, sizeof(value))
+                == ESP_OK) {
+            to_ms = strtoll(value, NULL, 10);
+        }
+    }
+
+    /* 2. The buckets are already aggregated, each is copied as it goes
+     * out. */
+    rollup_query(&cursor, res, from_ms, to_ms);
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return http_server_send<http_server_rollup_json_t>(req,
+                rollup_period_s(res),
+                [&cursor]() -> std::optional<std::tuple<int64_t, uint32_t,
+                                std::tuple<float, float, float>,
+                                std::tuple<float, float, float>>> {
+                    rollup_bucket_t bucket;
+
+                    if (!rollup_next(&cursor, &bucket)) {
+                        return std::nullopt;
+                    }
+                    return std::make_tuple(bucket.time_ms, bucket.count,
+                                    std::make_tuple(bucket.temperature.min,
+                                                    bucket.temperature.max,
+                                                    bucket.temperature.mean),
+                                    std::make_tuple(bucket.humidity.min,
+                                                    bucket.humidity.max,
+                                                    bucket.humidity.mean));
+                });
+}
+
+static bool http_server_accepts_cbor(httpd_req_t *req, bool *packed)
+{
+    char accept[HTTP_SERVER_ACCEPT_MAX_LEN];
+
+    /* A truncated header still carries its leading types. */
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept,
+                                                sizeof(accept));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+
+    /* Walk the comma separated list: `type[;param=value]...`. */
+    char *save_p = NULL;
+    for (char *type = strtok_r(accept, ",", &save_p);
+         type != NULL;
+         type = strtok_r(NULL, ",", &save_p)) {
+        while (*type == ' ' || *type == '\t') {
+            type++;
+        }
+
+        const size_t name_len = strcspn(type, " \t;");
+        if (name_len != sizeof(CBOR_CONTENT_TYPE) - 1
+            || strncasecmp(type, CBOR_CONTENT_TYPE, name_len) != 0) {
+            continue;
+        }
+
+        /* `q=0` refuses it, whatever comes next. */
+        const char *q_p = strstr(type + name_len, "q=");
+        if (q_p != NULL && strtod(q_p + 2, NULL) <= 0) {
+            return false;
+        }
+        *packed = strstr(type + name_len, "form=packed") != NULL;
+        return true;
+    }
+
+    return false;
+}
+
+template <typename Schema, typename... Args>
+static esp_err_t http_server_send(httpd_req_t *req, const Args &... values)
+{
+    bool packed = false;
+
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    if (http_server_accepts_cbor(req, &packed)) {
+        return cbor_send<Schema>(req, packed, values...);
+    }
+
+    return json_send<Schema>(req, values...);
+}
+
+static esp_err_t http_server_events_handler(httpd_req_t *req)
+{
+    char header[128];
+    http_server_events_client_t *client = NULL;
+
+    /* 1. A free stream slot, otherwise the page keeps polling. */
+    for (size_t i = 0; i < HTTP_SERVER_EVENTS_MAX_CLIENTS; i++) {
+        if (s_events_clients[i].fd < 0) {
+            client = &s_events_clients[i];
+            break;
+        }
+    }
+
+    if (client == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many event streams",
+                                HTTPD_RESP_USE_STRLEN);
+    }
+
+    /* 2. Header without a length, the body lasts as long as the socket. */
+    int header_len = snprintf(header, sizeof(header),
+                                "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/event-stream\r\n"
+                                "Cache-Control: no-cache\r\n"
+                                "\r\n"
+                                "retry: %d\n\n",
+                                HTTP_SERVER_EVENTS_RETRY_MS);
+    if (httpd_send(req, header, header_len) < 0) {
+        return ESP_FAIL;
+    }
+
+    /* 3. The session outlives the request, its free callback ends the
+     * stream. Every event is sent once the handler has returned. */
+    memset(client, 0, sizeof(*client));
+    client->fd = httpd_req_to_sockfd(req);
+    req->sess_ctx = client;
+    req->free_ctx = http_server_events_free_ctx;
+
+    DLOGI(TAG, "Event stream opened on socket %d.", client->fd);
+    http_server_events_schedule(false);
+
+    return ESP_OK;
+}
+
+static void http_server_events_free_ctx(void *ctx)
+{
+    http_server_events_client_t *client = (http_server_events_client_t *)ctx;
+
+    DLOGI(TAG, "Event stream closed on socket %d.", client->fd);
+    client->fd = -1;
+}
+
+static void http_server_events_publish(http_server_event_e type,
+                                        const char *data)
+{
+    xSemaphoreTake(s_events_mutex, portMAX_DELAY);
+    strlcpy(s_events[type].data, data, sizeof(s_events[type].data));
+    s_events[type].version = ++s_status_version;
+    xSemaphoreGive(s_events_mutex);
+
+    http_server_events_schedule(false);
+}
+
+static void http_server_ota_started(void)
+{
+    g_fw_update_state = OTA_UPDATE_PENDING_STATE;
+    s_fw_update_reason = OTA_UPDATE_REASON_NONE;
+    s_ota_bytes_written = 0;
+    s_ota_image_size = 0;
+    http_server_events_publish_ota();
+}
+
+static void http_server_events_publish_ota(void)
+{
+    char data[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+
+    json_write<http_server_ota_json_t>(data,
+                                        g_fw_update_state,
+                                        (int)s_fw_update_reason,
+                                        s_ota_bytes_written,
+                                        s_ota_image_size,
+                                        __TIME__,
+                                        __DATE__);
+    http_server_events_publish(HTTP_SERVER_EVENT_OTA, data);
+}
+
+static void http_server_events_publish_wifi(void)
+{
+    wifi_ap_record_t ap_info;
+    esp_netif_ip_info_t ip_info;
+    char data[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+
+    if (s_wifi_connect_status != WIFI_CONNECT_SUCCESS_STATE
+        || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK
+        || esp_netif_get_ip_info(g_esp_netif_station, &ip_info) != ESP_OK) {
+        json_write<http_server_wifi_status_json_t>(data,
+                                                    s_wifi_connect_status);
+    } else {
+        json_write<http_server_wifi_info_json_t>(data,
+                                                s_wifi_connect_status,
+                                                (const char *)ap_info.ssid,
+                                                ip_info.ip.addr,
+                                                ip_info.netmask.addr,
+                                                ip_info.gw.addr);
+    }
+
+    http_server_events_publish(HTTP_SERVER_EVENT_WIFI, data);
+}
+
+static void http_server_events_refresh_time(void)
+{
+    char local_time[HTTP_SERVER_LOCAL_TIME_MAX_LEN];
+    struct tm time_info;
+    time_t now;
+
+    time(&now);
+    localtime_r(&now, &time_info);
+
+    /* The clock starts at 1970 until SNTP sets it. */
+    if (time_info.tm_year < (2020 - 1900)) {
+        return;
+    }
+
+    strftime(local_time, sizeof(local_time), "%a %b %e %Y %H:%M",
+                &time_info);
+
+    /* Called from the monitor and httpd tasks. */
+    xSemaphoreTake(s_events_mutex, portMAX_DELAY);
+    const bool changed = (strcmp(local_time, s_local_time) != 0);
+    if (changed) {
+        strcpy(s_local_time, local_time);
+    }
+    xSemaphoreGive(s_events_mutex);
+
+    if (changed) {
+        char data[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+
+        json_write<http_server_time_json_t>(data, local_time);
+        http_server_events_publish(HTTP_SERVER_EVENT_TIME, data);
+    }
+}
+
+static void http_server_events_schedule(bool keepalive)
+{
+    if (s_http_server_handler == NULL) {
+        return;
+    }
+
+    if (keepalive) {
+        httpd_queue_work(s_http_server_handler,
+                            http_server_events_keepalive,
+                            NULL);
+    } else if (!s_events_flush_queued) {
+        s_events_flush_queued = true;
+        if (httpd_queue_work(s_http_server_handler,
+                                http_server_events_flush,
+                                NULL) != ESP_OK) {
+            s_events_flush_queued = false;
+        }
+    }
+}
+
+static void http_server_events_flush(void *arg)
+{
+    s_events_flush_queued = false;
+
+    for (size_t i = 0; i < HTTP_SERVER_EVENTS_MAX_CLIENTS; i++) {
+        if (s_events_clients[i].fd >= 0) {
+            http_server_events_send(&s_events_clients[i], false);
+        }
+    }
+}
+
+static void http_server_events_keepalive(void *arg)
+{
+    for (size_t i = 0; i < HTTP_SERVER_EVENTS_MAX_CLIENTS; i++) {
+        if (s_events_clients[i].fd >= 0) {
+            http_server_events_send(&s_events_clients[i], true);
+        }
+    }
+}
+
+static void http_server_events_send(http_server_events_client_t *client,
+                                    bool keepalive)
+{
+    bool sent = false;
+
+    /* 1. A frame cut by a full socket goes first. */
+    if (!http_server_events_send_pending(client)) {
+        return;
+    }
+
+    /* 2. Only the latest payload of each type the client hasn't seen. */
+    for (size_t type = 0; type < HTTP_SERVER_EVENT_MAX; type++) {
+        xSemaphoreTake(s_events_mutex, portMAX_DELAY);
+        const bool stale = (client->sent[type] != s_events[type].version);
+        if (stale) {
+            client->pending_len = snprintf(client->pending,
+                                            sizeof(client->pending),
+                                            "event: %s\ndata: %s\n\n",
+                                            s_event_names[type],
+                                            s_events[type].data);
+            client->pending_off = 0;
+            client->sent[type] = s_events[type].version;
+        }
+        xSemaphoreGive(s_events_mutex);
+
+        if (stale) {
+            sent = true;
+            if (!http_server_events_send_pending(client)) {
+                return;
+            }
+        }
+    }
+
+    /* 3. A comment keeps idle streams through proxies and finds dead
+     * peers. */
+    if (keepalive && !sent) {
+        client->pending_len = snprintf(client->pending,
+                                        sizeof(client->pending),
+                                        ":\n\n");
+        client->pending_off = 0;
+        http_server_events_send_pending(client);
+    }
+}
+
+static bool http_server_events_send_pending(
+                                    http_server_events_client_t *client)
+{
+    while (!client->closing && client->pending_off < client->pending_len) {
+        int ret = httpd_socket_send(s_http_server_handler,
+                                    client->fd,
+                                    client->pending + client->pending_off,
+                                    client->pending_len - client->pending_off,
+                                    MSG_DONTWAIT);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            /* Socket full, the rest goes with the next flush. */
+            return false;
+        }
+
+        if (ret < 0) {
+            DLOGW(TAG, "Event stream on socket %d lost.", client->fd);
+            client->closing = true;
+            httpd_sess_trigger_close(s_http_server_handler, client->fd);
+            return false;
+        }
+
+        client->pending_off += ret;
+    }
+
+    if (client->closing) {
+        return false;
+    }
+
+    client->pending_len = 0;
+    client->pending_off = 0;
+    return true;
+}
+
+static void http_server_register_task(void *arg)
+{
+    (void)arg;
+    metrics_register_task(NULL, HTTP_SERVER_TASK_STACK_SIZE);
+}
+
+static void http_server_monitor(void *param)
+{
+    static const event_bus_type_e types[] = {
+        EVENT_BUS_WIFI_CONNECT_INIT,
+        EVENT_BUS_WIFI_CONNECT_SUCCESS,
+        EVENT_BUS_WIFI_CONNECT_FAIL,
+        EVENT_BUS_WIFI_DISCONNECTED,
+        EVENT_BUS_OTA_RESULT,
+        EVENT_BUS_OTA_PROGRESS,
+        EVENT_BUS_SENSOR_SAMPLE
+    };
+    event_bus_event_t event;
+
+    metrics_register_task(NULL, HTTP_SERVER_MONITOR_STACK_SIZE);
+    s_http_server_subscriber = event_bus_subscribe(
+                                        xTaskGetCurrentTaskHandle(),
+                                        types,
+                                        sizeof(types) / sizeof(types[0]));
 
     while(1) {
         
-        if (xQueueReceive(s_http_server_event_queue, &msg, portMAX_DELAY) 
-            != pdTRUE) {
+        /* Idle streams get a keepalive comment. */
+        if (!event_bus_receive(s_http_server_subscriber, &event,
+                            pdMS_TO_TICKS(HTTP_SERVER_EVENTS_KEEPALIVE_MS))) {
+                http_server_events_refresh_time();
+                http_server_events_schedule(true);
                 continue;
             }
 
-        switch (msg.msgID)
-        {
-            case HTTP_MSG_WIFI_CONNECT_INIT: {
+        http_server_events_refresh_time();
 
+        TRACE_BEGIN("http_server_monitor", event.type);
+        switch (event.type)
+        {
+            case EVENT_BUS_WIFI_CONNECT_INIT: {
+                s_wifi_connect_status = WIFI_CONNECT_CONNECTING_STATE;
             }
             break;
-            case HTTP_MSG_WIFI_CONNECT_SUCCESS: {
-
+            case EVENT_BUS_WIFI_CONNECT_SUCCESS: {
+                s_wifi_connect_status = WIFI_CONNECT_SUCCESS_STATE;
             }
             break;
-            case HTTP_MSG_WIFI_CONNECT_FAIL: {
-
+            case EVENT_BUS_WIFI_CONNECT_FAIL: {
+                s_wifi_connect_status = WIFI_CONNECT_FAILED_STATE;
             }
             break;
-            case HTTP_MSG_OTA_UPDATE_SUCCESSFUL: {
-                g_fw_update_state = OTA_UPDATE_SUCCESSFUL_STATE;
-                http_server_fw_update_reset_timer();
+            case EVENT_BUS_WIFI_DISCONNECTED: {
+                s_wifi_connect_status = WIFI_CONNECT_NONE_STATE;
             }
             break;
-            case HTTP_MSG_OTA_UPDATE_FAILED: {
-                g_fw_update_state = OTA_UPDATE_FAILED_STATE;
+            case EVENT_BUS_OTA_RESULT: {
+                s_fw_update_reason =
+                            (ota_update_reason_e)event.ota_result.reason;
+                if (s_fw_update_reason == OTA_UPDATE_REASON_NONE) {
+                    g_fw_update_state = OTA_UPDATE_SUCCESSFUL_STATE;
+                    http_server_fw_update_reset_timer();
+                } else {
+                    g_fw_update_state = OTA_UPDATE_FAILED_STATE;
+                }
+            }
+            break;
+            case EVENT_BUS_OTA_PROGRESS: {
+                s_ota_bytes_written = event.ota_progress.written;
+                s_ota_image_size = event.ota_progress.total;
+            }
+            break;
+            case EVENT_BUS_SENSOR_SAMPLE: {
+                s_sensor_temperature = event.sensor_sample.temperature;
+                s_sensor_humidity = event.sensor_sample.humidity;
             }
             break;
             default:
             break;
         }
+
+        /* Push the new state to the event streams. */
+        switch (event.type)
+        {
+            case EVENT_BUS_WIFI_CONNECT_INIT:
+            case EVENT_BUS_WIFI_CONNECT_SUCCESS:
+            case EVENT_BUS_WIFI_CONNECT_FAIL:
+            case EVENT_BUS_WIFI_DISCONNECTED:
+                http_server_events_publish_wifi();
+                break;
+            case EVENT_BUS_OTA_RESULT:
+            case EVENT_BUS_OTA_PROGRESS:
+                http_server_events_publish_ota();
+                break;
+            case EVENT_BUS_SENSOR_SAMPLE: {
+                char data[HTTP_SERVER_EVENT_DATA_MAX_LEN];
+
+                json_write<http_server_sensor_json_t>(data,
+                                                    s_sensor_temperature,
+                                                    s_sensor_humidity);
+                http_server_events_publish(HTTP_SERVER_EVENT_SENSOR, data);
+            }
+            break;
+            default:
+                break;
+        }
+        TRACE_END("http_server_monitor");
     }
 }
 
+static void http_server_report_ota_result(ota_update_reason_e reason)
+{
+    event_bus_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_BUS_OTA_RESULT;
+    event.ota_result.reason = reason;
+    event_bus_publish(&event);
+}
+
 static void http_server_fw_update_reset_timer(void)
 {
     if (g_fw_update_state == OTA_UPDATE_SUCCESSFUL_STATE) {
-        ESP_LOGI(TAG, "Updated firmware successful, starting Firmware update "
+        DLOGI(TAG, "Updated firmware successful, starting Firmware update "
                     "reset timer.");
 
         /* Give the webpage a chance to receive an acknowledge back and
@@ -468,6 +1705,6 @@ static void http_server_fw_update_reset_timer(void)
         ESP_ERROR_CHECK(esp_timer_start_once(s_fw_update_reset,
                         8000000));
     } else {
-        ESP_LOGI(TAG, "Updated firmware unsuccessful.");
+        DLOGI(TAG, "Updated firmware unsuccessful.");
     }
 }
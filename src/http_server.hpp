@@ -1,36 +1,49 @@
 #pragma once
 #include <esp_netif.h>
 
+#include "ota_writer.hpp"
+
 #define HTTP_SERVER_PORT                8000
 #define HTTP_SERVER_SEND_WAIT_TIMEOUT   10
 #define HTTP_SERVER_RECV_WAIT_TIMEOUT   10
+#define HTTP_SERVER_RESET_LOG_FLUSH_MS  200             /* Deferred lines. */
 #define OTA_UPDATE_PENDING_STATE        0
 #define OTA_UPDATE_SUCCESSFUL_STATE     1
 #define OTA_UPDATE_FAILED_STATE         -1
+#define OTA_UPDATE_RECV_TIMEOUT_RETRIES 5
+#define HTTP_SERVER_CONTENT_TYPE_MAX_LEN 128
+#define OTA_UPDATE_SHA256_HEADER        "X-OTA-SHA256"
+#define OTA_PULL_URL_HEADER             "X-OTA-URL"
+#define WIFI_CONNECT_SSID_HEADER        "my-connect-ssid"
+#define WIFI_CONNECT_PWD_HEADER         "my-connect-pwd"
+#define WIFI_CONNECT_NONE_STATE         0
+#define WIFI_CONNECT_CONNECTING_STATE   1
+#define WIFI_CONNECT_FAILED_STATE       2
+#define WIFI_CONNECT_SUCCESS_STATE      3
 
-/* Public types --------------------------------------------------------------*/
-typedef enum {
-    HTTP_MSG_WIFI_CONNECT_INIT = 0,
-    HTTP_MSG_WIFI_CONNECT_SUCCESS,
-    HTTP_MSG_WIFI_CONNECT_FAIL,
-    HTTP_MSG_OTA_UPDATE_SUCCESSFUL,
-    HTTP_MSG_OTA_UPDATE_FAILED
-} http_server_message_e;
-
-typedef struct {
-    http_server_message_e msgID;
-} http_server_message_t;
-
-/* Public function prototypes ------------------------------------------------*/
+/**
+ * @brief   /events keeps up to HTTP_SERVER_EVENTS_MAX_CLIENTS Server-Sent
+ *          Events streams open, a comment is sent on idle streams every
+ *          HTTP_SERVER_EVENTS_KEEPALIVE_MS and browsers reconnect after
+ *          HTTP_SERVER_EVENTS_RETRY_MS.
+ */
+#define HTTP_SERVER_EVENTS_MAX_CLIENTS  3
+#define HTTP_SERVER_EVENTS_KEEPALIVE_MS 15000
+#define HTTP_SERVER_EVENTS_RETRY_MS     3000
+#define HTTP_SERVER_EVENT_DATA_MAX_LEN  256
+#define HTTP_SERVER_STATUS_QUERY_MAX_LEN 32
+#define HTTP_SERVER_LOCAL_TIME_MAX_LEN  32
+#define HTTP_SERVER_HISTORY_QUERY_MAX_LEN 64             /* from= and to=. */
 
 /**
- * @brief   Sends a message to the queue.
- * @param[in]   msgID   - 
- * 
- * @return  pdTRUE if an item was successfully sent to the queue, otherwise
- *          pdFALSE is returned.
+ * @brief   /dhtSensor.json, /history and /rollup.json answer CBOR to
+ *          `Accept: application/cbor`, objects packed as arrays with
+ *          `application/cbor; form=packed`. Longer Accept headers are read
+ *          up to HTTP_SERVER_ACCEPT_MAX_LEN.
  */
-BaseType_t http_server_monitor_send_message(http_server_message_e msgID);
+#define HTTP_SERVER_ACCEPT_MAX_LEN      128
+
+/* Public function prototypes ------------------------------------------------*/
 
 /**
  * @brief   Starts the HTTP server.
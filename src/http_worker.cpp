@@ -0,0 +1,365 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_idf_version.h>
+#include <esp_log.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "http_worker.hpp"
+#include "metrics.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief   httpd_req_async_handler_begin() came with ESP-IDF 5.1, before it
+ *          a request can't leave the httpd task: a handler that can work on
+ *          the socket itself hands over the session instead,
+ *          http_worker_detach(), the others run there.
+ */
+#define HTTP_WORKER_ASYNC                                                   \
+    (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0))
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    httpd_req_t *req;                   /* Async copy, or NULL. */
+    http_worker_handler_t handler;
+    http_worker_conn_t *conn;           /* Detached session, or NULL. */
+    http_worker_conn_handler_t conn_handler;
+    void *arg;
+    metrics_request_t metrics;          /* Timed from the httpd task. */
+} http_worker_job_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "http_worker";
+
+static QueueHandle_t s_http_worker_queue = NULL;
+static TaskHandle_t s_http_workers[HTTP_WORKER_COUNT];
+static std::atomic<uint32_t> s_high_water(0);
+static std::atomic<uint32_t> s_refused(0);
+
+/**
+ * @brief   Session httpd closes next without closing its socket, only used
+ *          on the httpd task.
+ */
+static int s_detached_fd = -1;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Worker task: runs the queued handlers one after the other.
+ */
+static void http_worker_task(void *param);
+
+static bool http_worker_is_current(void);
+
+/**
+ * @brief   Queues `job` for the workers, from the httpd task.
+ */
+static void http_worker_queue(http_worker_job_t *job);
+
+/**
+ * @brief   Receive override of a session being detached: the socket is left
+ *          alone, httpd_req_recv() then only gives what httpd already read.
+ */
+static int http_worker_recv_none(httpd_handle_t hd, int sockfd, char *buf,
+                                    size_t buf_len, int flags);
+
+static esp_err_t http_worker_send_all(int fd, const char *buf, size_t len);
+
+/* Public function definition ------------------------------------------------*/
+void http_worker_start(void)
+{
+    if (s_http_worker_queue != NULL) {
+        return;
+    }
+
+    s_http_worker_queue = xQueueCreate(HTTP_WORKER_QUEUE_LENGTH,
+                                        sizeof(http_worker_job_t));
+
+    for (size_t i = 0; i < HTTP_WORKER_COUNT; i++) {
+        char name[16];
+
+        /* Numbered, the stacks are reported by name. */
+        snprintf(name, sizeof(name), "http_worker%u", (unsigned)i);
+        xTaskCreatePinnedToCore(&http_worker_task,
+                                name,
+                                HTTP_WORKER_TASK_STACK_SIZE,
+                                NULL,
+                                HTTP_WORKER_TASK_PRIORITY,
+                                &s_http_workers[i],
+                                task_placement_core(
+                                    TASK_PLACEMENT_HTTP_WORKER));
+    }
+
+    DLOGI(TAG, "Started %d workers.", HTTP_WORKER_COUNT);
+}
+
+bool http_worker_submit(httpd_req_t *req, http_worker_handler_t handler)
+{
+    http_worker_job_t job = {};
+
+    if (!HTTP_WORKER_ASYNC || s_http_worker_queue == NULL
+        || http_worker_is_current()) {
+        return false;
+    }
+
+    /* 1. Every worker busy and the queue full, the client retries. Only
+     * the httpd task queues, the space can't go in between. */
+    if (uxQueueSpacesAvailable(s_http_worker_queue) == 0) {
+        DLOGW(TAG, "Workers busy, %s refused.", req->uri);
+        s_refused.fetch_add(1, std::memory_order_relaxed);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", HTTP_WORKER_RETRY_AFTER_S);
+        httpd_resp_send(req, NULL, 0);
+        return true;
+    }
+
+    /* 2. Without memory for the copy, the request is served here. */
+#if HTTP_WORKER_ASYNC
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        DLOGW(TAG, "No async copy of %s, served in place.", req->uri);
+        return false;
+    }
+#endif
+
+    /* 3. Its latency goes on on the worker. */
+    job.handler = handler;
+    http_worker_queue(&job);
+    return true;
+}
+
+bool http_worker_detach(httpd_req_t *req, http_worker_conn_handler_t handler,
+                        void *arg)
+{
+    http_worker_job_t job = {};
+    int len;
+
+    if (HTTP_WORKER_ASYNC || s_http_worker_queue == NULL
+        || http_worker_is_current()) {
+        return false;
+    }
+
+    /* 1. The body is taken as it comes, a busy pool leaves it here rather
+     * than refusing a request already read up to it. */
+    if (uxQueueSpacesAvailable(s_http_worker_queue) == 0) {
+        DLOGW(TAG, "Workers busy, %s served in place.", req->uri);
+        return false;
+    }
+
+    job.conn = (http_worker_conn_t *)malloc(sizeof(*job.conn));
+    if (job.conn == NULL) {
+        DLOGW(TAG, "No memory to detach %s, served in place.", req->uri);
+        return false;
+    }
+
+    /* 2. Body httpd read with the headers. */
+    job.conn->fd = httpd_req_to_sockfd(req);
+    job.conn->content_len = req->content_len;
+    job.conn->buffered = 0;
+    job.conn->offset = 0;
+    httpd_sess_set_recv_override(req->handle, job.conn->fd,
+                                    http_worker_recv_none);
+    while (job.conn->buffered < sizeof(job.conn->buffer)
+            && (len = httpd_req_recv(req,
+                                job.conn->buffer + job.conn->buffered,
+                                sizeof(job.conn->buffer)
+                                    - job.conn->buffered)) > 0) {
+        job.conn->buffered += len;
+    }
+    job.conn->remaining = job.conn->content_len;
+
+    /* 3. httpd closes the session on this task once the handler fails,
+     * the socket stays open for the worker. */
+    s_detached_fd = job.conn->fd;
+    job.conn_handler = handler;
+    job.arg = arg;
+    http_worker_queue(&job);
+    return true;
+}
+
+int http_worker_conn_recv(http_worker_conn_t *conn, char *buf, size_t len)
+{
+    ssize_t ret;
+
+    len = MIN(len, conn->remaining);
+    if (len == 0) {
+        return 0;
+    }
+
+    /* 1. What httpd had read. */
+    if (conn->offset < conn->buffered) {
+        len = MIN(len, conn->buffered - conn->offset);
+        memcpy(buf, conn->buffer + conn->offset, len);
+        conn->offset += len;
+        conn->remaining -= len;
+        return (int)len;
+    }
+
+    /* 2. The socket, within the recv_wait_timeout httpd set on it. */
+    do {
+        ret = recv(conn->fd, buf, len, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK)
+                ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    conn->remaining -= (size_t)ret;
+    return (int)ret;
+}
+
+esp_err_t http_worker_conn_respond(http_worker_conn_t *conn,
+                                    const char *status, const char *body)
+{
+    char header[128];
+    const size_t body_len = (body != NULL) ? strlen(body) : 0;
+
+    const int len = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %s\r\n"
+                                "Content-Type: text/plain\r\n"
+                                "Content-Length: %u\r\n"
+                                "Connection: close\r\n\r\n",
+                                status, (unsigned)body_len);
+    if (len <= 0 || (size_t)len >= sizeof(header)
+        || http_worker_send_all(conn->fd, header, len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return http_worker_send_all(conn->fd, body, body_len);
+}
+
+void http_worker_close_session(httpd_handle_t hd, int sockfd)
+{
+    (void)hd;
+
+    if (sockfd == s_detached_fd) {
+        s_detached_fd = -1;
+        return;
+    }
+    close(sockfd);
+}
+
+void http_worker_get_stats(http_worker_stats_t *stats)
+{
+    stats->queued = (s_http_worker_queue != NULL)
+                    ? uxQueueMessagesWaiting(s_http_worker_queue) : 0;
+    stats->high_water = s_high_water.load(std::memory_order_relaxed);
+    stats->refused = s_refused.load(std::memory_order_relaxed);
+}
+
+/* Private function definition -----------------------------------------------*/
+static void http_worker_task(void *param)
+{
+    http_worker_job_t job;
+
+    (void)param;
+    metrics_register_task(NULL, HTTP_WORKER_TASK_STACK_SIZE);
+    while (1) {
+        if (xQueueReceive(s_http_worker_queue, &job, portMAX_DELAY)
+                != pdTRUE) {
+            continue;
+        }
+
+        /* A detached session ends with its response, sent with
+         * Connection: close. */
+        if (job.conn != NULL) {
+            metrics_request_attach(&job.metrics);
+            TRACE_BEGIN(metrics_request_uri(&job.metrics), job.conn->fd);
+            const esp_err_t err = job.conn_handler(job.conn, job.arg);
+            TRACE_END(metrics_request_uri(&job.metrics));
+            metrics_request_end(err);
+
+            close(job.conn->fd);
+            free(job.conn);
+            continue;
+        }
+
+        /* The copy is freed by the completion, the session outlives it. */
+        httpd_handle_t handle = job.req->handle;
+        const int fd = httpd_req_to_sockfd(job.req);
+        metrics_request_attach(&job.metrics);
+        TRACE_BEGIN(metrics_request_uri(&job.metrics), fd);
+        const esp_err_t err = job.handler(job.req);
+        TRACE_END(metrics_request_uri(&job.metrics));
+        metrics_request_end(err);
+
+#if HTTP_WORKER_ASYNC
+        httpd_req_async_handler_complete(job.req);
+#endif
+        if (err != ESP_OK) {
+            httpd_sess_trigger_close(handle, fd);
+        }
+    }
+}
+
+static bool http_worker_is_current(void)
+{
+    const TaskHandle_t current = xTaskGetCurrentTaskHandle();
+
+    for (size_t i = 0; i < HTTP_WORKER_COUNT; i++) {
+        if (s_http_workers[i] == current) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void http_worker_queue(http_worker_job_t *job)
+{
+    job->metrics = metrics_request_detach();
+    xQueueSend(s_http_worker_queue, job, 0);
+
+    const uint32_t queued = uxQueueMessagesWaiting(s_http_worker_queue);
+    TRACE_INSTANT("http_worker_submit", queued);
+    if (queued > s_high_water.load(std::memory_order_relaxed)) {
+        s_high_water.store(queued, std::memory_order_relaxed);
+    }
+}
+
+static int http_worker_recv_none(httpd_handle_t hd, int sockfd, char *buf,
+                                    size_t buf_len, int flags)
+{
+    (void)hd;
+    (void)sockfd;
+    (void)buf;
+    (void)buf_len;
+    (void)flags;
+    return HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+static esp_err_t http_worker_send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        const ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        buf += ret;
+        len -= (size_t)ret;
+    }
+    return ESP_OK;
+}
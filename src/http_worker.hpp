@@ -0,0 +1,126 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief   Retry-After of the 503 sent when every worker is busy and the
+ *          queue is full.
+ */
+#define HTTP_WORKER_RETRY_AFTER_S       "1"
+
+/**
+ * @brief   Body httpd read along with the headers, taken over by
+ *          http_worker_detach(): at most its header buffer.
+ */
+#define HTTP_WORKER_DETACH_BUFFER_SIZE                                      \
+    (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 64)
+
+/* Public types --------------------------------------------------------------*/
+
+typedef esp_err_t (*http_worker_handler_t)(httpd_req_t *req);
+
+/**
+ * @brief   A session taken from httpd by http_worker_detach(), served by a
+ *          worker on the socket itself.
+ */
+typedef struct {
+    int fd;
+    size_t content_len;                 /* Of the request. */
+    size_t remaining;                   /* Body not received yet. */
+    size_t buffered;                    /* Read by httpd, received first. */
+    size_t offset;                      /* Of `buffer` received so far. */
+    char buffer[HTTP_WORKER_DETACH_BUFFER_SIZE];
+} http_worker_conn_t;
+
+typedef esp_err_t (*http_worker_conn_handler_t)(http_worker_conn_t *conn,
+                                                void *arg);
+
+typedef struct {
+    uint32_t queued;                    /* Requests waiting for a worker. */
+    uint32_t high_water;                /* Most requests ever waiting. */
+    uint32_t refused;                   /* Answered 503. */
+} http_worker_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Creates the HTTP_WORKER_COUNT worker tasks and their queue, once.
+ */
+void http_worker_start(void);
+
+/**
+ * @brief   Hands `req` over to a worker task, which calls `handler` with a
+ *          copy of it, so the httpd task goes back to the other sessions.
+ *          Called first by long handlers:
+ *
+ *              if (http_worker_submit(req, http_server_history_handler)) {
+ *                  return ESP_OK;
+ *              }
+ *
+ * @note    The session isn't served again until the handler returns on the
+ *          worker, a failed handler closes it as httpd does. Requests wait
+ *          in a queue of HTTP_WORKER_QUEUE_LENGTH while every worker is
+ *          busy, beyond it they get 503 Service Unavailable.
+ *
+ * @param   req     - HTTP request, on the httpd task.
+ * @param   handler - Handler to run on the worker.
+ * @return  true if the request was taken, answered or queued. false on a
+ *          worker, before http_worker_start() or without the async request
+ *          handoff (ESP-IDF before 5.1), the caller then serves it itself.
+ */
+bool http_worker_submit(httpd_req_t *req, http_worker_handler_t handler);
+
+/**
+ * @brief   Without the async request handoff, hands the session itself over
+ *          to a worker: httpd forgets it, `handler` receives the rest of the
+ *          body and responds on the socket, which is then closed. Called
+ *          once the request is read up to its body, the handler returns
+ *          ESP_FAIL right after:
+ *
+ *              if (http_worker_detach(req, http_server_ota_update_detached,
+ *                                      arg)) {
+ *                  return ESP_FAIL;
+ *              }
+ *
+ * @note    httpd closes the session of a failed handler through
+ *          http_worker_close_session(), which leaves this socket open.
+ *
+ * @param   req     - HTTP request, on the httpd task.
+ * @param   handler - Handler to run on the worker.
+ * @param   arg     - Passed to `handler`.
+ * @return  true if the session was queued for a worker. false with the
+ *          async request handoff (http_worker_submit() then has taken the
+ *          request), on a worker, every worker busy or without memory, the
+ *          caller then serves it itself.
+ */
+bool http_worker_detach(httpd_req_t *req, http_worker_conn_handler_t handler,
+                        void *arg);
+
+/**
+ * @brief   httpd_req_recv() of a detached session.
+ *
+ * @return  Bytes received, 0 once the body is complete or the client gone,
+ *          HTTPD_SOCK_ERR_TIMEOUT past recv_wait_timeout, otherwise
+ *          HTTPD_SOCK_ERR_FAIL.
+ */
+int http_worker_conn_recv(http_worker_conn_t *conn, char *buf, size_t len);
+
+/**
+ * @brief   Sends the response of a detached session, `body` as text/plain,
+ *          none if NULL. The session is closed after it.
+ *
+ * @param   status  - Status line, e.g. HTTPD_200.
+ */
+esp_err_t http_worker_conn_respond(http_worker_conn_t *conn,
+                                    const char *status, const char *body);
+
+/**
+ * @brief   close_fn of the httpd config: closes a session, except the one
+ *          just detached.
+ */
+void http_worker_close_session(httpd_handle_t hd, int sockfd);
+
+void http_worker_get_stats(http_worker_stats_t *stats);
@@ -0,0 +1,523 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief   JSON writer driven by a schema described at compile time.
+ * @note    A schema is a type built from the templates below, e.g.
+ *
+ *              JSON_KEY(temp);
+ *              JSON_KEY(humidity);
+ *              typedef json_object<
+ *                  json_field<json_key_temp, json_fixed<1>>,
+ *                  json_field<json_key_humidity, json_fixed<1>>
+ *              > sensor_json_t;
+ *
+ *              char json[sensor_json_t::max_size + 1];
+ *              size_t len = json_write<sensor_json_t>(json, 21.5f, 40.0f);
+ *
+ *          Keys and punctuation are compiled in, values are formatted
+ *          without snprintf and `max_size` is the longest output any value
+ *          can produce. json_write() refuses, at compile time, a buffer
+ *          smaller than that bound, so it writes with no check per byte.
+ *          Schemas without a bound (JSON_UNBOUNDED arrays) can only be
+ *          streamed with json_send(), in JSON_CHUNK_SIZE chunks.
+ */
+
+/**
+ * @brief   `max_size` of a schema whose output has no upper bound.
+ */
+#define JSON_UNBOUNDED                  SIZE_MAX
+
+/**
+ * @brief   Chunk buffer of json_send(), on the caller's stack.
+ */
+#define JSON_CHUNK_SIZE                 512
+
+/**
+ * @brief   Declares the key `name`, with its quotes and separator.
+ */
+#define JSON_KEY(name)                                                      \
+    struct json_key_##name {                                                \
+        static constexpr char text[] = "\"" #name "\": ";                   \
+    }
+
+/* Sizes ---------------------------------------------------------------------*/
+
+constexpr size_t json_size_add(size_t a, size_t b)
+{
+    return (a > JSON_UNBOUNDED - b) ? JSON_UNBOUNDED : a + b;
+}
+
+constexpr size_t json_size_mul(size_t a, size_t n)
+{
+    return (n != 0 && a > JSON_UNBOUNDED / n) ? JSON_UNBOUNDED : a * n;
+}
+
+constexpr size_t json_size_sum(std::initializer_list<size_t> sizes)
+{
+    size_t sum = 0;
+
+    for (size_t size : sizes) {
+        sum = json_size_add(sum, size);
+    }
+
+    return sum;
+}
+
+/* Sinks ---------------------------------------------------------------------*/
+
+/**
+ * @brief   Writes into a buffer known to be large enough, see json_write().
+ */
+struct json_buffer_sink {
+    char *buffer;
+    size_t len;
+
+    void put(char c)
+    {
+        buffer[len++] = c;
+    }
+
+    void put(const char *data, size_t n)
+    {
+        memcpy(buffer + len, data, n);
+        len += n;
+    }
+
+    bool failed(void) const
+    {
+        return false;
+    }
+};
+
+/**
+ * @brief   Sends the output as chunks of a chunked HTTP response, see
+ *          json_send(). The first error stops the output.
+ */
+template <size_t N>
+struct json_chunk_sink {
+    httpd_req_t *req;
+    size_t len;
+    esp_err_t err;
+    char buffer[N];
+
+    void put(char c)
+    {
+        if (len == N) {
+            flush();
+        }
+        buffer[len++] = c;
+    }
+
+    void put(const char *data, size_t n)
+    {
+        while (n > 0) {
+            if (len == N) {
+                flush();
+            }
+
+            const size_t part = (n < N - len) ? n : N - len;
+            memcpy(buffer + len, data, part);
+            len += part;
+            data += part;
+            n -= part;
+        }
+    }
+
+    void flush(void)
+    {
+        if (len > 0 && err == ESP_OK) {
+            err = httpd_resp_send_chunk(req, buffer, len);
+        }
+        len = 0;
+    }
+
+    bool failed(void) const
+    {
+        return err != ESP_OK;
+    }
+};
+
+/* Values --------------------------------------------------------------------*/
+
+/**
+ * @brief   Integer of type T.
+ */
+template <typename T>
+struct json_int {
+    static_assert(std::is_integral<T>::value, "json_int needs an integer");
+
+    static constexpr size_t max_size = std::numeric_limits<T>::digits10 + 1
+                                        + (std::is_signed<T>::value ? 1 : 0);
+
+    template <typename Sink>
+    static void write(Sink &sink, T value)
+    {
+        typedef typename std::make_unsigned<T>::type unsigned_t;
+        char digits[max_size];
+        size_t i = max_size;
+
+        const bool negative = std::is_signed<T>::value && value < 0;
+        unsigned_t magnitude = negative ? unsigned_t(0) - unsigned_t(value)
+                                        : unsigned_t(value);
+        do {
+            digits[--i] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude != 0);
+
+        if (negative) {
+            digits[--i] = '-';
+        }
+
+        sink.put(digits + i, max_size - i);
+    }
+};
+
+/**
+ * @brief   Number with `Decimals` fixed decimals, null if it isn't finite or
+ *          is beyond 1e9.
+ */
+template <unsigned Decimals>
+struct json_fixed {
+    static_assert(Decimals <= 6, "json_fixed keeps at most 6 decimals");
+
+    static constexpr size_t max_size = 1 + 10 + (Decimals > 0 ? 1 : 0)
+                                        + Decimals;
+
+    template <typename Sink>
+    static void write(Sink &sink, double value)
+    {
+        if (!(fabs(value) < 1e9)) {
+            sink.put("null", 4);
+            return;
+        }
+
+        uint32_t scale = 1;
+        for (unsigned i = 0; i < Decimals; i++) {
+            scale *= 10;
+        }
+
+        const bool negative = value < 0;
+        const uint64_t scaled = (uint64_t)llround(fabs(value) * scale);
+        const uint64_t integer = scaled / scale;
+        uint32_t fraction = (uint32_t)(scaled % scale);
+
+        if (negative && scaled != 0) {
+            sink.put('-');
+        }
+        json_int<uint32_t>::write(sink, (uint32_t)integer);
+
+        if (Decimals > 0) {
+            char digits[Decimals + 1];
+
+            digits[0] = '.';
+            for (unsigned i = Decimals; i > 0; i--) {
+                digits[i] = '0' + fraction % 10;
+                fraction /= 10;
+            }
+            sink.put(digits, Decimals + 1);
+        }
+    }
+};
+
+/**
+ * @brief   true or false.
+ */
+struct json_bool {
+    static constexpr size_t max_size = 5;
+
+    template <typename Sink>
+    static void write(Sink &sink, bool value)
+    {
+        if (value) {
+            sink.put("true", 4);
+        } else {
+            sink.put("false", 5);
+        }
+    }
+};
+
+/**
+ * @brief   String of at most `MaxLen` bytes, longer ones are cut. Quotes,
+ *          backslashes and \b \f \n \r \t are escaped, other control
+ *          characters dropped, so each byte takes at most two.
+ */
+template <size_t MaxLen>
+struct json_string {
+    static constexpr size_t max_size = 2 + 2 * MaxLen;
+
+    template <typename Sink>
+    static void write(Sink &sink, const char *value)
+    {
+        static const char escapes[] = "btnvfr";
+        size_t start = 0;
+        size_t i = 0;
+
+        sink.put('"');
+        for (; i < MaxLen && value[i] != '\0'; i++) {
+            const unsigned char c = value[i];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+
+            /* Copy the plain run before the character then escape it. */
+            sink.put(value + start, i - start);
+            start = i + 1;
+
+            if (c == '"' || c == '\\') {
+                sink.put('\\');
+                sink.put(c);
+            } else if (c >= '\b' && c <= '\r' && c != '\v') {
+                sink.put('\\');
+                sink.put(escapes[c - '\b']);
+            }
+        }
+        sink.put(value + start, i - start);
+        sink.put('"');
+    }
+};
+
+/**
+ * @brief   IPv4 address as a dotted string, in lwIP byte order (first octet
+ *          in the lowest byte).
+ */
+struct json_ipv4 {
+    static constexpr size_t max_size = 2 + 15;
+
+    template <typename Sink>
+    static void write(Sink &sink, uint32_t addr)
+    {
+        sink.put('"');
+        for (size_t i = 0; i < 4; i++) {
+            if (i > 0) {
+                sink.put('.');
+            }
+            json_int<uint8_t>::write(sink, (uint8_t)(addr >> (8 * i)));
+        }
+        sink.put('"');
+    }
+};
+
+/**
+ * @brief   Already serialized JSON of at most `MaxLen` bytes, copied as is.
+ */
+template <size_t MaxLen>
+struct json_raw {
+    static constexpr size_t max_size = MaxLen;
+
+    template <typename Sink>
+    static void write(Sink &sink, const char *value)
+    {
+        sink.put(value, strnlen(value, MaxLen));
+    }
+};
+
+/* Structure -----------------------------------------------------------------*/
+
+/**
+ * @brief   `Key` (see JSON_KEY()) with a value of type `Value`.
+ */
+template <typename Key, typename Value>
+struct json_field {
+    static constexpr size_t key_len = sizeof(Key::text) - 1;
+    static constexpr size_t max_size = json_size_add(key_len,
+                                                        Value::max_size);
+
+    template <typename Sink, typename Arg>
+    static void write(Sink &sink, const Arg &value, bool &first)
+    {
+        if (!first) {
+            sink.put(", ", 2);
+        }
+        first = false;
+
+        sink.put(Key::text, key_len);
+        Value::write(sink, value);
+    }
+};
+
+/**
+ * @brief   json_field left out when its value, given by pointer, is NULL.
+ */
+template <typename Key, typename Value>
+struct json_optional_field {
+    static constexpr size_t max_size = json_field<Key, Value>::max_size;
+
+    template <typename Sink, typename Arg>
+    static void write(Sink &sink, const Arg &value, bool &first)
+    {
+        if (value != NULL) {
+            json_field<Key, Value>::write(sink, value, first);
+        }
+    }
+};
+
+/**
+ * @brief   Object of `Fields`, written from one value per field in order. A
+ *          nested object takes a std::tuple of its values.
+ */
+template <typename... Fields>
+struct json_object {
+    static constexpr size_t max_size = json_size_sum({
+        2,
+        (sizeof...(Fields) > 0 ? 2 * (sizeof...(Fields) - 1) : 0),
+        Fields::max_size...
+    });
+
+    template <typename Sink, typename... Args>
+    static void write(Sink &sink, const Args &... values)
+    {
+        static_assert(sizeof...(Args) == sizeof...(Fields),
+                        "one value per field");
+        bool first = true;
+
+        sink.put('{');
+        (void)first;
+        (Fields::write(sink, values, first), ...);
+        sink.put('}');
+    }
+
+    template <typename Sink, typename... Args>
+    static void write(Sink &sink, const std::tuple<Args...> &values)
+    {
+        std::apply([&sink](const Args &... args) {
+            write(sink, args...);
+        }, values);
+    }
+};
+
+/**
+ * @brief   Array of at most `MaxCount` `Element`, JSON_UNBOUNDED for any
+ *          count. `get(i)` returns the value of element i, written as it is
+ *          produced, so large arrays stream through json_send() without
+ *          being held in memory. A nested array takes a std::pair of the
+ *          count and `get`.
+ */
+template <typename Element, size_t MaxCount>
+struct json_array {
+    static constexpr size_t max_size =
+        (MaxCount == JSON_UNBOUNDED)
+            ? JSON_UNBOUNDED
+            : json_size_sum({
+                2,
+                json_size_mul(Element::max_size, MaxCount),
+                (MaxCount > 0 ? 2 * (MaxCount - 1) : 0)
+            });
+
+    template <typename Sink, typename Get>
+    static void write(Sink &sink, size_t count, Get get)
+    {
+        if (count > MaxCount) {
+            count = MaxCount;
+        }
+
+        sink.put('[');
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                sink.put(", ", 2);
+            }
+            Element::write(sink, get(i));
+        }
+        sink.put(']');
+    }
+
+    template <typename Sink, typename Get>
+    static void write(Sink &sink, const std::pair<size_t, Get> &values)
+    {
+        write(sink, values.first, values.second);
+    }
+};
+
+/**
+ * @brief   Array of `Element` whose count isn't known up front. `next()`
+ *          returns a std::optional of the next value, empty at the end. It
+ *          is not called again once the sink failed, so a reader of slow
+ *          storage stops with the client.
+ */
+template <typename Element>
+struct json_stream {
+    static constexpr size_t max_size = JSON_UNBOUNDED;
+
+    template <typename Sink, typename Next>
+    static void write(Sink &sink, Next next)
+    {
+        bool first = true;
+
+        sink.put('[');
+        while (!sink.failed()) {
+            const auto value = next();
+            if (!value) {
+                break;
+            }
+            if (!first) {
+                sink.put(", ", 2);
+            }
+            first = false;
+            Element::write(sink, *value);
+        }
+        sink.put(']');
+    }
+};
+
+/* Output --------------------------------------------------------------------*/
+
+/**
+ * @brief   Writes `Schema` into `buffer` and terminates it. The buffer must
+ *          hold `Schema::max_size` bytes and the terminator, which the
+ *          compiler checks.
+ *
+ * @param   buffer  - Output buffer.
+ * @param   values  - Values of the schema.
+ * @return  Length written, without the terminator.
+ */
+template <typename Schema, size_t N, typename... Args>
+size_t json_write(char (&buffer)[N], const Args &... values)
+{
+    static_assert(Schema::max_size < N, "buffer below the schema bound");
+    json_buffer_sink sink = { buffer, 0 };
+
+    Schema::write(sink, values...);
+    buffer[sink.len] = '\0';
+
+    return sink.len;
+}
+
+/**
+ * @brief   Sends `Schema` as a chunked `application/json` response, through a
+ *          JSON_CHUNK_SIZE buffer whatever the size of the output.
+ *
+ * @param   req     - HTTP request.
+ * @param   values  - Values of the schema.
+ * @return  ESP_OK, otherwise the first error of httpd_resp_send_chunk().
+ */
+template <typename Schema, typename... Args>
+esp_err_t json_send(httpd_req_t *req, const Args &... values)
+{
+    json_chunk_sink<JSON_CHUNK_SIZE> sink;
+
+    sink.req = req;
+    sink.len = 0;
+    sink.err = httpd_resp_set_type(req, "application/json");
+
+    Schema::write(sink, values...);
+    sink.flush();
+
+    if (sink.err == ESP_OK) {
+        sink.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    return sink.err;
+}
@@ -1,11 +1,22 @@
 #include <Arduino.h>
 #include <nvs_flash.h>
 
+#include "config.hpp"
+#include "dht_sensor.hpp"
+#include "dlog.hpp"
+#include "history_store.hpp"
+#include "power.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
 #include "wifi_app.hpp"
 
 void setup() {
     //Serial.begin(115200);
 
+    /* 0. Tracing, before any task records, and the deferred log. */
+    trace_init();
+    dlog_start();
+
     /* 1. Initialize NVS. */
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES
@@ -15,9 +26,29 @@ void setup() {
         }
     
     ESP_ERROR_CHECK(ret);
+
+    /* The cores saved over those of config.hpp, before any task is made. */
+    task_placement_init();
+
+    /* 2. Recover the flash history before the first sample reaches it. */
+    history_store_start();
+
+    /* 3. Sample the sensor, on the core the WiFi stack leaves idle unless
+     * placed otherwise. */
+    dht_sensor_start();
+
+    /* 4. The CPU slows down and sleeps unless a transfer holds it. */
+    power_init();
+    if (POWER_MEASURE_PERIOD_MS > 0) {
+        power_measure_start(POWER_MEASURE_PERIOD_MS);
+    }
+
+    /* 5. Everything else runs in the tasks of the WiFi application. */
+    wifi_app_start();
 }
 
 void loop() {
-    wifi_app_start();
-    while (1);
+    /* Nothing left for the loop task, deleted so the idle task runs and
+     * the core can sleep. */
+    vTaskDelete(NULL);
 }
\ No newline at end of file
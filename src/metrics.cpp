@@ -0,0 +1,618 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_http_server.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "event_bus.hpp"
+#include "http_worker.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
+#include "power.hpp"
+#include "trace.hpp"
+
+#define METRICS_CONTENT_TYPE            "text/plain; version=0.0.4"
+#define METRICS_LINE_MAX_LEN            192
+#define METRICS_TASK_NAME_MAX_LEN       16
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   A URI handler registered through the wrapper, and what it
+ *          measured.
+ */
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    std::atomic<uint32_t> errors;
+    metrics_counter64_t bytes;
+    metrics_histogram_t latency;
+} metrics_uri_t;
+
+typedef struct {
+    TaskHandle_t task;                  /* NULL while free. */
+    uint32_t stack_size;
+} metrics_task_t;
+
+typedef json_chunk_sink<JSON_CHUNK_SIZE> metrics_sink_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Upper bounds of the latency buckets, the +Inf one has none.
+ */
+static const uint32_t s_bucket_bounds_us[METRICS_BUCKET_COUNT - 1] = {
+    500, 1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+
+static const char *const s_bucket_labels[METRICS_BUCKET_COUNT] = {
+    "0.0005", "0.001", "0.002", "0.005", "0.01", "0.025", "0.05", "0.1",
+    "0.25", "0.5", "1", "2.5", "5", "10", "+Inf"
+};
+
+static const char *const s_method_names[] = {
+    "DELETE", "GET", "HEAD", "POST", "PUT"
+};
+
+/**
+ * @brief   Slots are only added, by the task registering the handlers, and
+ *          published by the count.
+ */
+static metrics_uri_t s_uris[METRICS_MAX_URIS];
+static std::atomic<uint32_t> s_uri_count(0);
+
+static std::atomic<uint32_t> s_values[METRICS_VALUE_MAX];
+
+/**
+ * @brief   A task is read under the lock, so it isn't deleted meanwhile.
+ */
+static metrics_task_t s_tasks[METRICS_MAX_TASKS];
+static portMUX_TYPE s_task_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief   Request being served by this task.
+ */
+static thread_local metrics_request_t s_request;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Wrapper registered for every handler: times it and counts what
+ *          it sends.
+ */
+static esp_err_t metrics_uri_handler(httpd_req_t *req);
+
+/**
+ * @brief   Send override of the sessions, the default send of httpd which
+ *          also counts the bytes of the request in progress.
+ */
+static int metrics_sock_send(httpd_handle_t hd, int sockfd, const char *buf,
+                                size_t buf_len, int flags);
+
+static void metrics_printf(metrics_sink_t &sink, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief   # HELP and # TYPE lines of a metric family.
+ */
+static void metrics_family(metrics_sink_t &sink, const char *name,
+                            const char *type, const char *help);
+
+static void metrics_send_http(metrics_sink_t &sink);
+static void metrics_send_ota(metrics_sink_t &sink);
+static void metrics_send_queues(metrics_sink_t &sink);
+static void metrics_send_tasks(metrics_sink_t &sink);
+static void metrics_send_heap(metrics_sink_t &sink);
+
+/**
+ * @brief   The last period of power_measure_start(), if running.
+ */
+static void metrics_send_power(metrics_sink_t &sink);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t metrics_register_uri_handler(httpd_handle_t handle,
+                                        const httpd_uri_t *uri)
+{
+    const uint32_t index = s_uri_count.load(std::memory_order_relaxed);
+
+    if (index == METRICS_MAX_URIS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    metrics_uri_t *slot = &s_uris[index];
+    slot->uri = uri->uri;
+    slot->method = uri->method;
+    slot->handler = uri->handler;
+    slot->user_ctx = uri->user_ctx;
+
+    httpd_uri_t wrapper = *uri;
+    wrapper.handler = metrics_uri_handler;
+    wrapper.user_ctx = slot;
+
+    const esp_err_t err = httpd_register_uri_handler(handle, &wrapper);
+    if (err == ESP_OK) {
+        s_uri_count.store(index + 1, std::memory_order_release);
+    }
+    return err;
+}
+
+metrics_request_t metrics_request_detach(void)
+{
+    const metrics_request_t request = s_request;
+
+    s_request.uri = NULL;
+    return request;
+}
+
+void metrics_request_attach(const metrics_request_t *request)
+{
+    s_request = *request;
+}
+
+const char *metrics_request_uri(const metrics_request_t *request)
+{
+    const metrics_uri_t *uri = (const metrics_uri_t *)request->uri;
+
+    return (uri != NULL) ? uri->uri : "";
+}
+
+void metrics_request_end(esp_err_t err)
+{
+    metrics_uri_t *uri = (metrics_uri_t *)s_request.uri;
+
+    if (uri == NULL) {
+        return;
+    }
+    s_request.uri = NULL;
+    power_lock_release(POWER_LOCK_HTTP);
+
+    const int64_t elapsed_us = esp_timer_get_time() - s_request.start_us;
+    metrics_histogram_observe(&uri->latency, (uint32_t)MIN(elapsed_us,
+                                                    (int64_t)UINT32_MAX));
+    metrics_counter64_add(&uri->bytes, s_request.bytes);
+    if (err != ESP_OK) {
+        uri->errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void metrics_register_task(TaskHandle_t task, uint32_t stack_size)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+
+    portENTER_CRITICAL(&s_task_lock);
+    for (size_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        if (s_tasks[i].task == NULL) {
+            s_tasks[i].task = task;
+            s_tasks[i].stack_size = stack_size;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_task_lock);
+}
+
+void metrics_unregister_task(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+
+    portENTER_CRITICAL(&s_task_lock);
+    for (size_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        if (s_tasks[i].task == task) {
+            s_tasks[i].task = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_task_lock);
+}
+
+void metrics_counter64_add(metrics_counter64_t *counter, uint32_t n)
+{
+    const uint32_t before = counter->low.fetch_add(n,
+                                                std::memory_order_relaxed);
+
+    if ((uint32_t)(before + n) < before) {
+        counter->high.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t metrics_counter64_load(const metrics_counter64_t *counter)
+{
+    uint32_t high;
+    uint32_t low;
+
+    do {
+        high = counter->high.load(std::memory_order_acquire);
+        low = counter->low.load(std::memory_order_acquire);
+    } while (high != counter->high.load(std::memory_order_acquire));
+
+    return ((uint64_t)high << 32) | low;
+}
+
+void metrics_add(metrics_value_e value, uint32_t n)
+{
+    s_values[value].fetch_add(n, std::memory_order_relaxed);
+}
+
+void metrics_set(metrics_value_e value, uint32_t n)
+{
+    s_values[value].store(n, std::memory_order_relaxed);
+}
+
+uint32_t metrics_get(metrics_value_e value)
+{
+    return s_values[value].load(std::memory_order_relaxed);
+}
+
+void metrics_histogram_observe(metrics_histogram_t *histogram, uint32_t us)
+{
+    size_t bucket = 0;
+
+    /* Bounds are inclusive, as Prometheus' `le`. */
+    while (bucket < METRICS_BUCKET_COUNT - 1
+            && us > s_bucket_bounds_us[bucket]) {
+        bucket++;
+    }
+
+    histogram->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    metrics_counter64_add(&histogram->sum_us, us);
+}
+
+double metrics_histogram_quantile(const metrics_histogram_t *histogram,
+                                    double q)
+{
+    uint32_t counts[METRICS_BUCKET_COUNT];
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKET_COUNT; i++) {
+        counts[i] = histogram->buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const double rank = q * total;
+    uint64_t below = 0;
+    for (size_t i = 0; i < METRICS_BUCKET_COUNT - 1; i++) {
+        if (below + counts[i] >= rank && counts[i] > 0) {
+            const double lower = (i == 0) ? 0 : s_bucket_bounds_us[i - 1];
+
+            return lower + (s_bucket_bounds_us[i] - lower)
+                            * (rank - below) / counts[i];
+        }
+        below += counts[i];
+    }
+    return s_bucket_bounds_us[METRICS_BUCKET_COUNT - 2];
+}
+
+esp_err_t metrics_send(httpd_req_t *req)
+{
+    metrics_sink_t sink;
+
+    sink.req = req;
+    sink.len = 0;
+    sink.err = httpd_resp_set_type(req, METRICS_CONTENT_TYPE);
+
+    metrics_send_http(sink);
+    metrics_send_ota(sink);
+    metrics_send_queues(sink);
+    metrics_send_tasks(sink);
+    metrics_send_heap(sink);
+    metrics_send_power(sink);
+    sink.flush();
+
+    if (sink.err == ESP_OK) {
+        sink.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return sink.err;
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t metrics_uri_handler(httpd_req_t *req)
+{
+    metrics_uri_t *uri = (metrics_uri_t *)req->user_ctx;
+
+    /* 1. The handler sees its own context. Set on every request, httpd
+     * has no hook between accepting a session and its first request. */
+    req->user_ctx = uri->user_ctx;
+    httpd_sess_set_send_override(req->handle, httpd_req_to_sockfd(req),
+                                    metrics_sock_send);
+
+    s_request.uri = uri;
+    s_request.start_us = esp_timer_get_time();
+    s_request.bytes = 0;
+    power_lock_acquire(POWER_LOCK_HTTP);
+
+    /* 2. Recorded here, unless it was handed to a worker. */
+    TRACE_BEGIN(uri->uri, uri->method);
+    const esp_err_t err = uri->handler(req);
+    TRACE_END(uri->uri);
+    metrics_request_end(err);
+    return err;
+}
+
+static int metrics_sock_send(httpd_handle_t hd, int sockfd, const char *buf,
+                                size_t buf_len, int flags)
+{
+    int ret;
+
+    (void)hd;
+    do {
+        ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        if (errno == EBADF || errno == EINVAL || errno == EFAULT) {
+            return HTTPD_SOCK_ERR_INVALID;
+        }
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+
+    if (s_request.uri != NULL) {
+        s_request.bytes += ret;
+    }
+    return ret;
+}
+
+static void metrics_printf(metrics_sink_t &sink, const char *format, ...)
+{
+    char line[METRICS_LINE_MAX_LEN];
+    va_list args;
+
+    va_start(args, format);
+    const int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (len > 0) {
+        sink.put(line, MIN((size_t)len, sizeof(line) - 1));
+    }
+}
+
+static void metrics_family(metrics_sink_t &sink, const char *name,
+                            const char *type, const char *help)
+{
+    metrics_printf(sink, "# HELP iot_%s %s\n# TYPE iot_%s %s\n",
+                    name, help, name, type);
+}
+
+static void metrics_send_http(metrics_sink_t &sink)
+{
+    const uint32_t count = s_uri_count.load(std::memory_order_acquire);
+
+    metrics_family(sink, "http_request_duration_seconds", "histogram",
+                    "Time from the dispatch of a request to the return of "
+                    "its handler, the wait for a worker included.");
+    for (uint32_t i = 0; i < count && !sink.failed(); i++) {
+        const metrics_uri_t *uri = &s_uris[i];
+        const char *method = s_method_names[uri->method];
+        uint32_t cumulative = 0;
+
+        for (size_t b = 0; b < METRICS_BUCKET_COUNT; b++) {
+            cumulative += uri->latency.buckets[b].load(
+                                                std::memory_order_relaxed);
+            metrics_printf(sink, "iot_http_request_duration_seconds_bucket"
+                            "{uri=\"%s\",method=\"%s\",le=\"%s\"} %u\n",
+                            uri->uri, method, s_bucket_labels[b],
+                            (unsigned)cumulative);
+        }
+
+        const uint64_t sum_us = metrics_counter64_load(&uri->latency.sum_us);
+        metrics_printf(sink, "iot_http_request_duration_seconds_sum"
+                        "{uri=\"%s\",method=\"%s\"} %llu.%06u\n"
+                        "iot_http_request_duration_seconds_count"
+                        "{uri=\"%s\",method=\"%s\"} %u\n",
+                        uri->uri, method,
+                        (unsigned long long)(sum_us / 1000000),
+                        (unsigned)(sum_us % 1000000),
+                        uri->uri, method, (unsigned)cumulative);
+    }
+
+    metrics_family(sink, "http_request_errors_total", "counter",
+                    "Requests whose handler failed, the session was "
+                    "closed.");
+    for (uint32_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_http_request_errors_total"
+                        "{uri=\"%s\",method=\"%s\"} %u\n",
+                        s_uris[i].uri, s_method_names[s_uris[i].method],
+                        (unsigned)s_uris[i].errors.load(
+                                                std::memory_order_relaxed));
+    }
+
+    metrics_family(sink, "http_response_bytes_total", "counter",
+                    "Bytes sent by the handlers, headers included.");
+    for (uint32_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_http_response_bytes_total"
+                        "{uri=\"%s\",method=\"%s\"} %llu\n",
+                        s_uris[i].uri, s_method_names[s_uris[i].method],
+                        (unsigned long long)metrics_counter64_load(
+                                                        &s_uris[i].bytes));
+    }
+}
+
+static void metrics_send_ota(metrics_sink_t &sink)
+{
+    metrics_family(sink, "ota_received_bytes_total", "counter",
+                    "Bytes of OTA images received, uploaded or pulled.");
+    metrics_printf(sink, "iot_ota_received_bytes_total %u\n",
+                    (unsigned)metrics_get(METRICS_OTA_RECEIVED_BYTES));
+
+    metrics_family(sink, "ota_updates_total", "counter",
+                    "OTA updates finished or aborted.");
+    metrics_printf(sink, "iot_ota_updates_total %u\n",
+                    (unsigned)metrics_get(METRICS_OTA_UPDATES));
+
+    metrics_family(sink, "ota_failures_total", "counter",
+                    "OTA updates which failed.");
+    metrics_printf(sink, "iot_ota_failures_total %u\n",
+                    (unsigned)metrics_get(METRICS_OTA_FAILURES));
+
+    metrics_family(sink, "ota_throughput_bytes_per_second", "gauge",
+                    "Received bytes over the duration of the last OTA "
+                    "update.");
+    metrics_printf(sink, "iot_ota_throughput_bytes_per_second %u\n",
+                    (unsigned)metrics_get(METRICS_OTA_THROUGHPUT));
+}
+
+static void metrics_send_queues(metrics_sink_t &sink)
+{
+    event_bus_stats_t rings[EVENT_BUS_MAX_SUBSCRIBERS];
+    http_worker_stats_t workers;
+
+    const size_t count = event_bus_get_stats(rings,
+                                                EVENT_BUS_MAX_SUBSCRIBERS);
+    http_worker_get_stats(&workers);
+
+    metrics_family(sink, "queue_depth", "gauge",
+                    "Items waiting in the event bus ring of a task, or for "
+                    "an HTTP worker.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_queue_depth{queue=\"%s\"} %u\n",
+                        pcTaskGetName(rings[i].task),
+                        (unsigned)rings[i].depth);
+    }
+    metrics_printf(sink, "iot_queue_depth{queue=\"http_worker\"} %u\n",
+                    (unsigned)workers.queued);
+
+    metrics_family(sink, "queue_high_water", "gauge",
+                    "Most items ever waiting in the queue.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_queue_high_water{queue=\"%s\"} %u\n",
+                        pcTaskGetName(rings[i].task),
+                        (unsigned)rings[i].high_water);
+    }
+    metrics_printf(sink, "iot_queue_high_water{queue=\"http_worker\"} %u\n",
+                    (unsigned)workers.high_water);
+
+    metrics_family(sink, "queue_capacity", "gauge",
+                    "Items the queue holds.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_queue_capacity{queue=\"%s\"} %u\n",
+                        pcTaskGetName(rings[i].task),
+                        (unsigned)EVENT_BUS_RING_SIZE);
+    }
+    metrics_printf(sink, "iot_queue_capacity{queue=\"http_worker\"} %u\n",
+                    (unsigned)HTTP_WORKER_QUEUE_LENGTH);
+
+    metrics_family(sink, "queue_dropped_total", "counter",
+                    "Items lost to a full queue, 503 answers for the "
+                    "workers.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_queue_dropped_total{queue=\"%s\"} %u\n",
+                        pcTaskGetName(rings[i].task),
+                        (unsigned)rings[i].dropped);
+    }
+    metrics_printf(sink, "iot_queue_dropped_total{queue=\"http_worker\"} "
+                    "%u\n", (unsigned)workers.refused);
+}
+
+static void metrics_send_tasks(metrics_sink_t &sink)
+{
+    char names[METRICS_MAX_TASKS][METRICS_TASK_NAME_MAX_LEN];
+    uint32_t stack_sizes[METRICS_MAX_TASKS];
+    uint32_t free_min[METRICS_MAX_TASKS];
+    size_t count = 0;
+
+    /* 1. Copied under the lock, which isn't held while sending. */
+    portENTER_CRITICAL(&s_task_lock);
+    for (size_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        if (s_tasks[i].task == NULL) {
+            continue;
+        }
+        strlcpy(names[count], pcTaskGetName(s_tasks[i].task),
+                sizeof(names[count]));
+        stack_sizes[count] = s_tasks[i].stack_size;
+        free_min[count] = uxTaskGetStackHighWaterMark(s_tasks[i].task);
+        count++;
+    }
+    portEXIT_CRITICAL(&s_task_lock);
+
+    /* 2. The stack of ESP-IDF tasks is counted in bytes. */
+    metrics_family(sink, "task_stack_size_bytes", "gauge",
+                    "Stack size a task was created with.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_task_stack_size_bytes{task=\"%s\"} %u\n",
+                        names[i], (unsigned)stack_sizes[i]);
+    }
+
+    metrics_family(sink, "task_stack_free_min_bytes", "gauge",
+                    "Least stack a task ever had left, its high-water "
+                    "mark.");
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(sink, "iot_task_stack_free_min_bytes{task=\"%s\"} "
+                        "%u\n", names[i], (unsigned)free_min[i]);
+    }
+}
+
+static void metrics_send_heap(metrics_sink_t &sink)
+{
+    metrics_family(sink, "heap_free_bytes", "gauge", "Free heap.");
+    metrics_printf(sink, "iot_heap_free_bytes %u\n",
+                    (unsigned)esp_get_free_heap_size());
+
+    metrics_family(sink, "heap_free_min_bytes", "gauge",
+                    "Least free heap since boot.");
+    metrics_printf(sink, "iot_heap_free_min_bytes %u\n",
+                    (unsigned)esp_get_minimum_free_heap_size());
+
+    metrics_family(sink, "heap_largest_free_block_bytes", "gauge",
+                    "Largest block malloc() can return.");
+    metrics_printf(sink, "iot_heap_largest_free_block_bytes %u\n",
+                    (unsigned)heap_caps_get_largest_free_block(
+                                                        MALLOC_CAP_8BIT));
+}
+
+static void metrics_send_power(metrics_sink_t &sink)
+{
+    power_report_t report;
+
+    if (!power_get_report(&report)) {
+        return;
+    }
+
+    metrics_family(sink, "cpu_idle_ratio", "gauge",
+                    "Share of the last measurement period a core was "
+                    "idle or asleep.");
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        metrics_printf(sink, "iot_cpu_idle_ratio{core=\"%u\"} %u.%03u\n",
+                        (unsigned)core, report.idle[core] / 1000,
+                        report.idle[core] % 1000);
+    }
+
+    metrics_family(sink, "cpu_frequency_ratio", "gauge",
+                    "Share of the last measurement period the CPU ran at a "
+                    "frequency.");
+    for (size_t i = 0; i < POWER_MEASURE_FREQS; i++) {
+        if (report.freq_mhz[i] != 0) {
+            metrics_printf(sink, "iot_cpu_frequency_ratio{mhz=\"%u\"} "
+                            "%u.%03u\n", report.freq_mhz[i],
+                            report.freq[i] / 1000, report.freq[i] % 1000);
+        }
+    }
+
+    metrics_family(sink, "cpu_light_sleep_ratio", "gauge",
+                    "Share of the last measurement period spent in light "
+                    "sleep.");
+    metrics_printf(sink, "iot_cpu_light_sleep_ratio %u.%03u\n",
+                    report.sleep / 1000, report.sleep % 1000);
+}
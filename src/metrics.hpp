@@ -0,0 +1,151 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief   Up to METRICS_MAX_URIS URI handlers and METRICS_MAX_TASKS tasks
+ *          are tracked. Latencies are counted in METRICS_BUCKET_COUNT
+ *          buckets, from 0.5 ms to 10 s then one past it.
+ */
+#define METRICS_MAX_URIS                28
+#define METRICS_MAX_TASKS               12
+#define METRICS_BUCKET_COUNT            15
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   64-bit counter made of two 32-bit atomics, the ESP32 has no
+ *          64-bit atomic instructions. The high word is carried after the
+ *          low one wrapped, a read in between is 2^32 short.
+ */
+typedef struct {
+    std::atomic<uint32_t> low;
+    std::atomic<uint32_t> high;
+} metrics_counter64_t;
+
+/**
+ * @brief   Latency histogram. The buckets aren't cumulative, the +Inf one
+ *          is the last.
+ */
+typedef struct {
+    std::atomic<uint32_t> buckets[METRICS_BUCKET_COUNT];
+    metrics_counter64_t sum_us;
+} metrics_histogram_t;
+
+/**
+ * @brief   Values updated by the application, counters only grow.
+ */
+typedef enum {
+    METRICS_OTA_RECEIVED_BYTES = 0,     /* Counter, pushed and pulled. */
+    METRICS_OTA_UPDATES,                /* Counter, finished or aborted. */
+    METRICS_OTA_FAILURES,               /* Counter. */
+    METRICS_OTA_THROUGHPUT,             /* Gauge, bytes/s of the last one. */
+    METRICS_VALUE_MAX
+} metrics_value_e;
+
+/**
+ * @brief   Request timed on a task, see metrics_request_detach().
+ */
+typedef struct {
+    void *uri;                          /* Handler slot, NULL if none. */
+    int64_t start_us;
+    uint32_t bytes;                     /* Sent so far, headers too. */
+} metrics_request_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Registers a URI handler through a wrapper which counts its
+ *          requests, errors, bytes sent and latency, in place of
+ *          httpd_register_uri_handler(). The CPU is kept at full speed,
+ *          POWER_LOCK_HTTP, until the request is recorded.
+ * @note    The bytes are counted by a send override set on the session,
+ *          those sent outside the handler (event streams) aren't.
+ *
+ * @return  ESP_ERR_NO_MEM past METRICS_MAX_URIS, otherwise the result of
+ *          httpd_register_uri_handler().
+ */
+esp_err_t metrics_register_uri_handler(httpd_handle_t handle,
+                                        const httpd_uri_t *uri);
+
+/**
+ * @brief   Takes the request timed on this task out of it, for another task
+ *          to go on with metrics_request_attach(). The handler returning
+ *          here is then not recorded.
+ */
+metrics_request_t metrics_request_detach(void);
+
+/**
+ * @brief   Goes on timing a detached request on this task, the wait in
+ *          between is part of its latency.
+ */
+void metrics_request_attach(const metrics_request_t *request);
+
+/**
+ * @brief   URI a detached request was registered with, empty if none.
+ */
+const char *metrics_request_uri(const metrics_request_t *request);
+
+/**
+ * @brief   Records the request timed on this task, if any, and releases
+ *          its power lock.
+ *
+ * @param   err - Result of the handler, counted as an error if not ESP_OK.
+ */
+void metrics_request_end(esp_err_t err);
+
+/**
+ * @brief   Reports the stack high-water mark of a task, called by the task
+ *          itself first thing.
+ *
+ * @param   task        - Task handle, NULL for the calling task.
+ * @param   stack_size  - Stack size it was created with.
+ */
+void metrics_register_task(TaskHandle_t task, uint32_t stack_size);
+
+/**
+ * @brief   Stops reporting a task, before it is deleted.
+ *
+ * @param   task    - Task handle, NULL for the calling task.
+ */
+void metrics_unregister_task(TaskHandle_t task);
+
+void metrics_counter64_add(metrics_counter64_t *counter, uint32_t n);
+uint64_t metrics_counter64_load(const metrics_counter64_t *counter);
+
+void metrics_add(metrics_value_e value, uint32_t n);
+void metrics_set(metrics_value_e value, uint32_t n);
+uint32_t metrics_get(metrics_value_e value);
+
+/**
+ * @brief   Counts a latency in its bucket and in the sum. Lock-free,
+ *          callable from any task.
+ */
+void metrics_histogram_observe(metrics_histogram_t *histogram, uint32_t us);
+
+/**
+ * @brief   Estimates a quantile as Prometheus' histogram_quantile() does,
+ *          interpolating linearly inside the bucket where it falls.
+ *
+ * @param   q   - Quantile, 0 to 1.
+ * @return  Microseconds, the highest bound if it falls in the +Inf bucket,
+ *          0 if the histogram is empty.
+ */
+double metrics_histogram_quantile(const metrics_histogram_t *histogram,
+                                    double q);
+
+/**
+ * @brief   GET /metrics handler, every metric in the Prometheus text
+ *          format: per URI latency histograms, errors and bytes sent, OTA
+ *          transfers, event bus rings and worker queue, task stacks and
+ *          heap.
+ */
+esp_err_t metrics_send(httpd_req_t *req);
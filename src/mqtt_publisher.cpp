@@ -0,0 +1,631 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stddef.h>
+#include <string.h>
+
+#include <tuple>
+#include <utility>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mqtt_client.h>
+#include <nvs.h>
+
+#include "cbor_writer.hpp"
+#include "config.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "history_store.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
+#include "mqtt_publisher.hpp"
+#include "task_placement.hpp"
+
+#define MQTT_PUBLISHER_DRAIN_PERIOD_US  (1000000 / MQTT_PUBLISHER_DRAIN_PER_S)
+
+/**
+ * @brief   Slots the backlog may take, one is left to the live batch when
+ *          the window has more.
+ */
+#define MQTT_PUBLISHER_DRAIN_INFLIGHT_MAX                                   \
+    ((MQTT_PUBLISHER_INFLIGHT_MAX > 1) ? MQTT_PUBLISHER_INFLIGHT_MAX - 1 : 1)
+
+static_assert(MQTT_PUBLISHER_INFLIGHT_MAX <= EVENT_BUS_RING_SIZE / 2,
+                "a PUBACK event per message must fit the ring");
+static_assert(MQTT_PUBLISHER_DRAIN_PER_S > 0, "the backlog must drain");
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    int64_t time_ms;                    /* Unix time. */
+    float temperature;
+    float humidity;
+} mqtt_publisher_sample_t;
+
+/**
+ * @brief   Message waiting for its PUBACK. Only its time range is kept, a
+ *          batch that isn't acked is read back from the flash history.
+ */
+typedef struct {
+    int msg_id;                         /* -1 while free. */
+    bool drained;                       /* From the backlog. */
+    uint32_t count;
+    int64_t sent_us;
+    int64_t first_ms;
+    int64_t last_ms;
+} mqtt_publisher_inflight_t;
+
+JSON_KEY(samples);
+JSON_KEY(time);
+JSON_KEY(temp);
+JSON_KEY(humidity);
+
+typedef json_object<
+    json_field<json_key_time, json_int<int64_t>>,
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>
+> mqtt_publisher_sample_json_t;
+
+typedef json_object<
+    json_field<json_key_samples, json_array<mqtt_publisher_sample_json_t,
+                                            MQTT_PUBLISHER_BATCH_SIZE>>
+> mqtt_publisher_json_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "mqtt_publisher";
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static TaskHandle_t s_mqtt_publisher_task = NULL;
+static event_bus_subscriber_t *s_mqtt_publisher_subscriber = NULL;
+static bool s_history = false;              /* The backlog can be read. */
+static bool s_connected = false;
+
+static mqtt_publisher_sample_t s_live[MQTT_PUBLISHER_BATCH_SIZE];
+static size_t s_live_count = 0;
+static mqtt_publisher_sample_t s_drain[MQTT_PUBLISHER_BATCH_SIZE];
+static history_store_cursor_t s_cursor;     /* Too large for the stack. */
+static mqtt_publisher_inflight_t s_inflight[MQTT_PUBLISHER_INFLIGHT_MAX];
+static char s_payload[mqtt_publisher_json_t::max_size + 1];  /* Or CBOR. */
+
+/**
+ * @brief   Samples between these times are left to send from flash. The
+ *          start is 0 while the backlog is empty, and the end 0 until the
+ *          first sample after boot bounds an outage found in NVS.
+ */
+static int64_t s_backlog_from_ms = 0;
+static int64_t s_backlog_to_ms = 0;
+static bool s_booted = false;               /* First sample seen. */
+static int64_t s_next_drain_us = 0;
+static int64_t s_drain_start_us = 0;        /* 0 while not draining. */
+static uint32_t s_drain_batches = 0;
+static uint32_t s_drain_samples = 0;
+
+static mqtt_publisher_stats_t s_stats;      /* Task only. */
+static mqtt_publisher_stats_t s_stats_copy; /* For other tasks. */
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Batches the samples and publishes them, acks and drains.
+ *
+ * @param param
+ */
+static void mqtt_publisher_task(void *param);
+
+/**
+ * @brief   Runs on the MQTT client task, forwards what the publisher needs
+ *          to the event bus.
+ */
+static void mqtt_publisher_event_handler(void *arg, esp_event_base_t base,
+                                            int32_t event_id,
+                                            void *event_data);
+
+/**
+ * @brief   Adds a sample to the live batch, which goes out when full.
+ */
+static void mqtt_publisher_add(const event_bus_event_t *event);
+
+/**
+ * @brief   Publishes a batch with QoS 1 in a free window slot.
+ *
+ * @return  false if the window is full or the client refused it.
+ */
+static bool mqtt_publisher_publish(const mqtt_publisher_sample_t *samples,
+                                    size_t count, bool drained);
+
+/**
+ * @brief   Frees the slot of an acked message.
+ */
+static void mqtt_publisher_acked(int msg_id);
+
+/**
+ * @brief   Leaves the slots unacked after MQTT_PUBLISHER_ACK_TIMEOUT_MS, or
+ *          all of them, to the backlog.
+ */
+static void mqtt_publisher_expire(bool all);
+
+/**
+ * @brief   Publishes the next batch of the backlog, at most
+ *          MQTT_PUBLISHER_DRAIN_PER_S a second.
+ */
+static void mqtt_publisher_drain(void);
+
+/**
+ * @brief   Extends the backlog over a batch that wasn't delivered.
+ */
+static void mqtt_publisher_spill(int64_t first_ms, int64_t last_ms);
+
+/**
+ * @brief   Empties the backlog once it is sent.
+ */
+static void mqtt_publisher_backlog_done(void);
+
+/**
+ * @brief   Ticks until the task has something to do without an event.
+ */
+static TickType_t mqtt_publisher_wait_ticks(void);
+
+static size_t mqtt_publisher_inflight_count(void);
+static esp_err_t mqtt_publisher_load_backlog(int64_t *from_ms);
+static void mqtt_publisher_save_backlog(int64_t from_ms);
+
+/* Public function definition ------------------------------------------------*/
+void mqtt_publisher_start(void)
+{
+    if (s_mqtt_publisher_task != NULL) {
+        return;
+    }
+
+    /* 1. The client reconnects on its own from now on. A batch goes out in
+     * one write. */
+    esp_mqtt_client_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.uri = MQTT_PUBLISHER_BROKER_URI;
+    config.keepalive = MQTT_PUBLISHER_KEEPALIVE_S;
+    config.out_buffer_size = sizeof(s_payload) + sizeof(MQTT_PUBLISHER_TOPIC)
+                                + 16;
+
+    s_client = esp_mqtt_client_init(&config);
+    if (s_client == NULL) {
+        DLOGE(TAG, "MQTT client init failed.");
+        return;
+    }
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_ANY,
+                                    &mqtt_publisher_event_handler, NULL);
+
+    /* 2. Without the flash history nothing can wait for the broker. */
+    s_history = (history_store_init() == ESP_OK);
+    if (!s_history) {
+        DLOGW(TAG, "No history, batches the broker misses are lost.");
+    }
+
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        s_inflight[i].msg_id = -1;
+    }
+
+    xTaskCreatePinnedToCore(&mqtt_publisher_task,
+                            "mqtt_publisher_task",
+                            MQTT_PUBLISHER_TASK_STACK_SIZE,
+                            NULL,
+                            MQTT_PUBLISHER_TASK_PRIORITY,
+                            &s_mqtt_publisher_task,
+                            task_placement_core(TASK_PLACEMENT_MQTT_PUBLISHER));
+}
+
+void mqtt_publisher_get_stats(mqtt_publisher_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats_copy;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Private function definition -----------------------------------------------*/
+static void mqtt_publisher_task(void *param)
+{
+    static const event_bus_type_e types[] = {
+        EVENT_BUS_SENSOR_SAMPLE,
+        EVENT_BUS_MQTT_CONNECTED,
+        EVENT_BUS_MQTT_DISCONNECTED,
+        EVENT_BUS_MQTT_PUBLISHED
+    };
+    event_bus_event_t event;
+
+    metrics_register_task(NULL, MQTT_PUBLISHER_TASK_STACK_SIZE);
+    s_mqtt_publisher_subscriber = event_bus_subscribe(
+                                        xTaskGetCurrentTaskHandle(),
+                                        types,
+                                        sizeof(types) / sizeof(types[0]));
+
+    /* 1. An outage the last boot didn't finish sending, bounded by the
+     * first sample. */
+    if (s_history && mqtt_publisher_load_backlog(&s_backlog_from_ms)
+                        == ESP_OK) {
+        DLOGI(TAG, "Backlog from %lld left by the last boot.",
+                    (long long)s_backlog_from_ms);
+    }
+
+    /* 2. Subscribed first, the connection isn't missed. */
+    esp_mqtt_client_start(s_client);
+
+    while (1) {
+        if (event_bus_receive(s_mqtt_publisher_subscriber, &event,
+                                mqtt_publisher_wait_ticks())) {
+            switch (event.type) {
+                case EVENT_BUS_SENSOR_SAMPLE:
+                    mqtt_publisher_add(&event);
+                    break;
+
+                case EVENT_BUS_MQTT_CONNECTED:
+                    DLOGI(TAG, "EVENT_BUS_MQTT_CONNECTED");
+                    s_connected = true;
+                    s_next_drain_us = esp_timer_get_time();
+                    break;
+
+                case EVENT_BUS_MQTT_DISCONNECTED:
+                    /* Also sent by every failed attempt. */
+                    if (s_connected) {
+                        DLOGI(TAG, "EVENT_BUS_MQTT_DISCONNECTED");
+                    }
+                    s_connected = false;
+                    mqtt_publisher_expire(true);
+                    break;
+
+                case EVENT_BUS_MQTT_PUBLISHED:
+                    mqtt_publisher_acked(event.mqtt_published.msg_id);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        mqtt_publisher_expire(false);
+        mqtt_publisher_drain();
+
+        s_stats.connected = s_connected;
+        s_stats.inflight = mqtt_publisher_inflight_count();
+        s_stats.backlog_from_ms = s_backlog_from_ms;
+        s_stats.backlog_to_ms = s_backlog_to_ms;
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats_copy = s_stats;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+static void mqtt_publisher_event_handler(void *arg, esp_event_base_t base,
+                                            int32_t event_id,
+                                            void *event_data)
+{
+    const esp_mqtt_event_handle_t mqtt_event =
+                                        (esp_mqtt_event_handle_t)event_data;
+    event_bus_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    switch (mqtt_event->event_id) {
+        case MQTT_EVENT_CONNECTED:
+            event.type = EVENT_BUS_MQTT_CONNECTED;
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            event.type = EVENT_BUS_MQTT_DISCONNECTED;
+            break;
+
+        case MQTT_EVENT_PUBLISHED:
+            event.type = EVENT_BUS_MQTT_PUBLISHED;
+            event.mqtt_published.msg_id = mqtt_event->msg_id;
+            break;
+
+        default:
+            return;
+    }
+
+    event_bus_publish(&event);
+}
+
+static void mqtt_publisher_add(const event_bus_event_t *event)
+{
+    const int64_t time_ms = event->sensor_sample.time_ms;
+
+    /* 1. Not logged either before the clock is set. */
+    if (time_ms == 0) {
+        return;
+    }
+
+    /* 2. The first sample bounds the samples taken before the start, since
+     * the saved backlog or since boot. */
+    if (!s_booted && s_history) {
+        if (s_backlog_from_ms == 0) {
+            s_backlog_from_ms = time_ms - esp_timer_get_time() / 1000;
+            mqtt_publisher_save_backlog(s_backlog_from_ms);
+        }
+        s_backlog_to_ms = time_ms - 1;
+        if (s_backlog_from_ms > s_backlog_to_ms) {
+            mqtt_publisher_backlog_done();
+        }
+    }
+    s_booted = true;
+
+    mqtt_publisher_sample_t *sample = &s_live[s_live_count++];
+    sample->time_ms = time_ms;
+    sample->temperature = event->sensor_sample.temperature;
+    sample->humidity = event->sensor_sample.humidity;
+
+    if (s_live_count < MQTT_PUBLISHER_BATCH_SIZE) {
+        return;
+    }
+
+    /* 3. The newest samples go first, older ones wait in the backlog. */
+    if (!s_connected || !mqtt_publisher_publish(s_live, s_live_count,
+                                                false)) {
+        mqtt_publisher_spill(s_live[0].time_ms,
+                                s_live[s_live_count - 1].time_ms);
+    }
+    s_live_count = 0;
+}
+
+static bool mqtt_publisher_publish(const mqtt_publisher_sample_t *samples,
+                                    size_t count, bool drained)
+{
+    mqtt_publisher_inflight_t *slot = NULL;
+
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        if (s_inflight[i].msg_id < 0) {
+            slot = &s_inflight[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        return false;
+    }
+
+    const auto batch = std::make_pair(count, [samples](size_t i) {
+        return std::make_tuple(samples[i].time_ms,
+                                samples[i].temperature,
+                                samples[i].humidity);
+    });
+    const size_t len = MQTT_PUBLISHER_CBOR
+                        ? cbor_write<mqtt_publisher_json_t, true>(s_payload,
+                                                                    batch)
+                        : json_write<mqtt_publisher_json_t>(s_payload, batch);
+
+    const int msg_id = esp_mqtt_client_publish(s_client,
+                                                MQTT_PUBLISHER_TOPIC,
+                                                s_payload, (int)len, 1, 0);
+    if (msg_id < 0) {
+        return false;
+    }
+
+    slot->msg_id = msg_id;
+    slot->drained = drained;
+    slot->count = count;
+    slot->sent_us = esp_timer_get_time();
+    slot->first_ms = samples[0].time_ms;
+    slot->last_ms = samples[count - 1].time_ms;
+    return true;
+}
+
+static void mqtt_publisher_acked(int msg_id)
+{
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        mqtt_publisher_inflight_t *slot = &s_inflight[i];
+
+        if (slot->msg_id != msg_id) {
+            continue;
+        }
+
+        s_stats.published++;
+        s_stats.samples += slot->count;
+        if (slot->drained) {
+            s_stats.drained++;
+        }
+        slot->msg_id = -1;
+        return;
+    }
+
+    /* Expired already, the batch is in the backlog again. */
+    DLOGD(TAG, "Late PUBACK of %d.", msg_id);
+}
+
+static void mqtt_publisher_expire(bool all)
+{
+    const int64_t now_us = esp_timer_get_time();
+
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        mqtt_publisher_inflight_t *slot = &s_inflight[i];
+
+        if (slot->msg_id < 0 || (!all && now_us - slot->sent_us
+                                < MQTT_PUBLISHER_ACK_TIMEOUT_MS * 1000LL)) {
+            continue;
+        }
+
+        DLOGW(TAG, "Message %d not acked, back to the backlog.",
+                    slot->msg_id);
+        mqtt_publisher_spill(slot->first_ms, slot->last_ms);
+        slot->msg_id = -1;
+    }
+}
+
+static void mqtt_publisher_drain(void)
+{
+    history_store_stats_t stats;
+    history_store_sample_t sample;
+    size_t count = 0;
+    const int64_t now_us = esp_timer_get_time();
+
+    if (!s_connected || s_backlog_from_ms == 0
+        || s_backlog_to_ms < s_backlog_from_ms
+        || mqtt_publisher_inflight_count()
+            >= MQTT_PUBLISHER_DRAIN_INFLIGHT_MAX
+        || now_us < s_next_drain_us) {
+        return;
+    }
+
+    /* 1. The rate holds on average, a late turn doesn't bunch the next
+     * ones. */
+    s_next_drain_us += MQTT_PUBLISHER_DRAIN_PERIOD_US;
+    if (s_next_drain_us < now_us) {
+        s_next_drain_us = now_us;
+    }
+
+    /* 2. Only what is on flash, the rest of the range is still in the RAM
+     * batch of the history. */
+    history_store_get_stats(&stats);
+    const int64_t end_ms = (s_backlog_to_ms < stats.newest_ms)
+                                ? s_backlog_to_ms : stats.newest_ms;
+    if (end_ms < s_backlog_from_ms) {
+        return;
+    }
+
+    history_store_query(&s_cursor, s_backlog_from_ms, end_ms);
+    while (count < MQTT_PUBLISHER_BATCH_SIZE
+            && history_store_next(&s_cursor, &sample)) {
+        s_drain[count].time_ms = sample.time_ms;
+        s_drain[count].temperature = sample.temperature;
+        s_drain[count].humidity = sample.humidity;
+        count++;
+    }
+
+    /* 3. Nothing left on flash in the range, recycled or never logged. */
+    if (count == 0) {
+        s_backlog_from_ms = end_ms + 1;
+    } else if (mqtt_publisher_publish(s_drain, count, true)) {
+        if (s_drain_start_us == 0) {
+            s_drain_start_us = now_us;
+            s_drain_batches = 0;
+            s_drain_samples = 0;
+        }
+        s_drain_batches++;
+        s_drain_samples += count;
+        s_backlog_from_ms = s_drain[count - 1].time_ms + 1;
+    }
+
+    if (s_backlog_from_ms > s_backlog_to_ms) {
+        mqtt_publisher_backlog_done();
+    }
+}
+
+static void mqtt_publisher_spill(int64_t first_ms, int64_t last_ms)
+{
+    if (!s_history) {
+        s_stats.dropped++;
+        return;
+    }
+
+    s_stats.spilled++;
+    if (s_backlog_from_ms == 0 || first_ms < s_backlog_from_ms) {
+        s_backlog_from_ms = first_ms;
+        mqtt_publisher_save_backlog(first_ms);
+    }
+    if (last_ms > s_backlog_to_ms) {
+        s_backlog_to_ms = last_ms;
+    }
+}
+
+static void mqtt_publisher_backlog_done(void)
+{
+    nvs_handle_t handle;
+
+    if (s_drain_start_us != 0) {
+        DLOGI(TAG, "Backlog sent: %u batches, %u samples in %lld ms, "
+                        "stack high water mark %u.",
+                    (unsigned)s_drain_batches, (unsigned)s_drain_samples,
+                    (long long)((esp_timer_get_time() - s_drain_start_us)
+                                / 1000),
+                    (unsigned)uxTaskGetStackHighWaterMark(NULL));
+        s_drain_start_us = 0;
+    }
+
+    s_backlog_from_ms = 0;
+    s_backlog_to_ms = 0;
+
+    if (nvs_open(MQTT_PUBLISHER_NVS_NAMESPACE, NVS_READWRITE, &handle)
+        != ESP_OK) {
+        return;
+    }
+    nvs_erase_key(handle, MQTT_PUBLISHER_NVS_KEY_BACKLOG);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static TickType_t mqtt_publisher_wait_ticks(void)
+{
+    const int64_t now_us = esp_timer_get_time();
+    int64_t wake_us = INT64_MAX;
+
+    /* 1. The next turn of the backlog. */
+    if (s_connected && s_backlog_from_ms != 0
+        && s_backlog_to_ms >= s_backlog_from_ms
+        && mqtt_publisher_inflight_count()
+            < MQTT_PUBLISHER_DRAIN_INFLIGHT_MAX) {
+        wake_us = s_next_drain_us;
+    }
+
+    /* 2. The first PUBACK to give up on. */
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        const int64_t expiry_us = s_inflight[i].sent_us
+                                    + MQTT_PUBLISHER_ACK_TIMEOUT_MS * 1000LL;
+
+        if (s_inflight[i].msg_id >= 0 && expiry_us < wake_us) {
+            wake_us = expiry_us;
+        }
+    }
+
+    if (wake_us == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    if (wake_us <= now_us) {
+        return 0;
+    }
+    return pdMS_TO_TICKS((wake_us - now_us + 999) / 1000);
+}
+
+static size_t mqtt_publisher_inflight_count(void)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < MQTT_PUBLISHER_INFLIGHT_MAX; i++) {
+        if (s_inflight[i].msg_id >= 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static esp_err_t mqtt_publisher_load_backlog(int64_t *from_ms)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(MQTT_PUBLISHER_NVS_NAMESPACE, NVS_READONLY,
+                                &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_get_i64(handle, MQTT_PUBLISHER_NVS_KEY_BACKLOG, from_ms);
+    nvs_close(handle);
+    return err;
+}
+
+static void mqtt_publisher_save_backlog(int64_t from_ms)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(MQTT_PUBLISHER_NVS_NAMESPACE, NVS_READWRITE, &handle)
+        != ESP_OK) {
+        return;
+    }
+    if (nvs_set_i64(handle, MQTT_PUBLISHER_NVS_KEY_BACKLOG, from_ms)
+        == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief   Broker and topic of the telemetry. Each message is a batch of
+ *          samples as JSON, {"samples": [{"time", "temp", "humidity"}]},
+ *          the form of /history, or with MQTT_PUBLISHER_CBOR the same as
+ *          packed CBOR, [[[time, temp, humidity], ...]].
+ */
+#define MQTT_PUBLISHER_BROKER_URI       "mqtt://192.168.0.100"
+#define MQTT_PUBLISHER_TOPIC            "iot-core/sensor"
+#define MQTT_PUBLISHER_KEEPALIVE_S      60
+
+/**
+ * @brief   Where the start of the backlog survives a reboot.
+ */
+#define MQTT_PUBLISHER_NVS_NAMESPACE    "mqtt"
+#define MQTT_PUBLISHER_NVS_KEY_BACKLOG  "backlog_from"
+
+/* Public types --------------------------------------------------------------*/
+
+typedef struct {
+    bool connected;
+    uint32_t inflight;                  /* QoS 1 messages not acked yet. */
+    uint32_t published;                 /* Batches acked since boot. */
+    uint32_t samples;                   /* Samples of those batches. */
+    uint32_t spilled;                   /* Batches left to the backlog. */
+    uint32_t drained;                   /* Of the published, from flash. */
+    uint32_t dropped;                   /* Batches lost, no flash log. */
+    int64_t backlog_from_ms;            /* 0 if the backlog is empty. */
+    int64_t backlog_to_ms;
+} mqtt_publisher_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Starts the MQTT client and the task publishing the sensor
+ *          samples, once. Called on every IP_EVENT_STA_GOT_IP, the client
+ *          reconnects by itself afterwards.
+ * @note    Samples are sent MQTT_PUBLISHER_BATCH_SIZE at a time with QoS 1,
+ *          with up to MQTT_PUBLISHER_INFLIGHT_MAX messages waiting for
+ *          their PUBACK. A batch that can't go out now, because the broker
+ *          is away, the window is full or the PUBACK never came, is left to
+ *          the backlog: a time range of the flash history, read back and
+ *          sent MQTT_PUBLISHER_DRAIN_PER_S batches a second once the window
+ *          has room. The history is the bounded offline queue, no sample is
+ *          kept twice, and the backlog start is saved in NVS so an outage
+ *          across a reboot is sent too. Delivery is at least once, a batch
+ *          can arrive twice and consumers key samples by time.
+ */
+void mqtt_publisher_start(void);
+
+void mqtt_publisher_get_stats(mqtt_publisher_stats_t *stats);
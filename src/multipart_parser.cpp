@@ -0,0 +1,346 @@
+#include <string.h>
+#include <strings.h>
+
+#include <esp_err.h>
+
+#include "multipart_parser.hpp"
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Searches the delimiter in `data`, continuing a match started at
+ *          the end of the previous chunk.
+ * @note    Boyer-Moore-Horspool over the chunk, bytes that can't be part of
+ *          a delimiter are passed to `on_part_data` (when `emit` is set)
+ *          without copying. A tail which is a prefix of the delimiter is
+ *          held back in the lookbehind buffer until the next chunk decides.
+ *
+ * @param   parser      - Parser.
+ * @param   data        - Chunk.
+ * @param   len         - Chunk length.
+ * @param   emit        - Whether the skipped bytes are body data.
+ * @param   consumed_p  - Number of bytes of `data` used, including the
+ *                        delimiter when found.
+ * @param   found_p     - Set when the delimiter has been fully matched.
+ * @return  ESP_OK, otherwise the error of the data callback.
+ */
+static esp_err_t multipart_parser_scan(multipart_parser_t *parser,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        bool emit,
+                                        size_t *consumed_p,
+                                        bool *found_p);
+
+/**
+ * @brief   Passes body bytes to the data callback.
+ */
+static esp_err_t multipart_parser_emit(multipart_parser_t *parser,
+                                        bool emit,
+                                        const uint8_t *data,
+                                        size_t len);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t multipart_parser_init(multipart_parser_t *parser,
+                                const char *boundary,
+                                const multipart_callbacks_t *callbacks,
+                                void *ctx)
+{
+    size_t boundary_len = strlen(boundary);
+    if (boundary_len == 0 || boundary_len > MULTIPART_MAX_BOUNDARY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(parser, 0, sizeof(*parser));
+    parser->callbacks = callbacks;
+    parser->ctx = ctx;
+
+    /* 1. The delimiter is CRLF "--" boundary. */
+    memcpy(parser->delimiter, "\r\n--", 4);
+    memcpy(parser->delimiter + 4, boundary, boundary_len);
+    parser->delimiter_len = boundary_len + 4;
+
+    /* 2. Horspool shifts, from the last occurrence of each byte in all but
+     * the last delimiter position. */
+    const size_t m = parser->delimiter_len;
+    memset(parser->skip, (int)m, sizeof(parser->skip));
+    for (size_t i = 0; i < m - 1; i++) {
+        parser->skip[parser->delimiter[i]] = (uint8_t)(m - 1 - i);
+    }
+
+    /* 3. The first boundary may start the body without a leading CRLF, act
+     * as if that CRLF had already been seen. */
+    memcpy(parser->lookbehind, "\r\n", 2);
+    parser->lookbehind_len = 2;
+    parser->state = MULTIPART_STATE_PREAMBLE;
+
+    return ESP_OK;
+}
+
+esp_err_t multipart_parser_feed(multipart_parser_t *parser,
+                                const uint8_t *data,
+                                size_t len)
+{
+    const multipart_callbacks_t *callbacks = parser->callbacks;
+    esp_err_t err = ESP_OK;
+
+    while (len > 0 && err == ESP_OK) {
+        switch (parser->state)
+        {
+            case MULTIPART_STATE_PREAMBLE:
+            case MULTIPART_STATE_BODY: {
+                const bool in_body = (parser->state == MULTIPART_STATE_BODY);
+                size_t consumed = 0;
+                bool found = false;
+
+                err = multipart_parser_scan(parser, data, len, in_body,
+                                            &consumed, &found);
+                data += consumed;
+                len -= consumed;
+
+                if (err == ESP_OK && found) {
+                    if (in_body && callbacks->on_part_end != NULL) {
+                        err = callbacks->on_part_end(parser->ctx);
+                    }
+                    parser->state = MULTIPART_STATE_DELIMITER_TAIL;
+                }
+            }
+            break;
+            case MULTIPART_STATE_DELIMITER_TAIL: {
+                const uint8_t c = *data++;
+                len--;
+
+                if (c == '-') {
+                    parser->state = MULTIPART_STATE_CLOSE_DASH;
+                } else if (c == '\r') {
+                    parser->state = MULTIPART_STATE_DELIMITER_LF;
+                } else if (c != ' ' && c != '\t') {
+                    /* Only transport padding may follow the boundary. */
+                    err = ESP_ERR_INVALID_RESPONSE;
+                }
+            }
+            break;
+            case MULTIPART_STATE_CLOSE_DASH: {
+                const uint8_t c = *data++;
+                len--;
+
+                if (c == '-') {
+                    parser->state = MULTIPART_STATE_EPILOGUE;
+                } else {
+                    err = ESP_ERR_INVALID_RESPONSE;
+                }
+            }
+            break;
+            case MULTIPART_STATE_DELIMITER_LF: {
+                const uint8_t c = *data++;
+                len--;
+
+                if (c == '\n') {
+                    /* The CRLF just read counts towards CRLF CRLF, so a part
+                     * without headers is accepted. */
+                    parser->header_match = 2;
+                    parser->header_len = 0;
+                    parser->state = MULTIPART_STATE_HEADERS;
+                } else {
+                    err = ESP_ERR_INVALID_RESPONSE;
+                }
+            }
+            break;
+            case MULTIPART_STATE_HEADERS: {
+                static const char header_end[] = "\r\n\r\n";
+
+                while (len > 0 && parser->header_match < 4) {
+                    const uint8_t c = *data++;
+                    len--;
+
+                    if (c == (uint8_t)header_end[parser->header_match]) {
+                        parser->header_match++;
+                    } else {
+                        parser->header_match = (c == '\r') ? 1 : 0;
+                    }
+
+                    if (++parser->header_len > MULTIPART_MAX_HEADER_LEN) {
+                        err = ESP_ERR_INVALID_RESPONSE;
+                        break;
+                    }
+                }
+
+                if (err == ESP_OK && parser->header_match == 4) {
+                    parser->lookbehind_len = 0;
+                    parser->state = MULTIPART_STATE_BODY;
+                    if (callbacks->on_part_begin != NULL) {
+                        err = callbacks->on_part_begin(parser->ctx);
+                    }
+                }
+            }
+            break;
+            case MULTIPART_STATE_EPILOGUE:
+                /* Ignored, as the RFC says. */
+                len = 0;
+                break;
+            case MULTIPART_STATE_ERROR:
+            default:
+                return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    if (err != ESP_OK) {
+        parser->state = MULTIPART_STATE_ERROR;
+    }
+
+    return err;
+}
+
+bool multipart_parser_is_done(const multipart_parser_t *parser)
+{
+    return parser->state == MULTIPART_STATE_EPILOGUE;
+}
+
+esp_err_t multipart_parser_get_boundary(const char *content_type,
+                                        char *boundary,
+                                        size_t size)
+{
+    static const char parameter[] = "boundary=";
+    const size_t parameter_len = sizeof(parameter) - 1;
+
+    if (strncasecmp(content_type, "multipart/", 10) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* 1. Find the parameter, ignoring the case of its name. */
+    const char *value_p = NULL;
+    for (const char *p = strchr(content_type, ';');
+         p != NULL;
+         p = strchr(p + 1, ';')) {
+        const char *name_p = p + 1 + strspn(p + 1, " \t");
+        if (strncasecmp(name_p, parameter, parameter_len) == 0) {
+            value_p = name_p + parameter_len;
+            break;
+        }
+    }
+
+    if (value_p == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* 2. The value may be quoted. */
+    size_t value_len;
+    if (*value_p == '"') {
+        value_p++;
+        const char *end_p = strchr(value_p, '"');
+        if (end_p == NULL) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        value_len = end_p - value_p;
+    } else {
+        value_len = strcspn(value_p, " \t;");
+    }
+
+    if (value_len == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (value_len > MULTIPART_MAX_BOUNDARY_LEN || value_len >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(boundary, value_p, value_len);
+    boundary[value_len] = '\0';
+
+    return ESP_OK;
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t multipart_parser_scan(multipart_parser_t *parser,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        bool emit,
+                                        size_t *consumed_p,
+                                        bool *found_p)
+{
+    const uint8_t *delimiter = parser->delimiter;
+    const size_t m = parser->delimiter_len;
+    esp_err_t err;
+
+    *found_p = false;
+
+    /* 1. Resolve the bytes held back from the previous chunk, the
+     * lookbehind is always a proper prefix of the delimiter. */
+    while (parser->lookbehind_len > 0) {
+        const size_t held = parser->lookbehind_len;
+        const size_t needed = m - held;
+        const size_t available = (len < needed) ? len : needed;
+
+        if (memcmp(data, delimiter + held, available) == 0) {
+            if (available == needed) {
+                parser->lookbehind_len = 0;
+                *consumed_p = needed;
+                *found_p = true;
+                return ESP_OK;
+            }
+
+            /* The whole chunk extends the partial match. */
+            memcpy(parser->lookbehind + held, data, len);
+            parser->lookbehind_len += len;
+            *consumed_p = len;
+            return ESP_OK;
+        }
+
+        /* The first held byte is data. Drop up to the next held position
+         * which still starts a delimiter prefix. */
+        size_t shift = 1;
+        while (shift < held
+                && memcmp(parser->lookbehind + shift,
+                            delimiter,
+                            held - shift) != 0) {
+            shift++;
+        }
+
+        err = multipart_parser_emit(parser, emit, parser->lookbehind, shift);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        memmove(parser->lookbehind, parser->lookbehind + shift, held - shift);
+        parser->lookbehind_len = held - shift;
+    }
+
+    /* 2. Horspool: align the delimiter, compare its last byte first and
+     * shift by the bad character rule on mismatch. */
+    size_t i = 0;
+    while (i + m <= len) {
+        const uint8_t last = data[i + m - 1];
+
+        if (last == delimiter[m - 1]
+            && memcmp(data + i, delimiter, m - 1) == 0) {
+            *consumed_p = i + m;
+            *found_p = true;
+            return multipart_parser_emit(parser, emit, data, i);
+        }
+
+        i += parser->skip[last];
+    }
+
+    /* 3. Alignments skipped by the shifts can't match, even partially. Keep
+     * the earliest tail which is a prefix of the delimiter. */
+    size_t tail = (i < len) ? i : len;
+    while (tail < len && memcmp(data + tail, delimiter, len - tail) != 0) {
+        tail++;
+    }
+
+    memcpy(parser->lookbehind, data + tail, len - tail);
+    parser->lookbehind_len = len - tail;
+    *consumed_p = len;
+
+    return multipart_parser_emit(parser, emit, data, tail);
+}
+
+static esp_err_t multipart_parser_emit(multipart_parser_t *parser,
+                                        bool emit,
+                                        const uint8_t *data,
+                                        size_t len)
+{
+    if (!emit || len == 0 || parser->callbacks->on_part_data == NULL) {
+        return ESP_OK;
+    }
+
+    return parser->callbacks->on_part_data(parser->ctx, data, len);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @brief   Longest boundary allowed by RFC 2046.
+ */
+#define MULTIPART_MAX_BOUNDARY_LEN      70
+
+/**
+ * @brief   Delimiter searched in the body: CRLF "--" boundary.
+ */
+#define MULTIPART_MAX_DELIMITER_LEN     (MULTIPART_MAX_BOUNDARY_LEN + 4)
+
+/**
+ * @brief   Upper bound on the header block of a single part.
+ */
+#define MULTIPART_MAX_HEADER_LEN        1024
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Parser states.
+ */
+typedef enum {
+    MULTIPART_STATE_PREAMBLE = 0,       /* Skipping until the 1st boundary. */
+    MULTIPART_STATE_DELIMITER_TAIL,     /* After a boundary: CRLF or "--". */
+    MULTIPART_STATE_CLOSE_DASH,         /* Second '-' of the close delimiter. */
+    MULTIPART_STATE_DELIMITER_LF,       /* LF ending the boundary line. */
+    MULTIPART_STATE_HEADERS,            /* Part headers, up to CRLF CRLF. */
+    MULTIPART_STATE_BODY,               /* Part body, up to the delimiter. */
+    MULTIPART_STATE_EPILOGUE,           /* After the close delimiter. */
+    MULTIPART_STATE_ERROR
+} multipart_state_e;
+
+/**
+ * @brief   Callbacks, any may be NULL. Returning an error stops the parser
+ *          and is returned by multipart_parser_feed().
+ * @note    `on_part_data` slices point into the buffer given to
+ *          multipart_parser_feed(), only bytes held back because they could
+ *          start a delimiter split across two chunks (at most
+ *          MULTIPART_MAX_DELIMITER_LEN - 1) are delivered from the parser.
+ */
+typedef struct {
+    esp_err_t (*on_part_begin)(void *ctx);
+    esp_err_t (*on_part_data)(void *ctx, const uint8_t *data, size_t len);
+    esp_err_t (*on_part_end)(void *ctx);
+} multipart_callbacks_t;
+
+/**
+ * @brief   Streaming multipart/form-data parser, needs no heap.
+ */
+typedef struct {
+    multipart_state_e state;
+    const multipart_callbacks_t *callbacks;
+    void *ctx;
+
+    uint8_t delimiter[MULTIPART_MAX_DELIMITER_LEN];
+    size_t delimiter_len;
+
+    /* Horspool bad character shift table. */
+    uint8_t skip[256];
+
+    /* Tail of the previous chunk which is a prefix of the delimiter. */
+    uint8_t lookbehind[MULTIPART_MAX_DELIMITER_LEN];
+    size_t lookbehind_len;
+
+    /* Progress through the CR LF CR LF ending the part headers. */
+    uint8_t header_match;
+    size_t header_len;
+} multipart_parser_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Initializes a parser for `boundary`.
+ *
+ * @param   parser      - Parser to initialize.
+ * @param   boundary    - Boundary parameter of the Content-Type header,
+ *                        without the leading "--".
+ * @param   callbacks   - Callbacks, must outlive the parser.
+ * @param   ctx         - Passed to the callbacks.
+ * @return  ESP_OK, ESP_ERR_INVALID_ARG if the boundary is empty or too long.
+ */
+esp_err_t multipart_parser_init(multipart_parser_t *parser,
+                                const char *boundary,
+                                const multipart_callbacks_t *callbacks,
+                                void *ctx);
+
+/**
+ * @brief   Feeds the next chunk of the request body, chunks may be split at
+ *          any byte.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_RESPONSE on malformed input, otherwise the
+ *          error returned by a callback.
+ */
+esp_err_t multipart_parser_feed(multipart_parser_t *parser,
+                                const uint8_t *data,
+                                size_t len);
+
+/**
+ * @brief   Whether the close delimiter has been seen.
+ */
+bool multipart_parser_is_done(const multipart_parser_t *parser);
+
+/**
+ * @brief   Extracts the boundary parameter of a multipart Content-Type value.
+ *
+ * @param   content_type    - Content-Type header value.
+ * @param   boundary        - Receives the boundary, NUL terminated.
+ * @param   size            - Size of `boundary`, at least
+ *                            MULTIPART_MAX_BOUNDARY_LEN + 1.
+ * @return  ESP_OK, ESP_ERR_NOT_FOUND if it isn't multipart or has no
+ *          boundary, ESP_ERR_INVALID_SIZE if the boundary is too long.
+ */
+esp_err_t multipart_parser_get_boundary(const char *content_type,
+                                        char *boundary,
+                                        size_t size);
@@ -0,0 +1,796 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include <nvs.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "metrics.hpp"
+#include "ota_client.hpp"
+#include "ota_decoder.hpp"
+#include "ota_writer.hpp"
+#include "power.hpp"
+#include "task_placement.hpp"
+
+#define OTA_CLIENT_NVS_NAMESPACE        "ota_client"
+#define OTA_CLIENT_NVS_KEY_URL          "url"
+#define OTA_CLIENT_NVS_KEY_JOB          "job"
+#define OTA_CLIENT_JOB_VERSION          1
+#define OTA_CLIENT_SECTOR_SIZE          4096
+#define OTA_CLIENT_CONTENT_RANGE_LEN    64
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Pull job saved in NVS, rewritten at every commit.
+ */
+typedef struct {
+    uint32_t version;
+    uint32_t partition_address;     /* The job is dropped if it changed. */
+    uint32_t offset;                /* Committed bytes, sector aligned. */
+    uint32_t size;                  /* Image size, 0 while unknown. */
+    uint8_t has_sha256;
+    uint8_t sha256[OTA_WRITER_SHA256_LEN];          /* Expected digest. */
+    uint8_t prefix_sha256[OTA_WRITER_SHA256_LEN];   /* Of committed bytes. */
+    char etag[OTA_CLIENT_ETAG_MAX_LEN];             /* If-Range validator. */
+} ota_client_job_t;
+
+/**
+ * @brief   Response headers captured by the HTTP client event handler.
+ */
+typedef struct {
+    char etag[OTA_CLIENT_ETAG_MAX_LEN];
+    char content_range[OTA_CLIENT_CONTENT_RANGE_LEN];
+} ota_client_response_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "ota_client";
+
+static TaskHandle_t s_ota_client_task = NULL;
+static char s_url[OTA_CLIENT_URL_MAX_LEN];
+static ota_client_job_t s_job;
+static const esp_partition_t *s_partition = NULL;
+static esp_ota_handle_t s_ota_handle;
+static mbedtls_sha256_context s_sha256;
+static uint8_t s_buffer[OTA_CLIENT_BUFFER_SIZE];
+
+static uint32_t s_write_offset;         /* Image bytes written. */
+static uint32_t s_erased_end;           /* Flash erased up to here. */
+static bool s_decoding;                 /* Stream goes through ota_decoder. */
+static ota_update_reason_e s_reason;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Pull task: downloads with retries, then finishes the update and
+ *          reports it to the HTTP server monitor.
+ *
+ * @param param
+ */
+static void ota_client_task(void *param);
+
+/**
+ * @brief   Creates the pull task for the job in s_url/s_job.
+ */
+static esp_err_t ota_client_spawn(void);
+
+/**
+ * @brief   One download attempt from the write cursor to the end of the
+ *          image.
+ *
+ * @return  ESP_OK once the whole image is written, otherwise an error with
+ *          s_reason set.
+ */
+static esp_err_t ota_client_download(void);
+
+/**
+ * @brief   Verifies the digest, closes the image and switches the boot
+ *          partition.
+ */
+static esp_err_t ota_client_finish(void);
+
+/**
+ * @brief   Restarts the image from its first byte.
+ */
+static void ota_client_reset_progress(void);
+
+/**
+ * @brief   Hashes the committed prefix back from the flash so the running
+ *          digest continues where it stopped. Restarts from zero if the
+ *          prefix doesn't match the digest saved with it.
+ */
+static void ota_client_restore_prefix(void);
+
+/**
+ * @brief   Passes downloaded bytes to the decoder, or straight to the flash
+ *          for a resumed raw image.
+ */
+static esp_err_t ota_client_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief   Decoder sink, erases sectors ahead of the write cursor then
+ *          writes and hashes the image bytes. Commits at every
+ *          OTA_CLIENT_COMMIT_INTERVAL boundary.
+ */
+static esp_err_t ota_client_write_image(void *ctx,
+                                        const uint8_t *data,
+                                        size_t len);
+
+/**
+ * @brief   Saves the offset and the digest of the bytes written so far.
+ */
+static void ota_client_commit(void);
+
+/**
+ * @brief   Publishes the bytes written so far.
+ */
+static void ota_client_publish_progress(void);
+
+/**
+ * @brief   Captures the ETag and Content-Range response headers.
+ */
+static esp_err_t ota_client_http_event(esp_http_client_event_t *evt);
+
+/**
+ * @brief   Parses "bytes <first>-<last>/<size>".
+ *
+ * @return  true if it is a satisfied range with a known size.
+ */
+static bool ota_client_parse_content_range(const char *value,
+                                            uint32_t *first_p,
+                                            uint32_t *size_p);
+
+/**
+ * @brief   Records why the update failed, the first reason of an attempt
+ *          wins.
+ */
+static void ota_client_fail(ota_update_reason_e reason);
+
+/**
+ * @brief   NVS storage of the job.
+ */
+static esp_err_t ota_client_load_job(void);
+static esp_err_t ota_client_save_job(bool with_url);
+static void ota_client_clear_job(void);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t ota_client_start(const char *url, const uint8_t *sha256)
+{
+    if (strlen(url) >= sizeof(s_url)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* An upload or another pull owns the partition. */
+    if (!ota_writer_claim(OTA_WRITER_OWNER_PULL)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_partition = esp_ota_get_next_update_partition(NULL);
+    if (s_partition == NULL) {
+        ota_writer_release(OTA_WRITER_OWNER_PULL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* 1. A new job replaces any unfinished one. */
+    strcpy(s_url, url);
+    memset(&s_job, 0, sizeof(s_job));
+    s_job.version = OTA_CLIENT_JOB_VERSION;
+    s_job.partition_address = s_partition->address;
+    s_job.has_sha256 = (sha256 != NULL);
+    if (sha256 != NULL) {
+        memcpy(s_job.sha256, sha256, OTA_WRITER_SHA256_LEN);
+    }
+
+    esp_err_t err = ota_client_save_job(true);
+    if (err != ESP_OK) {
+        DLOGE(TAG, "Can't save the job: %s", esp_err_to_name(err));
+        ota_writer_release(OTA_WRITER_OWNER_PULL);
+        return err;
+    }
+
+    DLOGI(TAG, "Pulling %s", s_url);
+
+    /* 2. Download. */
+    return ota_client_spawn();
+}
+
+void ota_client_resume(void)
+{
+    if (!ota_writer_claim(OTA_WRITER_OWNER_PULL)) {
+        return;
+    }
+
+    if (ota_client_load_job() != ESP_OK) {
+        ota_writer_release(OTA_WRITER_OWNER_PULL);
+        return;
+    }
+
+    /* The image may have been booted, or the partition table changed. */
+    s_partition = esp_ota_get_next_update_partition(NULL);
+    if (s_partition == NULL
+        || s_job.version != OTA_CLIENT_JOB_VERSION
+        || s_job.partition_address != s_partition->address
+        || s_job.offset % OTA_CLIENT_SECTOR_SIZE != 0
+        || s_job.offset > s_partition->size) {
+        DLOGW(TAG, "Dropping a stale OTA pull job.");
+        ota_client_clear_job();
+        ota_writer_release(OTA_WRITER_OWNER_PULL);
+        return;
+    }
+
+    DLOGI(TAG, "Resuming %s at %u bytes.",
+                s_url,
+                (unsigned)s_job.offset);
+    ota_client_spawn();
+}
+
+bool ota_client_is_running(void)
+{
+    return s_ota_client_task != NULL;
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t ota_client_spawn(void)
+{
+    if (xTaskCreatePinnedToCore(&ota_client_task,
+                                "ota_client",
+                                OTA_CLIENT_TASK_STACK_SIZE,
+                                NULL,
+                                OTA_CLIENT_TASK_PRIORITY,
+                                &s_ota_client_task,
+                                task_placement_core(
+                                    TASK_PLACEMENT_OTA_CLIENT)) != pdPASS) {
+        s_ota_client_task = NULL;
+        ota_writer_release(OTA_WRITER_OWNER_PULL);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+static void ota_client_task(void *param)
+{
+    uint32_t delay_ms = OTA_CLIENT_RETRY_BASE_MS;
+    esp_err_t err;
+    const int64_t start_us = esp_timer_get_time();
+    const uint32_t received = metrics_get(METRICS_OTA_RECEIVED_BYTES);
+
+    metrics_register_task(NULL, OTA_CLIENT_TASK_STACK_SIZE);
+    s_reason = OTA_UPDATE_REASON_NONE;
+    power_lock_acquire(POWER_LOCK_OTA);
+
+    /* 1. Open the partition without erasing it, so a committed prefix
+     * survives. Sectors are erased just ahead of the write cursor. */
+    err = esp_ota_begin(s_partition, OTA_WITH_SEQUENTIAL_WRITES, &s_ota_handle);
+    if (err != ESP_OK) {
+        DLOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        ota_client_fail(OTA_UPDATE_REASON_BEGIN_FAILED);
+    } else {
+        mbedtls_sha256_init(&s_sha256);
+        ota_client_restore_prefix();
+
+        /* 2. Download, dropped connections resume where they stopped. Only
+         * attempts which get no further count, a link which keeps dropping
+         * but makes progress still finishes. */
+        uint32_t furthest = s_write_offset;
+        int failures = 0;
+        while (1) {
+            s_reason = OTA_UPDATE_REASON_NONE;
+            err = ota_client_download();
+            if (err == ESP_OK
+                || s_reason != OTA_UPDATE_REASON_RECEIVE_FAILED) {
+                break;
+            }
+
+            if (s_write_offset > furthest) {
+                furthest = s_write_offset;
+                failures = 0;
+                delay_ms = OTA_CLIENT_RETRY_BASE_MS;
+            }
+            if (++failures >= OTA_CLIENT_MAX_ATTEMPTS) {
+                break;
+            }
+
+            DLOGW(TAG, "Stopped at %u bytes, retrying in %u ms.",
+                        (unsigned)s_write_offset,
+                        (unsigned)delay_ms);
+            /* The CPU may slow down and sleep while it waits. */
+            power_lock_release(POWER_LOCK_OTA);
+            vTaskDelay(pdMS_TO_TICKS(delay_ms));
+            power_lock_acquire(POWER_LOCK_OTA);
+            delay_ms = MIN(2 * delay_ms, OTA_CLIENT_RETRY_MAX_MS);
+        }
+
+        /* 3. Verify and switch the boot partition. */
+        if (err == ESP_OK) {
+            /* The last sector is rarely full. */
+            ota_client_publish_progress();
+            err = ota_client_finish();
+        } else {
+            esp_ota_abort(s_ota_handle);
+        }
+
+        if (s_decoding) {
+            ota_decoder_end();
+        }
+        mbedtls_sha256_free(&s_sha256);
+    }
+    power_lock_release(POWER_LOCK_OTA);
+
+    /* 4. A network failure keeps the job for the next IP, anything else
+     * would fail again. */
+    if (err == ESP_OK || s_reason != OTA_UPDATE_REASON_RECEIVE_FAILED) {
+        ota_client_clear_job();
+    }
+
+    DLOGI(TAG, "OTA pull finished: %s", esp_err_to_name(err));
+    metrics_add(METRICS_OTA_UPDATES, 1);
+    metrics_add(METRICS_OTA_FAILURES, (err != ESP_OK) ? 1 : 0);
+    metrics_set(METRICS_OTA_THROUGHPUT,
+                (uint32_t)((metrics_get(METRICS_OTA_RECEIVED_BYTES) - received)
+                            * 1000000LL
+                            / MAX(esp_timer_get_time() - start_us, 1)));
+    event_bus_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_BUS_OTA_RESULT;
+    event.ota_result.reason = s_reason;
+    event_bus_publish(&event);
+
+    s_ota_client_task = NULL;
+    ota_writer_release(OTA_WRITER_OWNER_PULL);
+    metrics_unregister_task(NULL);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t ota_client_download(void)
+{
+    ota_client_response_t response;
+    esp_http_client_config_t config;
+    char range[32];
+    esp_err_t err = ESP_OK;
+
+    memset(&response, 0, sizeof(response));
+    memset(&config, 0, sizeof(config));
+    config.url = s_url;
+    config.timeout_ms = OTA_CLIENT_TIMEOUT_MS;
+    config.event_handler = ota_client_http_event;
+    config.user_data = &response;
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        ota_client_fail(OTA_UPDATE_REASON_RECEIVE_FAILED);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* 1. Only ask for the missing bytes, and only if the image is still the
+     * one the prefix came from. A raw image continues at the write cursor,
+     * the flash after it is already erased. */
+    if (s_decoding && ota_decoder_get_format() == OTA_DECODER_FORMAT_GZIP) {
+        ota_client_reset_progress();
+    }
+
+    if (s_write_offset > 0) {
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned)s_write_offset);
+        esp_http_client_set_header(client, "Range", range);
+        if (s_job.etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-Range", s_job.etag);
+        }
+    }
+
+    err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        DLOGE(TAG, "Connection failed: %s", esp_err_to_name(err));
+        ota_client_fail(OTA_UPDATE_REASON_RECEIVE_FAILED);
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    int content_length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    /* 2. The server decides whether the download resumes. */
+    uint32_t first = 0;
+    uint32_t size = 0;
+    if (status == 206
+        && ota_client_parse_content_range(response.content_range,
+                                            &first, &size)
+        && first == s_write_offset
+        && (s_job.size == 0 || size == s_job.size)) {
+        s_job.size = size;
+    } else if (status == 200) {
+        if (s_write_offset > 0) {
+            DLOGW(TAG, "Server sent the whole image, restarting.");
+        }
+        ota_client_reset_progress();
+        s_job.size = (content_length > 0) ? content_length : 0;
+    } else if (status == 206 || status == 416) {
+        /* Not the range asked for, start over on the next attempt. */
+        DLOGW(TAG, "Unexpected range response, restarting.");
+        ota_client_reset_progress();
+        ota_client_fail(OTA_UPDATE_REASON_RECEIVE_FAILED);
+        err = ESP_ERR_INVALID_RESPONSE;
+    } else {
+        DLOGE(TAG, "Download refused, HTTP status %d.", status);
+        ota_client_fail((status >= 500 || status <= 0)
+                            ? OTA_UPDATE_REASON_RECEIVE_FAILED
+                            : OTA_UPDATE_REASON_DOWNLOAD_REFUSED);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    /* A weak validator can't be used with If-Range. */
+    if (err == ESP_OK) {
+        if (strncmp(response.etag, "W/", 2) != 0) {
+            memcpy(s_job.etag, response.etag, sizeof(s_job.etag));
+        } else {
+            s_job.etag[0] = '\0';
+        }
+    }
+
+    /* 3. Stream the body into the flash. */
+    while (err == ESP_OK) {
+        int len = esp_http_client_read(client,
+                                        (char *)s_buffer,
+                                        sizeof(s_buffer));
+        if (len == 0 && esp_http_client_is_complete_data_received(client)) {
+            break;
+        }
+
+        if (len <= 0) {
+            DLOGE(TAG, "Connection dropped at %u bytes.",
+                        (unsigned)s_write_offset);
+            ota_client_fail(OTA_UPDATE_REASON_RECEIVE_FAILED);
+            err = ESP_FAIL;
+            break;
+        }
+
+        metrics_add(METRICS_OTA_RECEIVED_BYTES, len);
+        err = ota_client_feed(s_buffer, len);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+
+    return err;
+}
+
+static esp_err_t ota_client_finish(void)
+{
+    uint8_t digest[OTA_WRITER_SHA256_LEN];
+    esp_err_t err = ESP_OK;
+
+    /* 1. A compressed image must end with a matching gzip trailer. */
+    if (s_decoding) {
+        err = ota_decoder_end();
+        s_decoding = false;
+        if (err != ESP_OK) {
+            ota_client_fail((err == ESP_ERR_INVALID_SIZE)
+                                ? OTA_UPDATE_REASON_IMAGE_TRUNCATED
+                                : OTA_UPDATE_REASON_DECODE_FAILED);
+        }
+    }
+
+    /* 2. Digest, before the image can become bootable. */
+    mbedtls_sha256_finish(&s_sha256, digest);
+    if (err == ESP_OK
+        && s_job.has_sha256
+        && memcmp(digest, s_job.sha256, OTA_WRITER_SHA256_LEN) != 0) {
+        DLOGE(TAG, "Image SHA-256 mismatch, update rejected.");
+        ota_client_fail(OTA_UPDATE_REASON_DIGEST_MISMATCH);
+        err = ESP_ERR_INVALID_CRC;
+    }
+
+    if (err != ESP_OK) {
+        esp_ota_abort(s_ota_handle);
+        return err;
+    }
+
+    /* 3. Validate the image and boot it next. */
+    err = esp_ota_end(s_ota_handle);
+    if (err != ESP_OK) {
+        DLOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        ota_client_fail(OTA_UPDATE_REASON_IMAGE_INVALID);
+        return err;
+    }
+
+    err = esp_ota_set_boot_partition(s_partition);
+    if (err != ESP_OK) {
+        ota_client_fail(OTA_UPDATE_REASON_SET_BOOT_FAILED);
+        return err;
+    }
+
+    DLOGI(TAG, "Pulled %u bytes (%s) to partition at 0x%x.",
+                (unsigned)s_write_offset,
+                s_job.has_sha256 ? "SHA-256 verified" : "unverified",
+                (unsigned)s_partition->address);
+
+    return ESP_OK;
+}
+
+static void ota_client_reset_progress(void)
+{
+    if (s_decoding) {
+        ota_decoder_end();
+    }
+
+    s_job.offset = 0;
+    s_job.size = 0;
+    s_job.etag[0] = '\0';
+    s_write_offset = 0;
+    s_erased_end = 0;
+
+    mbedtls_sha256_free(&s_sha256);
+    mbedtls_sha256_init(&s_sha256);
+    mbedtls_sha256_starts(&s_sha256, 0);
+    ota_decoder_begin(ota_client_write_image, NULL);
+    s_decoding = true;
+}
+
+static void ota_client_restore_prefix(void)
+{
+    uint8_t digest[OTA_WRITER_SHA256_LEN];
+    mbedtls_sha256_context prefix;
+    const uint32_t offset = s_job.offset;
+
+    s_decoding = false;
+    mbedtls_sha256_free(&s_sha256);
+    mbedtls_sha256_init(&s_sha256);
+    mbedtls_sha256_starts(&s_sha256, 0);
+
+    /* 1. Re-hash what the flash holds, it is cheap next to a download. */
+    for (uint32_t read = 0; read < offset; ) {
+        size_t len = MIN(sizeof(s_buffer), offset - read);
+        if (esp_partition_read(s_partition, read, s_buffer, len) != ESP_OK) {
+            break;
+        }
+
+        mbedtls_sha256_update(&s_sha256, s_buffer, len);
+        read += len;
+    }
+
+    mbedtls_sha256_init(&prefix);
+    mbedtls_sha256_clone(&prefix, &s_sha256);
+    mbedtls_sha256_finish(&prefix, digest);
+    mbedtls_sha256_free(&prefix);
+
+    /* 2. Continue after the prefix only if it is intact. */
+    if (offset == 0
+        || memcmp(digest, s_job.prefix_sha256, OTA_WRITER_SHA256_LEN) != 0) {
+        if (offset > 0) {
+            DLOGW(TAG, "Committed prefix doesn't match, restarting.");
+        }
+        ota_client_reset_progress();
+        return;
+    }
+
+    /* Bytes past the commit may be half written, erase before reuse. */
+    s_write_offset = offset;
+    s_erased_end = offset;
+}
+
+static esp_err_t ota_client_feed(const uint8_t *data, size_t len)
+{
+    if (!s_decoding) {
+        return ota_client_write_image(NULL, data, len);
+    }
+
+    esp_err_t err = ota_decoder_feed(data, len);
+    if (err != ESP_OK) {
+        ota_client_fail(OTA_UPDATE_REASON_DECODE_FAILED);
+    }
+
+    return err;
+}
+
+static esp_err_t ota_client_write_image(void *ctx,
+                                        const uint8_t *data,
+                                        size_t len)
+{
+    /* Only a raw image can continue from an offset. */
+    const bool commit = !s_decoding
+                        || ota_decoder_get_format() == OTA_DECODER_FORMAT_RAW;
+
+    while (len > 0) {
+        /* 1. Never cross a commit boundary within one write. */
+        const uint32_t boundary = (s_write_offset / OTA_CLIENT_COMMIT_INTERVAL
+                                    + 1) * OTA_CLIENT_COMMIT_INTERVAL;
+        const size_t chunk = MIN(len, boundary - s_write_offset);
+        const uint32_t end = s_write_offset + chunk;
+
+        /* 2. Erase just ahead of the cursor. */
+        if (end > s_erased_end) {
+            const uint32_t erase_end = (end + OTA_CLIENT_SECTOR_SIZE - 1)
+                                        & ~(OTA_CLIENT_SECTOR_SIZE - 1);
+            esp_err_t err = ESP_ERR_INVALID_SIZE;
+            if (erase_end <= s_partition->size) {
+                err = esp_partition_erase_range(s_partition,
+                                                s_erased_end,
+                                                erase_end - s_erased_end);
+            }
+            if (err != ESP_OK) {
+                DLOGE(TAG, "Erase failed: %s", esp_err_to_name(err));
+                ota_client_fail(OTA_UPDATE_REASON_WRITE_FAILED);
+                return err;
+            }
+            s_erased_end = erase_end;
+        }
+
+        /* 3. Write and hash. */
+        esp_err_t err = esp_ota_write_with_offset(s_ota_handle,
+                                                    data,
+                                                    chunk,
+                                                    s_write_offset);
+        if (err != ESP_OK) {
+            DLOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+            ota_client_fail(OTA_UPDATE_REASON_WRITE_FAILED);
+            return err;
+        }
+
+        mbedtls_sha256_update(&s_sha256, data, chunk);
+        s_write_offset = end;
+        data += chunk;
+        len -= chunk;
+
+        if (s_write_offset == boundary) {
+            if (commit) {
+                ota_client_commit();
+            }
+            ota_client_publish_progress();
+        }
+    }
+
+    return ESP_OK;
+}
+
+static void ota_client_publish_progress(void)
+{
+    event_bus_event_t event;
+
+    /* The size of a gzip download isn't the image size. */
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_BUS_OTA_PROGRESS;
+    event.ota_progress.written = s_write_offset;
+    event.ota_progress.total =
+        (s_decoding && ota_decoder_get_format() == OTA_DECODER_FORMAT_GZIP)
+            ? 0 : s_job.size;
+    event_bus_publish(&event);
+}
+
+static void ota_client_commit(void)
+{
+    mbedtls_sha256_context prefix;
+
+    mbedtls_sha256_init(&prefix);
+    mbedtls_sha256_clone(&prefix, &s_sha256);
+    mbedtls_sha256_finish(&prefix, s_job.prefix_sha256);
+    mbedtls_sha256_free(&prefix);
+
+    s_job.offset = s_write_offset;
+    if (ota_client_save_job(false) != ESP_OK) {
+        DLOGW(TAG, "Can't commit progress at %u bytes.",
+                    (unsigned)s_job.offset);
+    }
+}
+
+static esp_err_t ota_client_http_event(esp_http_client_event_t *evt)
+{
+    ota_client_response_t *response = (ota_client_response_t *)evt->user_data;
+
+    if (evt->event_id != HTTP_EVENT_ON_HEADER) {
+        return ESP_OK;
+    }
+
+    if (strcasecmp(evt->header_key, "ETag") == 0) {
+        snprintf(response->etag, sizeof(response->etag),
+                    "%s", evt->header_value);
+    } else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+        snprintf(response->content_range, sizeof(response->content_range),
+                    "%s", evt->header_value);
+    }
+
+    return ESP_OK;
+}
+
+static bool ota_client_parse_content_range(const char *value,
+                                            uint32_t *first_p,
+                                            uint32_t *size_p)
+{
+    unsigned first;
+    unsigned last;
+    unsigned size;
+
+    if (sscanf(value, "bytes %u-%u/%u", &first, &last, &size) != 3
+        || first > last
+        || last >= size) {
+        return false;
+    }
+
+    *first_p = first;
+    *size_p = size;
+    return true;
+}
+
+static void ota_client_fail(ota_update_reason_e reason)
+{
+    if (s_reason == OTA_UPDATE_REASON_NONE) {
+        s_reason = reason;
+    }
+}
+
+static esp_err_t ota_client_load_job(void)
+{
+    nvs_handle_t handle;
+    size_t url_len = sizeof(s_url);
+    size_t job_len = sizeof(s_job);
+
+    esp_err_t err = nvs_open(OTA_CLIENT_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_get_str(handle, OTA_CLIENT_NVS_KEY_URL, s_url, &url_len);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, OTA_CLIENT_NVS_KEY_JOB, &s_job, &job_len);
+    }
+    if (err == ESP_OK && job_len != sizeof(s_job)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+static esp_err_t ota_client_save_job(bool with_url)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(OTA_CLIENT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (with_url) {
+        err = nvs_set_str(handle, OTA_CLIENT_NVS_KEY_URL, s_url);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, OTA_CLIENT_NVS_KEY_JOB,
+                            &s_job, sizeof(s_job));
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+static void ota_client_clear_job(void)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(OTA_CLIENT_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
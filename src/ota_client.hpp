@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#define OTA_CLIENT_URL_MAX_LEN          256
+#define OTA_CLIENT_ETAG_MAX_LEN         64
+#define OTA_CLIENT_BUFFER_SIZE          4096
+#define OTA_CLIENT_TIMEOUT_MS           10000
+
+/**
+ * @brief   Progress is saved to NVS every OTA_CLIENT_COMMIT_INTERVAL bytes,
+ *          a multiple of the flash sector size. An interrupted download
+ *          restarts from the last committed sector.
+ */
+#define OTA_CLIENT_COMMIT_INTERVAL      (64 * 1024)
+
+/**
+ * @brief   Consecutive download attempts without progress per run, with
+ *          exponential backoff between them. A job still incomplete after
+ *          them is resumed on the next IP.
+ */
+#define OTA_CLIENT_MAX_ATTEMPTS         8
+#define OTA_CLIENT_RETRY_BASE_MS        1000
+#define OTA_CLIENT_RETRY_MAX_MS         30000
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Starts pulling a new image from `url` into the next OTA partition,
+ *          discarding any unfinished job.
+ * @note    The image is requested with `Range` from the last committed
+ *          offset after a drop, and the job (URL, offset, ETag, digests) is
+ *          kept in NVS so a reboot resumes it too. gzip images are inflated
+ *          like uploads but always restart from their first byte, a deflate
+ *          stream can't be resumed midway.
+ *          The outcome is reported to the HTTP server monitor like a push
+ *          update.
+ *
+ * @param   url     - http:// URL of the image, raw or gzip.
+ * @param   sha256  - Expected SHA-256 of the decoded image, may be NULL.
+ * @return  ESP_OK, ESP_ERR_INVALID_STATE if an OTA update is running,
+ *          ESP_ERR_INVALID_ARG if the URL is too long, otherwise an NVS or
+ *          task creation error.
+ */
+esp_err_t ota_client_start(const char *url, const uint8_t *sha256);
+
+/**
+ * @brief   Resumes the job saved in NVS, if any. Called once the station
+ *          has an IP address.
+ */
+void ota_client_resume(void);
+
+/**
+ * @brief   Whether a pull is running.
+ */
+bool ota_client_is_running(void);
@@ -0,0 +1,364 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <rom/crc.h>
+#include <rom/miniz.h>
+
+#include "dlog.hpp"
+#include "ota_decoder.hpp"
+
+/* gzip header flags (RFC 1952). */
+#define OTA_DECODER_GZIP_CM_DEFLATE     8
+#define OTA_DECODER_GZIP_FHCRC          0x02
+#define OTA_DECODER_GZIP_FEXTRA         0x04
+#define OTA_DECODER_GZIP_FNAME          0x08
+#define OTA_DECODER_GZIP_FCOMMENT       0x10
+#define OTA_DECODER_GZIP_FRESERVED      0xe0
+
+#define OTA_DECODER_GZIP_HEADER_LEN     10
+#define OTA_DECODER_GZIP_TRAILER_LEN    8
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Decoder states, in stream order.
+ */
+typedef enum {
+    OTA_DECODER_STATE_DETECT = 0,
+    OTA_DECODER_STATE_RAW,
+    OTA_DECODER_STATE_GZIP_HEADER,
+    OTA_DECODER_STATE_GZIP_EXTRA_LEN,
+    OTA_DECODER_STATE_GZIP_EXTRA,
+    OTA_DECODER_STATE_GZIP_NAME,
+    OTA_DECODER_STATE_GZIP_COMMENT,
+    OTA_DECODER_STATE_GZIP_HCRC,
+    OTA_DECODER_STATE_INFLATE,
+    OTA_DECODER_STATE_GZIP_TRAILER,
+    OTA_DECODER_STATE_DONE
+} ota_decoder_state_e;
+
+/**
+ * @brief   Inflate state, only allocated for gzip images.
+ */
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t window[TINFL_LZ_DICT_SIZE];
+} ota_decoder_inflate_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "ota_decoder";
+
+static ota_decoder_sink_t s_sink = NULL;
+static void *s_sink_ctx = NULL;
+static ota_decoder_state_e s_state = OTA_DECODER_STATE_DETECT;
+static ota_decoder_format_e s_format = OTA_DECODER_FORMAT_UNKNOWN;
+
+/* gzip framing. */
+static uint8_t s_field[OTA_DECODER_GZIP_HEADER_LEN];
+static size_t s_field_len;
+static size_t s_skip;
+static uint8_t s_flags;
+
+/* Inflate. */
+static ota_decoder_inflate_t *s_inflate = NULL;
+static size_t s_window_ofs;
+static uint32_t s_crc;
+static uint32_t s_size;
+static int64_t s_inflate_time_us;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Collects a fixed size field which may span chunks into s_field.
+ *
+ * @return  true once `field_len` bytes are collected.
+ */
+static bool ota_decoder_collect(const uint8_t **data_p,
+                                size_t *len_p,
+                                size_t field_len);
+
+/**
+ * @brief   Moves to the next optional gzip header field present in s_flags.
+ */
+static void ota_decoder_next_header_field(void);
+
+/**
+ * @brief   Inflates as much of the chunk as possible into the window and
+ *          passes the produced bytes to the sink.
+ */
+static esp_err_t ota_decoder_inflate(const uint8_t **data_p, size_t *len_p);
+
+/* Public function definition ------------------------------------------------*/
+void ota_decoder_begin(ota_decoder_sink_t sink, void *ctx)
+{
+    free(s_inflate);
+    s_inflate = NULL;
+
+    s_sink = sink;
+    s_sink_ctx = ctx;
+    s_state = OTA_DECODER_STATE_DETECT;
+    s_format = OTA_DECODER_FORMAT_UNKNOWN;
+    s_field_len = 0;
+    s_inflate_time_us = 0;
+}
+
+esp_err_t ota_decoder_feed(const uint8_t *data, size_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    while (len > 0 && err == ESP_OK) {
+        switch (s_state)
+        {
+            case OTA_DECODER_STATE_DETECT: {
+                /* An app image starts with ESP_IMAGE_HEADER_MAGIC (0xE9),
+                 * it can't be mistaken for the gzip ID. */
+                if (data[0] == OTA_DECODER_GZIP_ID1) {
+                    s_format = OTA_DECODER_FORMAT_GZIP;
+                    s_state = OTA_DECODER_STATE_GZIP_HEADER;
+                } else {
+                    s_format = OTA_DECODER_FORMAT_RAW;
+                    s_state = OTA_DECODER_STATE_RAW;
+                }
+            }
+            break;
+            case OTA_DECODER_STATE_RAW: {
+                err = s_sink(s_sink_ctx, data, len);
+                len = 0;
+            }
+            break;
+            case OTA_DECODER_STATE_GZIP_HEADER: {
+                if (!ota_decoder_collect(&data, &len,
+                                            OTA_DECODER_GZIP_HEADER_LEN)) {
+                    break;
+                }
+
+                s_flags = s_field[3];
+                if (s_field[1] != OTA_DECODER_GZIP_ID2
+                    || s_field[2] != OTA_DECODER_GZIP_CM_DEFLATE
+                    || (s_flags & OTA_DECODER_GZIP_FRESERVED) != 0) {
+                    DLOGE(TAG, "Unsupported gzip header.");
+                    err = ESP_ERR_INVALID_RESPONSE;
+                    break;
+                }
+
+                /* The window is only needed for compressed images. */
+                s_inflate = (ota_decoder_inflate_t *)
+                                malloc(sizeof(ota_decoder_inflate_t));
+                if (s_inflate == NULL) {
+                    DLOGE(TAG, "No memory for the inflate window.");
+                    err = ESP_ERR_NO_MEM;
+                    break;
+                }
+                tinfl_init(&s_inflate->inflator);
+                s_window_ofs = 0;
+                s_crc = 0;
+                s_size = 0;
+
+                ota_decoder_next_header_field();
+            }
+            break;
+            case OTA_DECODER_STATE_GZIP_EXTRA_LEN: {
+                if (ota_decoder_collect(&data, &len, 2)) {
+                    s_skip = s_field[0] | (s_field[1] << 8);
+                    s_state = OTA_DECODER_STATE_GZIP_EXTRA;
+                }
+            }
+            break;
+            case OTA_DECODER_STATE_GZIP_EXTRA:
+            case OTA_DECODER_STATE_GZIP_HCRC: {
+                size_t skipped = MIN(s_skip, len);
+                data += skipped;
+                len -= skipped;
+                s_skip -= skipped;
+
+                if (s_skip == 0) {
+                    s_flags &= (s_state == OTA_DECODER_STATE_GZIP_EXTRA)
+                                ? ~OTA_DECODER_GZIP_FEXTRA
+                                : ~OTA_DECODER_GZIP_FHCRC;
+                    ota_decoder_next_header_field();
+                }
+            }
+            break;
+            case OTA_DECODER_STATE_GZIP_NAME:
+            case OTA_DECODER_STATE_GZIP_COMMENT: {
+                /* Zero terminated strings. */
+                const uint8_t *nul_p = (const uint8_t *)memchr(data, 0, len);
+                if (nul_p == NULL) {
+                    len = 0;
+                    break;
+                }
+
+                len -= nul_p + 1 - data;
+                data = nul_p + 1;
+                s_flags &= (s_state == OTA_DECODER_STATE_GZIP_NAME)
+                            ? ~OTA_DECODER_GZIP_FNAME
+                            : ~OTA_DECODER_GZIP_FCOMMENT;
+                ota_decoder_next_header_field();
+            }
+            break;
+            case OTA_DECODER_STATE_INFLATE: {
+                err = ota_decoder_inflate(&data, &len);
+            }
+            break;
+            case OTA_DECODER_STATE_GZIP_TRAILER: {
+                if (!ota_decoder_collect(&data, &len,
+                                            OTA_DECODER_GZIP_TRAILER_LEN)) {
+                    break;
+                }
+
+                /* CRC-32 then ISIZE, both little endian. */
+                uint32_t crc = s_field[0] | (s_field[1] << 8)
+                                | (s_field[2] << 16)
+                                | ((uint32_t)s_field[3] << 24);
+                uint32_t size = s_field[4] | (s_field[5] << 8)
+                                | (s_field[6] << 16)
+                                | ((uint32_t)s_field[7] << 24);
+                if (crc != s_crc || size != s_size) {
+                    DLOGE(TAG, "gzip CRC-32/size mismatch.");
+                    err = ESP_ERR_INVALID_CRC;
+                    break;
+                }
+
+                s_state = OTA_DECODER_STATE_DONE;
+            }
+            break;
+            case OTA_DECODER_STATE_DONE:
+            default: {
+                DLOGE(TAG, "Unexpected data after the gzip member.");
+                err = ESP_ERR_INVALID_RESPONSE;
+            }
+            break;
+        }
+    }
+
+    return err;
+}
+
+esp_err_t ota_decoder_end(void)
+{
+    esp_err_t err = ESP_OK;
+
+    if (s_format == OTA_DECODER_FORMAT_GZIP) {
+        if (s_state != OTA_DECODER_STATE_DONE) {
+            DLOGE(TAG, "gzip stream is truncated.");
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            DLOGI(TAG, "Inflated %u bytes in %d ms.",
+                        (unsigned)s_size,
+                        (int)(s_inflate_time_us / 1000));
+        }
+    }
+
+    free(s_inflate);
+    s_inflate = NULL;
+
+    return err;
+}
+
+ota_decoder_format_e ota_decoder_get_format(void)
+{
+    return s_format;
+}
+
+int64_t ota_decoder_get_inflate_time_us(void)
+{
+    return s_inflate_time_us;
+}
+
+/* Private function definition -----------------------------------------------*/
+static bool ota_decoder_collect(const uint8_t **data_p,
+                                size_t *len_p,
+                                size_t field_len)
+{
+    size_t copied = MIN(field_len - s_field_len, *len_p);
+
+    memcpy(s_field + s_field_len, *data_p, copied);
+    s_field_len += copied;
+    *data_p += copied;
+    *len_p -= copied;
+
+    if (s_field_len < field_len) {
+        return false;
+    }
+
+    s_field_len = 0;
+    return true;
+}
+
+static void ota_decoder_next_header_field(void)
+{
+    if (s_flags & OTA_DECODER_GZIP_FEXTRA) {
+        s_state = OTA_DECODER_STATE_GZIP_EXTRA_LEN;
+    } else if (s_flags & OTA_DECODER_GZIP_FNAME) {
+        s_state = OTA_DECODER_STATE_GZIP_NAME;
+    } else if (s_flags & OTA_DECODER_GZIP_FCOMMENT) {
+        s_state = OTA_DECODER_STATE_GZIP_COMMENT;
+    } else if (s_flags & OTA_DECODER_GZIP_FHCRC) {
+        s_skip = 2;
+        s_state = OTA_DECODER_STATE_GZIP_HCRC;
+    } else {
+        s_state = OTA_DECODER_STATE_INFLATE;
+    }
+}
+
+static esp_err_t ota_decoder_inflate(const uint8_t **data_p, size_t *len_p)
+{
+    esp_err_t err = ESP_OK;
+    tinfl_status status;
+
+    do {
+        size_t in_bytes = *len_p;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - s_window_ofs;
+        int64_t start_us = esp_timer_get_time();
+
+        /* The window is a ring, back references may wrap around it. */
+        status = tinfl_decompress(&s_inflate->inflator,
+                                    *data_p,
+                                    &in_bytes,
+                                    s_inflate->window,
+                                    s_inflate->window + s_window_ofs,
+                                    &out_bytes,
+                                    TINFL_FLAG_HAS_MORE_INPUT);
+        *data_p += in_bytes;
+        *len_p -= in_bytes;
+
+        if (out_bytes > 0) {
+            const uint8_t *out_p = s_inflate->window + s_window_ofs;
+
+            /* CRC and inflate time, the sink's flash time is not ours. */
+            s_crc = crc32_le(s_crc, out_p, out_bytes);
+            s_size += out_bytes;
+            s_window_ofs = (s_window_ofs + out_bytes)
+                            & (TINFL_LZ_DICT_SIZE - 1);
+            s_inflate_time_us += esp_timer_get_time() - start_us;
+
+            err = s_sink(s_sink_ctx, out_p, out_bytes);
+        } else {
+            s_inflate_time_us += esp_timer_get_time() - start_us;
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            DLOGE(TAG, "Inflate failed: %d", (int)status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    } while (err == ESP_OK
+                && (status == TINFL_STATUS_HAS_MORE_OUTPUT
+                    || (status == TINFL_STATUS_NEEDS_MORE_INPUT
+                        && *len_p > 0)));
+
+    if (err == ESP_OK && status == TINFL_STATUS_DONE) {
+        s_state = OTA_DECODER_STATE_GZIP_TRAILER;
+    }
+
+    return err;
+}
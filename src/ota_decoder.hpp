@@ -0,0 +1,69 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @brief   First bytes of a gzip member (RFC 1952).
+ */
+#define OTA_DECODER_GZIP_ID1            0x1f
+#define OTA_DECODER_GZIP_ID2            0x8b
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Encoding of the uploaded image, detected from its first bytes.
+ */
+typedef enum {
+    OTA_DECODER_FORMAT_UNKNOWN = 0,     /* Nothing received yet. */
+    OTA_DECODER_FORMAT_RAW,             /* Plain ESP app image. */
+    OTA_DECODER_FORMAT_GZIP             /* gzip, a single deflate member. */
+} ota_decoder_format_e;
+
+/**
+ * @brief   Receives the decoded image bytes.
+ */
+typedef esp_err_t (*ota_decoder_sink_t)(void *ctx,
+                                        const uint8_t *data,
+                                        size_t len);
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Starts decoding a new image.
+ * @note    A gzip image is inflated in a streaming fashion through a
+ *          32 KB window, allocated when the gzip header is detected and
+ *          freed by ota_decoder_end(). The image is never buffered whole.
+ *
+ * @param   sink    - Receives the decoded bytes.
+ * @param   ctx     - Passed to `sink`.
+ */
+void ota_decoder_begin(ota_decoder_sink_t sink, void *ctx);
+
+/**
+ * @brief   Decodes the next chunk of the uploaded file.
+ *
+ * @return  ESP_OK, ESP_ERR_NO_MEM if the window can't be allocated,
+ *          ESP_ERR_INVALID_RESPONSE on a corrupt stream, otherwise the error
+ *          returned by the sink.
+ */
+esp_err_t ota_decoder_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief   Finishes the image and releases the window.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE if the stream is truncated,
+ *          ESP_ERR_INVALID_CRC if the gzip CRC-32 or size don't match.
+ */
+esp_err_t ota_decoder_end(void);
+
+/**
+ * @brief   Format of the current (or last) image.
+ */
+ota_decoder_format_e ota_decoder_get_format(void);
+
+/**
+ * @brief   Time spent inflating the current (or last) image.
+ */
+int64_t ota_decoder_get_inflate_time_us(void);
@@ -0,0 +1,733 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
+#include "metrics.hpp"
+#include "multipart_parser.hpp"
+#include "ota_decoder.hpp"
+#include "ota_writer.hpp"
+#include "power.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief   Erase granularity of the OTA partition.
+ */
+#define OTA_WRITER_SECTOR_SIZE          4096
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Message sent to the flash writer task, a NULL buffer asks the task
+ *          to signal that everything queued before it has been written.
+ */
+typedef struct {
+    uint8_t *buffer;
+    size_t offset;
+    size_t len;
+} ota_writer_message_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "ota_writer";
+
+static uint8_t s_buffers[OTA_WRITER_BUFFER_COUNT][OTA_WRITER_BUFFER_SIZE];
+
+static TaskHandle_t s_ota_writer_task = NULL;
+static QueueHandle_t s_free_queue = NULL;           /* Buffers ready to fill. */
+static QueueHandle_t s_write_queue = NULL;          /* Buffers to program. */
+static SemaphoreHandle_t s_drained = NULL;
+
+static esp_ota_handle_t s_ota_handle;
+static const esp_partition_t *s_partition;
+static size_t s_upload_size;
+static uint32_t s_write_offset;         /* Image bytes written. */
+static uint32_t s_erased_end;           /* Flash erased up to here. */
+static uint32_t s_erase_limit;          /* Erasing ahead stops here. */
+static uint32_t s_progress_offset;      /* Next progress event from here. */
+static bool s_active = false;
+static bool s_multipart = false;
+static multipart_parser_t s_parser;
+static size_t s_part_count;
+static volatile esp_err_t s_write_error = ESP_OK;
+static ota_update_reason_e s_reason = OTA_UPDATE_REASON_NONE;
+static mbedtls_sha256_context s_sha256;
+static uint8_t s_expected_sha256[OTA_WRITER_SHA256_LEN];
+static bool s_has_expected_sha256;
+static ota_writer_stats_t s_stats;
+static int64_t s_begin_time_us;
+
+/**
+ * @brief   Handlers and the pull task claim the partition side by side.
+ */
+static ota_writer_owner_e s_owner = OTA_WRITER_OWNER_NONE;
+static portMUX_TYPE s_owner_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Flash writer task, programs the queued buffers in order.
+ *
+ * @param param
+ */
+static void ota_writer_task(void *param);
+
+/**
+ * @brief   Creates the buffer pool queues and the writer task on first use.
+ *
+ * @return  ESP_OK, ESP_ERR_NO_MEM if a queue or the task can't be created.
+ */
+static esp_err_t ota_writer_init(void);
+
+/**
+ * @brief   Blocks until the writer task has processed every queued buffer.
+ */
+static void ota_writer_drain(void);
+
+/**
+ * @brief   Erases the sectors between the erased end and `end`, rounded up to
+ *          a sector.
+ *
+ * @param   end     - Offset that must be erased.
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE past the end of the partition,
+ *          otherwise the error of esp_partition_erase_range().
+ */
+static esp_err_t ota_writer_erase_until(uint32_t end);
+
+/**
+ * @brief   Erases the next sector ahead of the write cursor, called by the
+ *          writer task while no buffer is waiting.
+ *
+ * @return  true if a sector was erased, false if there is nothing to erase.
+ */
+static bool ota_writer_erase_next(void);
+
+/**
+ * @brief   Publishes EVENT_BUS_OTA_PROGRESS once the image crossed the next
+ *          OTA_WRITER_PROGRESS_INTERVAL, one event per interval however
+ *          small the buffers.
+ *
+ * @param   final   - Published anyway: the last count, before the result.
+ */
+static void ota_writer_publish_progress(bool final);
+
+/**
+ * @brief   Records why the update failed, the first reason wins since later
+ *          failures are usually its consequences.
+ */
+static void ota_writer_fail(ota_update_reason_e reason);
+
+/**
+ * @brief   Compares the SHA-256 of the written image with the expected one.
+ *
+ * @return  ESP_OK if it matches or no digest was given, ESP_ERR_INVALID_CRC
+ *          otherwise.
+ */
+static esp_err_t ota_writer_verify(void);
+
+/**
+ * @brief   Passes uploaded file bytes to the decoder, which inflates a
+ *          compressed image.
+ *
+ * @param   data    - Uploaded file bytes.
+ * @param   len     - Number of bytes.
+ * @return  ESP_OK, otherwise the error of the decoder or esp_ota_write().
+ */
+static esp_err_t ota_writer_decode(const uint8_t *data, size_t len);
+
+/**
+ * @brief   Decoder sink, programs image bytes into the OTA partition.
+ *
+ * @param   ctx     - Unused.
+ * @param   data    - Image bytes.
+ * @param   len     - Number of bytes.
+ * @return  ESP_OK, otherwise the error of the erase or esp_ota_write().
+ */
+static esp_err_t ota_writer_write_image(void *ctx,
+                                        const uint8_t *data,
+                                        size_t len);
+
+/**
+ * @brief   Multipart callbacks, the first part of the form is the image.
+ */
+static esp_err_t ota_writer_on_part_begin(void *ctx);
+static esp_err_t ota_writer_on_part_data(void *ctx,
+                                            const uint8_t *data,
+                                            size_t len);
+
+static const multipart_callbacks_t s_multipart_callbacks = {
+    .on_part_begin = ota_writer_on_part_begin,
+    .on_part_data = ota_writer_on_part_data,
+    .on_part_end = NULL
+};
+
+/* Public function definition ------------------------------------------------*/
+bool ota_writer_claim(ota_writer_owner_e owner)
+{
+    bool claimed = false;
+
+    portENTER_CRITICAL(&s_owner_lock);
+    if (s_owner == OTA_WRITER_OWNER_NONE) {
+        s_owner = owner;
+        claimed = true;
+    }
+    portEXIT_CRITICAL(&s_owner_lock);
+
+    return claimed;
+}
+
+void ota_writer_release(ota_writer_owner_e owner)
+{
+    portENTER_CRITICAL(&s_owner_lock);
+    if (s_owner == owner) {
+        s_owner = OTA_WRITER_OWNER_NONE;
+    }
+    portEXIT_CRITICAL(&s_owner_lock);
+}
+
+ota_writer_owner_e ota_writer_get_owner(void)
+{
+    return s_owner;
+}
+
+esp_err_t ota_writer_begin(const esp_partition_t *partition,
+                            size_t upload_size,
+                            const char *boundary,
+                            const uint8_t *sha256)
+{
+    if (s_active) {
+        DLOGE(TAG, "An OTA write is already in progress.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_reason = OTA_UPDATE_REASON_NONE;
+
+    esp_err_t err = ota_writer_init();
+    if (err != ESP_OK) {
+        ota_writer_fail(OTA_UPDATE_REASON_BEGIN_FAILED);
+        return err;
+    }
+
+    /* 0. Expected digest. */
+    s_has_expected_sha256 = (sha256 != NULL);
+    if (s_has_expected_sha256) {
+        memcpy(s_expected_sha256, sha256, OTA_WRITER_SHA256_LEN);
+    } else if (OTA_WRITER_REQUIRE_SHA256) {
+        DLOGE(TAG, "Image without a SHA-256 digest rejected.");
+        ota_writer_fail(OTA_UPDATE_REASON_DIGEST_MISSING);
+        return ESP_ERR_INVALID_ARG;
+    } else {
+        DLOGW(TAG, "No SHA-256 digest given, the image is unverified.");
+    }
+
+    /* 1. Body framing. Only multipart framing and compression can make the
+     * upload differ from the image size, the latter only makes it smaller. */
+    s_multipart = (boundary != NULL);
+    if (!s_multipart && upload_size > partition->size) {
+        DLOGE(TAG, "Upload of %u bytes exceeds the partition.",
+                    (unsigned)upload_size);
+        ota_writer_fail(OTA_UPDATE_REASON_IMAGE_TOO_LARGE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_part_count = 0;
+    if (s_multipart) {
+        err = multipart_parser_init(&s_parser,
+                                    boundary,
+                                    &s_multipart_callbacks,
+                                    NULL);
+        if (err != ESP_OK) {
+            DLOGE(TAG, "Invalid multipart boundary.");
+            ota_writer_fail(OTA_UPDATE_REASON_MALFORMED_UPLOAD);
+            return err;
+        }
+    }
+
+    /* 2. Every buffer starts in the free pool. */
+    xQueueReset(s_write_queue);
+    xQueueReset(s_free_queue);
+    for (size_t i = 0; i < OTA_WRITER_BUFFER_COUNT; i++) {
+        uint8_t *buffer = s_buffers[i];
+        xQueueSend(s_free_queue, &buffer, 0);
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    ota_decoder_begin(ota_writer_write_image, NULL);
+    mbedtls_sha256_init(&s_sha256);
+    mbedtls_sha256_starts(&s_sha256, 0);
+    s_write_error = ESP_OK;
+    s_partition = partition;
+    s_upload_size = upload_size;
+    s_write_offset = 0;
+    s_erased_end = 0;
+    s_erase_limit = partition->size;
+    s_progress_offset = 0;
+    s_begin_time_us = esp_timer_get_time();
+
+    /* 3. Open the partition. Erasing it all here blocks the receiver for
+     * seconds, with OTA_WRITER_ERASE_AHEAD the writer task erases it as the
+     * image arrives. The CPU stays at full speed until the end. */
+    power_lock_acquire(POWER_LOCK_OTA);
+    err = esp_ota_begin(partition,
+                        OTA_WRITER_ERASE_AHEAD ? OTA_WITH_SEQUENTIAL_WRITES
+                                                : OTA_SIZE_UNKNOWN,
+                        &s_ota_handle);
+    s_stats.begin_time_us = esp_timer_get_time() - s_begin_time_us;
+    if (err != ESP_OK) {
+        DLOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        ota_decoder_end();
+        mbedtls_sha256_free(&s_sha256);
+        ota_writer_fail(OTA_UPDATE_REASON_BEGIN_FAILED);
+        power_lock_release(POWER_LOCK_OTA);
+        return err;
+    }
+
+    DLOGI(TAG, "Writing to partition subtype %d at: 0x%x",
+                partition->subtype,
+                partition->address);
+
+    s_active = true;
+    ota_writer_publish_progress(false);
+    return ESP_OK;
+}
+
+uint8_t *ota_writer_acquire(void)
+{
+    uint8_t *buffer = NULL;
+
+    if (!s_active || s_write_error != ESP_OK) {
+        return NULL;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN("ota_writer_acquire", 0);
+    const BaseType_t received = xQueueReceive(s_free_queue,
+                            &buffer,
+                            pdMS_TO_TICKS(OTA_WRITER_BACKPRESSURE_TIMEOUT_MS));
+    TRACE_END("ota_writer_acquire");
+    if (received != pdTRUE) {
+        DLOGE(TAG, "Flash writer stalled, no free buffer.");
+        return NULL;
+    }
+    s_stats.stall_time_us += esp_timer_get_time() - start_us;
+
+    return buffer;
+}
+
+esp_err_t ota_writer_submit(uint8_t *buffer, size_t offset, size_t len)
+{
+    ota_writer_message_t msg = {
+        .buffer = buffer,
+        .offset = offset,
+        .len = len
+    };
+
+    /* Never blocks: the write queue holds every buffer of the pool. */
+    xQueueSend(s_write_queue, &msg, portMAX_DELAY);
+    metrics_add(METRICS_OTA_RECEIVED_BYTES, len);
+
+    return s_write_error;
+}
+
+esp_err_t ota_writer_end(ota_writer_stats_t *stats)
+{
+    if (!s_active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_writer_drain();
+    s_active = false;
+    power_lock_release(POWER_LOCK_OTA);
+    ota_writer_publish_progress(true);
+
+    /* A body cut before the close delimiter is a truncated image. */
+    esp_err_t err = s_write_error;
+    if (err == ESP_OK && s_multipart && !multipart_parser_is_done(&s_parser)) {
+        DLOGE(TAG, "Multipart body ended before its close delimiter.");
+        ota_writer_fail(OTA_UPDATE_REASON_IMAGE_TRUNCATED);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    /* A compressed image must end with a matching gzip trailer. */
+    esp_err_t decoder_err = ota_decoder_end();
+    if (err == ESP_OK && decoder_err != ESP_OK) {
+        ota_writer_fail((decoder_err == ESP_ERR_INVALID_SIZE)
+                            ? OTA_UPDATE_REASON_IMAGE_TRUNCATED
+                            : OTA_UPDATE_REASON_DECODE_FAILED);
+        err = decoder_err;
+    }
+
+    /* Checked before esp_ota_end() so a bad image never becomes bootable. */
+    if (err == ESP_OK) {
+        err = ota_writer_verify();
+    }
+    mbedtls_sha256_free(&s_sha256);
+
+    s_stats.compressed =
+        (ota_decoder_get_format() == OTA_DECODER_FORMAT_GZIP);
+    s_stats.inflate_time_us = ota_decoder_get_inflate_time_us();
+
+    if (err == ESP_OK) {
+        err = esp_ota_end(s_ota_handle);
+        if (err != ESP_OK) {
+            ota_writer_fail(OTA_UPDATE_REASON_IMAGE_INVALID);
+        }
+    } else {
+        esp_ota_abort(s_ota_handle);
+    }
+
+    s_stats.total_time_us = esp_timer_get_time() - s_begin_time_us;
+    DLOGI(TAG, "OTA wrote %u bytes from %u %s bytes (%s) in %d ms "
+                "(begin %d ms, first write %d ms, erase %d ms, "
+                "inflate %d ms, flash %d ms, receiver stalled %d ms): %s",
+                (unsigned)s_stats.bytes_written,
+                (unsigned)s_stats.bytes_received,
+                s_stats.compressed ? "gzip" : "raw",
+                s_stats.verified ? "SHA-256 verified" : "unverified",
+                (int)(s_stats.total_time_us / 1000),
+                (int)(s_stats.begin_time_us / 1000),
+                (int)(s_stats.first_write_time_us / 1000),
+                (int)(s_stats.erase_time_us / 1000),
+                (int)(s_stats.inflate_time_us / 1000),
+                (int)(s_stats.flash_time_us / 1000),
+                (int)(s_stats.stall_time_us / 1000),
+                esp_err_to_name(err));
+
+    metrics_add(METRICS_OTA_UPDATES, 1);
+    metrics_add(METRICS_OTA_FAILURES, (err != ESP_OK) ? 1 : 0);
+    metrics_set(METRICS_OTA_THROUGHPUT,
+                (uint32_t)(s_stats.bytes_received * 1000000LL
+                            / MAX(s_stats.total_time_us, 1)));
+
+    if (stats != NULL) {
+        *stats = s_stats;
+    }
+
+    return err;
+}
+
+void ota_writer_abort(void)
+{
+    if (!s_active) {
+        return;
+    }
+
+    ota_writer_drain();
+    s_active = false;
+    power_lock_release(POWER_LOCK_OTA);
+    ota_writer_publish_progress(true);
+    ota_decoder_end();
+    mbedtls_sha256_free(&s_sha256);
+    esp_ota_abort(s_ota_handle);
+    ota_writer_fail(OTA_UPDATE_REASON_RECEIVE_FAILED);
+    metrics_add(METRICS_OTA_UPDATES, 1);
+    metrics_add(METRICS_OTA_FAILURES, 1);
+
+    DLOGW(TAG, "OTA write aborted after %u bytes.",
+                (unsigned)s_stats.bytes_written);
+}
+
+bool ota_writer_is_active(void)
+{
+    return s_active;
+}
+
+ota_update_reason_e ota_writer_get_reason(void)
+{
+    return s_reason;
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t ota_writer_init(void)
+{
+    if (s_ota_writer_task != NULL) {
+        return ESP_OK;
+    }
+
+    /* 1. Buffer pool and write queue, both can hold every buffer. */
+    s_free_queue = xQueueCreate(OTA_WRITER_BUFFER_COUNT, sizeof(uint8_t *));
+    s_write_queue = xQueueCreate(OTA_WRITER_BUFFER_COUNT + 1,
+                                    sizeof(ota_writer_message_t));
+    s_drained = xSemaphoreCreateBinary();
+    if (s_free_queue == NULL || s_write_queue == NULL || s_drained == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* 2. Flash writer task. */
+    if (xTaskCreatePinnedToCore(&ota_writer_task,
+                                "ota_writer",
+                                OTA_WRITER_TASK_STACK_SIZE,
+                                NULL,
+                                OTA_WRITER_TASK_PRIORITY,
+                                &s_ota_writer_task,
+                                task_placement_core(
+                                    TASK_PLACEMENT_OTA_WRITER)) != pdPASS) {
+        s_ota_writer_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+static void ota_writer_drain(void)
+{
+    ota_writer_message_t msg = {
+        .buffer = NULL,
+        .offset = 0,
+        .len = 0
+    };
+
+    xQueueSend(s_write_queue, &msg, portMAX_DELAY);
+    xSemaphoreTake(s_drained, portMAX_DELAY);
+}
+
+static esp_err_t ota_writer_erase_until(uint32_t end)
+{
+    if (end <= s_erased_end) {
+        return ESP_OK;
+    }
+
+    const uint32_t erase_end = (end + OTA_WRITER_SECTOR_SIZE - 1)
+                                & ~(OTA_WRITER_SECTOR_SIZE - 1);
+    if (erase_end > s_partition->size) {
+        DLOGE(TAG, "Image exceeds the partition.");
+        ota_writer_fail(OTA_UPDATE_REASON_IMAGE_TOO_LARGE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN("ota_writer_erase", erase_end - s_erased_end);
+    esp_err_t err = esp_partition_erase_range(s_partition,
+                                                s_erased_end,
+                                                erase_end - s_erased_end);
+    TRACE_END("ota_writer_erase");
+    s_stats.erase_time_us += esp_timer_get_time() - start_us;
+
+    if (err != ESP_OK) {
+        DLOGE(TAG, "Erase failed: %s", esp_err_to_name(err));
+        ota_writer_fail(OTA_UPDATE_REASON_WRITE_FAILED);
+        return err;
+    }
+
+    s_erased_end = erase_end;
+    return ESP_OK;
+}
+
+static bool ota_writer_erase_next(void)
+{
+    const uint32_t target = MIN(s_write_offset + OTA_WRITER_ERASE_AHEAD_SIZE,
+                                s_erase_limit);
+
+    if (!OTA_WRITER_ERASE_AHEAD
+        || s_write_error != ESP_OK
+        || s_erased_end >= target) {
+        return false;
+    }
+
+    esp_err_t err = ota_writer_erase_until(s_erased_end
+                                            + OTA_WRITER_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        s_write_error = err;
+        return false;
+    }
+
+    return true;
+}
+
+static void ota_writer_publish_progress(bool final)
+{
+    event_bus_event_t event;
+
+    if (!final && s_write_offset < s_progress_offset) {
+        return;
+    }
+    s_progress_offset = (s_write_offset / OTA_WRITER_PROGRESS_INTERVAL + 1)
+                        * OTA_WRITER_PROGRESS_INTERVAL;
+
+    /* Only a raw image uploaded alone has a known size. */
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_BUS_OTA_PROGRESS;
+    event.ota_progress.written = s_write_offset;
+    event.ota_progress.total =
+        (!s_multipart
+            && ota_decoder_get_format() == OTA_DECODER_FORMAT_RAW)
+        ? s_upload_size : 0;
+    event_bus_publish(&event);
+}
+
+static void ota_writer_fail(ota_update_reason_e reason)
+{
+    if (s_reason == OTA_UPDATE_REASON_NONE) {
+        s_reason = reason;
+    }
+}
+
+static esp_err_t ota_writer_verify(void)
+{
+    uint8_t digest[OTA_WRITER_SHA256_LEN];
+
+    mbedtls_sha256_finish(&s_sha256, digest);
+    if (!s_has_expected_sha256) {
+        return ESP_OK;
+    }
+
+    if (memcmp(digest, s_expected_sha256, OTA_WRITER_SHA256_LEN) != 0) {
+        DLOGE(TAG, "Image SHA-256 mismatch, update rejected.");
+        ota_writer_fail(OTA_UPDATE_REASON_DIGEST_MISMATCH);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    DLOGI(TAG, "Image SHA-256 verified.");
+    s_stats.verified = true;
+    return ESP_OK;
+}
+
+static void ota_writer_task(void *param)
+{
+    ota_writer_message_t msg;
+
+    metrics_register_task(NULL, OTA_WRITER_TASK_STACK_SIZE);
+    while (1) {
+        /* While no buffer waits, erase ahead of the write cursor. A sector
+         * erase takes tens of ms, so the queue is checked between each. */
+        if (xQueueReceive(s_write_queue, &msg, 0) != pdTRUE) {
+            if (ota_writer_erase_next()) {
+                continue;
+            }
+
+            if (xQueueReceive(s_write_queue, &msg, portMAX_DELAY) != pdTRUE) {
+                continue;
+            }
+        }
+
+        if (msg.buffer == NULL) {
+            /* The update is ending, nothing more to erase. */
+            s_erase_limit = 0;
+            xSemaphoreGive(s_drained);
+            continue;
+        }
+
+        /* After the first failure the remaining buffers are only recycled. */
+        if (s_write_error == ESP_OK && msg.len > 0) {
+            esp_err_t err;
+
+            TRACE_BEGIN("ota_writer_feed", msg.len);
+            if (s_multipart) {
+                err = multipart_parser_feed(&s_parser,
+                                            msg.buffer + msg.offset,
+                                            msg.len);
+            } else {
+                err = ota_writer_decode(msg.buffer + msg.offset, msg.len);
+            }
+            TRACE_END("ota_writer_feed");
+
+            if (err != ESP_OK) {
+                DLOGE(TAG, "OTA write failed: %s", esp_err_to_name(err));
+                ota_writer_fail(OTA_UPDATE_REASON_MALFORMED_UPLOAD);
+                s_write_error = err;
+            } else {
+                ota_writer_publish_progress(false);
+            }
+        }
+
+        xQueueSend(s_free_queue, &msg.buffer, portMAX_DELAY);
+    }
+}
+
+static esp_err_t ota_writer_decode(const uint8_t *data, size_t len)
+{
+    s_stats.bytes_received += len;
+
+    esp_err_t err = ota_decoder_feed(data, len);
+    if (err != ESP_OK) {
+        ota_writer_fail(OTA_UPDATE_REASON_DECODE_FAILED);
+    }
+
+    return err;
+}
+
+static esp_err_t ota_writer_write_image(void *ctx,
+                                        const uint8_t *data,
+                                        size_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    if (OTA_WRITER_ERASE_AHEAD) {
+        /* A raw image ends within the upload, don't erase past it. */
+        if (s_write_offset == 0
+            && ota_decoder_get_format() == OTA_DECODER_FORMAT_RAW) {
+            s_erase_limit = MIN(s_erase_limit, s_upload_size);
+        }
+
+        /* Usually already erased in the background. */
+        err = ota_writer_erase_until(s_write_offset + len);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN("ota_writer_write", len);
+    if (OTA_WRITER_ERASE_AHEAD) {
+        err = esp_ota_write_with_offset(s_ota_handle,
+                                        data,
+                                        len,
+                                        s_write_offset);
+    } else {
+        err = esp_ota_write(s_ota_handle, data, len);
+    }
+    TRACE_END("ota_writer_write");
+    s_stats.flash_time_us += esp_timer_get_time() - start_us;
+
+    if (err != ESP_OK) {
+        ota_writer_fail(OTA_UPDATE_REASON_WRITE_FAILED);
+        return err;
+    }
+
+    if (s_write_offset == 0) {
+        s_stats.first_write_time_us = esp_timer_get_time() - s_begin_time_us;
+    }
+    s_write_offset += len;
+
+    /* Single pass: hash the bytes while they are still in cache. */
+    mbedtls_sha256_update(&s_sha256, data, len);
+    s_stats.bytes_written += len;
+
+    return ESP_OK;
+}
+
+static esp_err_t ota_writer_on_part_begin(void *ctx)
+{
+    s_part_count++;
+    return ESP_OK;
+}
+
+static esp_err_t ota_writer_on_part_data(void *ctx,
+                                            const uint8_t *data,
+                                            size_t len)
+{
+    /* Other form fields are not part of the image. */
+    if (s_part_count != 1) {
+        return ESP_OK;
+    }
+
+    return ota_writer_decode(data, len);
+}
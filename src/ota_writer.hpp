@@ -0,0 +1,165 @@
+#pragma once
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+
+/**
+ * @brief   Length of the SHA-256 digest of an image.
+ */
+#define OTA_WRITER_SHA256_LEN           32
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Why an OTA update failed, reported as `ota_update_reason` by
+ *          /OTAstatus.
+ */
+typedef enum {
+    OTA_UPDATE_REASON_NONE = 0,
+    OTA_UPDATE_REASON_BEGIN_FAILED,         /* esp_ota_begin() failed. */
+    OTA_UPDATE_REASON_RECEIVE_FAILED,       /* Connection lost or stalled. */
+    OTA_UPDATE_REASON_MALFORMED_UPLOAD,     /* Invalid multipart body. */
+    OTA_UPDATE_REASON_DECODE_FAILED,        /* Corrupt gzip stream. */
+    OTA_UPDATE_REASON_IMAGE_TRUNCATED,      /* The upload ended early. */
+    OTA_UPDATE_REASON_WRITE_FAILED,         /* esp_ota_write() failed. */
+    OTA_UPDATE_REASON_DIGEST_MISSING,       /* No digest while required. */
+    OTA_UPDATE_REASON_DIGEST_MISMATCH,      /* SHA-256 of the image differs. */
+    OTA_UPDATE_REASON_IMAGE_INVALID,        /* esp_ota_end() rejected it. */
+    OTA_UPDATE_REASON_SET_BOOT_FAILED,      /* Boot partition not switched. */
+    OTA_UPDATE_REASON_DOWNLOAD_REFUSED,     /* Pull: the server refused it. */
+    OTA_UPDATE_REASON_IMAGE_TOO_LARGE       /* Larger than the partition. */
+} ota_update_reason_e;
+
+/**
+ * @brief   Who updates the OTA partition, see ota_writer_claim().
+ */
+typedef enum {
+    OTA_WRITER_OWNER_NONE = 0,
+    OTA_WRITER_OWNER_UPLOAD,                /* Push, /OTAupdate. */
+    OTA_WRITER_OWNER_PULL                   /* ota_client.hpp. */
+} ota_writer_owner_e;
+
+/**
+ * @brief   Statistics of the last OTA write, reported by ota_writer_end().
+ */
+typedef struct {
+    size_t bytes_received;          /* Uploaded bytes, maybe compressed. */
+    size_t bytes_written;           /* Image bytes handed to esp_ota_write(). */
+    bool compressed;                /* The uploaded image was gzip. */
+    bool verified;                  /* The SHA-256 digest was checked. */
+    int64_t begin_time_us;          /* Time spent in esp_ota_begin(). */
+    int64_t first_write_time_us;    /* ota_writer_begin() to the first write. */
+    int64_t erase_time_us;          /* Time the writer task spent erasing. */
+    int64_t inflate_time_us;        /* Time spent decompressing. */
+    int64_t flash_time_us;          /* Time the writer task spent writing. */
+    int64_t stall_time_us;          /* Time the receiver waited for a buffer. */
+    int64_t total_time_us;          /* ota_writer_begin() to ota_writer_end(). */
+} ota_writer_stats_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Claims the OTA partition for an update, before anything of it is
+ *          checked or started. The single place deciding between an upload
+ *          and a pull: only one owner at a time, until it calls
+ *          ota_writer_release().
+ *
+ * @return  Whether `owner` got it, false if an update already owns it.
+ */
+bool ota_writer_claim(ota_writer_owner_e owner);
+
+/**
+ * @brief   Gives the OTA partition back, nothing if `owner` doesn't hold it.
+ */
+void ota_writer_release(ota_writer_owner_e owner);
+
+/**
+ * @brief   Current owner of the OTA partition.
+ */
+ota_writer_owner_e ota_writer_get_owner(void);
+
+/**
+ * @brief   Starts an OTA write to `partition`: creates the flash writer task
+ *          on first use and calls esp_ota_begin().
+ * @note    The writer owns OTA_WRITER_BUFFER_COUNT buffers of
+ *          OTA_WRITER_BUFFER_SIZE bytes. The receiver fills them while the
+ *          writer task programs the flash, so network and flash overlap.
+ *          With a boundary, the submitted bytes are a multipart/form-data
+ *          body parsed by the writer task and its first part is the image.
+ *          A gzip image is detected from its magic bytes and inflated on the
+ *          fly through a fixed 32 KB window, see ota_decoder.hpp.
+ *          The SHA-256 of the decoded image is computed as it is written
+ *          (hardware SHA through mbedtls), no second pass over the flash.
+ *          With OTA_WRITER_ERASE_AHEAD, esp_ota_begin() erases nothing: the
+ *          writer task erases sectors up to OTA_WRITER_ERASE_AHEAD_SIZE
+ *          ahead of the write cursor while it waits for data, so erasing
+ *          overlaps the transfer instead of delaying the first write.
+ *
+ * @param   partition   - OTA app partition to write.
+ * @param   upload_size - Content-Length of the upload. It bounds a raw image
+ *                        so the erase doesn't run past its end.
+ * @param   boundary    - Multipart boundary, NULL if the bytes are the raw
+ *                        image.
+ * @param   sha256      - Expected SHA-256 of the decoded image, NULL if the
+ *                        sender gave none.
+ * @return  ESP_OK, ESP_ERR_INVALID_ARG without a digest while
+ *          OTA_WRITER_REQUIRE_SHA256 is set, ESP_ERR_INVALID_SIZE if a raw
+ *          upload is larger than the partition, otherwise the error of
+ *          esp_ota_begin().
+ */
+esp_err_t ota_writer_begin(const esp_partition_t *partition,
+                            size_t upload_size,
+                            const char *boundary,
+                            const uint8_t *sha256);
+
+/**
+ * @brief   Takes a free buffer from the pool. Blocks while every buffer is
+ *          queued for the flash (backpressure) for at most
+ *          OTA_WRITER_BACKPRESSURE_TIMEOUT_MS.
+ *
+ * @return  A buffer of OTA_WRITER_BUFFER_SIZE bytes, NULL if the writer
+ *          failed or stalled.
+ */
+uint8_t *ota_writer_acquire(void);
+
+/**
+ * @brief   Queues `len` bytes at `offset` of an acquired buffer for writing.
+ *          The buffer returns to the pool once it is written.
+ *
+ * @param   buffer  - Buffer returned by ota_writer_acquire().
+ * @param   offset  - Offset of the data inside the buffer.
+ * @param   len     - Number of bytes, may be 0 to just release.
+ * @return  ESP_OK, otherwise the first write error of the writer task.
+ */
+esp_err_t ota_writer_submit(uint8_t *buffer, size_t offset, size_t len);
+
+/**
+ * @brief   Waits for every queued buffer to be written then finishes the
+ *          update with esp_ota_end().
+ *
+ * @param   stats   - Optional, receives the statistics of this write.
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE if a multipart body ended before its
+ *          close delimiter or a gzip image is truncated,
+ *          ESP_ERR_INVALID_CRC if the gzip CRC-32 or the SHA-256 digest
+ *          doesn't match, otherwise
+ *          the first error of the multipart parser, the decoder,
+ *          esp_ota_write() or esp_ota_end().
+ */
+esp_err_t ota_writer_end(ota_writer_stats_t *stats);
+
+/**
+ * @brief   Drops the update: waits for the writer task to drain its queue
+ *          and releases the OTA handle with esp_ota_abort().
+ */
+void ota_writer_abort(void);
+
+/**
+ * @brief   Whether an update is between ota_writer_begin() and
+ *          ota_writer_end() or ota_writer_abort().
+ */
+bool ota_writer_is_active(void);
+
+/**
+ * @brief   Reason of the last failed ota_writer_begin(), ota_writer_end() or
+ *          ota_writer_abort(), OTA_UPDATE_REASON_NONE after a success.
+ */
+ota_update_reason_e ota_writer_get_reason(void);
@@ -0,0 +1,294 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_freertos_hooks.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_private/esp_clk.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "power.hpp"
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Ticks counted by the tick hooks, each by a single core, which
+ *          needs no atomic increment.
+ */
+typedef struct {
+    std::atomic<uint32_t> ticks[portNUM_PROCESSORS];
+    std::atomic<uint32_t> idle[portNUM_PROCESSORS];
+    std::atomic<uint32_t> freq_ticks[POWER_MEASURE_FREQS];
+} power_counts_t;
+
+typedef struct {
+    uint32_t ticks[portNUM_PROCESSORS];
+    uint32_t idle[portNUM_PROCESSORS];
+    uint32_t freq_ticks[POWER_MEASURE_FREQS];
+} power_snapshot_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "power";
+
+static esp_pm_lock_handle_t s_power_locks[POWER_LOCK_MAX] = {};
+static const char *const s_power_lock_names[POWER_LOCK_MAX] = {
+    "http",
+    "ota"
+};
+
+/**
+ * @brief   Read by the tick hooks, in DRAM for ticks taken while the flash
+ *          cache is off.
+ */
+static TaskHandle_t s_power_idle_tasks[portNUM_PROCESSORS] = {};
+static power_counts_t s_power_counts;
+static std::atomic<uint32_t> s_power_freq_mhz[POWER_MEASURE_FREQS];
+
+static esp_timer_handle_t s_power_measure_timer = NULL;
+static power_snapshot_t s_power_last;
+static int64_t s_power_last_us = 0;
+static power_report_t s_power_report;
+static bool s_power_reported = false;
+static portMUX_TYPE s_power_report_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Tick hook of each core, whether its idle task is running and, on
+ *          core 0, the frequency the CPU runs at.
+ */
+static void power_tick_hook(void);
+
+/**
+ * @brief   esp_timer callback, the report of the ticks since the last one.
+ */
+static void power_measure_report(void *arg);
+
+/**
+ * @brief   Adds a tick to a counter of the calling core.
+ */
+static inline void power_count(std::atomic<uint32_t> *counter);
+
+/* Public function definition ------------------------------------------------*/
+
+esp_err_t power_init(void)
+{
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = POWER_MAX_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = (POWER_LIGHT_SLEEP != 0)
+    };
+
+    /* 1. Light sleep needs tickless idle in the build, scaling alone
+     * doesn't. */
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable) {
+        DLOGW(TAG, "No light sleep in this build, scaling only.");
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK) {
+        DLOGW(TAG, "Power management unavailable: %s",
+                    esp_err_to_name(err));
+        return err;
+    }
+
+    /* 2. A lock per user, esp_pm_dump_locks() tells them apart. */
+    for (size_t i = 0; i < POWER_LOCK_MAX; i++) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0,
+                                    s_power_lock_names[i],
+                                    &s_power_locks[i]);
+        if (err != ESP_OK) {
+            DLOGE(TAG, "Could not create the %s lock: %s",
+                        s_power_lock_names[i], esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    DLOGI(TAG, "CPU scales from %d to %d MHz, light sleep %s.",
+                config.min_freq_mhz, config.max_freq_mhz,
+                config.light_sleep_enable ? "on" : "off");
+    return ESP_OK;
+}
+
+void power_lock_acquire(power_lock_e lock)
+{
+    if (s_power_locks[lock] != NULL) {
+        esp_pm_lock_acquire(s_power_locks[lock]);
+    }
+}
+
+void power_lock_release(power_lock_e lock)
+{
+    if (s_power_locks[lock] != NULL) {
+        esp_pm_lock_release(s_power_locks[lock]);
+    }
+}
+
+esp_err_t power_measure_start(uint32_t period_ms)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &power_measure_report,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "power_measure"
+    };
+
+    if (s_power_measure_timer != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* 1. The hooks tell idle ticks by the idle task of their core. */
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        s_power_idle_tasks[core] = xTaskGetIdleTaskHandleForCPU(core);
+    }
+    s_power_last_us = esp_timer_get_time();
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_err_t err = esp_register_freertos_tick_hook_for_cpu(
+                                                        power_tick_hook,
+                                                        core);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    /* 2. A report every period, the timer wakes the CPU that often. */
+    esp_err_t err = esp_timer_create(&timer_args, &s_power_measure_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(s_power_measure_timer,
+                                        (uint64_t)period_ms * 1000);
+    }
+
+    DLOGI(TAG, "Measuring idle time and CPU frequency every %u ms.",
+                (unsigned)period_ms);
+    return err;
+}
+
+bool power_get_report(power_report_t *report)
+{
+    portENTER_CRITICAL(&s_power_report_lock);
+    *report = s_power_report;
+    const bool reported = s_power_reported;
+    portEXIT_CRITICAL(&s_power_report_lock);
+
+    return reported;
+}
+
+/* Private function definition -----------------------------------------------*/
+
+static void IRAM_ATTR power_tick_hook(void)
+{
+    const BaseType_t core = xPortGetCoreID();
+
+    power_count(&s_power_counts.ticks[core]);
+    if (xTaskGetCurrentTaskHandle() == s_power_idle_tasks[core]) {
+        power_count(&s_power_counts.idle[core]);
+    }
+
+    /* The frequency is the same on both cores, core 0 alone counts it and
+     * gives a new one the next free slot. */
+    if (core != 0) {
+        return;
+    }
+    const uint32_t mhz = esp_clk_cpu_freq() / 1000000;
+    for (size_t i = 0; i < POWER_MEASURE_FREQS; i++) {
+        const uint32_t slot = s_power_freq_mhz[i].load(
+                                                std::memory_order_relaxed);
+
+        if (slot == 0) {
+            s_power_freq_mhz[i].store(mhz, std::memory_order_release);
+        }
+        if (slot == 0 || slot == mhz) {
+            power_count(&s_power_counts.freq_ticks[i]);
+            return;
+        }
+    }
+}
+
+static void power_measure_report(void *arg)
+{
+    power_report_t report;
+
+    (void)arg;
+
+    /* 1. Ticks since the last report, against those the period had. Light
+     * sleep skips them, the cores were idle then. */
+    const int64_t now_us = esp_timer_get_time();
+    const uint32_t expected = MAX((now_us - s_power_last_us)
+                                    / (portTICK_PERIOD_MS * 1000), 1);
+
+    memset(&report, 0, sizeof(report));
+    report.period_ms = (now_us - s_power_last_us) / 1000;
+    s_power_last_us = now_us;
+
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        const uint32_t ticks = s_power_counts.ticks[core].load(
+                                                std::memory_order_relaxed);
+        const uint32_t idle = s_power_counts.idle[core].load(
+                                                std::memory_order_relaxed);
+        const uint32_t sampled = ticks - s_power_last.ticks[core];
+        const uint32_t skipped = (expected > sampled) ? expected - sampled
+                                                        : 0;
+
+        report.idle[core] = MIN((idle - s_power_last.idle[core] + skipped)
+                                    * 1000 / expected, 1000);
+        if (core == 0) {
+            report.sleep = skipped * 1000 / expected;
+        }
+        s_power_last.ticks[core] = ticks;
+        s_power_last.idle[core] = idle;
+    }
+
+    for (size_t i = 0; i < POWER_MEASURE_FREQS; i++) {
+        const uint32_t ticks = s_power_counts.freq_ticks[i].load(
+                                                std::memory_order_relaxed);
+
+        report.freq_mhz[i] = s_power_freq_mhz[i].load(
+                                                std::memory_order_acquire);
+        report.freq[i] = MIN((ticks - s_power_last.freq_ticks[i]) * 1000
+                                / expected, 1000);
+        s_power_last.freq_ticks[i] = ticks;
+    }
+
+    portENTER_CRITICAL(&s_power_report_lock);
+    s_power_report = report;
+    s_power_reported = true;
+    portEXIT_CRITICAL(&s_power_report_lock);
+
+    /* 2. The cores, then where the time went on core 0. */
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        DLOGI(TAG, "Core %u idle %u.%u %% over %u ms.", (unsigned)core,
+                    report.idle[core] / 10, report.idle[core] % 10,
+                    (unsigned)report.period_ms);
+    }
+    for (size_t i = 0; i < POWER_MEASURE_FREQS; i++) {
+        if (report.freq_mhz[i] != 0) {
+            DLOGI(TAG, "At %u MHz %u.%u %% of the time.",
+                        report.freq_mhz[i], report.freq[i] / 10,
+                        report.freq[i] % 10);
+        }
+    }
+    DLOGI(TAG, "In light sleep %u.%u %% of the time.", report.sleep / 10,
+                report.sleep % 10);
+}
+
+static inline void IRAM_ATTR power_count(std::atomic<uint32_t> *counter)
+{
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * @brief   Up to POWER_MEASURE_FREQS distinct CPU frequencies are told apart
+ *          by the measurement.
+ */
+#define POWER_MEASURE_FREQS             4
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Users of the power management locks, each keeps the CPU at its
+ *          highest frequency and out of light sleep while held.
+ */
+typedef enum {
+    POWER_LOCK_HTTP = 0,                /* A request being served. */
+    POWER_LOCK_OTA,                     /* An image being received. */
+    POWER_LOCK_MAX
+} power_lock_e;
+
+/**
+ * @brief   Where the time of a measurement period went, in per mille. A
+ *          core is idle while its idle task runs or it sleeps, the ticks
+ *          light sleep skips are counted as `sleep`.
+ */
+typedef struct {
+    uint32_t period_ms;
+    uint16_t idle[portNUM_PROCESSORS];
+    uint16_t sleep;
+    uint16_t freq_mhz[POWER_MEASURE_FREQS];     /* 0 if unused. */
+    uint16_t freq[POWER_MEASURE_FREQS];
+} power_report_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Lets the CPU scale between POWER_MIN_FREQ_MHZ and
+ *          POWER_MAX_FREQ_MHZ and sleep when idle (config.hpp), and creates
+ *          the locks. Without light sleep in the build (tickless idle) only
+ *          the frequency scales.
+ *
+ * @return  ESP_ERR_NOT_SUPPORTED if power management isn't in the build,
+ *          the locks then do nothing.
+ */
+esp_err_t power_init(void);
+
+/**
+ * @brief   Takes a lock, for as long as a transfer is active. Locks count,
+ *          several requests may hold the same one.
+ */
+void power_lock_acquire(power_lock_e lock);
+void power_lock_release(power_lock_e lock);
+
+/**
+ * @brief   Samples every tick, on each core, whether it is idle and on core
+ *          0 the CPU frequency, and logs a report every `period_ms`.
+ */
+esp_err_t power_measure_start(uint32_t period_ms);
+
+/**
+ * @brief   The last report of the measurement.
+ *
+ * @return  false before the first one.
+ */
+bool power_get_report(power_report_t *report);
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include "config.hpp"
+#include "rollup.hpp"
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Bucket as kept, values in tenths like the sensor sends them.
+ */
+typedef struct {
+    uint32_t start_s;                   /* Period start, 0 if never used. */
+    int32_t temperature_sum;
+    int32_t humidity_sum;
+    uint16_t count;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    int16_t humidity_min;
+    int16_t humidity_max;
+} rollup_slot_t;
+
+typedef struct {
+    uint32_t period_s;
+    uint32_t count;
+    rollup_slot_t *slots;
+    uint32_t newest_s;                  /* Latest period with a sample. */
+} rollup_ring_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static rollup_slot_t s_slots_1m[ROLLUP_1M_BUCKETS];
+static rollup_slot_t s_slots_15m[ROLLUP_15M_BUCKETS];
+static rollup_slot_t s_slots_1h[ROLLUP_1H_BUCKETS];
+
+static rollup_ring_t s_rings[ROLLUP_RES_MAX] = {
+    {60, ROLLUP_1M_BUCKETS, s_slots_1m, 0},
+    {15 * 60, ROLLUP_15M_BUCKETS, s_slots_15m, 0},
+    {3600, ROLLUP_1H_BUCKETS, s_slots_1h, 0}
+};
+
+/**
+ * @brief   Held for the update of a sample or the copy of one bucket.
+ */
+static portMUX_TYPE s_rollup_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Mean and bounds of one value of a bucket.
+ */
+static void rollup_stat(rollup_stat_t *stat, int32_t sum, uint16_t count,
+                        int16_t min, int16_t max);
+
+/* Public function definition ------------------------------------------------*/
+void rollup_add(int64_t time_ms, float temperature, float humidity)
+{
+    if (time_ms < 0 || !isfinite(temperature) || !isfinite(humidity)
+        || fabsf(temperature) * 10 > INT16_MAX
+        || fabsf(humidity) * 10 > INT16_MAX) {
+        return;
+    }
+
+    const uint32_t time_s = (uint32_t)(time_ms / 1000);
+    const int16_t temperature_tenths = (int16_t)lroundf(temperature * 10);
+    const int16_t humidity_tenths = (int16_t)lroundf(humidity * 10);
+
+    portENTER_CRITICAL(&s_rollup_lock);
+    for (size_t i = 0; i < ROLLUP_RES_MAX; i++) {
+        rollup_ring_t *ring = &s_rings[i];
+        const uint32_t start_s = time_s - time_s % ring->period_s;
+        rollup_slot_t *slot = &ring->slots[(start_s / ring->period_s)
+                                            % ring->count];
+
+        /* 1. A newer lap holds the slot, the sample is too old. */
+        if (slot->start_s > start_s) {
+            continue;
+        }
+
+        /* 2. The first sample of the period takes the slot over. */
+        if (slot->start_s < start_s) {
+            slot->start_s = start_s;
+            slot->temperature_sum = 0;
+            slot->humidity_sum = 0;
+            slot->count = 0;
+            slot->temperature_min = INT16_MAX;
+            slot->temperature_max = INT16_MIN;
+            slot->humidity_min = INT16_MAX;
+            slot->humidity_max = INT16_MIN;
+        }
+        if (slot->count == UINT16_MAX) {
+            continue;
+        }
+
+        /* 3. Folded in, nothing else is kept of the sample. */
+        slot->temperature_sum += temperature_tenths;
+        slot->humidity_sum += humidity_tenths;
+        slot->count++;
+        if (temperature_tenths < slot->temperature_min) {
+            slot->temperature_min = temperature_tenths;
+        }
+        if (temperature_tenths > slot->temperature_max) {
+            slot->temperature_max = temperature_tenths;
+        }
+        if (humidity_tenths < slot->humidity_min) {
+            slot->humidity_min = humidity_tenths;
+        }
+        if (humidity_tenths > slot->humidity_max) {
+            slot->humidity_max = humidity_tenths;
+        }
+
+        if (start_s > ring->newest_s) {
+            ring->newest_s = start_s;
+        }
+    }
+    portEXIT_CRITICAL(&s_rollup_lock);
+}
+
+uint32_t rollup_period_s(rollup_res_e res)
+{
+    return s_rings[res].period_s;
+}
+
+void rollup_query(rollup_cursor_t *cursor, rollup_res_e res,
+                    int64_t from_ms, int64_t to_ms)
+{
+    const rollup_ring_t *ring = &s_rings[res];
+    const int64_t period_s = ring->period_s;
+
+    portENTER_CRITICAL(&s_rollup_lock);
+    const int64_t newest_s = ring->newest_s;
+    portEXIT_CRITICAL(&s_rollup_lock);
+
+    cursor->res = res;
+    cursor->next_s = 1;
+    cursor->end_s = 0;
+    if (newest_s == 0 || to_ms < from_ms) {
+        return;
+    }
+
+    /* Periods holding `from_ms` and `to_ms`, within the ring. */
+    const int64_t oldest_s = newest_s - (ring->count - 1) * period_s;
+    const int64_t from_s = (from_ms > 0) ? from_ms / 1000 : 0;
+    const int64_t to_s = to_ms / 1000;
+
+    cursor->next_s = from_s - from_s % period_s;
+    if (cursor->next_s < oldest_s) {
+        cursor->next_s = oldest_s;
+    }
+    cursor->end_s = (to_s < newest_s) ? to_s : newest_s;
+}
+
+bool rollup_next(rollup_cursor_t *cursor, rollup_bucket_t *bucket)
+{
+    const rollup_ring_t *ring = &s_rings[cursor->res];
+
+    while (cursor->next_s <= cursor->end_s) {
+        const uint32_t start_s = (uint32_t)cursor->next_s;
+        rollup_slot_t slot;
+
+        cursor->next_s += ring->period_s;
+
+        portENTER_CRITICAL(&s_rollup_lock);
+        slot = ring->slots[(start_s / ring->period_s) % ring->count];
+        portEXIT_CRITICAL(&s_rollup_lock);
+
+        /* A period without samples, or already overwritten. */
+        if (slot.start_s != start_s || slot.count == 0) {
+            continue;
+        }
+
+        bucket->time_ms = (int64_t)start_s * 1000;
+        bucket->count = slot.count;
+        rollup_stat(&bucket->temperature, slot.temperature_sum, slot.count,
+                    slot.temperature_min, slot.temperature_max);
+        rollup_stat(&bucket->humidity, slot.humidity_sum, slot.count,
+                    slot.humidity_min, slot.humidity_max);
+        return true;
+    }
+
+    return false;
+}
+
+/* Private function definition -----------------------------------------------*/
+static void rollup_stat(rollup_stat_t *stat, int32_t sum, uint16_t count,
+                        int16_t min, int16_t max)
+{
+    stat->min = min / 10.0f;
+    stat->max = max / 10.0f;
+    stat->mean = (float)sum / count / 10.0f;
+}
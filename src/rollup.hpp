@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Resolutions kept, each in a ring of ROLLUP_<res>_BUCKETS buckets.
+ */
+typedef enum {
+    ROLLUP_1M = 0,
+    ROLLUP_15M,
+    ROLLUP_1H,
+    ROLLUP_RES_MAX
+} rollup_res_e;
+
+typedef struct {
+    float min;
+    float max;
+    float mean;
+} rollup_stat_t;
+
+/**
+ * @brief   Samples of one period.
+ */
+typedef struct {
+    int64_t time_ms;                    /* Unix time of the period start. */
+    uint32_t count;
+    rollup_stat_t temperature;          /* Degrees Celsius. */
+    rollup_stat_t humidity;             /* Percent. */
+} rollup_bucket_t;
+
+/**
+ * @brief   Read position of a rollup_query(), on the reader's stack.
+ */
+typedef struct {
+    rollup_res_e res;
+    int64_t next_s;                     /* Start of the next period. */
+    int64_t end_s;                      /* Start of the last period. */
+} rollup_cursor_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Adds a sample to its bucket of every resolution. Constant time,
+ *          called by the sampling task for each read.
+ * @note    The bucket of a period sits at slot (start / period) % count of
+ *          its ring, a sample of a newer period resets the slot it lands
+ *          on. Buckets older than their ring are overwritten that way, so
+ *          the RAM cost is fixed: 24 bytes a bucket. Samples of a period
+ *          already overwritten are dropped.
+ *
+ * @param   time_ms     - Unix time of the sample.
+ */
+void rollup_add(int64_t time_ms, float temperature, float humidity);
+
+/**
+ * @brief   Period of a resolution, in seconds.
+ */
+uint32_t rollup_period_s(rollup_res_e res);
+
+/**
+ * @brief   Starts reading the buckets of `res` between `from_ms` and
+ *          `to_ms`. The range is cut to the periods the ring still holds,
+ *          so reading costs the buckets returned, at most one ring.
+ */
+void rollup_query(rollup_cursor_t *cursor, rollup_res_e res,
+                    int64_t from_ms, int64_t to_ms);
+
+/**
+ * @brief   Copies the next bucket holding samples, oldest first, callable
+ *          from any task.
+ *
+ * @return  false at the end of the range.
+ */
+bool rollup_next(rollup_cursor_t *cursor, rollup_bucket_t *bucket);
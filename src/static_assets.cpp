@@ -0,0 +1,562 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_http_server.h>
+#include <esp_err.h>
+#include <esp_log.h>
+
+#include "dlog.hpp"
+#include "metrics.hpp"
+#include "static_assets.hpp"
+#include "static_assets_etag.hpp"
+
+/**
+ * @brief   Head of a HEAD response, written by static_assets_send_head().
+ */
+#define STATIC_ASSETS_HEAD_MAX_LEN          512
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "static_assets";
+
+/**
+ * @brief   Embedded files, raw and gzip-compressed copies generated by
+ *          scripts/embed_assets.py at build time.
+ */
+extern const uint8_t
+jquery_3_3_1_min_js_start[] asm("_binary_resources_jquery_3_3_1_min_js_start");
+
+extern const uint8_t
+jquery_3_3_1_min_js_end[] asm("_binary_resources_jquery_3_3_1_min_js_end");
+
+extern const uint8_t jquery_3_3_1_min_js_gz_start[]
+    asm("_binary_resources_jquery_3_3_1_min_js_gz_start");
+
+extern const uint8_t jquery_3_3_1_min_js_gz_end[]
+    asm("_binary_resources_jquery_3_3_1_min_js_gz_end");
+
+extern const uint8_t
+index_html_start[] asm("_binary_resources_index_html_start");
+
+extern const uint8_t
+index_html_end[] asm("_binary_resources_index_html_end");
+
+extern const uint8_t
+index_html_gz_start[] asm("_binary_resources_index_html_gz_start");
+
+extern const uint8_t
+index_html_gz_end[] asm("_binary_resources_index_html_gz_end");
+
+extern const uint8_t
+app_css_start[] asm("_binary_resources_app_css_start");
+
+extern const uint8_t
+app_css_end[] asm("_binary_resources_app_css_end");
+
+extern const uint8_t
+app_css_gz_start[] asm("_binary_resources_app_css_gz_start");
+
+extern const uint8_t
+app_css_gz_end[] asm("_binary_resources_app_css_gz_end");
+
+extern const uint8_t
+app_js_start[] asm("_binary_resources_app_js_start");
+
+extern const uint8_t
+app_js_end[] asm("_binary_resources_app_js_end");
+
+extern const uint8_t
+app_js_gz_start[] asm("_binary_resources_app_js_gz_start");
+
+extern const uint8_t
+app_js_gz_end[] asm("_binary_resources_app_js_gz_end");
+
+extern const uint8_t
+favicon_ico_start[] asm("_binary_resources_favicon_ico_start");
+
+extern const uint8_t
+favicon_ico_end[] asm("_binary_resources_favicon_ico_end");
+
+extern const uint8_t
+favicon_ico_gz_start[] asm("_binary_resources_favicon_ico_gz_start");
+
+extern const uint8_t
+favicon_ico_gz_end[] asm("_binary_resources_favicon_ico_gz_end");
+
+/**
+ * @brief   The static asset table.
+ */
+static const static_asset_t s_static_assets[] = {
+    {
+        .uri = "/jquery-3.3.1.min.js",
+        .type = "application/javascript",
+        .cache_control = STATIC_ASSETS_CACHE_IMMUTABLE,
+        .start = jquery_3_3_1_min_js_start,
+        .end = jquery_3_3_1_min_js_end,
+        .etag = STATIC_ASSET_ETAG_JQUERY_3_3_1_MIN_JS,
+        .gz_start = jquery_3_3_1_min_js_gz_start,
+        .gz_end = jquery_3_3_1_min_js_gz_end,
+        .gz_etag = STATIC_ASSET_ETAG_JQUERY_3_3_1_MIN_JS_GZ
+    },
+    {
+        .uri = "/index.html",
+        .type = "text/html",
+        .cache_control = STATIC_ASSETS_CACHE_REVALIDATE,
+        .start = index_html_start,
+        .end = index_html_end,
+        .etag = STATIC_ASSET_ETAG_INDEX_HTML,
+        .gz_start = index_html_gz_start,
+        .gz_end = index_html_gz_end,
+        .gz_etag = STATIC_ASSET_ETAG_INDEX_HTML_GZ
+    },
+    {
+        .uri = "/app.css",
+        .type = "text/css",
+        .cache_control = STATIC_ASSETS_CACHE_REVALIDATE,
+        .start = app_css_start,
+        .end = app_css_end,
+        .etag = STATIC_ASSET_ETAG_APP_CSS,
+        .gz_start = app_css_gz_start,
+        .gz_end = app_css_gz_end,
+        .gz_etag = STATIC_ASSET_ETAG_APP_CSS_GZ
+    },
+    {
+        .uri = "/app.js",
+        .type = "application/javascript",
+        .cache_control = STATIC_ASSETS_CACHE_REVALIDATE,
+        .start = app_js_start,
+        .end = app_js_end,
+        .etag = STATIC_ASSET_ETAG_APP_JS,
+        .gz_start = app_js_gz_start,
+        .gz_end = app_js_gz_end,
+        .gz_etag = STATIC_ASSET_ETAG_APP_JS_GZ
+    },
+    {
+        .uri = "/favicon.ico",
+        .type = "image/x-icon",
+        .cache_control = STATIC_ASSETS_CACHE_ONE_DAY,
+        .start = favicon_ico_start,
+        .end = favicon_ico_end,
+        .etag = STATIC_ASSET_ETAG_FAVICON_ICO,
+        .gz_start = favicon_ico_gz_start,
+        .gz_end = favicon_ico_gz_end,
+        .gz_etag = STATIC_ASSET_ETAG_FAVICON_ICO_GZ
+    }
+};
+
+#define STATIC_ASSETS_COUNT \
+    (sizeof(s_static_assets) / sizeof(s_static_assets[0]))
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   GET/HEAD handler shared by every entry of the asset table, the
+ *          entry is passed through `user_ctx`. HEAD gets the status and
+ *          headers a GET would, Content-Length included.
+ *
+ * @param req - HTTP request.
+ * @return esp_err_t - ESP_OK, otherwise the error from httpd_resp_send().
+ */
+static esp_err_t static_assets_handler(httpd_req_t *req);
+
+/**
+ * @brief   Checks the Accept-Encoding header of the request with
+ *          static_assets_gzip_accepted().
+ *
+ * @param req - HTTP request.
+ * @return  true if the gzip-compressed variant may be sent.
+ */
+static bool static_assets_accepts_gzip(httpd_req_t *req);
+
+/**
+ * @brief   Checks an If-None-Match / If-Range style entity-tag list against
+ *          the ETag of the selected variant.
+ *
+ * @param list      - Header value, `*` or a comma separated list of tags.
+ * @param etag      - Quoted strong ETag of the variant.
+ * @param weak_ok   - Whether `W/` tags may match (If-None-Match uses the weak
+ *                    comparison, If-Range the strong one).
+ * @return  true if one of the tags matches.
+ */
+static bool static_assets_etag_matches(const char *list,
+                                        const char *etag,
+                                        bool weak_ok);
+
+/**
+ * @brief   Parses a single `bytes=` range against a body of `size` bytes.
+ *
+ * @param value     - Range header value.
+ * @param size      - Size of the selected variant.
+ * @param first_p   - First byte offset of the range (inclusive).
+ * @param last_p    - Last byte offset of the range (inclusive).
+ * @return  ESP_OK if the range is satisfiable, ESP_ERR_INVALID_SIZE if it is
+ *          not, ESP_ERR_NOT_SUPPORTED if the header should be ignored
+ *          (malformed, other unit or multiple ranges).
+ */
+static esp_err_t static_assets_parse_range(const char *value,
+                                            size_t size,
+                                            size_t *first_p,
+                                            size_t *last_p);
+
+/**
+ * @brief   Reads a request header into `buffer`.
+ * @note    Truncated values are treated as absent, acting on a cut-off
+ *          range or tag list could select the wrong bytes.
+ *
+ * @return  true if the header is present and fits in `buffer`.
+ */
+static bool static_assets_get_hdr(httpd_req_t *req,
+                                    const char *field,
+                                    char *buffer,
+                                    size_t size);
+
+/**
+ * @brief   Writes the head of a HEAD response raw. httpd_resp_send() frames
+ *          a response with the length of the buffer it sends, which would
+ *          give Content-Length: 0.
+ *
+ * @param req           - HTTP request, its other headers already set.
+ * @param status        - Status line, e.g. "200 OK".
+ * @param asset         - Asset the GET would send.
+ * @param gzip          - Whether it is the gzip variant.
+ * @param content_range - Content-Range value, NULL for a full body.
+ * @param length        - Length of the body a GET would send.
+ * @return  ESP_OK, otherwise ESP_ERR_HTTPD_RESP_SEND.
+ */
+static esp_err_t static_assets_send_head(httpd_req_t *req,
+                                            const char *status,
+                                            const static_asset_t *asset,
+                                            bool gzip,
+                                            const char *content_range,
+                                            size_t length);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t static_assets_register(httpd_handle_t server)
+{
+    for (size_t i = 0; i < STATIC_ASSETS_COUNT; i++) {
+        httpd_uri_t asset_get = {
+            .uri = s_static_assets[i].uri,
+            .method = HTTP_GET,
+            .handler = static_assets_handler,
+            .user_ctx = (void *)&s_static_assets[i]
+        };
+
+        httpd_uri_t asset_head = asset_get;
+        asset_head.method = HTTP_HEAD;
+
+        esp_err_t err = metrics_register_uri_handler(server, &asset_get);
+        if (err == ESP_OK) {
+            err = metrics_register_uri_handler(server, &asset_head);
+        }
+
+        if (err != ESP_OK) {
+            DLOGE(TAG, "Failed to register %s: %s",
+                        s_static_assets[i].uri, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
+
+size_t static_assets_handler_count(void)
+{
+    return STATIC_ASSETS_COUNT * 2;
+}
+
+bool static_assets_gzip_accepted(const char *accept_encoding)
+{
+    int gzip = -1;                      /* -1 unlisted, 0 refused, 1 ok. */
+    int any = -1;
+    const char *entry = accept_encoding;
+
+    /* 1. Every `coding[;param]...` entry of the list. */
+    while (*entry != '\0') {
+        const size_t len = strcspn(entry, ",");
+        const char *end = entry + len;
+
+        while (entry < end && (*entry == ' ' || *entry == '\t')) {
+            entry++;
+        }
+        const size_t name_len = strcspn(entry, " \t;,");
+
+        /* 2. q=1 unless a `q` parameter says otherwise, `q=0`, `q=0.0`,
+         * ... refuse the coding. */
+        int accepted = 1;
+        for (const char *param = (const char *)memchr(entry, ';',
+                                                        end - entry);
+             param != NULL;
+             param = (const char *)memchr(param + 1, ';', end - param - 1)) {
+            const char *name = param + 1;
+            while (name < end && (*name == ' ' || *name == '\t')) {
+                name++;
+            }
+            if (end - name >= 2 && (name[0] == 'q' || name[0] == 'Q')
+                && name[1] == '=') {
+                accepted = (strtod(name + 2, NULL) > 0) ? 1 : 0;
+            }
+        }
+
+        if (name_len == 4 && strncasecmp(entry, "gzip", 4) == 0) {
+            gzip = accepted;
+        } else if (name_len == 1 && entry[0] == '*') {
+            any = accepted;
+        }
+
+        entry = (*end == ',') ? end + 1 : end;
+    }
+
+    /* 3. An explicit gzip entry wins over the wildcard. */
+    return (gzip >= 0) ? (gzip == 1) : (any == 1);
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t static_assets_handler(httpd_req_t *req)
+{
+    const static_asset_t *asset = (const static_asset_t *)req->user_ctx;
+    char hdr_value[STATIC_ASSETS_HDR_VALUE_MAX_LEN];
+    char content_range[48];
+
+    DLOGI(TAG, "%s is requested.", asset->uri);
+
+    /* 1. Select the representation: gzip variant when accepted. */
+    const bool gzip = static_assets_accepts_gzip(req);
+    const uint8_t *body_p = gzip ? asset->gz_start : asset->start;
+    const size_t size = gzip ? asset->gz_end - asset->gz_start
+                             : asset->end - asset->start;
+    const char *etag = gzip ? asset->gz_etag : asset->etag;
+
+    /* 2. Headers common to 200, 206 and 304 responses. */
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+
+    /* 3. Conditional request: the client already has this variant. */
+    if (static_assets_get_hdr(req, "If-None-Match",
+                                hdr_value, sizeof(hdr_value))
+        && static_assets_etag_matches(hdr_value, etag, true)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+
+    /* 4. Byte range, only honoured while If-Range (if any) still matches. */
+    size_t first = 0;
+    size_t last = size - 1;
+    bool partial = false;
+
+    if (static_assets_get_hdr(req, "Range", hdr_value, sizeof(hdr_value))) {
+        char if_range[STATIC_ASSETS_HDR_VALUE_MAX_LEN];
+        bool range_valid = !static_assets_get_hdr(req, "If-Range",
+                                                    if_range,
+                                                    sizeof(if_range))
+                            || static_assets_etag_matches(if_range,
+                                                            etag,
+                                                            false);
+
+        esp_err_t err = range_valid
+                        ? static_assets_parse_range(hdr_value, size,
+                                                    &first, &last)
+                        : ESP_ERR_NOT_SUPPORTED;
+
+        if (err == ESP_ERR_INVALID_SIZE) {
+            snprintf(content_range, sizeof(content_range),
+                        "bytes */%u", (unsigned)size);
+            httpd_resp_set_hdr(req, "Content-Range", content_range);
+            httpd_resp_set_status(req, "416 Range Not Satisfiable");
+            return httpd_resp_send(req, NULL, 0);
+        }
+
+        if (err == ESP_OK) {
+            partial = true;
+        } else {
+            first = 0;
+            last = size - 1;
+        }
+    }
+
+    if (partial) {
+        snprintf(content_range, sizeof(content_range), "bytes %u-%u/%u",
+                    (unsigned)first, (unsigned)last, (unsigned)size);
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+        httpd_resp_set_status(req, "206 Partial Content");
+    }
+
+    /* 5. HEAD only gets the headers, with the length of the body. */
+    if (req->method == HTTP_HEAD) {
+        return static_assets_send_head(req,
+                                        partial ? "206 Partial Content"
+                                                : "200 OK",
+                                        asset, gzip,
+                                        partial ? content_range : NULL,
+                                        last - first + 1);
+    }
+
+    return httpd_resp_send(req,
+                            (const char *)body_p + first,
+                            last - first + 1);
+}
+
+static esp_err_t static_assets_send_head(httpd_req_t *req,
+                                            const char *status,
+                                            const static_asset_t *asset,
+                                            bool gzip,
+                                            const char *content_range,
+                                            size_t length)
+{
+    char head[STATIC_ASSETS_HEAD_MAX_LEN];
+
+    /* The headers of step 2, in the order httpd would send them. */
+    int len = snprintf(head, sizeof(head),
+                        "HTTP/1.1 %s\r\n"
+                        "Content-Type: %s\r\n"
+                        "Content-Length: %u\r\n"
+                        "Vary: Accept-Encoding\r\n"
+                        "Cache-Control: %s\r\n"
+                        "ETag: %s\r\n"
+                        "%s"
+                        "Accept-Ranges: bytes\r\n",
+                        status, asset->type, (unsigned)length,
+                        asset->cache_control,
+                        gzip ? asset->gz_etag : asset->etag,
+                        gzip ? "Content-Encoding: gzip\r\n" : "");
+    if (content_range != NULL && len > 0 && (size_t)len < sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len,
+                        "Content-Range: %s\r\n", content_range);
+    }
+    if (len > 0 && (size_t)len < sizeof(head) - 2) {
+        memcpy(head + len, "\r\n", 2);
+        len += 2;
+    } else {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    return (httpd_send(req, head, len) == len) ? ESP_OK
+                                                : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+static bool static_assets_accepts_gzip(httpd_req_t *req)
+{
+    char accept_encoding[STATIC_ASSETS_HDR_VALUE_MAX_LEN];
+
+    /* A truncated header still carries its leading codings. */
+    esp_err_t err = httpd_req_get_hdr_value_str(req,
+                                                "Accept-Encoding",
+                                                accept_encoding,
+                                                sizeof(accept_encoding));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+
+    /* The last entry of a truncated header may have lost its q-value. */
+    if (err == ESP_ERR_HTTPD_RESULT_TRUNC) {
+        char *last_p = strrchr(accept_encoding, ',');
+        if (last_p == NULL) {
+            return false;
+        }
+        *last_p = '\0';
+    }
+
+    return static_assets_gzip_accepted(accept_encoding);
+}
+
+static bool static_assets_etag_matches(const char *list,
+                                        const char *etag,
+                                        bool weak_ok)
+{
+    const size_t etag_len = strlen(etag);
+    const char *tag_p = list;
+
+    while (*tag_p != '\0') {
+        tag_p += strspn(tag_p, " \t,");
+
+        if (*tag_p == '*') {
+            return true;
+        }
+
+        bool weak = (strncmp(tag_p, "W/", 2) == 0);
+        if (weak) {
+            tag_p += 2;
+        }
+
+        size_t tag_len = strcspn(tag_p, " \t,");
+        if ((!weak || weak_ok)
+            && tag_len == etag_len
+            && strncmp(tag_p, etag, etag_len) == 0) {
+            return true;
+        }
+
+        tag_p += tag_len;
+    }
+
+    return false;
+}
+
+static esp_err_t static_assets_parse_range(const char *value,
+                                            size_t size,
+                                            size_t *first_p,
+                                            size_t *last_p)
+{
+    char *end_p = NULL;
+
+    if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    value += 6;
+
+    if (*value == '-') {
+        /* Suffix range: the last N bytes. */
+        unsigned long suffix = strtoul(value + 1, &end_p, 10);
+        if (end_p == value + 1 || *end_p != '\0') {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (suffix == 0 || size == 0) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        *first_p = (suffix < size) ? size - suffix : 0;
+        *last_p = size - 1;
+        return ESP_OK;
+    }
+
+    unsigned long first = strtoul(value, &end_p, 10);
+    if (end_p == value || *end_p != '-') {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    value = end_p + 1;
+    unsigned long last = size - 1;
+    if (*value != '\0') {
+        last = strtoul(value, &end_p, 10);
+        if (end_p == value || *end_p != '\0' || last < first) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
+    if (first >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    *first_p = first;
+    *last_p = (last < size) ? last : size - 1;
+    return ESP_OK;
+}
+
+static bool static_assets_get_hdr(httpd_req_t *req,
+                                    const char *field,
+                                    char *buffer,
+                                    size_t size)
+{
+    return httpd_req_get_hdr_value_str(req, field, buffer, size) == ESP_OK;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <esp_http_server.h>
+
+/**
+ * @brief   Maximum length of a request header value inspected by the static
+ *          asset handler (Accept-Encoding, If-None-Match, Range, If-Range).
+ *          Longer values are truncated.
+ */
+#define STATIC_ASSETS_HDR_VALUE_MAX_LEN     128
+
+/**
+ * @brief   Cache policies.
+ * @note    Files whose URI does not change with their content must be
+ *          revalidated on every use (a cheap 304 thanks to the ETag), only
+ *          versioned file names can be cached as immutable.
+ */
+#define STATIC_ASSETS_CACHE_REVALIDATE      "no-cache"
+#define STATIC_ASSETS_CACHE_ONE_DAY         "public, max-age=86400"
+#define STATIC_ASSETS_CACHE_IMMUTABLE       "public, max-age=31536000, immutable"
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   One embedded file served by the static asset handler.
+ * @note    `etag`/`gz_etag` are strong validators of the raw and gzip
+ *          variants, computed at build time by scripts/embed_assets.py.
+ */
+typedef struct {
+    const char *uri;
+    const char *type;
+    const char *cache_control;
+    const uint8_t *start;
+    const uint8_t *end;
+    const char *etag;
+    const uint8_t *gz_start;
+    const uint8_t *gz_end;
+    const char *gz_etag;
+} static_asset_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Registers GET and HEAD handlers for every embedded file.
+ *
+ * @param   server  - HTTP server instance handle.
+ * @return  ESP_OK, otherwise the first error of
+ *          metrics_register_uri_handler().
+ */
+esp_err_t static_assets_register(httpd_handle_t server);
+
+/**
+ * @brief   Number of URI handlers static_assets_register() registers.
+ */
+size_t static_assets_handler_count(void);
+
+/**
+ * @brief   Checks an Accept-Encoding value for the gzip content coding:
+ *          decided by a `gzip` entry if there is one, otherwise by `*`, a
+ *          `q=0` refusing it. Neither listed refuses it.
+ *
+ * @param   accept_encoding - Header value, comma separated
+ *                            `coding[;q=value]` entries.
+ * @return  true if the gzip-compressed variant may be sent.
+ */
+bool static_assets_gzip_accepted(const char *accept_encoding);
@@ -0,0 +1,524 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "http_server.hpp"
+#include "json_writer.hpp"
+#include "task_placement.hpp"
+
+#define TASK_PLACEMENT_NVS_ANY          0xFF    /* No affinity, as a u8. */
+#define TASK_PLACEMENT_WAKEUP_DEFAULT   200
+#define TASK_PLACEMENT_RESTART_DELAY_US 500000  /* The answer goes first. */
+#define TASK_PLACEMENT_QUERY_MAX_LEN    192
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   A benchmark run, on the stack of the caller until both probe
+ *          tasks gave `done`.
+ */
+typedef struct {
+    QueueHandle_t queue;                /* esp_timer_get_time() stamps. */
+    SemaphoreHandle_t done;
+    TaskHandle_t feeder;
+    uint32_t count;
+    uint32_t *latencies_us;
+} task_placement_bench_t;
+
+JSON_KEY(wifi_app);
+JSON_KEY(http_server);
+JSON_KEY(http_monitor);
+JSON_KEY(http_worker);
+JSON_KEY(history_store);
+JSON_KEY(mqtt_publisher);
+JSON_KEY(ota_writer);
+JSON_KEY(ota_client);
+JSON_KEY(dht_sensor);
+JSON_KEY(task);
+JSON_KEY(core);
+JSON_KEY(priority);
+JSON_KEY(count);
+JSON_KEY(min_us);
+JSON_KEY(p50_us);
+JSON_KEY(p99_us);
+JSON_KEY(max_us);
+
+/**
+ * @brief   /placement, the core of each task, -1 for any.
+ */
+typedef json_object<
+    json_field<json_key_wifi_app, json_int<int>>,
+    json_field<json_key_http_server, json_int<int>>,
+    json_field<json_key_http_monitor, json_int<int>>,
+    json_field<json_key_http_worker, json_int<int>>,
+    json_field<json_key_history_store, json_int<int>>,
+    json_field<json_key_mqtt_publisher, json_int<int>>,
+    json_field<json_key_ota_writer, json_int<int>>,
+    json_field<json_key_ota_client, json_int<int>>,
+    json_field<json_key_dht_sensor, json_int<int>>
+> task_placement_json_t;
+
+typedef json_object<
+    json_field<json_key_task, json_string<15>>,
+    json_field<json_key_core, json_int<int>>,
+    json_field<json_key_priority, json_int<uint32_t>>,
+    json_field<json_key_count, json_int<uint32_t>>,
+    json_field<json_key_min_us, json_int<uint32_t>>,
+    json_field<json_key_p50_us, json_int<uint32_t>>,
+    json_field<json_key_p99_us, json_int<uint32_t>>,
+    json_field<json_key_max_us, json_int<uint32_t>>
+> task_placement_wakeup_json_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "task_placement";
+
+/**
+ * @brief   Also the NVS keys, at most 15 characters.
+ */
+static const char *const s_task_placement_names[TASK_PLACEMENT_MAX] = {
+    "wifi_app",
+    "http_server",
+    "http_monitor",
+    "http_worker",
+    "history_store",
+    "mqtt_publisher",
+    "ota_writer",
+    "ota_client",
+    "dht_sensor"
+};
+
+static const UBaseType_t s_task_placement_priorities[TASK_PLACEMENT_MAX] = {
+    WIFI_APP_TASK_PRIORITY,
+    HTTP_SERVER_TASK_PRIORITY,
+    HTTP_SERVER_MONITOR_PRIORITY,
+    HTTP_WORKER_TASK_PRIORITY,
+    HISTORY_STORE_TASK_PRIORITY,
+    MQTT_PUBLISHER_TASK_PRIORITY,
+    OTA_WRITER_TASK_PRIORITY,
+    OTA_CLIENT_TASK_PRIORITY,
+    DHT_SENSOR_TASK_PRIORITY
+};
+
+/**
+ * @brief   The build's placement until task_placement_init().
+ */
+static BaseType_t s_task_placement_cores[TASK_PLACEMENT_MAX] = {
+    WIFI_APP_TASK_CORE_ID,
+    HTTP_SERVER_TASK_CORE_ID,
+    HTTP_SERVER_MONITOR_CORE_ID,
+    HTTP_WORKER_TASK_CORE_ID,
+    HISTORY_STORE_TASK_CORE_ID,
+    MQTT_PUBLISHER_TASK_CORE_ID,
+    OTA_WRITER_TASK_CORE_ID,
+    OTA_CLIENT_TASK_CORE_ID,
+    DHT_SENSOR_TASK_CORE_ID
+};
+
+static std::atomic<bool> s_bench_running(false);
+static esp_timer_handle_t s_restart_timer = NULL;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Parses a core, 0 to portNUM_PROCESSORS - 1 or -1 for any.
+ *
+ * @return  false if it is none of them.
+ */
+static bool task_placement_parse_core(const char *text, BaseType_t *core);
+
+static void task_placement_save(void);
+
+/**
+ * @brief   Probe task where the WiFi stack runs: stamps and queues, then
+ *          waits for the receiver before the next tick.
+ */
+static void task_placement_feeder_task(void *param);
+
+/**
+ * @brief   Probe task with the placement under test: how long after its
+ *          stamp each item woke it up.
+ */
+static void task_placement_receiver_task(void *param);
+
+static int task_placement_compare(const void *a, const void *b);
+
+/**
+ * @brief   -1 for tskNO_AFFINITY, as shown and parsed.
+ */
+static int task_placement_shown(BaseType_t core);
+
+/* Public function definition ------------------------------------------------*/
+esp_err_t task_placement_init(void)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(TASK_PLACEMENT_NVS_NAMESPACE, NVS_READONLY,
+                                &handle);
+    if (err == ESP_OK) {
+        for (size_t i = 0; i < TASK_PLACEMENT_MAX; i++) {
+            uint8_t core;
+
+            if (nvs_get_u8(handle, s_task_placement_names[i], &core)
+                != ESP_OK) {
+                continue;
+            }
+            if (core == TASK_PLACEMENT_NVS_ANY) {
+                s_task_placement_cores[i] = tskNO_AFFINITY;
+            } else if (core < portNUM_PROCESSORS) {
+                s_task_placement_cores[i] = core;
+            }
+        }
+        nvs_close(handle);
+    }
+
+    DLOGI(TAG, "wifi_app %d, httpd %d, monitor %d, workers %d, history %d, "
+                    "mqtt %d, ota %d/%d, dht %d.",
+                task_placement_shown(s_task_placement_cores[0]),
+                task_placement_shown(s_task_placement_cores[1]),
+                task_placement_shown(s_task_placement_cores[2]),
+                task_placement_shown(s_task_placement_cores[3]),
+                task_placement_shown(s_task_placement_cores[4]),
+                task_placement_shown(s_task_placement_cores[5]),
+                task_placement_shown(s_task_placement_cores[6]),
+                task_placement_shown(s_task_placement_cores[7]),
+                task_placement_shown(s_task_placement_cores[8]));
+
+    /* No saved placement yet is the usual case. */
+    return (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+}
+
+BaseType_t task_placement_core(task_placement_e task)
+{
+    return s_task_placement_cores[task];
+}
+
+UBaseType_t task_placement_priority(task_placement_e task)
+{
+    return s_task_placement_priorities[task];
+}
+
+const char *task_placement_name(task_placement_e task)
+{
+    return s_task_placement_names[task];
+}
+
+esp_err_t task_placement_set_query(const char *query, bool save)
+{
+    BaseType_t cores[TASK_PLACEMENT_MAX];
+
+    /* 1. Every core is checked before any is set. */
+    memcpy(cores, s_task_placement_cores, sizeof(cores));
+    for (size_t i = 0; i < TASK_PLACEMENT_MAX; i++) {
+        char value[4];
+
+        if (httpd_query_key_value(query, s_task_placement_names[i],
+                                    value, sizeof(value)) != ESP_OK) {
+            continue;
+        }
+        if (!task_placement_parse_core(value, &cores[i])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    /* 2. Read by tasks being created, a word each. */
+    memcpy(s_task_placement_cores, cores, sizeof(cores));
+    if (save) {
+        task_placement_save();
+    }
+    return ESP_OK;
+}
+
+esp_err_t task_placement_wakeup_bench(task_placement_e task, uint32_t count,
+                                        task_placement_wakeup_t *result)
+{
+    task_placement_bench_t bench;
+    TaskHandle_t receiver = NULL;
+    esp_err_t err = ESP_OK;
+
+    if (count == 0 || count > TASK_PLACEMENT_WAKEUP_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_bench_running.exchange(true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* 1. One item in flight at a time, the feeder waits for each. */
+    bench.queue = xQueueCreate(1, sizeof(int64_t));
+    bench.done = xSemaphoreCreateCounting(2, 0);
+    bench.feeder = NULL;
+    bench.count = count;
+    bench.latencies_us = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (bench.queue == NULL || bench.done == NULL
+        || bench.latencies_us == NULL) {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    /* 2. The receiver waits on the queue first, as the task it stands for
+     * waits on its socket or event ring. */
+    if (err == ESP_OK
+        && xTaskCreatePinnedToCore(&task_placement_receiver_task,
+                                    "placement_rx",
+                                    TASK_PLACEMENT_PROBE_STACK_SIZE,
+                                    &bench,
+                                    task_placement_priority(task),
+                                    &receiver,
+                                    task_placement_core(task)) != pdPASS) {
+        err = ESP_FAIL;
+    }
+    if (err == ESP_OK
+        && xTaskCreatePinnedToCore(&task_placement_feeder_task,
+                                    "placement_tx",
+                                    TASK_PLACEMENT_PROBE_STACK_SIZE,
+                                    &bench,
+                                    TASK_PLACEMENT_PROBE_PRIORITY,
+                                    &bench.feeder,
+                                    TASK_PLACEMENT_PROBE_CORE_ID) != pdPASS) {
+        vTaskDelete(receiver);
+        err = ESP_FAIL;
+    }
+
+    if (err == ESP_OK) {
+        xSemaphoreTake(bench.done, portMAX_DELAY);
+        xSemaphoreTake(bench.done, portMAX_DELAY);
+
+        /* 3. Quantiles of the sorted latencies. */
+        qsort(bench.latencies_us, count, sizeof(uint32_t),
+                task_placement_compare);
+        result->count = count;
+        result->min_us = bench.latencies_us[0];
+        result->p50_us = bench.latencies_us[count / 2];
+        result->p99_us = bench.latencies_us[(count * 99) / 100];
+        result->max_us = bench.latencies_us[count - 1];
+
+        DLOGI(TAG, "Wake-up of %s on core %d: min %u, p50 %u, p99 %u, "
+                        "max %u us over %u.",
+                    s_task_placement_names[task],
+                    task_placement_shown(task_placement_core(task)),
+                    (unsigned)result->min_us, (unsigned)result->p50_us,
+                    (unsigned)result->p99_us, (unsigned)result->max_us,
+                    (unsigned)count);
+    } else {
+        DLOGE(TAG, "Could not start the wake-up probes: %s",
+                    esp_err_to_name(err));
+    }
+
+    /* 4. Both probes are gone by now. */
+    free(bench.latencies_us);
+    if (bench.done != NULL) {
+        vSemaphoreDelete(bench.done);
+    }
+    if (bench.queue != NULL) {
+        vQueueDelete(bench.queue);
+    }
+    s_bench_running.store(false);
+    return err;
+}
+
+esp_err_t task_placement_handler(httpd_req_t *req)
+{
+    char query[TASK_PLACEMENT_QUERY_MAX_LEN];
+    char value[4];
+    char json[task_placement_json_t::max_size + 1];
+    int cores[TASK_PLACEMENT_MAX];
+
+    /* 1. POST sets and saves the cores of its query. */
+    if (req->method == HTTP_POST) {
+        if (httpd_req_get_url_query_str(req, query, sizeof(query))
+            != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                        "No placement");
+        }
+        if (task_placement_set_query(query, true) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                        "Cores are 0, 1 or -1");
+        }
+        DLOGI(TAG, "Placement saved: %s", query);
+
+        /* The tasks are pinned when created, a restart applies it. */
+        if (httpd_query_key_value(query, "restart", value, sizeof(value))
+                == ESP_OK
+            && strcmp(value, "1") == 0 && s_restart_timer == NULL) {
+            const esp_timer_create_args_t timer_args = {
+                .callback = &http_server_fw_update_reset_callback,
+                .arg = NULL,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "placement_restart"
+            };
+
+            if (esp_timer_create(&timer_args, &s_restart_timer) == ESP_OK) {
+                esp_timer_start_once(s_restart_timer,
+                                        TASK_PLACEMENT_RESTART_DELAY_US);
+            }
+        }
+    }
+
+    /* 2. The cores tasks are created with from now on. */
+    for (size_t i = 0; i < TASK_PLACEMENT_MAX; i++) {
+        cores[i] = task_placement_shown(s_task_placement_cores[i]);
+    }
+    const size_t len = json_write<task_placement_json_t>(json,
+                                    cores[0], cores[1], cores[2], cores[3],
+                                    cores[4], cores[5], cores[6], cores[7],
+                                    cores[8]);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+esp_err_t task_placement_wakeup_handler(httpd_req_t *req)
+{
+    char query[TASK_PLACEMENT_QUERY_MAX_LEN];
+    char value[16];
+    char json[task_placement_wakeup_json_t::max_size + 1];
+    size_t task = TASK_PLACEMENT_MAX;
+    uint32_t count = TASK_PLACEMENT_WAKEUP_DEFAULT;
+    task_placement_wakeup_t result;
+
+    /* 1. The task whose placement is timed, and how many times. */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "task", value, sizeof(value))
+            == ESP_OK) {
+            for (task = 0; task < TASK_PLACEMENT_MAX; task++) {
+                if (strcmp(value, s_task_placement_names[task]) == 0) {
+                    break;
+                }
+            }
+        }
+        if (httpd_query_key_value(query, "count", value, sizeof(value))
+            == ESP_OK) {
+            count = strtoul(value, NULL, 10);
+        }
+    }
+    if (task == TASK_PLACEMENT_MAX) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                    "Unknown task");
+    }
+
+    /* 2. Blocks this task for the run, one at a time. */
+    esp_err_t err = task_placement_wakeup_bench((task_placement_e)task,
+                                                count, &result);
+    if (err == ESP_ERR_INVALID_ARG) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                    "Count out of range");
+    } else if (err != ESP_OK) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    const size_t len = json_write<task_placement_wakeup_json_t>(json,
+                            s_task_placement_names[task],
+                            task_placement_shown(s_task_placement_cores[task]),
+                            (uint32_t)s_task_placement_priorities[task],
+                            result.count, result.min_us, result.p50_us,
+                            result.p99_us, result.max_us);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+/* Private function definition -----------------------------------------------*/
+static bool task_placement_parse_core(const char *text, BaseType_t *core)
+{
+    char *end;
+    const long value = strtol(text, &end, 10);
+
+    if (end == text || *end != '\0') {
+        return false;
+    }
+    if (value == TASK_PLACEMENT_NO_AFFINITY) {
+        *core = tskNO_AFFINITY;
+        return true;
+    }
+    if (value >= 0 && value < portNUM_PROCESSORS) {
+        *core = value;
+        return true;
+    }
+    return false;
+}
+
+static void task_placement_save(void)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(TASK_PLACEMENT_NVS_NAMESPACE, NVS_READWRITE, &handle)
+        != ESP_OK) {
+        DLOGE(TAG, "Could not save the placement.");
+        return;
+    }
+    for (size_t i = 0; i < TASK_PLACEMENT_MAX; i++) {
+        const BaseType_t core = s_task_placement_cores[i];
+
+        nvs_set_u8(handle, s_task_placement_names[i],
+                    (core == tskNO_AFFINITY) ? TASK_PLACEMENT_NVS_ANY
+                                                : (uint8_t)core);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void task_placement_feeder_task(void *param)
+{
+    task_placement_bench_t *bench = (task_placement_bench_t *)param;
+
+    for (uint32_t i = 0; i < bench->count; i++) {
+        /* A tick apart, the receiver's core has gone idle or on to other
+         * work in between, as between two packets. */
+        vTaskDelay(1);
+
+        const int64_t stamp_us = esp_timer_get_time();
+        xQueueSend(bench->queue, &stamp_us, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(bench->done);
+    vTaskDelete(NULL);
+}
+
+static void task_placement_receiver_task(void *param)
+{
+    task_placement_bench_t *bench = (task_placement_bench_t *)param;
+
+    for (uint32_t i = 0; i < bench->count; i++) {
+        int64_t stamp_us;
+
+        xQueueReceive(bench->queue, &stamp_us, portMAX_DELAY);
+        bench->latencies_us[i] = (uint32_t)(esp_timer_get_time() - stamp_us);
+        xTaskNotifyGive(bench->feeder);
+    }
+
+    xSemaphoreGive(bench->done);
+    vTaskDelete(NULL);
+}
+
+static int task_placement_compare(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int task_placement_shown(BaseType_t core)
+{
+    return (core == tskNO_AFFINITY) ? TASK_PLACEMENT_NO_AFFINITY : core;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief   Cores saved in NVS under TASK_PLACEMENT_NVS_NAMESPACE, one int8
+ *          key per task named as task_placement_name(), -1 for no
+ *          affinity.
+ */
+#define TASK_PLACEMENT_NVS_NAMESPACE    "placement"
+#define TASK_PLACEMENT_NO_AFFINITY      -1
+
+/**
+ * @brief   The wake-up benchmark times at most TASK_PLACEMENT_WAKEUP_MAX
+ *          hand-overs per run.
+ */
+#define TASK_PLACEMENT_WAKEUP_MAX       1000
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Application tasks placed by this layer. The dlog task starts
+ *          before NVS and keeps DLOG_TASK_CORE_ID.
+ */
+typedef enum {
+    TASK_PLACEMENT_WIFI_APP = 0,
+    TASK_PLACEMENT_HTTP_SERVER,
+    TASK_PLACEMENT_HTTP_MONITOR,
+    TASK_PLACEMENT_HTTP_WORKER,
+    TASK_PLACEMENT_HISTORY_STORE,
+    TASK_PLACEMENT_MQTT_PUBLISHER,
+    TASK_PLACEMENT_OTA_WRITER,
+    TASK_PLACEMENT_OTA_CLIENT,
+    TASK_PLACEMENT_DHT_SENSOR,
+    TASK_PLACEMENT_MAX
+} task_placement_e;
+
+/**
+ * @brief   Wake-up latencies of one benchmark run, in microseconds.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} task_placement_wakeup_t;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Takes the cores saved in NVS over the *_TASK_CORE_ID defaults of
+ *          config.hpp. Called after nvs_flash_init(), before the tasks are
+ *          created.
+ */
+esp_err_t task_placement_init(void);
+
+/**
+ * @brief   Core to create a task on, tskNO_AFFINITY if it may run on any.
+ */
+BaseType_t task_placement_core(task_placement_e task);
+UBaseType_t task_placement_priority(task_placement_e task);
+const char *task_placement_name(task_placement_e task);
+
+/**
+ * @brief   Sets the cores of the tasks named in a URL query, e.g.
+ *          "http_server=1&wifi_app=0". Tasks created from now on use them,
+ *          running ones keep theirs until the next boot.
+ *
+ * @param   query   - Cores 0, 1 or -1, other keys are ignored.
+ * @param   save    - Whether to keep them in NVS for the next boots.
+ * @return  ESP_ERR_INVALID_ARG on a bad core, nothing is set then.
+ */
+esp_err_t task_placement_set_query(const char *query, bool save);
+
+/**
+ * @brief   Times the wake-up of a task of `task`'s core and priority by a
+ *          queue, `count` times, fed by a task where the WiFi and LwIP
+ *          tasks run (TASK_PLACEMENT_PROBE_CORE_ID). Blocks the caller for
+ *          about a tick per hand-over.
+ */
+esp_err_t task_placement_wakeup_bench(task_placement_e task, uint32_t count,
+                                        task_placement_wakeup_t *result);
+
+/**
+ * @brief   GET /placement handler, the core of every task as JSON.
+ *          POST /placement?<task>=<core>[&restart=1] saves cores in NVS,
+ *          applied at the next boot, now with `restart=1`.
+ */
+esp_err_t task_placement_handler(httpd_req_t *req);
+
+/**
+ * @brief   GET /placement/wakeup?task=<task>[&count=<n>] handler, runs
+ *          task_placement_wakeup_bench(), 200 hand-overs by default, and
+ *          answers its latencies as JSON.
+ */
+esp_err_t task_placement_wakeup_handler(httpd_req_t *req);
@@ -0,0 +1,420 @@
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <tuple>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_cpu.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_private/esp_clk.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "dlog.hpp"
+#include "json_writer.hpp"
+#include "trace.hpp"
+
+#if TRACE_ENABLED
+
+#define TRACE_NAME_MAX_LEN              32
+#define TRACE_TASK_NAME_MAX_LEN         16
+#define TRACE_CALIBRATION_COUNT         64
+#define TRACE_PID                       1
+
+/**
+ * @brief   The cycle counter slows down with the CPU and stops in light
+ *          sleep, events are then timed in microseconds by esp_timer.
+ */
+#define TRACE_CYCLE_CLOCK               (POWER_MIN_FREQ_MHZ                 \
+                                            == POWER_MAX_FREQ_MHZ           \
+                                            && !POWER_LIGHT_SLEEP)
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    const char *name;
+    uint32_t cycles;                    /* trace_clock(). */
+    uint32_t ticks;                     /* Tells the wraps of `cycles` apart. */
+    uint32_t arg;
+    uint8_t phase;                      /* trace_phase_e. */
+    uint8_t task;                       /* s_tasks index + 1. */
+} trace_event_t;
+
+typedef struct {
+    std::atomic<uint32_t> seq;          /* Position + 1 once written. */
+    trace_event_t event;
+} trace_slot_t;
+
+/**
+ * @brief   Cycle counter, tick count and esp_timer read together on a core,
+ *          which place its events in time.
+ */
+typedef struct {
+    uint32_t cycles;
+    uint32_t ticks;
+    int64_t us;
+} trace_anchor_t;
+
+typedef struct {
+    std::atomic<uint32_t> head;         /* Next position to claim. */
+    std::atomic<bool> anchored;
+    trace_anchor_t anchor;
+    trace_slot_t slots[TRACE_RING_SIZE];
+} trace_ring_t;
+
+typedef struct {
+    std::atomic<bool> named;
+    char name[TRACE_TASK_NAME_MAX_LEN];
+} trace_task_t;
+
+/**
+ * @brief   Nanoseconds written as microseconds with 3 decimals, the unit of
+ *          `ts`. json_fixed stops at 1e9, 16 minutes of uptime.
+ */
+struct trace_json_us {
+    static constexpr size_t max_size = json_int<uint64_t>::max_size + 4;
+
+    template <typename Sink>
+    static void write(Sink &sink, uint64_t ns)
+    {
+        char fraction[4];
+
+        fraction[0] = '.';
+        fraction[1] = '0' + ns / 100 % 10;
+        fraction[2] = '0' + ns / 10 % 10;
+        fraction[3] = '0' + ns % 10;
+        json_int<uint64_t>::write(sink, ns / 1000);
+        sink.put(fraction, sizeof(fraction));
+    }
+};
+
+JSON_KEY(traceEvents);
+JSON_KEY(displayTimeUnit);
+JSON_KEY(otherData);
+JSON_KEY(name);
+JSON_KEY(ph);
+JSON_KEY(ts);
+JSON_KEY(pid);
+JSON_KEY(tid);
+JSON_KEY(args);
+JSON_KEY(core);
+JSON_KEY(arg);
+JSON_KEY(cpu_mhz);
+JSON_KEY(record_cycles);
+JSON_KEY(overwritten);
+
+typedef json_object<
+    json_field<json_key_name, json_string<TRACE_NAME_MAX_LEN>>,
+    json_field<json_key_ph, json_string<1>>,
+    json_field<json_key_ts, trace_json_us>,
+    json_field<json_key_pid, json_int<uint8_t>>,
+    json_field<json_key_tid, json_int<uint8_t>>,
+    json_field<json_key_args, json_object<
+        json_field<json_key_core, json_int<uint8_t>>,
+        json_field<json_key_arg, json_int<uint32_t>>
+    >>
+> trace_event_json_t;
+
+typedef json_object<
+    json_field<json_key_name, json_string<TRACE_NAME_MAX_LEN>>,
+    json_field<json_key_ph, json_string<1>>,
+    json_field<json_key_pid, json_int<uint8_t>>,
+    json_field<json_key_tid, json_int<uint8_t>>,
+    json_field<json_key_args, json_object<
+        json_field<json_key_name, json_string<TRACE_TASK_NAME_MAX_LEN>>
+    >>
+> trace_meta_json_t;
+
+static constexpr size_t TRACE_JSON_MAX_LEN =
+                                    std::max(trace_event_json_t::max_size,
+                                                trace_meta_json_t::max_size);
+
+typedef json_object<
+    json_field<json_key_traceEvents,
+                json_stream<json_raw<TRACE_JSON_MAX_LEN>>>,
+    json_field<json_key_displayTimeUnit, json_string<2>>,
+    json_field<json_key_otherData, json_object<
+        json_field<json_key_cpu_mhz, json_int<uint32_t>>,
+        json_field<json_key_record_cycles, json_int<uint32_t>>,
+        json_field<json_key_overwritten, json_int<uint32_t>>
+    >>
+> trace_json_t;
+
+/**
+ * @brief   Where trace_send() is in its output: the task names, then the
+ *          events of each ring up to its head when the request came.
+ */
+typedef struct {
+    uint32_t task;
+    uint32_t core;
+    uint32_t pos;
+    uint32_t starts[portNUM_PROCESSORS];
+    uint32_t heads[portNUM_PROCESSORS];
+    uint32_t mhz;
+    char json[TRACE_JSON_MAX_LEN + 1];
+} trace_cursor_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/**
+ * @brief   Tag used for ESP serial console messages.
+ */
+static const char TAG[] = "trace";
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+static portMUX_TYPE s_anchor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief   Slots are claimed by the count, which goes past TRACE_MAX_TASKS,
+ *          and readable once named.
+ */
+static trace_task_t s_tasks[TRACE_MAX_TASKS];
+static std::atomic<uint32_t> s_task_count(0);
+
+static uint32_t s_record_cycles = 0;
+static uint32_t s_record_mhz = 0;       /* CPU frequency of the calibration. */
+
+/**
+ * @brief   Task id of the calling task, 0 until its first record.
+ */
+static thread_local uint8_t s_task = 0;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Clock of the events, the cycle counter or esp_timer cut to 32
+ *          bits.
+ */
+static inline uint32_t trace_clock(void);
+
+/**
+ * @brief   Anchors the ring of the current core, once.
+ */
+static void trace_anchor(trace_ring_t *ring);
+
+/**
+ * @brief   Names the calling task in the output.
+ *
+ * @return  Its id, TRACE_MAX_TASKS + 1 (unnamed) past TRACE_MAX_TASKS.
+ */
+static uint8_t trace_task_register(void);
+
+/**
+ * @brief   Time of an event since boot. The tick count tells which wrap of
+ *          the 32-bit clock it was recorded in, the clock, at `mhz`, gives
+ *          the time within it.
+ */
+static int64_t trace_time_ns(const trace_anchor_t *anchor,
+                                const trace_event_t *event, uint32_t mhz);
+
+/**
+ * @brief   Next element of the traceEvents array, empty at the end.
+ */
+static std::optional<const char *> trace_next(trace_cursor_t *cursor);
+
+/* Public function definition ------------------------------------------------*/
+void trace_init(void)
+{
+    /* 1. The first record anchors the core and names the task. */
+    trace_record("trace_init", TRACE_PHASE_INSTANT, 0);
+
+    /* 2. The cost of a record, the call and the counter read included. */
+    const uint32_t start = esp_cpu_get_ccount();
+    for (uint32_t i = 0; i < TRACE_CALIBRATION_COUNT; i++) {
+        trace_record("trace_init", TRACE_PHASE_INSTANT, i);
+    }
+    s_record_cycles = (esp_cpu_get_ccount() - start)
+                        / TRACE_CALIBRATION_COUNT;
+    s_record_mhz = esp_clk_cpu_freq() / 1000000;
+
+    /* 3. Emptied for the application, the anchors are kept. */
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        s_rings[core].head.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < TRACE_RING_SIZE; i++) {
+            s_rings[core].slots[i].seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    DLOGI(TAG, "%u cycles per event, %u events per core.",
+                (unsigned)s_record_cycles, (unsigned)TRACE_RING_SIZE);
+}
+
+void trace_record(const char *name, trace_phase_e phase, uint32_t arg)
+{
+    trace_ring_t *ring = &s_rings[xPortGetCoreID()];
+    const uint32_t cycles = trace_clock();
+    const uint32_t ticks = xTaskGetTickCount();
+
+    if (!ring->anchored.load(std::memory_order_acquire)) {
+        trace_anchor(ring);
+    }
+    if (s_task == 0) {
+        s_task = trace_task_register();
+    }
+
+    const uint32_t pos = ring->head.fetch_add(1, std::memory_order_relaxed);
+    trace_slot_t *slot = &ring->slots[pos & (TRACE_RING_SIZE - 1)];
+
+    /* Invalid while written, a reader skips it. */
+    slot->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->event.name = name;
+    slot->event.cycles = cycles;
+    slot->event.ticks = ticks;
+    slot->event.arg = arg;
+    slot->event.phase = phase;
+    slot->event.task = s_task;
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+uint32_t trace_record_cycles(void)
+{
+    return s_record_cycles;
+}
+
+esp_err_t trace_send(httpd_req_t *req)
+{
+    trace_cursor_t cursor;
+    uint32_t overwritten = 0;
+
+    /* 1. Up to the events recorded by now. Those overwritten while sending
+     * are left out. */
+    memset(&cursor, 0, sizeof(cursor));
+    cursor.mhz = TRACE_CYCLE_CLOCK ? esp_clk_cpu_freq() / 1000000 : 1;
+    for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+        const uint32_t head = s_rings[core].head.load(
+                                                std::memory_order_acquire);
+
+        cursor.heads[core] = head;
+        cursor.starts[core] = (head > TRACE_RING_SIZE)
+                                ? head - TRACE_RING_SIZE : 0;
+        overwritten += cursor.starts[core];
+    }
+    cursor.pos = cursor.starts[0];
+
+    return json_send<trace_json_t>(req,
+                                [&cursor]() { return trace_next(&cursor); },
+                                "ns",
+                                std::make_tuple(s_record_mhz,
+                                                s_record_cycles,
+                                                overwritten));
+}
+
+/* Private function definition -----------------------------------------------*/
+static inline uint32_t trace_clock(void)
+{
+#if TRACE_CYCLE_CLOCK
+    return esp_cpu_get_ccount();
+#else
+    return (uint32_t)esp_timer_get_time();
+#endif
+}
+
+static void trace_anchor(trace_ring_t *ring)
+{
+    portENTER_CRITICAL(&s_anchor_lock);
+    if (!ring->anchored.load(std::memory_order_relaxed)) {
+        ring->anchor.cycles = trace_clock();
+        ring->anchor.ticks = xTaskGetTickCount();
+        ring->anchor.us = esp_timer_get_time();
+        ring->anchored.store(true, std::memory_order_release);
+    }
+    portEXIT_CRITICAL(&s_anchor_lock);
+}
+
+static uint8_t trace_task_register(void)
+{
+    const uint32_t index = s_task_count.fetch_add(1,
+                                                std::memory_order_relaxed);
+
+    if (index >= TRACE_MAX_TASKS) {
+        return TRACE_MAX_TASKS + 1;
+    }
+
+    strlcpy(s_tasks[index].name, pcTaskGetName(NULL),
+            sizeof(s_tasks[index].name));
+    s_tasks[index].named.store(true, std::memory_order_release);
+    return index + 1;
+}
+
+static int64_t trace_time_ns(const trace_anchor_t *anchor,
+                                const trace_event_t *event, uint32_t mhz)
+{
+    /* 1. Cycles since the anchor from the ticks, within two ticks. */
+    const int64_t estimate = (int64_t)(int32_t)(event->ticks - anchor->ticks)
+                                * portTICK_PERIOD_MS * 1000 * mhz;
+
+    /* 2. The count of the cycle counter nearest to it. */
+    const int64_t cycles = estimate
+                            + (int32_t)(event->cycles - anchor->cycles
+                                        - (uint32_t)estimate);
+
+    return MAX(anchor->us * 1000 + cycles * 1000 / mhz, 0);
+}
+
+static std::optional<const char *> trace_next(trace_cursor_t *cursor)
+{
+    const uint32_t tasks = MIN(s_task_count.load(std::memory_order_relaxed),
+                                TRACE_MAX_TASKS);
+
+    /* 1. A thread_name event per task. */
+    while (cursor->task < tasks) {
+        const trace_task_t *task = &s_tasks[cursor->task++];
+
+        if (task->named.load(std::memory_order_acquire)) {
+            json_write<trace_meta_json_t>(cursor->json, "thread_name", "M",
+                                            (uint8_t)TRACE_PID,
+                                            (uint8_t)cursor->task,
+                                            std::make_tuple(task->name));
+            return cursor->json;
+        }
+    }
+
+    /* 2. The events of each ring, oldest first. */
+    while (cursor->core < portNUM_PROCESSORS) {
+        const trace_ring_t *ring = &s_rings[cursor->core];
+
+        if (cursor->pos == cursor->heads[cursor->core]) {
+            cursor->core++;
+            if (cursor->core < portNUM_PROCESSORS) {
+                cursor->pos = cursor->starts[cursor->core];
+            }
+            continue;
+        }
+
+        const uint32_t pos = cursor->pos++;
+        const trace_slot_t *slot = &ring->slots[pos & (TRACE_RING_SIZE - 1)];
+
+        /* Copied between two reads of the sequence, kept if unchanged. */
+        if (slot->seq.load(std::memory_order_acquire) != pos + 1) {
+            continue;
+        }
+        const trace_event_t event = slot->event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != pos + 1) {
+            continue;
+        }
+
+        const char phase[2] = { (char)event.phase, '\0' };
+        json_write<trace_event_json_t>(cursor->json, event.name, phase,
+                                trace_time_ns(&ring->anchor, &event,
+                                                cursor->mhz),
+                                (uint8_t)TRACE_PID, event.task,
+                                std::make_tuple((uint8_t)cursor->core,
+                                                event.arg));
+        return cursor->json;
+    }
+
+    return std::nullopt;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief   0 compiles the tracing out, the macros below then expand to
+ *          nothing. Set from the build with -DTRACE_ENABLED=0.
+ */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED                   1
+#endif
+
+/**
+ * @brief   Every core records into its own ring of TRACE_RING_SIZE events,
+ *          a power of 2, the oldest overwritten. Up to TRACE_MAX_TASKS
+ *          tasks are named in the output.
+ */
+#define TRACE_RING_SIZE                 256
+#define TRACE_MAX_TASKS                 24
+
+/* Public types --------------------------------------------------------------*/
+
+/**
+ * @brief   Chrome trace_event phases.
+ */
+typedef enum {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_INSTANT = 'i'
+} trace_phase_e;
+
+/* Public function prototypes ------------------------------------------------*/
+
+/**
+ * @brief   Records a span on the calling task, closed by TRACE_END() on the
+ *          same task, or a point in time. `name` must outlive the trace, a
+ *          string literal or a registered URI. `arg` is shown with it.
+ */
+#if TRACE_ENABLED
+#define TRACE_BEGIN(name, arg)                                              \
+    trace_record((name), TRACE_PHASE_BEGIN, (uint32_t)(arg))
+#define TRACE_END(name)                                                     \
+    trace_record((name), TRACE_PHASE_END, 0)
+#define TRACE_INSTANT(name, arg)                                            \
+    trace_record((name), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+
+/**
+ * @brief   Measures the cost of a record, then empties the rings. Called
+ *          first thing, before any other task records.
+ */
+void trace_init(void);
+
+/**
+ * @brief   Appends an event to the ring of the current core, timestamped
+ *          with the cycle counter. Lock-free, a slot is claimed with one
+ *          atomic add and written in place. Only the first record of a core
+ *          takes a lock, the first of a task copies its name.
+ * @note    With the CPU scaling or sleeping (config.hpp POWER_*), events
+ *          are timestamped with esp_timer instead, to the microsecond.
+ */
+void trace_record(const char *name, trace_phase_e phase, uint32_t arg);
+
+/**
+ * @brief   Cycles a record takes, as measured by trace_init().
+ */
+uint32_t trace_record_cycles(void);
+
+/**
+ * @brief   GET /trace handler, the rings as Chrome trace_event JSON, to
+ *          open in chrome://tracing or ui.perfetto.dev.
+ */
+esp_err_t trace_send(httpd_req_t *req);
+#else
+#define TRACE_BEGIN(name, arg)          do {} while (0)
+#define TRACE_END(name)                 do {} while (0)
+#define TRACE_INSTANT(name, arg)        do {} while (0)
+
+static inline void trace_init(void)
+{
+}
+#endif
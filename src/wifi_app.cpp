@@ -1,18 +1,74 @@
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 
+#include <string.h>
+#include <sys/param.h>
+
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/task.h>
 
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
 #include <lwip/netdb.h>
+#include <nvs.h>
 
 #include "config.hpp"
+#include "dlog.hpp"
+#include "event_bus.hpp"
 #include "wifi_app.hpp"
 #include "http_server.hpp"
+#include "metrics.hpp"
+#include "mqtt_publisher.hpp"
+#include "ota_client.hpp"
+#include "task_placement.hpp"
+#include "trace.hpp"
+
+#define WIFI_APP_NVS_NAMESPACE          "wifi_app"
+#define WIFI_APP_NVS_KEY_STA            "sta"
+#define WIFI_APP_STA_VERSION            1
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   Station connection states.
+ */
+typedef enum {
+    WIFI_APP_STA_IDLE = 0,          /* No network to connect to. */
+    WIFI_APP_STA_FAST_CONNECTING,   /* Cached BSSID and channel, no scan. */
+    WIFI_APP_STA_SCAN_CONNECTING,   /* All channels scanned. */
+    WIFI_APP_STA_BACKOFF,           /* Waiting for the retry timer. */
+    WIFI_APP_STA_CONNECTED,         /* Associated, with or waiting for IP. */
+    WIFI_APP_STA_DISCONNECTING      /* Waiting for the driver to let go. */
+} wifi_app_sta_state_e;
 
+/**
+ * @brief   Where the station address of an attempt comes from.
+ */
+typedef enum {
+    WIFI_APP_STA_IP_DHCP = 0,
+    WIFI_APP_STA_IP_LEASE,          /* Last DHCP lease taken again. */
+    WIFI_APP_STA_IP_STATIC          /* WIFI_STA_STATIC_IP. */
+} wifi_app_sta_ip_e;
+
+/**
+ * @brief   Network saved in NVS, rewritten when the station gets an IP
+ *          address from another AP or lease.
+ */
+typedef struct {
+    uint32_t version;
+    char ssid[MAX_SSID_LENGTH + 1];
+    char password[MAX_PASSWORD_LENGTH + 1];
+    uint8_t bssid[6];
+    uint8_t channel;                /* 0 until the first connection. */
+    uint8_t has_lease;
+    uint32_t ip;                    /* Last DHCP lease, network order. */
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_app_sta_t;
 
 /* Private variables ---------------------------------------------------------*/
 
@@ -21,10 +77,24 @@
  */
 static const char TAG[] = "wifi_app";
 
-static QueueHandle_t s_wifi_app_event_queue = NULL;
+static event_bus_subscriber_t *s_wifi_app_subscriber = NULL;
 esp_netif_t *g_esp_netif_station = NULL;
 esp_netif_t *g_esp_netif_ap = NULL;
 
+static wifi_app_sta_t s_sta;                /* Network of the station. */
+static bool s_sta_saved = false;            /* s_sta is the one in NVS. */
+static wifi_app_sta_t s_sta_request;        /* From wifi_app_connect_sta(). */
+static portMUX_TYPE s_sta_request_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_sta_reconnect = false;        /* Connect once disconnected. */
+static wifi_app_sta_state_e s_sta_state = WIFI_APP_STA_IDLE;
+static wifi_app_sta_ip_e s_sta_ip = WIFI_APP_STA_IP_DHCP;
+static bool s_sta_fast = false;             /* Attempt without scan. */
+static uint32_t s_sta_failures = 0;         /* Since the last IP address. */
+static uint32_t s_sta_attempts = 0;         /* Of the current connection. */
+static esp_timer_handle_t s_sta_retry_timer = NULL;
+static int64_t s_sta_connect_start_us = 0;  /* Boot or link loss. */
+static bool s_sta_got_ip_once = false;      /* Boot-to-IP is logged once. */
+
 /* Private function prototype ------------------------------------------------*/
 
 /**
@@ -66,80 +136,263 @@ static void wifi_app_default_config_init(void);
  */
 static void wifi_app_soft_ap_config(void);
 
+/**
+ * @brief   Starts a connection attempt to s_sta.
+ *
+ * @param   fast    - Goes straight to the cached BSSID and channel, falls
+ *                    back to a full scan without a cached channel.
+ */
+static void wifi_app_sta_connect(bool fast);
+
+/**
+ * @brief   Next step after the station lost its AP or failed to connect:
+ *          a full scan after a fast attempt, otherwise a backoff.
+ */
+static void wifi_app_sta_disconnected(void);
+
+/**
+ * @brief   Gives up the new credentials that never connected, and goes back
+ *          to the saved network if any.
+ */
+static void wifi_app_sta_give_up(void);
+
+/**
+ * @brief   Sets the static address or the cached lease once associated.
+ */
+static void wifi_app_sta_set_ip(void);
+
+/**
+ * @brief   Caches the AP and the lease of the new IP address and logs how
+ *          long it took.
+ *
+ * @param   event   - The EVENT_BUS_WIFI_STA_GOT_IP event.
+ */
+static void wifi_app_sta_got_ip(const event_bus_event_t *event);
+
+/**
+ * @brief   Retry timer callback, publishes EVENT_BUS_WIFI_STA_RETRY.
+ *
+ * @param   arg
+ */
+static void wifi_app_sta_retry_callback(void *arg);
+
+/**
+ * @brief   Loads the saved network into s_sta.
+ *
+ * @return  ESP_OK, otherwise an NVS error.
+ */
+static esp_err_t wifi_app_sta_load(void);
+
+/**
+ * @brief   Saves s_sta to NVS.
+ */
+static esp_err_t wifi_app_sta_save(void);
+
+/**
+ * @brief   Forgets the saved network.
+ */
+static void wifi_app_sta_clear(void);
+
 /* Public function definition ------------------------------------------------*/
-BaseType_t wifi_app_send_message(wifi_app_message_e msgID)
+esp_err_t wifi_app_connect_sta(const char *ssid, const char *password)
 {
-    wifi_app_message_t msg;
-    msg.msgID = msgID;
-    return xQueueSend(s_wifi_app_event_queue, &msg, portMAX_DELAY);
+    if (strlen(ssid) > MAX_SSID_LENGTH
+        || strlen(password) > MAX_PASSWORD_LENGTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Too large for an event, taken over by the WiFi task. A later request
+     * replaces it. */
+    portENTER_CRITICAL(&s_sta_request_lock);
+    memset(&s_sta_request, 0, sizeof(s_sta_request));
+    s_sta_request.version = WIFI_APP_STA_VERSION;
+    strcpy(s_sta_request.ssid, ssid);
+    strcpy(s_sta_request.password, password);
+    portEXIT_CRITICAL(&s_sta_request_lock);
+
+    event_bus_publish_type(EVENT_BUS_WIFI_CONNECT_REQUESTED);
+    return ESP_OK;
+}
+
+void wifi_app_disconnect_sta(void)
+{
+    event_bus_publish_type(EVENT_BUS_WIFI_DISCONNECT_REQUESTED);
 }
 
 void wifi_app_start(void)
 {
-    ESP_LOGI(TAG, "Starting WiFi Application.");
+    DLOGI(TAG, "Starting WiFi Application.");
 
     /* 1. Configure logging messages. */
     esp_log_level_set("*", ESP_LOG_DEBUG);
     esp_log_level_set("wifi", ESP_LOG_DEBUG);
     esp_log_level_set("dhcpc", ESP_LOG_DEBUG);
 
-    /* 2. Create message queue. */
-    s_wifi_app_event_queue = xQueueCreate(WIFI_APP_MAX_QUEUE_HANDLE,
-                                            sizeof(wifi_app_message_t));
-
-    /* 3. Start the WiFi application. */
+    /* 2. Start the WiFi application. */
     xTaskCreatePinnedToCore(&wifi_app_task,
                             "wifi_app_task",
                             WIFI_APP_TASK_STACK_SIZE,
                             NULL,
                             WIFI_APP_TASK_PRIORITY,
                             NULL,
-                            WIFI_APP_TASK_CORE_ID);
+                            task_placement_core(TASK_PLACEMENT_WIFI_APP));
 }
 
 /* Private function definition -----------------------------------------------*/
 static void wifi_app_task(void *param)
 {
-    wifi_app_message_t msg;
-    /* 1. Initialize the event handler. */
+    static const event_bus_type_e types[] = {
+        EVENT_BUS_WIFI_START_HTTP_SERVER,
+        EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS,
+        EVENT_BUS_WIFI_CONNECT_REQUESTED,
+        EVENT_BUS_WIFI_DISCONNECT_REQUESTED,
+        EVENT_BUS_WIFI_STA_RETRY,
+        EVENT_BUS_WIFI_STA_CONNECTED,
+        EVENT_BUS_WIFI_STA_DISCONNECTED,
+        EVENT_BUS_WIFI_STA_GOT_IP
+    };
+    event_bus_event_t event;
+
+    metrics_register_task(NULL, WIFI_APP_TASK_STACK_SIZE);
+
+    /* 1. Events of the task, before the driver can raise any. */
+    s_wifi_app_subscriber = event_bus_subscribe(xTaskGetCurrentTaskHandle(),
+                                        types,
+                                        sizeof(types) / sizeof(types[0]));
+
+    /* 2. Initialize the event handler. */
     wifi_app_event_handler_init();
 
-    /* 2. Initialize TCP/IP stack and WiFi configuration. */
+    /* 3. Initialize TCP/IP stack and WiFi configuration. */
     wifi_app_default_config_init();
 
-    /* 3. SoftAP configuration. */
+    /* 4. SoftAP configuration. */
     wifi_app_soft_ap_config();
 
-    /* 4. Start WiFi. */
+    /* 5. Start WiFi. */
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    /* 5. Send start http server message. */
-    wifi_app_send_message(WIFI_APP_MESSAGE_START_HTTP_SERVER);
+    /* 6. Retry timer of the station. */
+    const esp_timer_create_args_t retry_args = {
+        .callback = &wifi_app_sta_retry_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_sta_retry"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_sta_retry_timer));
+
+    /* 7. Send start http server message, then reconnect the saved
+     * network. */
+    event_bus_publish_type(EVENT_BUS_WIFI_START_HTTP_SERVER);
+    event_bus_publish_type(EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS);
     while(1) {
-        if (xQueueReceive(s_wifi_app_event_queue, &msg, portMAX_DELAY) 
-            != pdTRUE) {
+        if (!event_bus_receive(s_wifi_app_subscriber, &event,
+                                portMAX_DELAY)) {
                 continue;
             }
 
-        switch (msg.msgID)
+        TRACE_BEGIN("wifi_app", event.type);
+        switch (event.type)
         {
-            case WIFI_APP_MESSAGE_START_HTTP_SERVER: {
-                ESP_LOGI(TAG, "WIFI_APP_MESSAGE_START_HTTP_SERVER");
+            case EVENT_BUS_WIFI_START_HTTP_SERVER: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_START_HTTP_SERVER");
                 http_server_start();
             }
             break;
-            case WIFI_APP_MESSAGE_CONNECTING_FROM_HTTP_SERVER: {
-                ESP_LOGI(TAG, "WIFI_APP_MESSAGE_CONNECTING_FROM_HTTP_SERVER");
+            case EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS");
+                if (wifi_app_sta_load() == ESP_OK) {
+                    s_sta_saved = true;
+                    s_sta_connect_start_us = esp_timer_get_time();
+                    wifi_app_sta_connect(true);
+                }
+            }
+            break;
+            case EVENT_BUS_WIFI_CONNECT_REQUESTED: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_CONNECT_REQUESTED");
+                portENTER_CRITICAL(&s_sta_request_lock);
+                s_sta = s_sta_request;
+                portEXIT_CRITICAL(&s_sta_request_lock);
+                s_sta_saved = false;
+                s_sta_failures = 0;
+                s_sta_connect_start_us = esp_timer_get_time();
+                event_bus_publish_type(EVENT_BUS_WIFI_CONNECT_INIT);
+
+                esp_timer_stop(s_sta_retry_timer);
+                if (s_sta_state == WIFI_APP_STA_IDLE
+                    || s_sta_state == WIFI_APP_STA_BACKOFF) {
+                    wifi_app_sta_connect(false);
+                } else {
+                    /* Connected or connecting elsewhere, the new network is
+                     * tried once the driver reports the disconnect. */
+                    s_sta_reconnect = true;
+                    s_sta_state = WIFI_APP_STA_DISCONNECTING;
+                    esp_wifi_disconnect();
+                }
+            }
+            break;
+            case EVENT_BUS_WIFI_DISCONNECT_REQUESTED: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_DISCONNECT_REQUESTED");
+                wifi_app_sta_clear();
+                s_sta_saved = false;
+                s_sta_reconnect = false;
+                event_bus_publish_type(EVENT_BUS_WIFI_DISCONNECTED);
+
+                esp_timer_stop(s_sta_retry_timer);
+                if (s_sta_state == WIFI_APP_STA_IDLE
+                    || s_sta_state == WIFI_APP_STA_BACKOFF) {
+                    s_sta_state = WIFI_APP_STA_IDLE;
+                } else {
+                    s_sta_state = WIFI_APP_STA_DISCONNECTING;
+                    esp_wifi_disconnect();
+                }
             }
             break;
-            case WIFI_APP_MESSAGE_STATION_CONNECTED_GOT_IP: {
-                ESP_LOGI(TAG, "WIFI_APP_MESSAGE_STATION_CONNECTED_GOT_IP");
+            case EVENT_BUS_WIFI_STA_CONNECTED: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_STA_CONNECTED");
+                if (s_sta_state == WIFI_APP_STA_FAST_CONNECTING
+                    || s_sta_state == WIFI_APP_STA_SCAN_CONNECTING) {
+                    s_sta_state = WIFI_APP_STA_CONNECTED;
+                    wifi_app_sta_set_ip();
+                }
+            }
+            break;
+            case EVENT_BUS_WIFI_STA_DISCONNECTED: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_STA_DISCONNECTED, reason %u",
+                            (unsigned)event.sta_disconnected.reason);
+                wifi_app_sta_disconnected();
+            }
+            break;
+            case EVENT_BUS_WIFI_STA_RETRY: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_STA_RETRY");
+                if (s_sta_state == WIFI_APP_STA_BACKOFF) {
+                    wifi_app_sta_connect(false);
+                }
+            }
+            break;
+            case EVENT_BUS_WIFI_STA_GOT_IP: {
+                DLOGI(TAG, "EVENT_BUS_WIFI_STA_GOT_IP");
+                wifi_app_sta_got_ip(&event);
+                event_bus_publish_type(EVENT_BUS_WIFI_CONNECT_SUCCESS);
+
+                /* Finish a pull update cut by a disconnect or a reboot. */
+                ota_client_resume();
+
+                /* SNTP keeps polling across reconnects once started. */
+                if (!sntp_enabled()) {
+                    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+                    sntp_setservername(0, WIFI_STA_SNTP_SERVER);
+                    sntp_init();
+                }
+
+                /* Telemetry, the client reconnects by itself afterwards. */
+                mqtt_publisher_start();
             }
             break;
             default:
                 break;
         }
-
+        TRACE_END("wifi_app");
     }
 }
 
@@ -168,53 +421,76 @@ static void wifi_app_event_handler(void *event_handler_arg,
                                     int32_t event_id,
                                     void *event_data)
 {
+    TRACE_BEGIN("wifi_app_event_handler", event_id);
     if (event_base == WIFI_EVENT) {
         switch (event_id)
         {
             case WIFI_EVENT_AP_START:
-                ESP_LOGI(TAG, "WIFI_EVENT_AP_START");
+                DLOGI(TAG, "WIFI_EVENT_AP_START");
                 break;
             case WIFI_EVENT_AP_STOP:
-                ESP_LOGI(TAG, "WIFI_EVENT_AP_STOP");
+                DLOGI(TAG, "WIFI_EVENT_AP_STOP");
                 break;
             case WIFI_EVENT_AP_STACONNECTED:
                 /* Every time a station is connected to ESP32 AP, the
                 WIFI_EVENT_AP_STACONNECTED will arise. */
-                ESP_LOGI(TAG, "WIFI_EVENT_AP_STACONNECTED");
+                DLOGI(TAG, "WIFI_EVENT_AP_STACONNECTED");
                 break;
             case WIFI_EVENT_AP_STADISCONNECTED:
-                ESP_LOGI(TAG, "WIFI_EVENT_AP_STADISCONNECTED");
+                DLOGI(TAG, "WIFI_EVENT_AP_STADISCONNECTED");
                 break;
             case WIFI_EVENT_STA_START:
-                ESP_LOGI(TAG, "WIFI_EVENT_STA_START");
+                DLOGI(TAG, "WIFI_EVENT_STA_START");
                 break;
             case WIFI_EVENT_STA_STOP:
-                ESP_LOGI(TAG, "WIFI_EVENT_STA_STOP");
+                DLOGI(TAG, "WIFI_EVENT_STA_STOP");
                 break;
             case WIFI_EVENT_STA_CONNECTED:
-                ESP_LOGI(TAG, "WIFI_EVENT_STA_CONNECTED");
-                break;
-            case WIFI_EVENT_STA_DISCONNECTED:
-                ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
+                DLOGI(TAG, "WIFI_EVENT_STA_CONNECTED");
+                event_bus_publish_type(EVENT_BUS_WIFI_STA_CONNECTED);
                 break;
+            case WIFI_EVENT_STA_DISCONNECTED: {
+                const wifi_event_sta_disconnected_t *disconnected =
+                            (const wifi_event_sta_disconnected_t *)event_data;
+                event_bus_event_t event;
+
+                DLOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
+                memset(&event, 0, sizeof(event));
+                event.type = EVENT_BUS_WIFI_STA_DISCONNECTED;
+                event.sta_disconnected.reason = disconnected->reason;
+                event_bus_publish(&event);
+            }
+            break;
             default:
                 break;
         }
     } else if (event_base == IP_EVENT) {
         switch (event_id)
         {
-            case IP_EVENT_STA_GOT_IP:
+            case IP_EVENT_STA_GOT_IP: {
                 /* This event arises when the DHCP client successfully gets the
                  * IPV4 address from the DHCP server, or when the IPV4 address
                  * is changed. The event means that everything is ready and the
                  * application can begin its tasks (e.g., creating sockets). */
-                ESP_LOGI(TAG, "IP_EVENT_STA_GOT_IP");
-                break;
+                const ip_event_got_ip_t *got_ip =
+                                        (const ip_event_got_ip_t *)event_data;
+                event_bus_event_t event;
+
+                DLOGI(TAG, "IP_EVENT_STA_GOT_IP");
+                memset(&event, 0, sizeof(event));
+                event.type = EVENT_BUS_WIFI_STA_GOT_IP;
+                event.sta_got_ip.ip = got_ip->ip_info.ip.addr;
+                event.sta_got_ip.netmask = got_ip->ip_info.netmask.addr;
+                event.sta_got_ip.gw = got_ip->ip_info.gw.addr;
+                event_bus_publish(&event);
+            }
+            break;
 
             default:
                 break;
         }
     }
+    TRACE_END("wifi_app_event_handler");
 }
 
 static void wifi_app_default_config_init(void)
@@ -233,19 +509,19 @@ static void wifi_app_default_config_init(void)
 
 static void wifi_app_soft_ap_config(void)
 {
-    /* 1. Soft AP - WiFi Access point configuration. */
-    wifi_config_t ap_config = {
-        .ap = {
-            {.ssid = WIFI_AP_SSID},
-            {.password = WIFI_AP_PASSWORD},
-            .ssid_len = strlen(WIFI_AP_SSID),
-            .channel = WIFI_AP_CHANNEL,
-            .authmode = WIFI_AUTH_WPA2_PSK,
-            .ssid_hidden = WIFI_AP_SSID_HIDDEN,
-            .max_connection = WIFI_AP_MAX_CONN,
-            .beacon_interval = WIFI_AP_BEACON_INTERVAL
-        }
-    };
+    /* 1. Soft AP - WiFi Access point configuration. Assigned field by
+     * field, the nested designators don't build with the host compiler. */
+    wifi_config_t ap_config;
+    memset(&ap_config, 0, sizeof(ap_config));
+    memcpy(ap_config.ap.ssid, WIFI_AP_SSID, strlen(WIFI_AP_SSID));
+    memcpy(ap_config.ap.password, WIFI_AP_PASSWORD,
+            strlen(WIFI_AP_PASSWORD));
+    ap_config.ap.ssid_len = strlen(WIFI_AP_SSID);
+    ap_config.ap.channel = WIFI_AP_CHANNEL;
+    ap_config.ap.authmode = WIFI_AUTH_WPA2_PSK;
+    ap_config.ap.ssid_hidden = WIFI_AP_SSID_HIDDEN;
+    ap_config.ap.max_connection = WIFI_AP_MAX_CONN;
+    ap_config.ap.beacon_interval = WIFI_AP_BEACON_INTERVAL;
 
     /* 2. Configure DHCP for the Access Point. */
     esp_netif_ip_info_t ap_ip_info;
@@ -274,3 +550,265 @@ static void wifi_app_soft_ap_config(void)
     /* Set power save mode. */
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_STA_POWER_SAVE));
 }
+
+static void wifi_app_sta_connect(bool fast)
+{
+    wifi_config_t sta_config;
+    memset(&sta_config, 0, sizeof(sta_config));
+
+    /* 1. Credentials, the password isn't NUL terminated at 64 characters. */
+    memcpy(sta_config.sta.ssid, s_sta.ssid, strlen(s_sta.ssid));
+    memcpy(sta_config.sta.password, s_sta.password, strlen(s_sta.password));
+
+    /* 2. A known AP is joined on its channel without scanning the others,
+     * a full scan picks the strongest AP of the network. */
+    fast = fast && s_sta.channel != 0;
+    if (fast) {
+        sta_config.sta.scan_method = WIFI_FAST_SCAN;
+        sta_config.sta.bssid_set = true;
+        memcpy(sta_config.sta.bssid, s_sta.bssid, sizeof(s_sta.bssid));
+        sta_config.sta.channel = s_sta.channel;
+    } else {
+        sta_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        sta_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+
+    /* 3. Address: the DHCP client must be stopped before the association
+     * starts it. */
+    if (strlen(WIFI_STA_STATIC_IP) > 0) {
+        s_sta_ip = WIFI_APP_STA_IP_STATIC;
+    } else if (WIFI_STA_REUSE_LEASE && fast && s_sta.has_lease) {
+        s_sta_ip = WIFI_APP_STA_IP_LEASE;
+    } else {
+        s_sta_ip = WIFI_APP_STA_IP_DHCP;
+    }
+
+    if (s_sta_ip == WIFI_APP_STA_IP_DHCP) {
+        esp_netif_dhcpc_start(g_esp_netif_station);
+    } else {
+        esp_netif_dhcpc_stop(g_esp_netif_station);
+    }
+
+    DLOGI(TAG, "Connecting to %s, %s.", s_sta.ssid,
+                fast ? "cached AP" : "full scan");
+
+    s_sta_attempts++;
+    s_sta_fast = fast;
+    s_sta_state = fast ? WIFI_APP_STA_FAST_CONNECTING
+                        : WIFI_APP_STA_SCAN_CONNECTING;
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+    if (err == ESP_OK) {
+        err = esp_wifi_connect();
+    }
+    if (err != ESP_OK) {
+        /* No disconnect event will come, retry after the backoff. */
+        DLOGE(TAG, "Connect failed: %s.", esp_err_to_name(err));
+        s_sta_state = WIFI_APP_STA_SCAN_CONNECTING;
+        wifi_app_sta_disconnected();
+    }
+}
+
+static void wifi_app_sta_disconnected(void)
+{
+    switch (s_sta_state)
+    {
+        case WIFI_APP_STA_DISCONNECTING: {
+            s_sta_state = WIFI_APP_STA_IDLE;
+            if (s_sta_reconnect) {
+                s_sta_reconnect = false;
+                wifi_app_sta_connect(false);
+            }
+        }
+        break;
+        case WIFI_APP_STA_CONNECTED: {
+            /* Link lost, the AP is most likely still where it was. */
+            s_sta_attempts = 0;
+            s_sta_connect_start_us = esp_timer_get_time();
+            event_bus_publish_type(EVENT_BUS_WIFI_CONNECT_INIT);
+            wifi_app_sta_connect(true);
+        }
+        break;
+        case WIFI_APP_STA_FAST_CONNECTING: {
+            /* The AP moved to another channel or is gone. */
+            wifi_app_sta_connect(false);
+        }
+        break;
+        case WIFI_APP_STA_SCAN_CONNECTING: {
+            s_sta_failures++;
+            if (!s_sta_saved && s_sta_failures >= MAX_CONNECTION_RETRIES) {
+                wifi_app_sta_give_up();
+                break;
+            }
+
+            const uint32_t shift = MIN(s_sta_failures - 1, 16);
+            const uint32_t delay_ms = MIN(WIFI_STA_RETRY_BASE_MS << shift,
+                                            WIFI_STA_RETRY_MAX_MS);
+
+            DLOGW(TAG, "Connect failed %u times, retrying in %u ms.",
+                        (unsigned)s_sta_failures, (unsigned)delay_ms);
+            s_sta_state = WIFI_APP_STA_BACKOFF;
+            esp_timer_start_once(s_sta_retry_timer,
+                                    (uint64_t)delay_ms * 1000);
+        }
+        break;
+        default:
+            break;
+    }
+}
+
+static void wifi_app_sta_give_up(void)
+{
+    DLOGW(TAG, "Giving up %s.", s_sta.ssid);
+    s_sta_state = WIFI_APP_STA_IDLE;
+    s_sta_failures = 0;
+    event_bus_publish_type(EVENT_BUS_WIFI_CONNECT_FAIL);
+
+    if (wifi_app_sta_load() == ESP_OK) {
+        s_sta_saved = true;
+        s_sta_attempts = 0;
+        s_sta_connect_start_us = esp_timer_get_time();
+        wifi_app_sta_connect(true);
+    } else {
+        memset(&s_sta, 0, sizeof(s_sta));
+    }
+}
+
+static void wifi_app_sta_set_ip(void)
+{
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns_info;
+    memset(&ip_info, 0, sizeof(ip_info));
+    memset(&dns_info, 0, sizeof(dns_info));
+
+    if (s_sta_ip == WIFI_APP_STA_IP_STATIC) {
+        inet_pton(AF_INET, WIFI_STA_STATIC_IP, &ip_info.ip);
+        inet_pton(AF_INET, WIFI_STA_STATIC_GATEWAY, &ip_info.gw);
+        inet_pton(AF_INET, WIFI_STA_STATIC_NETMASK, &ip_info.netmask);
+        inet_pton(AF_INET, WIFI_STA_STATIC_DNS, &dns_info.ip.u_addr.ip4);
+    } else if (s_sta_ip == WIFI_APP_STA_IP_LEASE) {
+        ip_info.ip.addr = s_sta.ip;
+        ip_info.gw.addr = s_sta.gw;
+        ip_info.netmask.addr = s_sta.netmask;
+        dns_info.ip.u_addr.ip4.addr = s_sta.dns;
+    } else {
+        return;
+    }
+
+    /* Raises IP_EVENT_STA_GOT_IP like a DHCP lease. */
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(g_esp_netif_station, &ip_info));
+
+    if (dns_info.ip.u_addr.ip4.addr != 0) {
+        dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+        esp_netif_set_dns_info(g_esp_netif_station, ESP_NETIF_DNS_MAIN,
+                                &dns_info);
+    }
+}
+
+static void wifi_app_sta_got_ip(const event_bus_event_t *event)
+{
+    static const char *const ip_names[] = {"DHCP", "lease", "static"};
+    const int64_t now_us = esp_timer_get_time();
+    wifi_ap_record_t ap_info;
+    esp_netif_dns_info_t dns_info;
+    wifi_app_sta_t sta = s_sta;
+
+    if (s_sta_state != WIFI_APP_STA_CONNECTED) {
+        return;
+    }
+
+    /* 1. How long it took, from boot the first time. */
+    if (!s_sta_got_ip_once) {
+        s_sta_got_ip_once = true;
+        DLOGI(TAG, "Boot to IP in %u ms.", (unsigned)(now_us / 1000));
+    }
+    DLOGI(TAG, "Got IP in %u ms, %u attempt(s), last %s, %s address.",
+                (unsigned)((now_us - s_sta_connect_start_us) / 1000),
+                (unsigned)s_sta_attempts,
+                s_sta_fast ? "to the cached AP" : "after a scan",
+                ip_names[s_sta_ip]);
+    s_sta_failures = 0;
+    s_sta_attempts = 0;
+
+    /* 2. AP and lease for the next connection. */
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        memcpy(sta.bssid, ap_info.bssid, sizeof(sta.bssid));
+        sta.channel = ap_info.primary;
+    }
+    if (s_sta_ip == WIFI_APP_STA_IP_DHCP) {
+        sta.has_lease = true;
+        sta.ip = event->sta_got_ip.ip;
+        sta.netmask = event->sta_got_ip.netmask;
+        sta.gw = event->sta_got_ip.gw;
+        if (esp_netif_get_dns_info(g_esp_netif_station, ESP_NETIF_DNS_MAIN,
+                                    &dns_info) == ESP_OK) {
+            sta.dns = dns_info.ip.u_addr.ip4.addr;
+        }
+    }
+
+    /* 3. The flash is only written when something changed. */
+    if (!s_sta_saved || memcmp(&sta, &s_sta, sizeof(sta)) != 0) {
+        s_sta = sta;
+        if (wifi_app_sta_save() == ESP_OK) {
+            s_sta_saved = true;
+        } else {
+            DLOGE(TAG, "Failed to save the station network.");
+        }
+    }
+}
+
+static void wifi_app_sta_retry_callback(void *arg)
+{
+    event_bus_publish_type(EVENT_BUS_WIFI_STA_RETRY);
+}
+
+static esp_err_t wifi_app_sta_load(void)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(s_sta);
+
+    esp_err_t err = nvs_open(WIFI_APP_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_get_blob(handle, WIFI_APP_NVS_KEY_STA, &s_sta, &len);
+    if (err == ESP_OK && (len != sizeof(s_sta)
+                            || s_sta.version != WIFI_APP_STA_VERSION)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+static esp_err_t wifi_app_sta_save(void)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(WIFI_APP_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(handle, WIFI_APP_NVS_KEY_STA, &s_sta, sizeof(s_sta));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+static void wifi_app_sta_clear(void)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(WIFI_APP_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
@@ -42,6 +42,33 @@
 
 #define MAX_CONNECTION_RETRIES  5            /* Retries number on disconnect. */
 
+/**
+ * @brief   A station that can't connect retries after an exponential backoff
+ *          from WIFI_STA_RETRY_BASE_MS up to WIFI_STA_RETRY_MAX_MS. New
+ *          credentials from the web page are given up after
+ *          MAX_CONNECTION_RETRIES failures, saved ones are retried forever.
+ */
+#define WIFI_STA_RETRY_BASE_MS  1000
+#define WIFI_STA_RETRY_MAX_MS   60000
+
+/**
+ * @brief   Station address. With WIFI_STA_STATIC_IP set the DHCP client is
+ *          never started. Otherwise, with WIFI_STA_REUSE_LEASE, a reconnect
+ *          to the cached BSSID takes the last DHCP lease again without asking
+ *          the server, only safe where the router reserves the address.
+ */
+#define WIFI_STA_STATIC_IP      ""                      /* Empty for DHCP. */
+#define WIFI_STA_STATIC_GATEWAY ""
+#define WIFI_STA_STATIC_NETMASK ""
+#define WIFI_STA_STATIC_DNS     ""
+#define WIFI_STA_REUSE_LEASE    0
+
+/**
+ * @brief   Sets the clock once the station has an address, the sensor
+ *          history is kept in Unix time.
+ */
+#define WIFI_STA_SNTP_SERVER    "pool.ntp.org"
+
 /**
  * @brief   Netif objects for the station and access point.
  * 
@@ -50,32 +77,22 @@ extern esp_netif_t *g_esp_netif_station;
 extern esp_netif_t *g_esp_netif_ap;
 
 
-/* Public types --------------------------------------------------------------*/
+/* Public function prototypes ------------------------------------------------*/
 
 /**
- * @brief   Message IDs for the WiFi application task.
- * @note    Expand this based on your application requirements.
+ * @brief   Connects the station to a new network, replacing the current one.
+ *          The credentials are saved to NVS once an IP address is obtained.
+ *
+ * @param   ssid        - Network name, up to MAX_SSID_LENGTH characters.
+ * @param   password    - Up to MAX_PASSWORD_LENGTH characters.
+ * @return  ESP_OK, ESP_ERR_INVALID_ARG if either is too long.
  */
-typedef enum {
-    WIFI_APP_MESSAGE_START_HTTP_SERVER = 0,
-    WIFI_APP_MESSAGE_CONNECTING_FROM_HTTP_SERVER,
-    WIFI_APP_MESSAGE_STATION_CONNECTED_GOT_IP
-} wifi_app_message_e;
-
-typedef struct {
-    wifi_app_message_e msgID;
-} wifi_app_message_t;
-
-/* Public function prototypes ------------------------------------------------*/
+esp_err_t wifi_app_connect_sta(const char *ssid, const char *password);
 
 /**
- * @brief   Sends a message to the queue.
- * @param[in]   msgID   - 
- * 
- * @return  pdTRUE if an item was successfully sent to the queue, otherwise
- *          pdFALSE is returned.
+ * @brief   Disconnects the station and forgets the saved network.
  */
-BaseType_t wifi_app_send_message(wifi_app_message_e msgID);
+void wifi_app_disconnect_sta(void);
 
 /**
  * @brief   Starts the WiFi task.
@@ -0,0 +1,290 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <unity.h>
+
+#include "json_writer.hpp"
+
+/**
+ * @brief   Objects written per timing in test_section_speed().
+ */
+#define TEST_SECTION_RUNS       100000
+
+/**
+ * @brief   Samples of the array in test_array_streaming(), a long /history.
+ */
+#define TEST_ARRAY_COUNT        1000
+#define TEST_ARRAY_RUNS         200
+
+/* Schemas -------------------------------------------------------------------*/
+
+JSON_KEY(ota_update_status);
+JSON_KEY(ota_update_reason);
+JSON_KEY(ota_bytes_written);
+JSON_KEY(ota_image_size);
+JSON_KEY(compile_time);
+JSON_KEY(compile_date);
+JSON_KEY(time);
+JSON_KEY(temp);
+JSON_KEY(humidity);
+
+/**
+ * @brief   The ota section of /events, as http_server.cpp has it.
+ */
+typedef json_object<
+    json_field<json_key_ota_update_status, json_int<int>>,
+    json_field<json_key_ota_update_reason, json_int<int>>,
+    json_field<json_key_ota_bytes_written, json_int<uint32_t>>,
+    json_field<json_key_ota_image_size, json_int<uint32_t>>,
+    json_field<json_key_compile_time, json_string<16>>,
+    json_field<json_key_compile_date, json_string<16>>
+> test_ota_json_t;
+
+#define TEST_OTA_FORMAT                                                     \
+    "{\"ota_update_status\": %d, \"ota_update_reason\": %d, "               \
+    "\"ota_bytes_written\": %" PRIu32 ", \"ota_image_size\": %" PRIu32 ", " \
+    "\"compile_time\": \"%s\", \"compile_date\": \"%s\"}"
+
+/**
+ * @brief   A history sample, time in ms.
+ */
+typedef json_object<
+    json_field<json_key_time, json_int<int64_t>>,
+    json_field<json_key_temp, json_fixed<1>>,
+    json_field<json_key_humidity, json_fixed<1>>
+> test_sample_json_t;
+
+typedef json_array<test_sample_json_t, JSON_UNBOUNDED> test_samples_json_t;
+
+#define TEST_SAMPLE_FORMAT                                                  \
+    "{\"time\": %" PRId64 ", \"temp\": %.1f, \"humidity\": %.1f}"
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   json_chunk_sink with the chunks appended to `output` instead of
+ *          sent, the same JSON_CHUNK_SIZE buffer in between.
+ */
+struct test_chunk_sink {
+    std::string *output;
+    size_t len;
+    char buffer[JSON_CHUNK_SIZE];
+
+    void put(char c)
+    {
+        if (len == JSON_CHUNK_SIZE) {
+            flush();
+        }
+        buffer[len++] = c;
+    }
+
+    void put(const char *data, size_t n)
+    {
+        while (n > 0) {
+            if (len == JSON_CHUNK_SIZE) {
+                flush();
+            }
+
+            const size_t part = (n < JSON_CHUNK_SIZE - len)
+                                ? n : JSON_CHUNK_SIZE - len;
+            memcpy(buffer + len, data, part);
+            len += part;
+            data += part;
+            n -= part;
+        }
+    }
+
+    void flush(void)
+    {
+        output->append(buffer, len);
+        len = 0;
+    }
+
+    bool failed(void) const
+    {
+        return false;
+    }
+};
+
+typedef struct {
+    int64_t time_ms;
+    double temperature;
+    double humidity;
+} test_sample_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static std::vector<test_sample_t> s_samples;
+
+/* Private function prototype ------------------------------------------------*/
+
+/**
+ * @brief   Microseconds since `start`.
+ */
+static double test_elapsed_us(std::chrono::steady_clock::time_point start);
+
+/**
+ * @brief   The samples with snprintf() into one buffer holding them all.
+ */
+static size_t test_samples_snprintf(char *buffer, size_t size);
+
+/**
+ * @brief   The samples through test_samples_json_t and a chunk buffer.
+ */
+static void test_samples_stream(std::string *output);
+
+/* Tests ---------------------------------------------------------------------*/
+
+void setUp(void)
+{
+    /* Tenths, as the sensor gives them: printf rounds them alike. */
+    s_samples.resize(TEST_ARRAY_COUNT);
+    for (size_t i = 0; i < TEST_ARRAY_COUNT; i++) {
+        s_samples[i].time_ms = 1760000000000LL + (int64_t)i * 2000;
+        s_samples[i].temperature = (int)(i % 400 - 100) / 10.0;
+        s_samples[i].humidity = (int)(i % 1000) / 10.0;
+    }
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief   The section byte for byte as the snprintf() it replaced.
+ */
+static void test_section_matches_snprintf(void)
+{
+    const int statuses[] = { -1, 0, 1, 2147483647 };
+    const uint32_t sizes[] = { 0, 1, 65536, 4294967295u };
+    char expected[256];
+    char actual[test_ota_json_t::max_size + 1];
+
+    for (int status : statuses) {
+        for (uint32_t size : sizes) {
+            snprintf(expected, sizeof(expected), TEST_OTA_FORMAT, status,
+                        -status, size / 3, size, "12:34:56", "Oct 17 2026");
+            json_write<test_ota_json_t>(actual, status, -status, size / 3,
+                                        size, "12:34:56", "Oct 17 2026");
+            TEST_ASSERT_EQUAL_STRING(expected, actual);
+        }
+    }
+}
+
+/**
+ * @brief   Time per section, json_write() against snprintf().
+ */
+static void test_section_speed(void)
+{
+    char buffer[256];
+    char json[test_ota_json_t::max_size + 1];
+    size_t total[2] = { 0, 0 };
+    char message[96];
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < TEST_SECTION_RUNS; i++) {
+        total[0] += snprintf(buffer, sizeof(buffer), TEST_OTA_FORMAT, 1, 0,
+                                i, 1048576u, "12:34:56", "Oct 17 2026");
+    }
+    const double snprintf_us = test_elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < TEST_SECTION_RUNS; i++) {
+        total[1] += json_write<test_ota_json_t>(json, 1, 0, i, 1048576u,
+                                                "12:34:56", "Oct 17 2026");
+    }
+    const double json_us = test_elapsed_us(start);
+
+    TEST_ASSERT_EQUAL(total[0], total[1]);
+    snprintf(message, sizeof(message),
+                "ota section: json_write %.0f ns, snprintf %.0f ns",
+                json_us * 1000 / TEST_SECTION_RUNS,
+                snprintf_us * 1000 / TEST_SECTION_RUNS);
+    TEST_MESSAGE(message);
+}
+
+/**
+ * @brief   A large array streamed through a JSON_CHUNK_SIZE buffer against
+ *          snprintf() into a buffer of the whole output: same bytes, and
+ *          the time of each.
+ */
+static void test_array_streaming(void)
+{
+    std::vector<char> buffer(TEST_ARRAY_COUNT * 64);
+    std::string streamed;
+    double best[2] = { 1e12, 1e12 };
+    size_t len = 0;
+    char message[128];
+
+    streamed.reserve(buffer.size());
+    for (int run = 0; run < TEST_ARRAY_RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        len = test_samples_snprintf(buffer.data(), buffer.size());
+        best[0] = std::min(best[0], test_elapsed_us(start));
+
+        streamed.clear();
+        start = std::chrono::steady_clock::now();
+        test_samples_stream(&streamed);
+        best[1] = std::min(best[1], test_elapsed_us(start));
+    }
+
+    TEST_ASSERT_EQUAL(len, streamed.size());
+    TEST_ASSERT_EQUAL_MEMORY(buffer.data(), streamed.data(), len);
+    snprintf(message, sizeof(message),
+                "%d samples (%u bytes): streamed %.0f us through %d bytes, "
+                "snprintf %.0f us into %u bytes",
+                TEST_ARRAY_COUNT, (unsigned)len, best[1], JSON_CHUNK_SIZE,
+                best[0], (unsigned)buffer.size());
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_section_matches_snprintf);
+    RUN_TEST(test_section_speed);
+    RUN_TEST(test_array_streaming);
+    return UNITY_END();
+}
+
+/* Private function definition -----------------------------------------------*/
+static double test_elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t test_samples_snprintf(char *buffer, size_t size)
+{
+    size_t len = 0;
+
+    len += snprintf(buffer + len, size - len, "[");
+    for (size_t i = 0; i < s_samples.size(); i++) {
+        len += snprintf(buffer + len, size - len, "%s" TEST_SAMPLE_FORMAT,
+                        (i > 0) ? ", " : "", s_samples[i].time_ms,
+                        s_samples[i].temperature, s_samples[i].humidity);
+    }
+    len += snprintf(buffer + len, size - len, "]");
+    return len;
+}
+
+static void test_samples_stream(std::string *output)
+{
+    test_chunk_sink sink;
+
+    sink.output = output;
+    sink.len = 0;
+    test_samples_json_t::write(sink, s_samples.size(), [](size_t i) {
+        return std::make_tuple(s_samples[i].time_ms,
+                                s_samples[i].temperature,
+                                s_samples[i].humidity);
+    });
+    sink.flush();
+}
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <unity.h>
+
+#include "multipart_parser.hpp"
+
+/**
+ * @brief   Boundary of the bodies, the one curl sends.
+ */
+#define TEST_BOUNDARY           "------------------------a1b2c3d4e5f6a7b8"
+
+/**
+ * @brief   Random splits tried per body, and the chunks of each.
+ */
+#define TEST_RANDOM_SPLITS      2000
+#define TEST_RANDOM_MAX_CHUNKS  16
+
+/**
+ * @brief   Body parsed by test_throughput(), in chunks of an OTA buffer.
+ */
+#define TEST_BENCH_SIZE         (16 * 1024 * 1024)
+#define TEST_BENCH_CHUNK        4096
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+ * @brief   What the callbacks saw, the data of each part.
+ */
+typedef struct {
+    std::vector<std::string> parts;
+    int open_parts;
+} test_output_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static uint32_t s_seed;
+
+/* Private function prototype ------------------------------------------------*/
+
+static esp_err_t test_on_part_begin(void *ctx);
+static esp_err_t test_on_part_data(void *ctx, const uint8_t *data,
+                                    size_t len);
+static esp_err_t test_on_part_end(void *ctx);
+
+static const multipart_callbacks_t s_callbacks = {
+    .on_part_begin = test_on_part_begin,
+    .on_part_data = test_on_part_data,
+    .on_part_end = test_on_part_end
+};
+
+/**
+ * @brief   xorshift32, the same sequence on every run.
+ */
+static uint32_t test_random(void)
+{
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+/**
+ * @brief   Part data full of near misses of the delimiter: CR, CRLF, CRLF
+ *          "-", CRLF "--" and longer prefixes of the boundary, each followed
+ *          by a byte that breaks the match.
+ */
+static std::string test_tricky_data(size_t len)
+{
+    const std::string delimiter = "\r\n--" TEST_BOUNDARY;
+    std::string data;
+
+    while (data.size() < len) {
+        const uint32_t r = test_random();
+
+        if (r % 4 == 0) {
+            data.append(delimiter, 0, 1 + (r >> 8) % (delimiter.size() - 1));
+            data.push_back('\r');
+        } else {
+            data.push_back((char)(r >> 8));
+        }
+    }
+    data.resize(len);
+    return data;
+}
+
+/**
+ * @brief   A form of `parts`, with a preamble and an epilogue.
+ */
+static std::string test_body(const std::vector<std::string> &parts)
+{
+    std::string body = "preamble, ignored\r\n";
+
+    for (size_t i = 0; i < parts.size(); i++) {
+        body += "--" TEST_BOUNDARY "\r\n"
+                "Content-Disposition: form-data; name=\"file" +
+                std::to_string(i) + "\"; filename=\"firmware.bin\"\r\n"
+                "Content-Type: application/octet-stream\r\n\r\n";
+        body += parts[i];
+        body += "\r\n";
+    }
+    body += "--" TEST_BOUNDARY "--\r\nepilogue, ignored";
+    return body;
+}
+
+/**
+ * @brief   Parses `body` cut at `splits`, increasing offsets, and checks the
+ *          parts byte for byte.
+ */
+static void test_parse(const std::string &body,
+                        const std::vector<size_t> &splits,
+                        const std::vector<std::string> &expected)
+{
+    multipart_parser_t parser;
+    test_output_t output = {};
+    size_t start = 0;
+    char message[64];
+
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, TEST_BOUNDARY,
+                                                    &s_callbacks, &output));
+
+    for (size_t i = 0; i <= splits.size(); i++) {
+        const size_t end = (i < splits.size()) ? splits[i] : body.size();
+
+        snprintf(message, sizeof(message), "chunk %u at %u",
+                    (unsigned)i, (unsigned)start);
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_OK,
+            multipart_parser_feed(&parser,
+                                    (const uint8_t *)body.data() + start,
+                                    end - start),
+            message);
+        start = end;
+    }
+
+    TEST_ASSERT_TRUE(multipart_parser_is_done(&parser));
+    TEST_ASSERT_EQUAL(0, output.open_parts);
+    TEST_ASSERT_EQUAL(expected.size(), output.parts.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL(expected[i].size(), output.parts[i].size());
+        TEST_ASSERT_EQUAL_MEMORY(expected[i].data(), output.parts[i].data(),
+                                    expected[i].size());
+    }
+}
+
+/* Tests ---------------------------------------------------------------------*/
+
+void setUp(void)
+{
+    s_seed = 2463534242u;
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief   The body in a single chunk, and a byte at a time.
+ */
+static void test_whole_and_bytewise(void)
+{
+    const std::vector<std::string> parts = {
+        test_tricky_data(3000), "", test_tricky_data(17)
+    };
+    const std::string body = test_body(parts);
+    std::vector<size_t> bytes;
+
+    test_parse(body, {}, parts);
+    for (size_t i = 1; i < body.size(); i++) {
+        bytes.push_back(i);
+    }
+    test_parse(body, bytes, parts);
+}
+
+/**
+ * @brief   Two chunks, cut at every offset: inside each delimiter, its
+ *          CRLF and the part data held back in the lookbehind.
+ */
+static void test_every_split(void)
+{
+    const std::vector<std::string> parts = {
+        test_tricky_data(200), test_tricky_data(90)
+    };
+    const std::string body = test_body(parts);
+
+    for (size_t i = 0; i <= body.size(); i++) {
+        test_parse(body, {i}, parts);
+    }
+}
+
+/**
+ * @brief   Three chunks, the middle one shorter than the delimiter and
+ *          starting at each byte around the end of the first part: the
+ *          lookbehind must carry a prefix across two feeds.
+ */
+static void test_splits_inside_delimiter(void)
+{
+    const std::vector<std::string> parts = {
+        test_tricky_data(64) + "\r\n--" + std::string(TEST_BOUNDARY, 10),
+        test_tricky_data(64)
+    };
+    const std::string body = test_body(parts);
+    const size_t delimiter_len = strlen("\r\n--" TEST_BOUNDARY);
+    const size_t end = body.find("\r\n--" TEST_BOUNDARY "\r\n",
+                                    body.find("\r\n\r\n") + 4);
+
+    TEST_ASSERT_TRUE(end != std::string::npos);
+    for (size_t first = end - delimiter_len; first <= end + delimiter_len;
+            first++) {
+        for (size_t len = 1; len < delimiter_len; len++) {
+            test_parse(body, {first, first + len}, parts);
+        }
+    }
+}
+
+/**
+ * @brief   Random chunk boundaries, as TCP segments fall.
+ */
+static void test_random_splits(void)
+{
+    const std::vector<std::string> parts = {
+        test_tricky_data(5000), test_tricky_data(700)
+    };
+    const std::string body = test_body(parts);
+
+    for (int run = 0; run < TEST_RANDOM_SPLITS; run++) {
+        const size_t count = 1 + test_random() % TEST_RANDOM_MAX_CHUNKS;
+        std::vector<size_t> splits;
+
+        for (size_t i = 0; i < count; i++) {
+            splits.push_back(test_random() % (body.size() + 1));
+        }
+        std::sort(splits.begin(), splits.end());
+        test_parse(body, splits, parts);
+    }
+}
+
+/**
+ * @brief   A malformed body is an error, not silently accepted.
+ */
+static void test_malformed(void)
+{
+    multipart_parser_t parser;
+    test_output_t output = {};
+    const std::string body = "--" TEST_BOUNDARY "XX\r\n";
+
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, TEST_BOUNDARY,
+                                                    &s_callbacks, &output));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE,
+                        multipart_parser_feed(&parser,
+                                                (const uint8_t *)body.data(),
+                                                body.size()));
+    TEST_ASSERT_FALSE(multipart_parser_is_done(&parser));
+}
+
+/**
+ * @brief   Parse rate of an image upload in OTA buffers, reported in MB/s.
+ *          Random data, the delimiter's first byte in 1 of 256.
+ */
+static void test_throughput(void)
+{
+    std::string image(TEST_BENCH_SIZE, '\0');
+    multipart_parser_t parser;
+    test_output_t output = {};
+    char message[96];
+
+    for (char &byte : image) {
+        byte = (char)test_random();
+    }
+    const std::string body = test_body({image});
+    image.clear();
+
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, TEST_BOUNDARY,
+                                                    &s_callbacks, &output));
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < body.size();
+            offset += TEST_BENCH_CHUNK) {
+        const size_t len = std::min<size_t>(TEST_BENCH_CHUNK,
+                                            body.size() - offset);
+
+        TEST_ASSERT_EQUAL(ESP_OK,
+            multipart_parser_feed(&parser,
+                                    (const uint8_t *)body.data() + offset,
+                                    len));
+    }
+    const double seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+    TEST_ASSERT_TRUE(multipart_parser_is_done(&parser));
+    TEST_ASSERT_EQUAL(TEST_BENCH_SIZE, output.parts[0].size());
+    snprintf(message, sizeof(message), "%u MB in %u B chunks: %.0f MB/s",
+                TEST_BENCH_SIZE / (1024 * 1024), TEST_BENCH_CHUNK,
+                body.size() / seconds / (1024 * 1024));
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_and_bytewise);
+    RUN_TEST(test_every_split);
+    RUN_TEST(test_splits_inside_delimiter);
+    RUN_TEST(test_random_splits);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
+
+/* Private function definition -----------------------------------------------*/
+static esp_err_t test_on_part_begin(void *ctx)
+{
+    test_output_t *output = (test_output_t *)ctx;
+
+    output->parts.emplace_back();
+    output->open_parts++;
+    return ESP_OK;
+}
+
+static esp_err_t test_on_part_data(void *ctx, const uint8_t *data,
+                                    size_t len)
+{
+    test_output_t *output = (test_output_t *)ctx;
+
+    TEST_ASSERT_EQUAL(1, output->open_parts);
+    output->parts.back().append((const char *)data, len);
+    return ESP_OK;
+}
+
+static esp_err_t test_on_part_end(void *ctx)
+{
+    test_output_t *output = (test_output_t *)ctx;
+
+    output->open_parts--;
+    return ESP_OK;
+}
@@ -0,0 +1,68 @@
+#include <unity.h>
+
+#include "static_assets.hpp"
+
+/* Private types -------------------------------------------------------------*/
+
+typedef struct {
+    const char *accept_encoding;
+    bool gzip;
+} test_case_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static const test_case_t s_cases[] = {
+    /* Listed or not. */
+    { "", false },
+    { "identity", false },
+    { "gzip", true },
+    { "deflate, gzip, br", true },
+    { "GZip", true },
+    { "x-gzip", false },
+    { "gzipped", false },
+    /* q-values of gzip itself. */
+    { "gzip;q=0", false },
+    { "gzip; q=0.0", false },
+    { "gzip;q=0.001", true },
+    { "gzip ; Q=0.5", true },
+    { "gzip;level=1;q=0", false },
+    { "br;q=1.0, gzip;q=0.8, *;q=0.1", true },
+    /* The wildcard, only when gzip isn't listed. */
+    { "*", true },
+    { "*;q=0", false },
+    { "br, *;q=0.5", true },
+    { "*;q=0, gzip", true },
+    { "*, gzip;q=0", false },
+    { "gzip;q=0, *", false },
+    { "identity;q=0, *;q=0", false },
+};
+
+/* Tests ---------------------------------------------------------------------*/
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief   Every entry is read: gzip decides if listed, else `*`, q=0
+ *          refusing either.
+ */
+static void test_gzip_accepted(void)
+{
+    for (const test_case_t &test : s_cases) {
+        TEST_ASSERT_EQUAL_MESSAGE(test.gzip,
+                    static_assets_gzip_accepted(test.accept_encoding),
+                    test.accept_encoding);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_gzip_accepted);
+    return UNITY_END();
+}